@@ -1,4 +1,5 @@
 #include "rest_api.hpp"
+#include "../network/baseline_collector.hpp"
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
@@ -21,6 +22,114 @@ using tcp = boost::asio::ip::tcp;
 namespace netsentry {
 namespace api {
 
+namespace {
+
+std::string escapeJson(const std::string& value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+
+    for (char c : value) {
+        switch (c) {
+            case '"':  escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\r': escaped += "\\r"; break;
+            case '\t': escaped += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) >= 0x20) {
+                    escaped += c;
+                }
+                break;
+        }
+    }
+
+    return escaped;
+}
+
+// "bytes_per_second" and "packets_per_second" objects keyed by window,
+// each preceded by ",\n" at the given indent
+std::string ratesJson(const network::TrafficRates& rates, const std::string& indent) {
+    auto window = [](const char* name, double value) {
+        return std::string("\"") + name + "\": " + std::to_string(value);
+    };
+
+    std::string json;
+    json += ",\n" + indent + "\"bytes_per_second\": {" +
+            window("1s", rates.last_1s.bytes_per_second) + ", " +
+            window("10s", rates.last_10s.bytes_per_second) + ", " +
+            window("60s", rates.last_60s.bytes_per_second) + "}";
+    json += ",\n" + indent + "\"packets_per_second\": {" +
+            window("1s", rates.last_1s.packets_per_second) + ", " +
+            window("10s", rates.last_10s.packets_per_second) + ", " +
+            window("60s", rates.last_60s.packets_per_second) + "}";
+    return json;
+}
+
+// Object under key with the sample count and percentiles of a histogram,
+// preceded by ",\n" at the given indent
+std::string latencyJson(const data::LatencyHistogram& latency, const char* key, const std::string& indent) {
+    return ",\n" + indent + "\"" + key + "\": {" +
+           "\"samples\": " + std::to_string(latency.count()) + ", " +
+           "\"p50\": " + std::to_string(latency.percentile(0.50)) + ", " +
+           "\"p90\": " + std::to_string(latency.percentile(0.90)) + ", " +
+           "\"p99\": " + std::to_string(latency.percentile(0.99)) + "}";
+}
+
+// Counters, status classes and latency of an HTTP endpoint, one field per
+// line at the given indent
+std::string httpEndpointJson(const network::HttpEndpoint& endpoint, const std::string& indent) {
+    const auto& classes = endpoint.status_classes;
+
+    std::string json;
+    json += indent + "\"requests\": " + std::to_string(endpoint.requests) + ",\n";
+    json += indent + "\"responses\": " + std::to_string(endpoint.responses) + ",\n";
+    json += indent + "\"unanswered\": " + std::to_string(endpoint.unanswered) + ",\n";
+    json += indent + "\"status\": {";
+    for (size_t i = 1; i < classes.size(); ++i) {
+        json += "\"" + std::to_string(i) + "xx\": " + std::to_string(classes[i]) + ", ";
+    }
+    json += "\"other\": " + std::to_string(classes[0]) + "}";
+    json += latencyJson(endpoint.latency, "latency_us", indent);
+    return json;
+}
+
+// Entries of a "hosts" or "groups" list of anomalies
+std::string anomaliesJson(const std::vector<network::TrafficAnomaly>& anomalies, const char* key) {
+    std::string json;
+    bool first = true;
+
+    for (const auto& anomaly : anomalies) {
+        if (!first) {
+            json += ",\n";
+        }
+
+        json += "    {\n";
+        json += std::string("      \"") + key + "\": \"" + escapeJson(anomaly.name) + "\",\n";
+        json += "      \"bytes_per_second\": " + std::to_string(anomaly.observed_bytes_per_second) + ",\n";
+        json += "      \"expected_bytes_per_second\": " + std::to_string(anomaly.expected_bytes_per_second) + ",\n";
+        json += "      \"score\": " + std::to_string(anomaly.score) + "\n";
+        json += "    }";
+
+        first = false;
+    }
+
+    return json;
+}
+
+const char* tcpStateName(network::TcpState state) {
+    switch (state) {
+        case network::TcpState::SYN_SENT:     return "syn_sent";
+        case network::TcpState::SYN_RECEIVED: return "syn_received";
+        case network::TcpState::ESTABLISHED:  return "established";
+        case network::TcpState::CLOSING:      return "closing";
+        case network::TcpState::CLOSED:       return "closed";
+        case network::TcpState::RESET:        return "reset";
+        default:                              return "none";
+    }
+}
+
+}
+
 class RestApi::ServerImpl {
 private:
     std::unordered_map<std::string, std::unordered_map<HttpMethod, RouteHandler>> routes_;
@@ -268,8 +377,9 @@ public:
 
 RestApi::RestApi(
     std::vector<std::unique_ptr<collectors::CollectorBase>>& collectors,
-    std::unique_ptr<network::PacketAnalyzer>& packet_analyzer)
-    : collectors_(collectors), packet_analyzer_(packet_analyzer) {
+    std::unique_ptr<network::PacketAnalyzer>& packet_analyzer,
+    std::unique_ptr<network::PacketCapture>& packet_capture)
+    : collectors_(collectors), packet_analyzer_(packet_analyzer), packet_capture_(packet_capture) {
 
     server_impl_ = std::make_unique<ServerImpl>();
     setupRoutes();
@@ -317,8 +427,29 @@ void RestApi::setupRoutes() {
     server_impl_->addRoute("/api/v1/network/hosts", HttpMethod::GET,
         [this](const HttpRequest& request) { return handleGetTopHosts(request); });
 
+    server_impl_->addRoute("/api/v1/network/fanout", HttpMethod::GET,
+        [this](const HttpRequest& request) { return handleGetHostFanout(request); });
+
+    server_impl_->addRoute("/api/v1/network/groups", HttpMethod::GET,
+        [this](const HttpRequest& request) { return handleGetSubnetGroups(request); });
+
+    server_impl_->addRoute("/api/v1/network/tcp", HttpMethod::GET,
+        [this](const HttpRequest& request) { return handleGetTcpStats(request); });
+
+    server_impl_->addRoute("/api/v1/network/http", HttpMethod::GET,
+        [this](const HttpRequest& request) { return handleGetHttpStats(request); });
+
+    server_impl_->addRoute("/api/v1/network/anomalies", HttpMethod::GET,
+        [this](const HttpRequest& request) { return handleGetAnomalies(request); });
+
     server_impl_->addRoute("/api/v1/system/info", HttpMethod::GET,
         [this](const HttpRequest& request) { return handleGetSystemInfo(request); });
+
+    server_impl_->addRoute("/api/v1/network/capture/filter", HttpMethod::GET,
+        [this](const HttpRequest& request) { return handleGetCaptureFilter(request); });
+
+    server_impl_->addRoute("/api/v1/network/capture/filter", HttpMethod::PUT,
+        [this](const HttpRequest& request) { return handleSetCaptureFilter(request); });
 }
 
 HttpResponse RestApi::handleGetMetrics(const HttpRequest& request) {
@@ -386,8 +517,30 @@ HttpResponse RestApi::handleGetNetworkStats(const HttpRequest& request) {
     // Implementation would depend on PacketAnalyzer's interface
     response.body = "{\n";
     response.body += "  \"status\": \"Active\",\n";
-    response.body += "  \"connections\": " + std::to_string(packet_analyzer_->getTopConnections(1000).size()) + "\n";
-    response.body += "}";
+    response.body += "  \"connections\": " + std::to_string(packet_analyzer_->getConnectionCount());
+
+    if (packet_analyzer_->getSamplingRate() > 1) {
+        bool flow_sampling = packet_analyzer_->getSamplingMode() == network::SamplingMode::FLOW;
+
+        response.body += ",\n  \"sampling\": {\n";
+        response.body += "    \"mode\": \"" + std::string(flow_sampling ? "flow" : "packet") + "\",\n";
+        response.body += "    \"rate\": " + std::to_string(packet_analyzer_->getSamplingRate()) + "\n";
+        response.body += "  }";
+    }
+
+    if (packet_capture_) {
+        auto stats = packet_capture_->getStats();
+
+        response.body += ",\n  \"capture\": {\n";
+        response.body += "    \"packets\": " + std::to_string(stats.packets_captured) + ",\n";
+        response.body += "    \"bytes\": " + std::to_string(stats.bytes_captured) + ",\n";
+        response.body += "    \"kernel_received\": " + std::to_string(stats.kernel_received) + ",\n";
+        response.body += "    \"kernel_dropped\": " + std::to_string(stats.kernel_dropped) + ",\n";
+        response.body += "    \"interface_dropped\": " + std::to_string(stats.interface_dropped) + "\n";
+        response.body += "  }";
+    }
+
+    response.body += "\n}";
 
     return response;
 }
@@ -426,14 +579,26 @@ HttpResponse RestApi::handleGetConnections(const HttpRequest& request) {
         }
 
         json += "    {\n";
-        json += "      \"source\": \"" + key.source_ip + ":" + std::to_string(key.source_port) + "\",\n";
-        json += "      \"destination\": \"" + key.dest_ip + ":" + std::to_string(key.dest_port) + "\",\n";
+        json += "      \"source\": \"" + key.source_ip.toString() + ":" + std::to_string(key.source_port) + "\",\n";
+        json += "      \"destination\": \"" + key.dest_ip.toString() + ":" + std::to_string(key.dest_port) + "\",\n";
         json += "      \"protocol\": " + std::to_string(key.protocol) + ",\n";
         json += "      \"bytes_sent\": " + std::to_string(stats.bytes_sent) + ",\n";
         json += "      \"bytes_received\": " + std::to_string(stats.bytes_received) + ",\n";
         json += "      \"packets_sent\": " + std::to_string(stats.packets_sent) + ",\n";
-        json += "      \"packets_received\": " + std::to_string(stats.packets_received) + "\n";
-        json += "    }";
+        json += "      \"packets_received\": " + std::to_string(stats.packets_received);
+        if (key.protocol == 6) {
+            json += ",\n      \"tcp_state\": \"" + std::string(tcpStateName(stats.tcp_state)) + "\"";
+            if (stats.rtt_us > 0) {
+                json += ",\n      \"rtt_us\": " + std::to_string(stats.rtt_us);
+            }
+            json += ",\n      \"retransmits\": " + std::to_string(stats.retransmits);
+        }
+        json += ratesJson(stats.rates, "      ");
+        if (stats.sampling_rate > 1) {
+            json += ",\n      \"sampling_rate\": " + std::to_string(stats.sampling_rate);
+            json += ",\n      \"error_bound\": " + std::to_string(stats.error_bound);
+        }
+        json += "\n    }";
 
         first = false;
     }
@@ -464,27 +629,113 @@ HttpResponse RestApi::handleGetTopHosts(const HttpRequest& request) {
         }
     }
 
-    auto host_stats = packet_analyzer_->getHostTrafficStats();
+    std::vector<std::pair<network::IpAddress, network::HostTrafficEstimate>> hosts;
+
+    it = request.query_params.find("ip");
+    if (it != request.query_params.end()) {
+        auto address = network::IpAddress::parse(it->second);
+        if (!address) {
+            response.status_code = 400;
+            response.body = "{\n  \"error\": \"Invalid IP address\"\n}";
+            return response;
+        }
+
+        auto host = packet_analyzer_->getHostTraffic(*address);
+        if (host) {
+            hosts.emplace_back(*address, *host);
+        }
+    } else {
+        hosts = packet_analyzer_->getTopHosts(limit);
+    }
+
+    bool estimated = packet_analyzer_->getSamplingRate() > 1 || packet_analyzer_->isHostSketchEnabled();
+
+    std::string json = "{\n  \"hosts\": [\n";
+    bool first = true;
+
+    for (const auto& host : hosts) {
+        if (!first) {
+            json += ",\n";
+        }
+
+        json += "    {\n";
+        json += "      \"ip\": \"" + host.first.toString() + "\",\n";
+        json += "      \"bytes\": " + std::to_string(host.second.bytes);
+        if (estimated) {
+            json += ",\n      \"packets\": " + std::to_string(host.second.packets);
+            json += ",\n      \"error_bound\": " + std::to_string(host.second.error_bound);
+        }
+        if (!packet_analyzer_->isHostSketchEnabled()) {
+            json += ratesJson(host.second.rates, "      ");
+            json += latencyJson(host.second.rtt, "rtt_us", "      ");
+            json += ",\n      \"retransmits\": " + std::to_string(host.second.retransmits);
+        }
+        json += "\n    }";
+
+        first = false;
+    }
+
+    json += "\n  ]\n}";
+    response.body = json;
+
+    return response;
+}
 
-    std::vector<std::pair<std::string, uint64_t>> sorted_hosts;
-    for (const auto& entry : host_stats) {
-        sorted_hosts.emplace_back(entry);
+HttpResponse RestApi::handleGetHostFanout(const HttpRequest& request) {
+    HttpResponse response;
+    response.headers["Content-Type"] = "application/json";
+
+    if (!packet_analyzer_ || !packet_analyzer_->isFanoutTrackingEnabled()) {
+        response.status_code = 503;
+        response.body = "{\n  \"error\": \"Fan-out tracking not available\"\n}";
+        return response;
     }
 
-    std::sort(sorted_hosts.begin(), sorted_hosts.end(),
-              [](const auto& a, const auto& b) { return a.second > b.second; });
+    size_t limit = 10;
+    auto it = request.query_params.find("limit");
+    if (it != request.query_params.end()) {
+        try {
+            limit = std::stoul(it->second);
+        } catch (...) {
+            limit = 10;
+        }
+    }
+
+    it = request.query_params.find("sort");
+    bool by_ports = it == request.query_params.end() || it->second != "peers";
+
+    std::vector<std::pair<network::IpAddress, network::HostFanout>> hosts;
+
+    it = request.query_params.find("ip");
+    if (it != request.query_params.end()) {
+        auto address = network::IpAddress::parse(it->second);
+        if (!address) {
+            response.status_code = 400;
+            response.body = "{\n  \"error\": \"Invalid IP address\"\n}";
+            return response;
+        }
+
+        auto fanout = packet_analyzer_->getHostFanout(*address);
+        if (fanout) {
+            hosts.emplace_back(*address, *fanout);
+        }
+    } else {
+        hosts = packet_analyzer_->getTopFanout(limit, by_ports);
+    }
 
     std::string json = "{\n  \"hosts\": [\n";
     bool first = true;
 
-    for (size_t i = 0; i < std::min(limit, sorted_hosts.size()); ++i) {
+    for (const auto& host : hosts) {
         if (!first) {
             json += ",\n";
         }
 
         json += "    {\n";
-        json += "      \"ip\": \"" + sorted_hosts[i].first + "\",\n";
-        json += "      \"bytes\": " + std::to_string(sorted_hosts[i].second) + "\n";
+        json += "      \"ip\": \"" + host.first.toString() + "\",\n";
+        json += "      \"peers\": " + std::to_string(host.second.peers) + ",\n";
+        json += "      \"ports\": " + std::to_string(host.second.ports) + ",\n";
+        json += "      \"error_bound\": " + std::to_string(host.second.error_bound) + "\n";
         json += "    }";
 
         first = false;
@@ -496,6 +747,213 @@ HttpResponse RestApi::handleGetTopHosts(const HttpRequest& request) {
     return response;
 }
 
+HttpResponse RestApi::handleGetSubnetGroups(const HttpRequest& request) {
+    HttpResponse response;
+    response.headers["Content-Type"] = "application/json";
+
+    if (!packet_analyzer_ || !packet_analyzer_->isSubnetGroupingEnabled()) {
+        response.status_code = 503;
+        response.body = "{\n  \"error\": \"No subnet groups configured\"\n}";
+        return response;
+    }
+
+    std::vector<network::SubnetGroupStats> groups;
+
+    auto it = request.query_params.find("name");
+    if (it != request.query_params.end()) {
+        auto group = packet_analyzer_->getSubnetGroupStats(it->second);
+        if (!group) {
+            response.status_code = 404;
+            response.body = "{\n  \"error\": \"Subnet group not found\"\n}";
+            return response;
+        }
+        groups.push_back(std::move(*group));
+    } else {
+        groups = packet_analyzer_->getSubnetGroupStats();
+    }
+
+    bool estimated = packet_analyzer_->getSamplingRate() > 1;
+
+    std::string json = "{\n  \"groups\": [\n";
+    bool first = true;
+
+    for (const auto& group : groups) {
+        if (!first) {
+            json += ",\n";
+        }
+
+        json += "    {\n";
+        json += "      \"name\": \"" + escapeJson(group.name) + "\",\n";
+        json += "      \"bytes_sent\": " + std::to_string(group.bytes_sent) + ",\n";
+        json += "      \"bytes_received\": " + std::to_string(group.bytes_received) + ",\n";
+        json += "      \"packets_sent\": " + std::to_string(group.packets_sent) + ",\n";
+        json += "      \"packets_received\": " + std::to_string(group.packets_received) + ",\n";
+        json += "      \"flows\": " + std::to_string(group.flows);
+        if (estimated) {
+            json += ",\n      \"error_bound\": " + std::to_string(group.error_bound);
+        }
+        json += ratesJson(group.rates, "      ");
+        json += latencyJson(group.rtt, "rtt_us", "      ");
+        json += ",\n      \"retransmits\": " + std::to_string(group.retransmits);
+        json += "\n    }";
+
+        first = false;
+    }
+
+    json += "\n  ]\n}";
+    response.body = json;
+
+    return response;
+}
+
+HttpResponse RestApi::handleGetTcpStats(const HttpRequest& request) {
+    HttpResponse response;
+    response.headers["Content-Type"] = "application/json";
+
+    if (!packet_analyzer_) {
+        response.status_code = 503;
+        response.body = "{\n  \"error\": \"Network packet analyzer not available\"\n}";
+        return response;
+    }
+
+    size_t limit = 10;
+    auto it = request.query_params.find("limit");
+    if (it != request.query_params.end()) {
+        try {
+            limit = std::stoul(it->second);
+        } catch (...) {
+            limit = 10;
+        }
+    }
+
+    auto stats = packet_analyzer_->getTcpStats();
+    auto hosts = packet_analyzer_->getTopHalfOpenHosts(limit);
+    bool host_resets = !packet_analyzer_->isHostSketchEnabled();
+
+    std::string json = "{\n";
+    json += "  \"half_open\": " + std::to_string(stats.half_open) + ",\n";
+    json += "  \"syns\": " + std::to_string(stats.syns) + ",\n";
+    json += "  \"resets\": " + std::to_string(stats.resets) + ",\n";
+    json += "  \"handshake_timeouts\": " + std::to_string(stats.handshake_timeouts) + ",\n";
+    json += "  \"segments\": " + std::to_string(stats.segments) + ",\n";
+    json += "  \"retransmits\": " + std::to_string(stats.retransmits);
+    json += latencyJson(stats.rtt, "rtt_us", "  ") + ",\n";
+    json += "  \"half_open_hosts\": [\n";
+    bool first = true;
+
+    for (const auto& host : hosts) {
+        if (!first) {
+            json += ",\n";
+        }
+
+        json += "    {\n";
+        json += "      \"ip\": \"" + host.first.toString() + "\",\n";
+        json += "      \"half_open\": " + std::to_string(host.second.half_open);
+        if (host_resets) {
+            json += ",\n      \"resets_sent\": " + std::to_string(host.second.resets_sent);
+            json += ",\n      \"resets_received\": " + std::to_string(host.second.resets_received);
+        }
+        json += "\n    }";
+
+        first = false;
+    }
+
+    json += "\n  ]\n}";
+    response.body = json;
+
+    return response;
+}
+
+HttpResponse RestApi::handleGetHttpStats(const HttpRequest& request) {
+    HttpResponse response;
+    response.headers["Content-Type"] = "application/json";
+
+    if (!packet_analyzer_) {
+        response.status_code = 503;
+        response.body = "{\n  \"error\": \"Network packet analyzer not available\"\n}";
+        return response;
+    }
+
+    if (!packet_analyzer_->isHttpTrackingEnabled()) {
+        response.status_code = 503;
+        response.body = "{\n  \"error\": \"HTTP tracking not enabled\"\n}";
+        return response;
+    }
+
+    size_t limit = 10;
+    auto it = request.query_params.find("limit");
+    if (it != request.query_params.end()) {
+        try {
+            limit = std::stoul(it->second);
+        } catch (...) {
+            limit = 10;
+        }
+    }
+
+    std::string json = "{\n";
+    json += httpEndpointJson(packet_analyzer_->getHttpTotals(), "  ") + ",\n";
+    json += "  \"endpoints\": [\n";
+    bool first = true;
+
+    for (const auto& endpoint : packet_analyzer_->getHttpEndpoints(limit)) {
+        if (!first) {
+            json += ",\n";
+        }
+
+        json += "    {\n";
+        json += "      \"host\": \"" + escapeJson(endpoint.host) + "\",\n";
+        json += "      \"path\": \"" + escapeJson(endpoint.path) + "\",\n";
+        json += httpEndpointJson(endpoint, "      ");
+        json += "\n    }";
+
+        first = false;
+    }
+
+    json += "\n  ]\n}";
+    response.body = json;
+
+    return response;
+}
+
+HttpResponse RestApi::handleGetAnomalies(const HttpRequest& request) {
+    HttpResponse response;
+    response.headers["Content-Type"] = "application/json";
+
+    const network::TrafficBaselines* baselines = nullptr;
+    for (const auto& collector : collectors_) {
+        auto* baseline_collector = dynamic_cast<const network::BaselineCollector*>(collector.get());
+        if (baseline_collector) {
+            baselines = &baseline_collector->getBaselines();
+            break;
+        }
+    }
+
+    if (!baselines) {
+        response.status_code = 503;
+        response.body = "{\n  \"error\": \"Traffic baselines not enabled\"\n}";
+        return response;
+    }
+
+    size_t limit = 10;
+    auto it = request.query_params.find("limit");
+    if (it != request.query_params.end()) {
+        try {
+            limit = std::stoul(it->second);
+        } catch (...) {
+            limit = 10;
+        }
+    }
+
+    std::string json = "{\n  \"hosts\": [\n";
+    json += anomaliesJson(baselines->getTopHostAnomalies(limit), "ip");
+    json += "\n  ],\n  \"groups\": [\n";
+    json += anomaliesJson(baselines->getGroupAnomalies(), "name");
+    json += "\n  ]\n}";
+    response.body = json;
+
+    return response;
+}
+
 HttpResponse RestApi::handleGetSystemInfo(const HttpRequest& request) {
     HttpResponse response;
     response.headers["Content-Type"] = "application/json";
@@ -510,6 +968,66 @@ HttpResponse RestApi::handleGetSystemInfo(const HttpRequest& request) {
     return response;
 }
 
+HttpResponse RestApi::handleGetCaptureFilter(const HttpRequest&) {
+    HttpResponse response;
+    response.headers["Content-Type"] = "application/json";
+
+    if (!packet_capture_) {
+        response.status_code = 503;
+        response.body = "{\n  \"error\": \"Packet capture not available\"\n}";
+        return response;
+    }
+
+    std::string error = packet_capture_->getFilterError();
+
+    response.body = "{\n";
+    response.body += "  \"filter\": \"" + escapeJson(packet_capture_->getFilter()) + "\"";
+    if (!error.empty()) {
+        response.body += ",\n  \"error\": \"" + escapeJson(error) + "\"";
+    }
+    response.body += "\n}";
+
+    return response;
+}
+
+HttpResponse RestApi::handleSetCaptureFilter(const HttpRequest& request) {
+    HttpResponse response;
+    response.headers["Content-Type"] = "application/json";
+
+    if (!packet_capture_) {
+        response.status_code = 503;
+        response.body = "{\n  \"error\": \"Packet capture not available\"\n}";
+        return response;
+    }
+
+    // The request body is the raw filter expression; an empty body clears it
+    std::string expression = request.body;
+    expression.erase(0, expression.find_first_not_of(" \t\r\n"));
+    expression.erase(expression.find_last_not_of(" \t\r\n") + 1);
+
+    std::string error;
+    auto result = packet_capture_->setFilter(expression, &error);
+
+    if (result == network::CaptureError::INVALID_FILTER) {
+        response.status_code = 400;
+        response.body = "{\n  \"error\": \"Invalid filter: " + escapeJson(error) + "\"\n}";
+        return response;
+    }
+
+    if (result != network::CaptureError::NONE) {
+        response.status_code = 500;
+        response.body = "{\n  \"error\": \"Failed to apply filter: " + escapeJson(error) + "\"\n}";
+        return response;
+    }
+
+    response.body = "{\n";
+    response.body += "  \"success\": true,\n";
+    response.body += "  \"filter\": \"" + escapeJson(expression) + "\"\n";
+    response.body += "}";
+
+    return response;
+}
+
 // Helper system info functions (platform-specific)
 std::string getSystemHostname() {
     char hostname[1024];
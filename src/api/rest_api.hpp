@@ -12,6 +12,7 @@
 #include "../core/metrics/system_metrics.hpp"
 #include "../core/collectors/collector_base.hpp"
 #include "../network/packet_analyzer.hpp"
+#include "../network/packet_capture.hpp"
 
 namespace netsentry {
 namespace api {
@@ -44,7 +45,8 @@ class RestApi {
 public:
     RestApi(
         std::vector<std::unique_ptr<collectors::CollectorBase>>& collectors,
-        std::unique_ptr<network::PacketAnalyzer>& packet_analyzer);
+        std::unique_ptr<network::PacketAnalyzer>& packet_analyzer,
+        std::unique_ptr<network::PacketCapture>& packet_capture);
 
     ~RestApi();
 
@@ -59,6 +61,7 @@ private:
 
     std::vector<std::unique_ptr<collectors::CollectorBase>>& collectors_;
     std::unique_ptr<network::PacketAnalyzer>& packet_analyzer_;
+    std::unique_ptr<network::PacketCapture>& packet_capture_;
 
     std::thread server_thread_;
     std::atomic<bool> running_{false};
@@ -70,7 +73,14 @@ private:
     HttpResponse handleGetNetworkStats(const HttpRequest& request);
     HttpResponse handleGetConnections(const HttpRequest& request);
     HttpResponse handleGetTopHosts(const HttpRequest& request);
+    HttpResponse handleGetHostFanout(const HttpRequest& request);
+    HttpResponse handleGetSubnetGroups(const HttpRequest& request);
+    HttpResponse handleGetTcpStats(const HttpRequest& request);
+    HttpResponse handleGetHttpStats(const HttpRequest& request);
+    HttpResponse handleGetAnomalies(const HttpRequest& request);
     HttpResponse handleGetSystemInfo(const HttpRequest& request);
+    HttpResponse handleGetCaptureFilter(const HttpRequest& request);
+    HttpResponse handleSetCaptureFilter(const HttpRequest& request);
 };
 
 }
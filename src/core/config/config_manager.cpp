@@ -25,6 +25,67 @@ void ConfigManager::setDefaultConfig() {
 
     set<bool>("enable_packet_capture", false);
     set<std::string>("capture_interface", "eth0");
+    set<std::string>("capture_backend", "pcap");
+    set<uint32_t>("capture_ring_block_size", 1u << 22);
+    set<uint32_t>("capture_ring_block_count", 64);
+    set<uint32_t>("capture_ring_block_timeout_ms", 100);
+    set<uint32_t>("capture_fanout_workers", 0);
+    set<std::string>("capture_fanout_mode", "hash");
+    set<uint32_t>("capture_batch_size", 64);
+    set<std::string>("capture_filter", "");
+    set<bool>("capture_payload", false);
+    set<uint32_t>("capture_payload_max_size", 1024);
+    set<uint32_t>("packet_buffer_size", 8192);
+    set<uint32_t>("capture_read_timeout_ms", 100);
+    set<uint32_t>("analysis_workers", 0);
+    set<uint32_t>("analysis_queue_capacity", 1024);
+    set<std::string>("analysis_overflow_policy", "drop_newest");
+    set<uint32_t>("analysis_overflow_sample_rate", 8);
+    set<std::string>("analysis_sampling_mode", "none");
+    set<uint32_t>("analysis_sampling_rate", 1);
+    set<uint32_t>("analysis_flow_table_capacity", 65536);
+    set<uint32_t>("analysis_top_connections", 100);
+    set<uint32_t>("analysis_classify_max_packets", 8);
+    set<bool>("analysis_host_sketch", false);
+    set<double>("analysis_host_sketch_epsilon", 0.001);
+    set<double>("analysis_host_sketch_delta", 0.01);
+    set<uint32_t>("analysis_snapshot_interval_ms", 1000);
+    set<bool>("analysis_fanout", true);
+    set<uint32_t>("analysis_fanout_window", 60);
+    set<uint32_t>("analysis_fanout_max_hosts", 4096);
+    set<bool>("analysis_http", true);
+    set<uint32_t>("analysis_http_max_endpoints", 1024);
+    set<uint32_t>("analysis_http_uri_depth", 1);
+    set<std::string>("subnet_groups", "");
+    set<std::string>("subnet_groups_file", "");
+    set<bool>("traffic_baselines", false);
+    set<uint32_t>("baseline_interval", 60);
+    set<double>("baseline_alpha", 0.05);
+    set<double>("baseline_beta", 0.005);
+    set<double>("baseline_gamma", 0.05);
+    set<uint32_t>("baseline_warmup", 60);
+    set<double>("baseline_min_deviation", 1000.0);
+    set<uint32_t>("baseline_max_hosts", 262144);
+    set<uint32_t>("baseline_idle_retention", 86400);
+    set<uint32_t>("flow_timeout_tcp_idle", 300);
+    set<uint32_t>("flow_timeout_tcp_closed", 5);
+    set<uint32_t>("flow_timeout_tcp_half_open", 30);
+    set<uint32_t>("flow_timeout_udp_idle", 60);
+    set<uint32_t>("flow_timeout_icmp_idle", 30);
+    set<uint32_t>("flow_timeout_other_idle", 60);
+    set<uint32_t>("flow_timeout_active", 1800);
+    set<bool>("flow_database", true);
+    set<bool>("flow_export", false);
+    set<std::string>("flow_export_format", "ipfix");
+    set<std::string>("flow_export_host", "127.0.0.1");
+    set<uint16_t>("flow_export_port", 4739);
+    set<uint32_t>("flow_export_interval_ms", 1000);
+    set<uint32_t>("flow_export_template_refresh", 60);
+    set<uint32_t>("flow_export_domain", 0);
+    set<uint32_t>("flow_export_max_message_size", 1400);
+    set<std::string>("capture_file", "");
+    set<double>("capture_replay_speed", 1.0);
+    set<bool>("capture_replay_exit_on_finish", false);
 
     set<std::string>("log_level", "info");
     set<std::string>("log_file", "netsentry.log");
@@ -37,6 +98,14 @@ void ConfigManager::setDefaultConfig() {
 
     set<uint32_t>("memory_threshold_warning", 75);
     set<uint32_t>("memory_threshold_critical", 85);
+
+    set<uint32_t>("port_scan_threshold", 100);
+    set<uint32_t>("fanout_threshold", 250);
+    set<uint32_t>("syn_flood_threshold", 200);
+    set<uint32_t>("tcp_reset_rate_threshold", 1000);
+    set<double>("anomaly_score_threshold", 6.0);
+    set<double>("http_error_percent_threshold", 5.0);
+    set<uint32_t>("host_rate_threshold_bytes_per_second", 0);
 }
 
 bool ConfigManager::loadFromFile(const std::string& filename) {
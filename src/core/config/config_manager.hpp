@@ -10,6 +10,8 @@
 #include <memory>
 #include <fstream>
 #include <stdexcept>
+#include <limits>
+#include <cmath>
 
 namespace netsentry {
 namespace config {
@@ -33,7 +35,12 @@ public:
         }
 
         if (std::type_index(typeid(T)) != it->second.first) {
-            return std::nullopt;
+            if constexpr (std::is_arithmetic_v<T> && !std::is_same_v<T, bool>) {
+                // Numbers parsed from YAML are stored as int64_t/double
+                return convertNumeric<T>(it->second.first, it->second.second);
+            } else {
+                return std::nullopt;
+            }
         }
 
         return std::any_cast<T>(it->second.second);
@@ -88,6 +95,40 @@ private:
     bool parseYaml(const std::string& content);
     std::string generateYaml() const;
 
+    // Values that do not fit T (say -1 for an unsigned count) are rejected
+    // rather than wrapped, so getOrDefault() falls back to the default.
+    template<typename T>
+    static std::optional<T> convertNumeric(const std::type_index& type, const std::any& value) {
+        if (type == std::type_index(typeid(int64_t))) {
+            int64_t number = std::any_cast<int64_t>(value);
+            if constexpr (std::is_integral_v<T>) {
+                if constexpr (std::is_signed_v<T>) {
+                    if (number < std::numeric_limits<T>::min() || number > std::numeric_limits<T>::max()) {
+                        return std::nullopt;
+                    }
+                } else {
+                    if (number < 0 || static_cast<uint64_t>(number) > std::numeric_limits<T>::max()) {
+                        return std::nullopt;
+                    }
+                }
+            }
+            return static_cast<T>(number);
+        }
+        if (type == std::type_index(typeid(double))) {
+            double number = std::any_cast<double>(value);
+            if constexpr (std::is_integral_v<T>) {
+                // 2^digits is exact as a double, unlike max()
+                double limit = std::ldexp(1.0, std::numeric_limits<T>::digits);
+                double lowest = std::is_signed_v<T> ? -limit : 0.0;
+                if (!(number >= lowest && number < limit)) {
+                    return std::nullopt;
+                }
+            }
+            return static_cast<T>(number);
+        }
+        return std::nullopt;
+    }
+
     template<typename T>
     void parseYamlValue(const std::string& key, const std::string& value) {
         if constexpr (std::is_same_v<T, std::string>) {
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+namespace netsentry {
+namespace data {
+
+// Bit scans with the GCC/Clang builtins where available and a portable
+// loop elsewhere (MSVC).
+namespace bit_ops {
+
+// value must not be zero
+inline int countLeadingZeros(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(value);
+#else
+    int count = 0;
+    while ((value & (uint64_t{1} << 63)) == 0) {
+        value <<= 1;
+        ++count;
+    }
+    return count;
+#endif
+}
+
+// value must not be zero
+inline int countTrailingZeros(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(value);
+#else
+    int count = 0;
+    while ((value & 1) == 0) {
+        value >>= 1;
+        ++count;
+    }
+    return count;
+#endif
+}
+
+inline int popCount(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(value);
+#else
+    int count = 0;
+    for (; value != 0; value &= value - 1) {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+}
+
+}
+}
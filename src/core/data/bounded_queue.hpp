@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace netsentry {
+namespace data {
+
+// Fixed-capacity ring for handing items from one producer thread to a
+// consumer without locks or allocation. Items are exchanged with std::swap,
+// so a caller that pushes a filled container gets back whatever storage was
+// left in the slot and can refill it without reallocating.
+//
+// tryPush() must only be called by the single producer. tryPop() may be
+// called concurrently from more than one thread (per-slot sequence numbers,
+// after Vyukov's bounded queue), which lets the producer discard the oldest
+// entry itself when the queue is full.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+
+        slots_ = std::make_unique<Slot[]>(size);
+        mask_ = size - 1;
+
+        for (size_t i = 0; i < size; ++i) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    bool tryPush(T& item) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        Slot& slot = slots_[pos & mask_];
+
+        if (slot.sequence.load(std::memory_order_acquire) != pos) {
+            return false;
+        }
+
+        std::swap(slot.value, item);
+        slot.sequence.store(pos + 1, std::memory_order_release);
+        tail_.store(pos + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    bool tryPop(T& item) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+
+        while (true) {
+            Slot& slot = slots_[pos & mask_];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    std::swap(item, slot.value);
+                    slot.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    size_t size() const {
+        size_t tail = tail_.load(std::memory_order_acquire);
+        size_t head = head_.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    size_t capacity() const {
+        return mask_ + 1;
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<size_t> sequence{0};
+        T value{};
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_{0};
+
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) std::atomic<size_t> head_{0};
+};
+
+}
+}
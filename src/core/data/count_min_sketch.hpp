@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace netsentry {
+namespace data {
+
+// Count-Min sketch over pre-hashed keys. With width >= e / epsilon and
+// depth >= ln(1 / delta), an estimate never undercounts and overcounts by
+// more than epsilon * total() with probability at most delta. Updates are
+// conservative (only the counters at the current minimum are raised), which
+// tightens estimates further without weakening that bound.
+class CountMinSketch {
+public:
+    CountMinSketch(double epsilon, double delta) {
+        epsilon = std::max(epsilon, 1e-9);
+        delta = std::min(std::max(delta, 1e-9), 0.5);
+
+        size_t width = static_cast<size_t>(std::ceil(std::exp(1.0) / epsilon));
+        width_ = 1;
+        while (width_ < width) {
+            width_ <<= 1;
+        }
+
+        depth_ = static_cast<size_t>(std::ceil(std::log(1.0 / delta)));
+        epsilon_ = std::exp(1.0) / static_cast<double>(width_);
+        counters_.assign(width_ * depth_, 0);
+    }
+
+    // hash should be well mixed; its halves seed the per-row indexes.
+    void add(uint64_t hash, uint64_t count = 1) {
+        uint64_t current = estimate(hash);
+        uint64_t target = current + count;
+
+        for (size_t row = 0; row < depth_; ++row) {
+            uint64_t& counter = counters_[index(hash, row)];
+            if (counter < target) {
+                counter = target;
+            }
+        }
+
+        total_ += count;
+    }
+
+    uint64_t estimate(uint64_t hash) const {
+        uint64_t result = UINT64_MAX;
+        for (size_t row = 0; row < depth_; ++row) {
+            result = std::min(result, counters_[index(hash, row)]);
+        }
+        return result;
+    }
+
+    // Both sketches must have been built with the same epsilon and delta.
+    void merge(const CountMinSketch& other) {
+        for (size_t i = 0; i < counters_.size() && i < other.counters_.size(); ++i) {
+            counters_[i] += other.counters_[i];
+        }
+        total_ += other.total_;
+    }
+
+    void clear() {
+        std::fill(counters_.begin(), counters_.end(), 0);
+        total_ = 0;
+    }
+
+    uint64_t total() const { return total_; }
+
+    // Effective epsilon after rounding the width up to a power of two
+    double epsilon() const { return epsilon_; }
+
+    size_t width() const { return width_; }
+    size_t depth() const { return depth_; }
+
+private:
+    std::vector<uint64_t> counters_;
+    size_t width_{1};
+    size_t depth_{1};
+    double epsilon_{1.0};
+    uint64_t total_{0};
+
+    size_t index(uint64_t hash, size_t row) const {
+        // Kirsch-Mitzenmacher double hashing
+        uint64_t h1 = hash;
+        uint64_t h2 = (hash >> 32) | 1;
+        return row * width_ + ((h1 + row * h2) & (width_ - 1));
+    }
+};
+
+}
+}
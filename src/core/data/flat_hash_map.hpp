@@ -0,0 +1,304 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <utility>
+#include "bit_ops.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace netsentry {
+namespace data {
+
+// Open-addressing hash map in the style of SwissTable. Entries live in one
+// flat slot array next to a parallel array of one-byte control words holding
+// 7 bits of each entry's hash, and a probe compares a whole group of 16
+// control bytes at once (SSE2 when available), so most lookups touch one
+// cache line of metadata and a single slot.
+//
+// Inserting never allocates until the table is 7/8 full; callers that know
+// their working set should reserve() it up front. Hash must mix well across
+// all 64 bits: bits 7 and up select the group, the top 7 bits are the tag.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class FlatHashMap {
+public:
+    using value_type = std::pair<Key, Value>;
+
+    static constexpr size_t GROUP_SIZE = 16;
+
+    template <typename Entry, typename Map>
+    class Iterator {
+    public:
+        Iterator(Map* map, size_t index) : map_(map), index_(index) { skipFree(); }
+
+        Entry& operator*() const { return map_->slots_[index_]; }
+        Entry* operator->() const { return &map_->slots_[index_]; }
+
+        Iterator& operator++() {
+            ++index_;
+            skipFree();
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const { return index_ == other.index_; }
+        bool operator!=(const Iterator& other) const { return index_ != other.index_; }
+
+    private:
+        Map* map_;
+        size_t index_;
+
+        void skipFree() {
+            while (index_ < map_->capacity_ && !isFull(map_->ctrl_[index_])) {
+                ++index_;
+            }
+        }
+    };
+
+    using iterator = Iterator<value_type, FlatHashMap>;
+    using const_iterator = Iterator<const value_type, const FlatHashMap>;
+
+    explicit FlatHashMap(size_t expected = 0) {
+        reserve(expected);
+    }
+
+    FlatHashMap(const FlatHashMap&) = delete;
+    FlatHashMap& operator=(const FlatHashMap&) = delete;
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, capacity_); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, capacity_); }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t capacity() const { return capacity_; }
+
+    Value* find(const Key& key) {
+        size_t index = locate(key, hasher_(key));
+        return index == NPOS ? nullptr : &slots_[index].second;
+    }
+
+    const Value* find(const Key& key) const {
+        return const_cast<FlatHashMap*>(this)->find(key);
+    }
+
+    // Returns the value for key, default-constructing it first if absent.
+    std::pair<Value*, bool> tryEmplace(const Key& key) {
+        uint64_t hash = hasher_(key);
+
+        size_t index = locate(key, hash);
+        if (index != NPOS) {
+            return {&slots_[index].second, false};
+        }
+
+        if (size_ + tombstones_ + 1 > growthLimit()) {
+            rehash(size_ + 1 > growthLimit() / 2 ? capacity_ * 2 : capacity_);
+        }
+
+        index = freeSlot(hash);
+        if (ctrl_[index] == DELETED) {
+            --tombstones_;
+        }
+
+        ctrl_[index] = tag(hash);
+        slots_[index].first = key;
+        ++size_;
+
+        return {&slots_[index].second, true};
+    }
+
+    bool erase(const Key& key) {
+        size_t index = locate(key, hasher_(key));
+        if (index == NPOS) {
+            return false;
+        }
+
+        // A probe stops at the first group with an empty slot, so no entry
+        // was ever placed past a group that still has one; marking the slot
+        // empty again cannot hide anything.
+        size_t group = index & ~(GROUP_SIZE - 1);
+        if (matchEmpty(group) != 0) {
+            ctrl_[index] = EMPTY;
+        } else {
+            ctrl_[index] = DELETED;
+            ++tombstones_;
+        }
+
+        slots_[index] = value_type();
+        --size_;
+
+        return true;
+    }
+
+    void clear() {
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (isFull(ctrl_[i])) {
+                slots_[i] = value_type();
+            }
+        }
+
+        std::memset(ctrl_, EMPTY, capacity_);
+        size_ = 0;
+        tombstones_ = 0;
+    }
+
+    // Calls visit(key, value) for the entries in slots [cursor, cursor + steps)
+    // and returns where to resume, capacity() once the table is done. Lets a
+    // caller spread a full pass over several calls; entries must not be
+    // inserted or erased by visit.
+    template <typename F>
+    size_t scan(size_t cursor, size_t steps, F&& visit) {
+        size_t end = cursor + steps < capacity_ ? cursor + steps : capacity_;
+        for (; cursor < end; ++cursor) {
+            if (isFull(ctrl_[cursor])) {
+                visit(slots_[cursor].first, slots_[cursor].second);
+            }
+        }
+        return end;
+    }
+
+    void reserve(size_t count) {
+        size_t capacity = GROUP_SIZE;
+        while (capacity - capacity / 8 < count) {
+            capacity <<= 1;
+        }
+
+        if (capacity > capacity_) {
+            rehash(capacity);
+        }
+    }
+
+private:
+    static constexpr size_t NPOS = ~static_cast<size_t>(0);
+    static constexpr uint8_t EMPTY = 0x80;
+    static constexpr uint8_t DELETED = 0xFE;
+
+    // Groups are loaded with aligned 16-byte reads
+    struct alignas(GROUP_SIZE) Group {
+        uint8_t ctrl[GROUP_SIZE];
+    };
+
+    std::unique_ptr<Group[]> groups_;
+    uint8_t* ctrl_{nullptr};
+    std::unique_ptr<value_type[]> slots_;
+    size_t capacity_{0};
+    size_t size_{0};
+    size_t tombstones_{0};
+    Hash hasher_;
+
+    static bool isFull(uint8_t ctrl) { return (ctrl & 0x80) == 0; }
+    static uint8_t tag(uint64_t hash) { return static_cast<uint8_t>(hash >> 57); }
+
+    size_t growthLimit() const { return capacity_ - capacity_ / 8; }
+    size_t groupMask() const { return capacity_ / GROUP_SIZE - 1; }
+
+    // Bit i of the result is set when control byte i of the group equals value.
+    uint32_t match(size_t group, uint8_t value) const {
+#ifdef __SSE2__
+        __m128i ctrl = _mm_load_si128(reinterpret_cast<const __m128i*>(ctrl_ + group));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(static_cast<char>(value)))));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP_SIZE; ++i) {
+            mask |= static_cast<uint32_t>(ctrl_[group + i] == value) << i;
+        }
+        return mask;
+#endif
+    }
+
+    uint32_t matchEmpty(size_t group) const {
+        return match(group, EMPTY);
+    }
+
+    // Bit i is set when control byte i is EMPTY or DELETED (high bit set).
+    uint32_t matchFree(size_t group) const {
+#ifdef __SSE2__
+        __m128i ctrl = _mm_load_si128(reinterpret_cast<const __m128i*>(ctrl_ + group));
+        return static_cast<uint32_t>(_mm_movemask_epi8(ctrl));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP_SIZE; ++i) {
+            mask |= static_cast<uint32_t>(!isFull(ctrl_[group + i])) << i;
+        }
+        return mask;
+#endif
+    }
+
+    size_t locate(const Key& key, uint64_t hash) const {
+        if (size_ == 0) {
+            return NPOS;
+        }
+
+        size_t mask = groupMask();
+        size_t position = (hash >> 7) & mask;
+
+        // Triangular probing over groups visits every group once
+        for (size_t step = 1; step <= mask + 1; ++step) {
+            size_t group = position * GROUP_SIZE;
+
+            for (uint32_t bits = match(group, tag(hash)); bits != 0; bits &= bits - 1) {
+                size_t index = group + bit_ops::countTrailingZeros(bits);
+                if (slots_[index].first == key) {
+                    return index;
+                }
+            }
+
+            if (matchEmpty(group) != 0) {
+                return NPOS;
+            }
+
+            position = (position + step) & mask;
+        }
+
+        return NPOS;
+    }
+
+    size_t freeSlot(uint64_t hash) const {
+        size_t mask = groupMask();
+        size_t position = (hash >> 7) & mask;
+
+        for (size_t step = 1;; ++step) {
+            size_t group = position * GROUP_SIZE;
+
+            uint32_t bits = matchFree(group);
+            if (bits != 0) {
+                return group + bit_ops::countTrailingZeros(bits);
+            }
+
+            position = (position + step) & mask;
+        }
+    }
+
+    void rehash(size_t capacity) {
+        std::unique_ptr<Group[]> old_groups = std::move(groups_);
+        std::unique_ptr<value_type[]> old_slots = std::move(slots_);
+        const uint8_t* old_ctrl = ctrl_;
+        size_t old_capacity = capacity_;
+
+        groups_ = std::make_unique<Group[]>(capacity / GROUP_SIZE);
+        ctrl_ = groups_[0].ctrl;
+        slots_ = std::make_unique<value_type[]>(capacity);
+        capacity_ = capacity;
+        tombstones_ = 0;
+        std::memset(ctrl_, EMPTY, capacity_);
+
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (!isFull(old_ctrl[i])) {
+                continue;
+            }
+
+            uint64_t hash = hasher_(old_slots[i].first);
+            size_t index = freeSlot(hash);
+            ctrl_[index] = tag(hash);
+            slots_[index] = std::move(old_slots[i]);
+        }
+    }
+};
+
+}
+}
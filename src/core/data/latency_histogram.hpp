@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include "log2_buckets.hpp"
+
+namespace netsentry {
+namespace data {
+
+// Distribution of latencies in microseconds over power-of-two buckets:
+// bucket 0 holds zero, bucket i values in [2^(i-1), 2^i), and the last one
+// everything from about 4 seconds up. Fixed size (96 bytes), no
+// allocation, so one can be kept per host. Counts saturate rather than
+// wrap.
+class LatencyHistogram {
+public:
+    static constexpr size_t BUCKET_COUNT = 24;
+
+    using Buckets = std::array<uint32_t, BUCKET_COUNT>;
+
+    void add(uint64_t microseconds) {
+        uint32_t& bucket = buckets_[bucketFor(microseconds)];
+        if (bucket < std::numeric_limits<uint32_t>::max()) {
+            bucket++;
+        }
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            uint64_t sum = static_cast<uint64_t>(buckets_[i]) + other.buckets_[i];
+            buckets_[i] = static_cast<uint32_t>(std::min<uint64_t>(sum, std::numeric_limits<uint32_t>::max()));
+        }
+    }
+
+    void clear() { buckets_.fill(0); }
+
+    uint64_t count() const { return count(buckets_); }
+
+    // Estimated q-quantile (0..1), interpolated linearly inside the bucket
+    // it falls in; the open-ended last bucket reports its lower bound.
+    double percentile(double q) const { return percentile(buckets_, q); }
+
+    static uint64_t count(const Buckets& buckets) {
+        uint64_t total = 0;
+        for (uint32_t bucket : buckets) {
+            total += bucket;
+        }
+        return total;
+    }
+
+    // Also takes bucket counts directly, such as the difference of two
+    // readings, for a quantile over an interval.
+    static double percentile(const Buckets& buckets, double q) { return log2_buckets::percentile(buckets, q); }
+
+    const Buckets& buckets() const { return buckets_; }
+
+    // Smallest value counted in bucket
+    static uint64_t lowerBound(size_t bucket) { return log2_buckets::lowerBound(bucket); }
+
+    static size_t bucketFor(uint64_t value) { return log2_buckets::bucketFor(value, BUCKET_COUNT); }
+
+private:
+    Buckets buckets_{};
+};
+
+}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include "bit_ops.hpp"
+
+namespace netsentry {
+namespace data {
+
+// Power-of-two bucketing shared by LatencyHistogram and the histogram
+// metric: bucket 0 holds zero and bucket i values in [2^(i-1), 2^i), with
+// everything past the last bucket folded into it.
+namespace log2_buckets {
+
+inline size_t bucketFor(uint64_t value, size_t bucket_count) {
+    size_t bucket = value == 0 ? 0 : 64 - static_cast<size_t>(bit_ops::countLeadingZeros(value));
+    return std::min(bucket, bucket_count - 1);
+}
+
+// Smallest value counted in bucket
+inline uint64_t lowerBound(size_t bucket) {
+    return bucket == 0 ? 0 : 1ULL << (bucket - 1);
+}
+
+// Estimated q-quantile (0..1) of bucket counts, interpolated linearly
+// inside the bucket it falls in; the open-ended last bucket reports its
+// lower bound.
+template <typename Buckets>
+double percentile(const Buckets& buckets, double q) {
+    uint64_t total = 0;
+    for (auto count : buckets) {
+        total += count;
+    }
+
+    if (total == 0) {
+        return 0.0;
+    }
+
+    double rank = std::min(std::max(q, 0.0), 1.0) * static_cast<double>(total);
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        if (buckets[i] == 0) {
+            continue;
+        }
+
+        if (static_cast<double>(seen + buckets[i]) >= rank) {
+            if (i == 0) {
+                return 0.0;
+            }
+
+            double lower = static_cast<double>(lowerBound(i));
+            if (i == buckets.size() - 1) {
+                return lower;
+            }
+
+            double fraction = (rank - static_cast<double>(seen)) / static_cast<double>(buckets[i]);
+            return lower + lower * fraction;
+        }
+
+        seen += buckets[i];
+    }
+
+    return 0.0;
+}
+
+}
+
+}
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "bit_ops.hpp"
+
+namespace netsentry {
+namespace data {
+
+// Longest-prefix-match table over fixed-length big-endian keys (4 bytes for
+// IPv4, 16 for IPv6). Prefixes are collected by insert() and compiled by
+// build() into a multibit trie with a directly indexed 16-bit root and
+// 8-bit strides below it, where every prefix has been pushed down to the
+// entries it covers, so a lookup is one read per level with no
+// backtracking: at most 2 levels for an IPv4 prefix up to /24, 3 up to /32.
+//
+// Below the root, nodes are compressed as in Poptrie (Asai and Ohara): runs
+// of equal entries are kept once, right after a 256-bit bitmap marking
+// where each run starts, and found with a popcount. A node costs 36 bytes
+// plus 4 per run rather than 1 KB, and a sparse one fits in a cache line.
+// Values are 23 bits.
+class PrefixTable {
+public:
+    static constexpr uint32_t NONE = 0x7FFFFF;
+    static constexpr size_t MAX_KEY_BYTES = 16;
+
+    explicit PrefixTable(size_t key_bytes)
+        : key_bytes_(std::min(std::max<size_t>(key_bytes, 2), MAX_KEY_BYTES)), root_(ROOT_SIZE, NONE) {}
+
+    // Adds a prefix, or replaces the value of one already added; the bits of
+    // prefix beyond length are ignored. Lookups only see it after the next
+    // build(). Returns false if length exceeds the key or value does not
+    // fit.
+    bool insert(const uint8_t* prefix, uint8_t length, uint32_t value) {
+        if (length > key_bytes_ * 8 || value >= NONE) {
+            return false;
+        }
+
+        Route route{};
+        route.length = length;
+        route.value = value;
+        route.order = static_cast<uint32_t>(routes_.size());
+
+        for (size_t i = 0; i * 8 < length; ++i) {
+            uint8_t mask = length >= (i + 1) * 8 ? 0xFF : static_cast<uint8_t>(0xFF << ((i + 1) * 8 - length));
+            route.key[i] = prefix[i] & mask;
+        }
+
+        routes_.push_back(route);
+        return true;
+    }
+
+    // Compiles everything inserted so far. Not safe against concurrent
+    // lookups.
+    void build() {
+        // Sorted by key, then length, then insertion, keeping only the
+        // latest value for each prefix
+        std::sort(routes_.begin(), routes_.end(), [](const Route& a, const Route& b) {
+            if (a.key != b.key) {
+                return a.key < b.key;
+            }
+            if (a.length != b.length) {
+                return a.length < b.length;
+            }
+            return a.order < b.order;
+        });
+
+        size_t kept = 0;
+        for (size_t i = 0; i < routes_.size(); ++i) {
+            if (kept > 0 && routes_[kept - 1].key == routes_[i].key && routes_[kept - 1].length == routes_[i].length) {
+                routes_[kept - 1].value = routes_[i].value;
+            } else {
+                routes_[kept++] = routes_[i];
+            }
+        }
+        routes_.resize(kept);
+
+        for (size_t i = 0; i < routes_.size(); ++i) {
+            routes_[i].order = static_cast<uint32_t>(i);
+        }
+
+        root_.assign(ROOT_SIZE, NONE);
+        nodes_.clear();
+        buildLevel(routes_.data(), routes_.data() + routes_.size(), 0, root_.data());
+        nodes_.shrink_to_fit();
+    }
+
+    uint32_t lookup(const uint8_t* key) const {
+        uint32_t entry = root_[(static_cast<size_t>(key[0]) << 8) | key[1]];
+
+        for (size_t byte = 2; entry & CHILD; ++byte) {
+            const uint32_t* node = nodes_.data() + (entry & ~CHILD);
+            size_t word = key[byte] >> 6;
+
+            uint64_t bits;
+            memcpy(&bits, node + word * 2, sizeof(bits));
+            uint8_t before;
+            memcpy(&before, reinterpret_cast<const uint8_t*>(node + BITMAP_WORDS) + word, 1);
+
+            // Runs starting at or before this entry
+            size_t runs = before + bit_ops::popCount(bits & (~uint64_t{0} >> (63 - (key[byte] & 63))));
+            entry = node[HEADER_WORDS + runs - 1];
+        }
+
+        return entry;
+    }
+
+    void clear() {
+        routes_.clear();
+        root_.assign(ROOT_SIZE, NONE);
+        nodes_.clear();
+    }
+
+    // Distinct prefixes as of the last build(), plus any inserted since
+    size_t size() const { return routes_.size(); }
+
+    // Bytes used by the compiled trie
+    size_t memoryUsage() const {
+        return (root_.capacity() + nodes_.capacity()) * sizeof(uint32_t);
+    }
+
+private:
+    static constexpr size_t ROOT_BITS = 16;
+    static constexpr size_t ROOT_SIZE = size_t{1} << ROOT_BITS;
+    static constexpr size_t NODE_BITS = 8;
+    static constexpr size_t NODE_SIZE = size_t{1} << NODE_BITS;
+
+    // Entries hold a value, or the child flag and the node's offset
+    static constexpr uint32_t CHILD = 0x80000000;
+    // A node is a bitmap with bit i set where entry i starts a new run, the
+    // number of runs starting before each 64-bit word of it, then one entry
+    // per run
+    static constexpr size_t BITMAP_WORDS = NODE_SIZE / 32;
+    static constexpr size_t HEADER_WORDS = BITMAP_WORDS + 1;
+
+    struct Route {
+        std::array<uint8_t, MAX_KEY_BYTES> key;
+        uint8_t length;
+        uint32_t value;
+        uint32_t order;
+    };
+
+    size_t key_bytes_;
+    std::vector<Route> routes_;
+    std::vector<uint32_t> root_;
+    std::vector<uint32_t> nodes_;
+
+    // Fills the level whose entries are indexed by the key bits starting
+    // at byte, and creates its children. [begin, end) are sorted routes that
+    // all agree on the bytes before this level; those no longer than
+    // byte * 8 bits are already accounted for in slots.
+    void buildLevel(const Route* begin, const Route* end, size_t byte, uint32_t* slots) {
+        size_t bits = byte == 0 ? ROOT_BITS : NODE_BITS;
+        size_t level_start = byte * 8;
+        size_t level_end = level_start + bits;
+
+        auto slotOf = [byte](const Route& route) {
+            return byte == 0 ? (static_cast<size_t>(route.key[0]) << 8) | route.key[1] : route.key[byte];
+        };
+
+        // Routes that end within this level (at the root, including /0)
+        // cover a power-of-two run of its slots; shorter ones are painted
+        // first so longer ones win.
+        std::vector<const Route*> ending;
+        for (const Route* route = begin; route != end; ++route) {
+            if ((byte == 0 || route->length > level_start) && route->length <= level_end) {
+                ending.push_back(route);
+            }
+        }
+
+        std::stable_sort(ending.begin(), ending.end(),
+                         [](const Route* a, const Route* b) { return a->length < b->length; });
+
+        for (const Route* route : ending) {
+            size_t span_bits = level_end - route->length;
+            size_t first = (slotOf(*route) >> span_bits) << span_bits;
+            std::fill(slots + first, slots + first + (size_t{1} << span_bits), route->value);
+        }
+
+        // Routes that agree on this level's bits as well are contiguous
+        const Route* route = begin;
+        while (route != end) {
+            size_t slot = slotOf(*route);
+            const Route* run_end = route;
+            bool deeper = false;
+
+            while (run_end != end && slotOf(*run_end) == slot) {
+                deeper |= run_end->length > level_end;
+                ++run_end;
+            }
+
+            if (deeper) {
+                std::array<uint32_t, NODE_SIZE> child;
+                child.fill(slots[slot]);
+                buildLevel(route, run_end, byte + bits / 8, child.data());
+                slots[slot] = CHILD | addNode(child);
+            }
+
+            route = run_end;
+        }
+    }
+
+    uint32_t addNode(const std::array<uint32_t, NODE_SIZE>& slots) {
+        uint64_t bitmap[BITMAP_WORDS / 2] = {};
+        uint8_t before[BITMAP_WORDS / 2] = {};
+        size_t offset = nodes_.size();
+        nodes_.resize(offset + HEADER_WORDS);
+
+        for (size_t i = 0; i < NODE_SIZE; ++i) {
+            if (i % 64 == 0) {
+                before[i / 64] = static_cast<uint8_t>(nodes_.size() - offset - HEADER_WORDS);
+            }
+            if (i == 0 || slots[i] != slots[i - 1]) {
+                bitmap[i / 64] |= uint64_t{1} << (i % 64);
+                nodes_.push_back(slots[i]);
+            }
+        }
+
+        memcpy(nodes_.data() + offset, bitmap, sizeof(bitmap));
+        memcpy(nodes_.data() + offset + BITMAP_WORDS, before, sizeof(before));
+        return static_cast<uint32_t>(offset);
+    }
+};
+
+}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace netsentry {
+namespace data {
+
+// Bytes and packets over the last minute, in a ring of 1-second buckets
+// for the last 10 seconds and one of 10-second buckets for the last 60.
+// Each ring keeps one extra bucket for the period in progress, so sum()
+// always sees whole periods. Fixed size (about 220 bytes), no allocation;
+// buckets are cleared lazily as time moves past them.
+class RateWindow {
+public:
+    static constexpr size_t FINE_SECONDS = 10;
+    static constexpr size_t COARSE_BUCKETS = 6;
+    static constexpr uint64_t COARSE_SECONDS = 10;
+
+    struct Totals {
+        uint64_t bytes{0};
+        uint64_t packets{0};
+    };
+
+    // now is in whole seconds; samples older than the newest one seen are
+    // counted in the current bucket.
+    void add(uint64_t bytes, uint64_t now) {
+        if (now > last_) {
+            advance(now);
+        }
+
+        size_t fine = last_ % FINE_RING;
+        fine_bytes_[fine] += bytes;
+        fine_packets_[fine]++;
+
+        size_t coarse = (last_ / COARSE_SECONDS) % COARSE_RING;
+        coarse_bytes_[coarse] += bytes;
+        coarse_packets_[coarse]++;
+    }
+
+    // Totals over the last complete seconds before now: whole seconds up to
+    // FINE_SECONDS, or whole 10-second periods up to a minute beyond that.
+    Totals sum(uint64_t seconds, uint64_t now) const {
+        Totals totals;
+
+        if (seconds <= FINE_SECONDS) {
+            for (uint64_t second = now - std::min(seconds, now); second < now; ++second) {
+                if (second <= last_ && second + FINE_SECONDS >= last_) {
+                    totals.bytes += fine_bytes_[second % FINE_RING];
+                    totals.packets += fine_packets_[second % FINE_RING];
+                }
+            }
+            return totals;
+        }
+
+        uint64_t periods = std::min<uint64_t>(COARSE_BUCKETS, (seconds + COARSE_SECONDS - 1) / COARSE_SECONDS);
+        uint64_t current = now / COARSE_SECONDS;
+        uint64_t latest = last_ / COARSE_SECONDS;
+
+        for (uint64_t period = current - std::min(periods, current); period < current; ++period) {
+            if (period <= latest && period + COARSE_BUCKETS >= latest) {
+                totals.bytes += coarse_bytes_[period % COARSE_RING];
+                totals.packets += coarse_packets_[period % COARSE_RING];
+            }
+        }
+        return totals;
+    }
+
+private:
+    static constexpr size_t FINE_RING = FINE_SECONDS + 1;
+    static constexpr size_t COARSE_RING = COARSE_BUCKETS + 1;
+
+    std::array<uint64_t, FINE_RING> fine_bytes_{};
+    std::array<uint64_t, COARSE_RING> coarse_bytes_{};
+    std::array<uint32_t, FINE_RING> fine_packets_{};
+    std::array<uint32_t, COARSE_RING> coarse_packets_{};
+    uint64_t last_{0};
+
+    void advance(uint64_t now) {
+        for (uint64_t second = std::max(last_ + 1, now - std::min<uint64_t>(now, FINE_SECONDS)); second <= now; ++second) {
+            fine_bytes_[second % FINE_RING] = 0;
+            fine_packets_[second % FINE_RING] = 0;
+        }
+
+        uint64_t latest = last_ / COARSE_SECONDS;
+        uint64_t current = now / COARSE_SECONDS;
+        for (uint64_t period = std::max(latest + 1, current - std::min<uint64_t>(current, COARSE_BUCKETS)); period <= current; ++period) {
+            coarse_bytes_[period % COARSE_RING] = 0;
+            coarse_packets_[period % COARSE_RING] = 0;
+        }
+
+        last_ = now;
+    }
+};
+
+}
+}
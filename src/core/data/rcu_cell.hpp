@@ -0,0 +1,163 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace netsentry {
+namespace data {
+
+// Holds an immutable value that readers load with a single atomic pointer
+// read and that a writer replaces wholesale (read-copy-update). Replaced
+// values are freed with epoch-based reclamation: a reader announces the
+// epoch it entered in one of a fixed set of slots, and a value retired in
+// epoch e is only deleted once no slot still holds an epoch <= e. Readers
+// never block and never touch a lock; publishing never waits for readers.
+//
+// publish() must be serialized by the caller. More than SLOTS concurrent
+// readers spin until a slot frees up.
+template <typename T>
+class RcuCell {
+public:
+    static constexpr size_t SLOTS = 64;
+
+    class ReadGuard {
+    public:
+        ReadGuard() = default;
+
+        ReadGuard(ReadGuard&& other) noexcept : slot_(other.slot_), value_(other.value_) {
+            other.slot_ = nullptr;
+            other.value_ = nullptr;
+        }
+
+        ReadGuard& operator=(ReadGuard&& other) noexcept {
+            if (this != &other) {
+                release();
+                slot_ = std::exchange(other.slot_, nullptr);
+                value_ = std::exchange(other.value_, nullptr);
+            }
+            return *this;
+        }
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+        ~ReadGuard() { release(); }
+
+        explicit operator bool() const { return value_ != nullptr; }
+        const T* get() const { return value_; }
+        const T& operator*() const { return *value_; }
+        const T* operator->() const { return value_; }
+
+        void release() {
+            if (slot_) {
+                slot_->store(0, std::memory_order_release);
+                slot_ = nullptr;
+            }
+            value_ = nullptr;
+        }
+
+    private:
+        friend class RcuCell;
+
+        ReadGuard(std::atomic<uint64_t>* slot, const T* value) : slot_(slot), value_(value) {}
+
+        std::atomic<uint64_t>* slot_{nullptr};
+        const T* value_{nullptr};
+    };
+
+    RcuCell() = default;
+    RcuCell(const RcuCell&) = delete;
+    RcuCell& operator=(const RcuCell&) = delete;
+
+    ~RcuCell() {
+        delete current_.load(std::memory_order_relaxed);
+        for (auto& retired : retired_) {
+            delete retired.second;
+        }
+    }
+
+    // The value stays valid until the guard is released.
+    ReadGuard read() const {
+        std::atomic<uint64_t>* slot = claimSlot(epoch_.load(std::memory_order_seq_cst));
+        return ReadGuard(slot, current_.load(std::memory_order_seq_cst));
+    }
+
+    // Replaces the value (which may be null) and frees whatever earlier
+    // values no reader can still see.
+    void publish(std::unique_ptr<T> value) {
+        T* previous = current_.exchange(value.release(), std::memory_order_seq_cst);
+        uint64_t retired_epoch = epoch_.fetch_add(1, std::memory_order_seq_cst);
+
+        if (previous) {
+            retired_.emplace_back(retired_epoch, previous);
+        }
+
+        reclaim();
+    }
+
+    // Values replaced but not yet freed because a reader may still hold them
+    size_t pendingReclaim() const { return retired_.size(); }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{0};
+    };
+
+    mutable std::array<Slot, SLOTS> slots_;
+    std::atomic<uint64_t> epoch_{1};
+    std::atomic<T*> current_{nullptr};
+    std::vector<std::pair<uint64_t, T*>> retired_;
+
+    std::atomic<uint64_t>* claimSlot(uint64_t epoch) const {
+        // Threads start probing at different slots so they rarely collide
+        thread_local const size_t start = std::hash<std::thread::id>{}(std::this_thread::get_id());
+
+        for (size_t i = start;; ++i) {
+            std::atomic<uint64_t>& slot = slots_[i % SLOTS].epoch;
+
+            uint64_t expected = 0;
+            if (slot.load(std::memory_order_relaxed) == 0 &&
+                slot.compare_exchange_strong(expected, epoch, std::memory_order_seq_cst)) {
+                return &slot;
+            }
+
+            if (i % SLOTS == (start + SLOTS - 1) % SLOTS) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void reclaim() {
+        if (retired_.empty()) {
+            return;
+        }
+
+        uint64_t oldest = UINT64_MAX;
+        for (const auto& slot : slots_) {
+            uint64_t epoch = slot.epoch.load(std::memory_order_seq_cst);
+            if (epoch != 0 && epoch < oldest) {
+                oldest = epoch;
+            }
+        }
+
+        size_t kept = 0;
+        for (auto& retired : retired_) {
+            if (retired.first < oldest) {
+                delete retired.second;
+            } else {
+                retired_[kept++] = retired;
+            }
+        }
+        retired_.resize(kept);
+    }
+};
+
+}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace netsentry {
+namespace data {
+
+// Expected value of a series observed at a steady tick, by additive
+// Holt-Winters smoothing: a level, a trend and one seasonal offset per slot
+// of the season (hour of the day, by default), plus an exponentially
+// weighted variance of the forecast errors. Each observation is scored by
+// how many deviations it lies from the forecast made before it. With beta
+// and gamma at zero this is a plain EWMA. Fixed size (about 120 bytes),
+// O(1) per update, no allocation.
+class SeasonalBaseline {
+public:
+    static constexpr size_t SEASON_SLOTS = 24;
+
+    // Smoothing factors apply per update, so they set how many ticks the
+    // baseline remembers; gamma applies to the slot being updated only.
+    struct Parameters {
+        float alpha{0.05f};
+        float beta{0.005f};
+        float gamma{0.05f};
+        // Observations before scores are reported
+        uint32_t warmup{60};
+        // Lower bound on the deviation scores are relative to, so that a
+        // very steady series does not score every small change as extreme
+        float min_deviation{1.0f};
+    };
+
+    // Returns the score of value against the forecast for slot.
+    double update(double value, size_t slot, const Parameters& parameters) {
+        slot %= SEASON_SLOTS;
+
+        if (observations_ == 0) {
+            level_ = static_cast<float>(value);
+            observations_ = 1;
+            return 0.0;
+        }
+
+        double forecast = level_ + trend_ + season_[slot];
+        double error = value - forecast;
+
+        score_ = observations_ >= parameters.warmup ? static_cast<float>(error / deviationFor(parameters)) : 0.0f;
+
+        double previous_level = level_;
+        level_ += parameters.alpha * (value - season_[slot] - level_ - trend_) + trend_;
+        trend_ += parameters.beta * (level_ - previous_level - trend_);
+        season_[slot] += parameters.gamma * (value - level_ - season_[slot]);
+        variance_ += parameters.alpha * (error * error - variance_);
+
+        if (observations_ < UINT32_MAX) {
+            observations_++;
+        }
+
+        return score_;
+    }
+
+    // Never negative, as the series are rates
+    double forecast(size_t slot) const {
+        return std::max(0.0, static_cast<double>(level_ + trend_ + season_[slot % SEASON_SLOTS]));
+    }
+
+    double deviation() const { return std::sqrt(static_cast<double>(variance_)); }
+
+    // Of the latest observation
+    double score() const { return score_; }
+
+    uint32_t observations() const { return observations_; }
+
+private:
+    float level_{0.0f};
+    float trend_{0.0f};
+    float variance_{0.0f};
+    float score_{0.0f};
+    std::array<float, SEASON_SLOTS> season_{};
+    uint32_t observations_{0};
+
+    double deviationFor(const Parameters& parameters) const {
+        return std::max({deviation(), static_cast<double>(parameters.min_deviation), 1e-9});
+    }
+};
+
+}
+}
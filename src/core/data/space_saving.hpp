@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "flat_hash_map.hpp"
+
+namespace netsentry {
+namespace data {
+
+// Space-Saving heavy-hitter summary (Metwally et al.). Tracks at most
+// capacity keys; when a new key arrives and the summary is full it takes
+// over the smallest counter, inheriting its count as error. Any key whose
+// weight exceeds total / capacity is guaranteed to be tracked, and every
+// count overestimates the true weight by at most its error.
+template <typename Key, typename Hash>
+class SpaceSaving {
+public:
+    struct Counter {
+        Key key;
+        uint64_t count;
+        uint64_t error;
+    };
+
+    explicit SpaceSaving(size_t capacity)
+        : capacity_(std::max<size_t>(1, capacity)), index_(capacity_) {
+        heap_.reserve(capacity_);
+    }
+
+    void add(const Key& key, uint64_t weight = 1) {
+        size_t* position = index_.find(key);
+        if (position) {
+            heap_[*position].count += weight;
+            siftDown(*position);
+            return;
+        }
+
+        if (heap_.size() < capacity_) {
+            *index_.tryEmplace(key).first = heap_.size();
+            heap_.push_back({key, weight, 0});
+            siftUp(heap_.size() - 1);
+            return;
+        }
+
+        // Take over the minimum, which sits at the root
+        Counter& root = heap_[0];
+        index_.erase(root.key);
+        *index_.tryEmplace(key).first = 0;
+
+        root.key = key;
+        root.error = root.count;
+        root.count += weight;
+        siftDown(0);
+    }
+
+    // Tracked counters, largest first
+    std::vector<Counter> top(size_t limit) const {
+        std::vector<Counter> result(heap_.begin(), heap_.end());
+
+        auto larger = [](const Counter& a, const Counter& b) { return a.count > b.count; };
+        if (result.size() > limit) {
+            std::partial_sort(result.begin(), result.begin() + limit, result.end(), larger);
+            result.resize(limit);
+        } else {
+            std::sort(result.begin(), result.end(), larger);
+        }
+
+        return result;
+    }
+
+    const std::vector<Counter>& counters() const { return heap_; }
+
+    void clear() {
+        heap_.clear();
+        index_.clear();
+    }
+
+    size_t size() const { return heap_.size(); }
+    size_t capacity() const { return capacity_; }
+
+private:
+    size_t capacity_;
+    std::vector<Counter> heap_;
+    FlatHashMap<Key, size_t, Hash> index_;
+
+    void place(size_t position) {
+        *index_.find(heap_[position].key) = position;
+    }
+
+    void siftUp(size_t position) {
+        while (position > 0) {
+            size_t parent = (position - 1) / 2;
+            if (heap_[parent].count <= heap_[position].count) {
+                break;
+            }
+            std::swap(heap_[parent], heap_[position]);
+            place(position);
+            position = parent;
+        }
+        place(position);
+    }
+
+    void siftDown(size_t position) {
+        while (true) {
+            size_t smallest = position;
+            size_t left = 2 * position + 1;
+            size_t right = left + 1;
+
+            if (left < heap_.size() && heap_[left].count < heap_[smallest].count) {
+                smallest = left;
+            }
+            if (right < heap_.size() && heap_[right].count < heap_[smallest].count) {
+                smallest = right;
+            }
+            if (smallest == position) {
+                break;
+            }
+
+            std::swap(heap_[smallest], heap_[position]);
+            place(position);
+            position = smallest;
+        }
+        place(position);
+    }
+};
+
+}
+}
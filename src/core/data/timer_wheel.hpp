@@ -0,0 +1,176 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace netsentry {
+namespace data {
+
+// Hierarchical timing wheel: four levels of 64 slots, each level's slot
+// spanning 64 slots of the one below, so deadlines up to 64^4 ticks ahead
+// are scheduled and fired in O(1) without scanning pending timers. Entries
+// in higher levels are cascaded down as the wheel turns. Deadlines further
+// out are parked at the wheel's horizon until they come within range.
+//
+// Stretches with nothing pending in the lower levels are skipped in one step,
+// so the first advance() from tick 0 to a wall-clock timestamp costs a few
+// cascades per level rather than one iteration per elapsed tick.
+//
+// Timers cannot be cancelled or moved. Callers that extend a deadline (e.g.
+// on every packet of a flow) leave the old entry in place and re-schedule
+// from the expiry callback if the item turns out to still be live.
+template <typename T>
+class TimerWheel {
+public:
+    static constexpr size_t LEVELS = 4;
+    static constexpr size_t SLOT_BITS = 6;
+    static constexpr size_t SLOTS = 1 << SLOT_BITS;
+
+    explicit TimerWheel(uint64_t tick = 1) : tick_(tick ? tick : 1) {}
+
+    // deadline is in the same unit as advance()'s now and is rounded up to a
+    // whole tick; anything already due fires on the next tick.
+    void schedule(const T& item, uint64_t deadline) {
+        uint64_t ticks = deadline / tick_ + (deadline % tick_ != 0);
+        insert(Entry{item, ticks > current_ ? ticks : current_ + 1});
+        ++size_;
+    }
+
+    // Turns the wheel up to now, calling expired(item) for every entry whose
+    // deadline has passed. The callback may schedule new entries.
+    template <typename Callback>
+    void advance(uint64_t now, Callback&& expired) {
+        uint64_t target = now / tick_;
+
+        if (size_ == 0) {
+            if (target > current_) {
+                current_ = target;
+            }
+            return;
+        }
+
+        while (current_ < target) {
+            size_t empty = 0;
+            while (empty < LEVELS && counts_[empty] == 0) {
+                ++empty;
+            }
+
+            // Nothing can fire or cascade before the next slot boundary of
+            // the lowest occupied level
+            if (empty > 0) {
+                uint64_t last = current_ | ((uint64_t{1} << (SLOT_BITS * empty)) - 1);
+                if (empty == LEVELS || last >= target) {
+                    current_ = target;
+                    break;
+                }
+                current_ = last;
+            }
+
+            ++current_;
+
+            size_t index = current_ & (SLOTS - 1);
+            if (index == 0) {
+                cascade(1);
+            }
+
+            auto& slot = levels_[0][index];
+            if (slot.empty()) {
+                continue;
+            }
+
+            // Swap out so that callbacks can schedule into this slot again
+            firing_.swap(slot);
+            size_ -= firing_.size();
+            counts_[0] -= firing_.size();
+
+            for (auto& entry : firing_) {
+                expired(entry.item);
+            }
+
+            firing_.clear();
+
+            if (size_ == 0) {
+                current_ = target;
+            }
+        }
+    }
+
+    void clear() {
+        for (auto& level : levels_) {
+            for (auto& slot : level) {
+                slot.clear();
+            }
+        }
+        counts_.fill(0);
+        size_ = 0;
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+private:
+    struct Entry {
+        T item;
+        uint64_t deadline;
+    };
+
+    using Slot = std::vector<Entry>;
+
+    uint64_t tick_;
+    uint64_t current_{0};
+    size_t size_{0};
+    std::array<size_t, LEVELS> counts_{};
+    std::array<std::array<Slot, SLOTS>, LEVELS> levels_;
+    // Slots are emptied by swapping with these, so vector capacity moves
+    // between slots instead of being freed and scheduling stops allocating
+    // once the wheel has warmed up.
+    Slot firing_;
+    Slot cascading_;
+
+    void insert(Entry entry) {
+        // Entries beyond the horizon are parked in the top level and keep
+        // their real deadline, which is re-evaluated each time they cascade
+        uint64_t horizon = (uint64_t{1} << (SLOT_BITS * LEVELS)) - 1;
+        uint64_t slot_tick = entry.deadline - current_ > horizon ? current_ + horizon : entry.deadline;
+
+        uint64_t delta = slot_tick - current_;
+
+        for (size_t level = 0; level < LEVELS; ++level) {
+            if (delta < (uint64_t{1} << (SLOT_BITS * (level + 1))) || level + 1 == LEVELS) {
+                size_t index = (slot_tick >> (SLOT_BITS * level)) & (SLOTS - 1);
+                levels_[level][index].push_back(std::move(entry));
+                ++counts_[level];
+                return;
+            }
+        }
+    }
+
+    // Redistributes the level's current slot into the levels below, after
+    // first cascading the level above if this one has wrapped as well.
+    void cascade(size_t level) {
+        if (level >= LEVELS) {
+            return;
+        }
+
+        size_t index = (current_ >> (SLOT_BITS * level)) & (SLOTS - 1);
+        if (index == 0) {
+            cascade(level + 1);
+        }
+
+        // The level above has already finished with cascading_
+        cascading_.swap(levels_[level][index]);
+        counts_[level] -= cascading_.size();
+
+        for (auto& entry : cascading_) {
+            insert(std::move(entry));
+        }
+
+        cascading_.clear();
+    }
+};
+
+}
+}
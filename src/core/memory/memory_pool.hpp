@@ -90,7 +90,8 @@ private:
     bool isAddressInPool(Block* block) const {
         for (Block* chunk : chunks_) {
             if (block >= chunk && block < chunk + BlocksPerChunk) {
-                return (block - chunk) % sizeof(Block) == 0;
+                auto offset = reinterpret_cast<const uint8_t*>(block) - reinterpret_cast<const uint8_t*>(chunk);
+                return offset % sizeof(Block) == 0;
             }
         }
         return false;
@@ -1,4 +1,6 @@
 #include "system_metrics.hpp"
+#include <algorithm>
+#include "../data/log2_buckets.hpp"
 
 namespace netsentry {
 namespace metrics {
@@ -82,6 +84,81 @@ std::optional<double> CounterMetric::getValueAt(const TimePoint& time) const {
 
     return it->second;
 }
+HistogramMetric::HistogramMetric(const std::string& name)
+    : Metric(name, MetricType::HISTOGRAM) {}
+
+void HistogramMetric::update(double value) {
+    observe(value > 0.0 ? static_cast<uint64_t>(value) : 0);
+}
+
+void HistogramMetric::observe(uint64_t value) {
+    buckets_[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    raiseMax(value);
+}
+
+void HistogramMetric::merge(const Buckets& buckets, uint64_t sum, uint64_t max) {
+    uint64_t count = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        if (buckets[i] != 0) {
+            buckets_[i].fetch_add(buckets[i], std::memory_order_relaxed);
+            count += buckets[i];
+        }
+    }
+
+    count_.fetch_add(count, std::memory_order_relaxed);
+    sum_.fetch_add(sum, std::memory_order_relaxed);
+    raiseMax(max);
+}
+
+void HistogramMetric::raiseMax(uint64_t value) {
+    uint64_t current_max = max_.load(std::memory_order_relaxed);
+    while (value > current_max &&
+           !max_.compare_exchange_weak(current_max, value, std::memory_order_relaxed)) {
+    }
+}
+
+double HistogramMetric::getCurrentValue() const {
+    uint64_t count = count_.load(std::memory_order_relaxed);
+    if (count == 0) {
+        return 0.0;
+    }
+    return static_cast<double>(sum_.load(std::memory_order_relaxed)) / count;
+}
+
+std::optional<double> HistogramMetric::getValueAt(const TimePoint& time) const {
+    (void)time;
+
+    if (count_.load(std::memory_order_relaxed) == 0) {
+        return std::nullopt;
+    }
+    return getCurrentValue();
+}
+
+uint64_t HistogramMetric::getCount() const {
+    return count_.load(std::memory_order_relaxed);
+}
+
+uint64_t HistogramMetric::getMax() const {
+    return max_.load(std::memory_order_relaxed);
+}
+
+HistogramMetric::Buckets HistogramMetric::getBuckets() const {
+    Buckets buckets;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    }
+    return buckets;
+}
+
+double HistogramMetric::percentile(const Buckets& buckets, double q) {
+    return data::log2_buckets::percentile(buckets, q);
+}
+
+size_t HistogramMetric::bucketFor(uint64_t value) {
+    return data::log2_buckets::bucketFor(value, BUCKET_COUNT);
+}
 
 }
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <string>
 #include <chrono>
 #include <memory>
@@ -65,5 +67,46 @@ private:
     std::map<TimePoint, double> historical_values_;
 };
 
+// Histogram with power-of-two buckets (bucket i holds values in
+// [2^(i-1), 2^i), bucket 0 holds zero). Recording is a handful of relaxed
+// atomic adds and never takes the metric mutex, so it can sit on the packet
+// path. The current value is the mean of everything recorded.
+class HistogramMetric : public Metric {
+public:
+    static constexpr size_t BUCKET_COUNT = 65;
+    using Buckets = std::array<uint64_t, BUCKET_COUNT>;
+
+    HistogramMetric(const std::string& name);
+
+    void update(double value) override;
+    void observe(uint64_t value);
+
+    // Adds observations that were bucketed elsewhere, e.g. in a per-thread
+    // histogram that is folded in periodically.
+    void merge(const Buckets& buckets, uint64_t sum, uint64_t max);
+
+    double getCurrentValue() const override;
+    std::optional<double> getValueAt(const TimePoint& time) const override;
+
+    uint64_t getCount() const;
+    uint64_t getMax() const;
+    Buckets getBuckets() const;
+
+    // Estimated q-quantile (0..1) of the given bucket counts, interpolated
+    // linearly inside the bucket it falls in. Pass the difference of two
+    // getBuckets() results to get a quantile over an interval.
+    static double percentile(const Buckets& buckets, double q);
+
+    static size_t bucketFor(uint64_t value);
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+
+    void raiseMax(uint64_t value);
+};
+
 }
 }
@@ -18,6 +18,11 @@
 #include "core/config/config_manager.hpp"
 #include "network/packet_capture.hpp"
 #include "network/packet_analyzer.hpp"
+#include "network/capture_collector.hpp"
+#include "network/analyzer_collector.hpp"
+#include "network/baseline_collector.hpp"
+#include "network/flow_exporter.hpp"
+#include "network/packet_pipeline.hpp"
 #include "alert/alert_manager.hpp"
 #include "api/rest_api.hpp"
 #include "web/dashboard.hpp"
@@ -40,6 +45,8 @@ void printUsage(const char* program_name) {
     std::cout << "  --help                   Show this help message" << std::endl;
     std::cout << "  --config <file>          Load configuration from file" << std::endl;
     std::cout << "  --interface <interface>  Network interface for packet capture" << std::endl;
+    std::cout << "  --replay <file>          Replay a pcap/pcapng file instead of live capture" << std::endl;
+    std::cout << "  --replay-speed <factor>  Replay speed (1.0 original timing, 0 as fast as possible)" << std::endl;
     std::cout << "  --api-enable             Enable REST API server" << std::endl;
     std::cout << "  --api-port <port>        Set API server port (default: 8080)" << std::endl;
     std::cout << "  --web-enable             Enable web dashboard" << std::endl;
@@ -67,6 +74,11 @@ int main(int argc, char** argv) {
         } else if (strcmp(argv[i], "--interface") == 0 && i + 1 < argc) {
             config.set<std::string>("capture_interface", argv[++i]);
             config.set<bool>("enable_packet_capture", true);
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            config.set<std::string>("capture_file", argv[++i]);
+            config.set<bool>("enable_packet_capture", true);
+        } else if (strcmp(argv[i], "--replay-speed") == 0 && i + 1 < argc) {
+            config.set<double>("capture_replay_speed", std::stod(argv[++i]));
         } else if (strcmp(argv[i], "--api-enable") == 0) {
             config.set<bool>("enable_api", true);
         } else if (strcmp(argv[i], "--api-port") == 0 && i + 1 < argc) {
@@ -142,48 +154,273 @@ int main(int argc, char** argv) {
         LOG_INFO("System collectors started");
 
         // Initialize packet capture and analyzer
-        std::unique_ptr<network::PacketCapture> packet_capture;
+        // Declared so that capture is torn down before the pipeline that it
+        // feeds, and the pipeline before the analyzer its workers use.
+        std::unique_ptr<network::FlowExporter> flow_exporter;
         std::unique_ptr<network::PacketAnalyzer> packet_analyzer;
+        std::unique_ptr<network::PacketPipeline> packet_pipeline;
+        std::unique_ptr<network::PacketCapture> packet_capture;
+        bool expire_flows_on_wall_clock = false;
 
         if (config.getOrDefault<bool>("enable_packet_capture", false)) {
+            network::CaptureOptions capture_options;
+            std::string capture_backend = config.getOrDefault<std::string>("capture_backend", "pcap");
+            if (capture_backend == "tpacket_v3") {
+                capture_options.backend = network::CaptureBackend::TPACKET_V3;
+            }
+            capture_options.ring_block_size = config.getOrDefault<uint32_t>("capture_ring_block_size", 1u << 22);
+            capture_options.ring_block_count = config.getOrDefault<uint32_t>("capture_ring_block_count", 64);
+            capture_options.ring_block_timeout_ms = config.getOrDefault<uint32_t>("capture_ring_block_timeout_ms", 100);
+
+            capture_options.fanout_workers = config.getOrDefault<uint32_t>("capture_fanout_workers", 0);
+            std::string fanout_mode = config.getOrDefault<std::string>("capture_fanout_mode", "hash");
+            if (fanout_mode == "cpu") {
+                capture_options.fanout_mode = network::FanoutMode::CPU;
+            } else if (fanout_mode == "rollover") {
+                capture_options.fanout_mode = network::FanoutMode::ROLLOVER;
+            }
+            capture_options.fanout_group = config.getOrDefault<uint16_t>("capture_fanout_group", 0);
+            capture_options.pin_fanout_workers = config.getOrDefault<bool>("capture_fanout_pin_workers", true);
+            capture_options.batch_size = config.getOrDefault<uint32_t>("capture_batch_size", 64);
+            capture_options.filter = config.getOrDefault<std::string>("capture_filter", "");
+            capture_options.capture_payload = config.getOrDefault<bool>("capture_payload", false);
+            capture_options.payload_max_size = config.getOrDefault<uint32_t>("capture_payload_max_size", 1024);
+            capture_options.buffer_size_kb = config.getOrDefault<uint32_t>("packet_buffer_size", 8192);
+            capture_options.read_timeout_ms = config.getOrDefault<uint32_t>("capture_read_timeout_ms", 100);
+            uint32_t flow_table_capacity = config.getOrDefault<uint32_t>("analysis_flow_table_capacity", 65536);
+            if (!capture_options.capture_payload) {
+                // Direct-mapped, so kept at twice the flow count to hold collisions down
+                capture_options.classified_flows =
+                    std::make_shared<network::ClassifiedFlowSet>(std::max<size_t>(2 * size_t{flow_table_capacity}, 1024));
+            }
+
+            // A configured capture file takes precedence over the live interface
+            auto capture_source = config.getOrDefault<std::string>("capture_interface", "eth0");
+            auto capture_file = config.getOrDefault<std::string>("capture_file", "");
+            if (!capture_file.empty()) {
+                capture_options.backend = network::CaptureBackend::FILE;
+                capture_options.fanout_workers = 0;
+                capture_options.replay_speed = config.getOrDefault<double>("capture_replay_speed", 1.0);
+                capture_backend = "file";
+                capture_source = capture_file;
+            }
+
+            network::PipelineOptions pipeline_options;
+            pipeline_options.workers = config.getOrDefault<uint32_t>("analysis_workers", 0);
+            if (pipeline_options.workers == 0) {
+                pipeline_options.workers = std::max(1u, std::thread::hardware_concurrency());
+            }
+            pipeline_options.queue_capacity = config.getOrDefault<uint32_t>("analysis_queue_capacity", 1024);
+            pipeline_options.batch_min_packets = config.getOrDefault<uint32_t>("analysis_batch_min_packets", 64);
+            pipeline_options.batch_timeout_ms = config.getOrDefault<uint32_t>("analysis_batch_timeout_ms", 1);
+            std::string overflow_policy = config.getOrDefault<std::string>("analysis_overflow_policy", "drop_newest");
+            if (overflow_policy == "drop_oldest") {
+                pipeline_options.overflow_policy = network::OverflowPolicy::DROP_OLDEST;
+            } else if (overflow_policy == "sample") {
+                pipeline_options.overflow_policy = network::OverflowPolicy::SAMPLE;
+            }
+            pipeline_options.sample_rate = config.getOrDefault<uint32_t>("analysis_overflow_sample_rate", 8);
+
+            // Every capture queue feeds the pipeline as its own producer
+            pipeline_options.producers = std::max<size_t>(1, capture_options.fanout_workers);
+
             packet_capture = std::make_unique<network::PacketCapture>();
-            packet_analyzer = std::make_unique<network::PacketAnalyzer>();
-
-            packet_capture->registerHandler([&packet_analyzer, &thread_pool, &database](const network::PacketInfo& packet) {
-                thread_pool.enqueue([&packet_analyzer, &database, packet]() {
-                    packet_analyzer->processPacket(packet);
-
-                    // Store connection data in database
-                    auto conn_key = packet_analyzer->createConnectionKey(packet);
-                    auto conn_stats = packet_analyzer->getConnectionStats(conn_key);
-
-                    if (conn_stats) {
-                        db::ConnectionRecord record;
-                        record.source_ip = conn_key.source_ip;
-                        record.source_port = conn_key.source_port;
-                        record.dest_ip = conn_key.dest_ip;
-                        record.dest_port = conn_key.dest_port;
-                        record.protocol = conn_key.protocol;
-                        record.bytes_sent = conn_stats->bytes_sent;
-                        record.bytes_received = conn_stats->bytes_received;
-                        record.packets_sent = conn_stats->packets_sent;
-                        record.packets_received = conn_stats->packets_received;
-                        record.first_seen = conn_stats->first_seen;
-                        record.last_seen = conn_stats->last_seen;
-
-                        database->updateConnection(record);
-                    }
-                });
+            // One analyzer shard per pipeline worker. Both split packets with
+            // flowShard(), so worker i is the only writer of shard i; the
+            // kernel's fan-out hash is unrelated and cannot be used for this.
+            packet_analyzer = std::make_unique<network::PacketAnalyzer>(
+                pipeline_options.workers, flow_table_capacity);
+            packet_analyzer->setClassifiedFlowSet(capture_options.classified_flows);
+
+            std::string sampling_mode = config.getOrDefault<std::string>("analysis_sampling_mode", "none");
+            uint32_t sampling_rate = config.getOrDefault<uint32_t>("analysis_sampling_rate", 1);
+            if (sampling_mode == "packet") {
+                packet_analyzer->setSampling(network::SamplingMode::PACKET, sampling_rate);
+            } else if (sampling_mode == "flow") {
+                packet_analyzer->setSampling(network::SamplingMode::FLOW, sampling_rate);
+            }
+
+            network::FlowTimeouts flow_timeouts;
+            flow_timeouts.tcp_idle = std::chrono::seconds(config.getOrDefault<uint32_t>("flow_timeout_tcp_idle", 300));
+            flow_timeouts.tcp_closed = std::chrono::seconds(config.getOrDefault<uint32_t>("flow_timeout_tcp_closed", 5));
+            flow_timeouts.tcp_half_open = std::chrono::seconds(config.getOrDefault<uint32_t>("flow_timeout_tcp_half_open", 30));
+            flow_timeouts.udp_idle = std::chrono::seconds(config.getOrDefault<uint32_t>("flow_timeout_udp_idle", 60));
+            flow_timeouts.icmp_idle = std::chrono::seconds(config.getOrDefault<uint32_t>("flow_timeout_icmp_idle", 30));
+            flow_timeouts.other_idle = std::chrono::seconds(config.getOrDefault<uint32_t>("flow_timeout_other_idle", 60));
+            flow_timeouts.active = std::chrono::seconds(config.getOrDefault<uint32_t>("flow_timeout_active", 1800));
+            packet_analyzer->setFlowTimeouts(flow_timeouts);
+            packet_analyzer->setTopConnectionsTracked(config.getOrDefault<uint32_t>("analysis_top_connections", 100));
+            packet_analyzer->setClassificationLimit(
+                static_cast<uint16_t>(config.getOrDefault<uint32_t>("analysis_classify_max_packets", 8)));
+
+            if (config.getOrDefault<bool>("analysis_host_sketch", false)) {
+                packet_analyzer->setHostSketch(config.getOrDefault<double>("analysis_host_sketch_epsilon", 0.001),
+                                               config.getOrDefault<double>("analysis_host_sketch_delta", 0.01));
+            }
+
+            packet_analyzer->setSnapshotInterval(
+                std::chrono::milliseconds(config.getOrDefault<uint32_t>("analysis_snapshot_interval_ms", 1000)));
+
+            if (config.getOrDefault<bool>("analysis_fanout", true)) {
+                packet_analyzer->setFanoutTracking(
+                    std::chrono::seconds(config.getOrDefault<uint32_t>("analysis_fanout_window", 60)),
+                    config.getOrDefault<uint32_t>("analysis_fanout_max_hosts", 4096));
+            }
+
+            if (config.getOrDefault<bool>("analysis_http", true)) {
+                packet_analyzer->setHttpTracking(config.getOrDefault<uint32_t>("analysis_http_max_endpoints", 1024),
+                                                 config.getOrDefault<uint32_t>("analysis_http_uri_depth", 1));
+            }
+
+            // Traffic per configured CIDR group, from the inline list and/or a file
+            auto subnet_groups = std::make_shared<network::SubnetGroups>();
+            std::string subnet_error;
+            std::string subnet_groups_spec = config.getOrDefault<std::string>("subnet_groups", "");
+            std::string subnet_groups_file = config.getOrDefault<std::string>("subnet_groups_file", "");
+
+            if (!subnet_groups->parse(subnet_groups_spec, subnet_error) ||
+                (!subnet_groups_file.empty() && !subnet_groups->loadFile(subnet_groups_file, subnet_error))) {
+                LOG_ERROR("Invalid subnet groups: %s", subnet_error.c_str());
+            } else if (subnet_groups->groupCount() > 0) {
+                packet_analyzer->setSubnetGroups(subnet_groups);
+                LOG_INFO("Subnet groups: %zu groups, %zu prefixes", subnet_groups->groupCount(),
+                         subnet_groups->prefixCount());
+            }
+
+            if (config.getOrDefault<bool>("flow_export", false)) {
+                network::FlowExportOptions export_options;
+                export_options.collector_host = config.getOrDefault<std::string>("flow_export_host", "127.0.0.1");
+                export_options.collector_port = config.getOrDefault<uint16_t>("flow_export_port", 4739);
+                if (config.getOrDefault<std::string>("flow_export_format", "ipfix") == "netflow9") {
+                    export_options.format = network::FlowExportFormat::NETFLOW_V9;
+                }
+                export_options.interval =
+                    std::chrono::milliseconds(config.getOrDefault<uint32_t>("flow_export_interval_ms", 1000));
+                export_options.template_refresh =
+                    std::chrono::seconds(config.getOrDefault<uint32_t>("flow_export_template_refresh", 60));
+                export_options.observation_domain = config.getOrDefault<uint32_t>("flow_export_domain", 0);
+                export_options.max_message_size = config.getOrDefault<uint32_t>("flow_export_max_message_size", 1400);
+
+                flow_exporter = std::make_unique<network::FlowExporter>(export_options);
+                if (flow_exporter->start()) {
+                    LOG_INFO("Exporting flows to %s:%u", export_options.collector_host.c_str(),
+                             export_options.collector_port);
+                } else {
+                    LOG_ERROR("Failed to open flow export socket to %s:%u", export_options.collector_host.c_str(),
+                              export_options.collector_port);
+                    flow_exporter.reset();
+                }
+            }
+
+            // Hand each connection to the exporter and/or the database once it has ended
+            bool store_flows = config.getOrDefault<bool>("flow_database", true);
+            packet_analyzer->setFlowExpiredHandler([&database, &flow_exporter, store_flows](
+                                                       const network::ConnectionKey& conn_key,
+                                                       const network::ConnectionStats& conn_stats,
+                                                       network::FlowEndReason reason) {
+                if (flow_exporter) {
+                    flow_exporter->addFlow(conn_key, conn_stats, reason);
+                }
+
+                if (!store_flows) {
+                    return;
+                }
+
+                db::ConnectionRecord record;
+                record.source_ip = conn_key.source_ip.toString();
+                record.source_port = conn_key.source_port;
+                record.dest_ip = conn_key.dest_ip.toString();
+                record.dest_port = conn_key.dest_port;
+                record.protocol = conn_key.protocol;
+                record.bytes_sent = conn_stats.bytes_sent;
+                record.bytes_received = conn_stats.bytes_received;
+                record.packets_sent = conn_stats.packets_sent;
+                record.packets_received = conn_stats.packets_received;
+                record.first_seen = conn_stats.first_seen;
+                record.last_seen = conn_stats.last_seen;
+
+                database->insertConnection(record);
             });
 
-            auto interface = config.getOrDefault<std::string>("capture_interface", "eth0");
-            auto result = packet_capture->startCapture(interface);
+            // Live flows also age out while no packets arrive; a replay's
+            // flows age on trace time only.
+            expire_flows_on_wall_clock = capture_options.backend != network::CaptureBackend::FILE;
+
+            auto capture_collector = std::make_unique<network::CaptureCollector>(
+                std::chrono::seconds(1), *packet_capture);
+
+            // Replayed packets carry trace timestamps, so latency is only
+            // meaningful for live capture.
+            network::CaptureCollector* latency_recorder =
+                capture_options.backend == network::CaptureBackend::FILE ? nullptr : capture_collector.get();
+
+            auto analyze_batch = [&packet_analyzer, latency_recorder](const network::PacketBatch& batch) {
+                packet_analyzer->processBatch(batch);
+
+                if (latency_recorder) {
+                    latency_recorder->recordAnalyzed(batch);
+                }
+            };
+
+            packet_pipeline = std::make_unique<network::PacketPipeline>(pipeline_options, analyze_batch);
+            packet_pipeline->start();
+
+            // Each batch comes from a single capture queue, whose thread is
+            // the only producer for that queue's lanes. Copying the views into
+            // the pipeline only bumps slab refcounts; frame bytes are not copied.
+            packet_capture->registerBatchHandler([&packet_pipeline](const network::PacketBatch& batch) {
+                packet_pipeline->submit(batch[0].queue_id, batch);
+            });
+
+            capture_collector->setPipeline(packet_pipeline.get());
+
+            auto result = packet_capture->startCapture(capture_source, capture_options);
             if (result != network::CaptureError::NONE) {
-                LOG_ERROR("Failed to start packet capture on interface: %s", interface.c_str());
+                LOG_ERROR("Failed to start packet capture on: %s", capture_source.c_str());
                 packet_capture.reset();
+                packet_pipeline.reset();
                 packet_analyzer.reset();
             } else {
-                LOG_INFO("Capturing packets on interface: %s", interface.c_str());
+                LOG_INFO("Capturing packets on: %s (backend: %s, queues: %zu)",
+                         capture_source.c_str(), capture_backend.c_str(), packet_capture->getQueueCount());
+                LOG_INFO("Analysis pipeline: %zu workers, %s on overflow",
+                         packet_pipeline->getWorkerCount(), overflow_policy.c_str());
+                if (packet_analyzer->getSamplingRate() > 1) {
+                    LOG_INFO("Analyzing 1 in %u (%s sampling)",
+                             packet_analyzer->getSamplingRate(), sampling_mode.c_str());
+                }
+
+                capture_collector->start();
+                collectors.push_back(std::move(capture_collector));
+
+                auto analyzer_collector = std::make_unique<network::AnalyzerCollector>(
+                    std::chrono::seconds(1), *packet_analyzer);
+                analyzer_collector->start();
+                collectors.push_back(std::move(analyzer_collector));
+
+                if (config.getOrDefault<bool>("traffic_baselines", false)) {
+                    network::BaselineOptions baseline_options;
+                    baseline_options.interval = std::chrono::seconds(
+                        std::max<uint32_t>(1, config.getOrDefault<uint32_t>("baseline_interval", 60)));
+                    baseline_options.parameters.alpha = static_cast<float>(config.getOrDefault<double>("baseline_alpha", 0.05));
+                    baseline_options.parameters.beta = static_cast<float>(config.getOrDefault<double>("baseline_beta", 0.005));
+                    baseline_options.parameters.gamma = static_cast<float>(config.getOrDefault<double>("baseline_gamma", 0.05));
+                    baseline_options.parameters.warmup = config.getOrDefault<uint32_t>("baseline_warmup", 60);
+                    baseline_options.parameters.min_deviation =
+                        static_cast<float>(config.getOrDefault<double>("baseline_min_deviation", 1000.0));
+                    baseline_options.max_hosts = config.getOrDefault<uint32_t>("baseline_max_hosts", 262144);
+                    baseline_options.idle_retention = std::chrono::seconds(
+                        config.getOrDefault<uint32_t>("baseline_idle_retention", 86400));
+
+                    if (packet_analyzer->isHostSketchEnabled()) {
+                        LOG_WARNING("Traffic baselines cover subnet groups only while analysis_host_sketch is enabled");
+                    }
+
+                    auto baseline_collector = std::make_unique<network::BaselineCollector>(
+                        baseline_options, *packet_analyzer);
+                    baseline_collector->start();
+                    collectors.push_back(std::move(baseline_collector));
+                }
             }
         }
 
@@ -242,11 +479,93 @@ int main(int argc, char** argv) {
                 alert::Severity::CRITICAL);
         }
 
+        // Set up traffic rate, port scan, fan-out and TCP alerts on the analyzer's metrics
+        for (const auto& collector : collectors) {
+            auto rate_metric = collector->getMetric("analysis.max_host_bytes_per_second");
+            auto ports_metric = collector->getMetric("analysis.max_host_ports");
+            auto peers_metric = collector->getMetric("analysis.max_host_peers");
+            auto half_open_metric = collector->getMetric("analysis.max_host_half_open");
+            auto resets_metric = collector->getMetric("analysis.tcp_resets_per_second");
+            if (!rate_metric || !ports_metric || !peers_metric || !half_open_metric || !resets_metric) {
+                continue;
+            }
+
+            uint32_t rate_threshold = config.getOrDefault<uint32_t>("host_rate_threshold_bytes_per_second", 0);
+            if (rate_threshold > 0) {
+                alert_manager.createAlert(
+                    "High Host Traffic Rate",
+                    std::make_unique<alert::MetricThresholdCondition>(
+                        rate_metric, alert::Comparator::GREATER_THAN, rate_threshold),
+                    alert::Severity::WARNING);
+            }
+
+            alert_manager.createAlert(
+                "Port Scan Suspected",
+                std::make_unique<alert::MetricThresholdCondition>(
+                    ports_metric, alert::Comparator::GREATER_THAN,
+                    config.getOrDefault<uint32_t>("port_scan_threshold", 100)),
+                alert::Severity::WARNING);
+
+            alert_manager.createAlert(
+                "High Host Fan-out",
+                std::make_unique<alert::MetricThresholdCondition>(
+                    peers_metric, alert::Comparator::GREATER_THAN,
+                    config.getOrDefault<uint32_t>("fanout_threshold", 250)),
+                alert::Severity::WARNING);
+
+            alert_manager.createAlert(
+                "SYN Flood Suspected",
+                std::make_unique<alert::MetricThresholdCondition>(
+                    half_open_metric, alert::Comparator::GREATER_THAN,
+                    config.getOrDefault<uint32_t>("syn_flood_threshold", 200)),
+                alert::Severity::CRITICAL);
+
+            alert_manager.createAlert(
+                "High TCP Reset Rate",
+                std::make_unique<alert::MetricThresholdCondition>(
+                    resets_metric, alert::Comparator::GREATER_THAN,
+                    config.getOrDefault<uint32_t>("tcp_reset_rate_threshold", 1000)),
+                alert::Severity::WARNING);
+
+            auto http_errors_metric = collector->getMetric("analysis.http_error_percent");
+            if (http_errors_metric) {
+                alert_manager.createAlert(
+                    "High HTTP Error Rate",
+                    std::make_unique<alert::MetricThresholdCondition>(
+                        http_errors_metric, alert::Comparator::GREATER_THAN,
+                        config.getOrDefault<double>("http_error_percent_threshold", 5.0)),
+                    alert::Severity::WARNING);
+            }
+        }
+
+        // Set up anomaly alerts on the traffic baselines' scores
+        for (const auto& collector : collectors) {
+            auto host_score_metric = collector->getMetric("analysis.max_host_anomaly_score");
+            auto group_score_metric = collector->getMetric("analysis.max_group_anomaly_score");
+            if (!host_score_metric || !group_score_metric) {
+                continue;
+            }
+
+            double anomaly_threshold = config.getOrDefault<double>("anomaly_score_threshold", 6.0);
+
+            alert_manager.createAlert(
+                "Host Traffic Anomaly",
+                std::make_unique<alert::MetricThresholdCondition>(
+                    host_score_metric, alert::Comparator::GREATER_THAN, anomaly_threshold),
+                alert::Severity::WARNING);
+
+            alert_manager.createAlert(
+                "Subnet Traffic Anomaly",
+                std::make_unique<alert::MetricThresholdCondition>(
+                    group_score_metric, alert::Comparator::GREATER_THAN, anomaly_threshold),
+                alert::Severity::WARNING);
+        }
+
         // Initialize API server if enabled
         std::unique_ptr<api::RestApi> api_server;
         if (config.getOrDefault<bool>("enable_api", false)) {
             uint16_t api_port = config.getOrDefault<uint16_t>("api_port", 8080);
-            api_server = std::make_unique<api::RestApi>(collectors, packet_analyzer);
+            api_server = std::make_unique<api::RestApi>(collectors, packet_analyzer, packet_capture);
             api_server->start(api_port);
             LOG_INFO("REST API server started on port %u", api_port);
         }
@@ -267,7 +586,47 @@ int main(int argc, char** argv) {
         bool enable_auto_cleanup = config.getOrDefault<bool>("enable_auto_cleanup", true);
         int64_t cleanup_interval = config.getOrDefault<uint32_t>("cleanup_interval_seconds", 3600);
 
+        auto replay_start_time = std::chrono::steady_clock::now();
+        bool replay_reported = false;
+        bool replay_flushed = false;
+        bool exit_on_replay_finish = config.getOrDefault<bool>("capture_replay_exit_on_finish", false);
+
         while (keep_running) {
+            // The capture thread has stopped submitting, so the packets the
+            // pipeline holds back for fuller batches can be handed over
+            if (packet_capture && packet_capture->isFinished() && packet_pipeline && !replay_flushed) {
+                packet_pipeline->flush();
+                replay_flushed = true;
+            }
+
+            // Report a finished file replay once its batches have been analyzed
+            if (packet_capture && packet_capture->isFinished() && !replay_reported &&
+                (!packet_pipeline || packet_pipeline->getStats().queued_batches == 0)) {
+                double elapsed = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - replay_start_time).count();
+                uint64_t packets = packet_capture->getPacketsCaptured();
+
+                LOG_INFO("Replay finished: %llu packets, %llu bytes in %.2f s (%.0f packets/s)",
+                         static_cast<unsigned long long>(packets),
+                         static_cast<unsigned long long>(packet_capture->getBytesCaptured()),
+                         elapsed, elapsed > 0 ? packets / elapsed : 0.0);
+                replay_reported = true;
+
+                if (exit_on_replay_finish) {
+                    break;
+                }
+            }
+
+            if (packet_analyzer && expire_flows_on_wall_clock) {
+                packet_analyzer->expireFlows(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count());
+            }
+
+            // API and collector reads are served from this snapshot
+            if (packet_analyzer) {
+                packet_analyzer->refreshSnapshot();
+            }
+
             // Check alerts
             thread_pool.enqueue([&alert_manager]() {
                 alert_manager.checkAlerts();
@@ -340,11 +699,33 @@ int main(int argc, char** argv) {
         }
         LOG_INFO("System collectors stopped");
 
-        if (packet_capture && packet_capture->isCapturing()) {
+        // A finished replay is no longer capturing but still has a thread to join
+        if (packet_capture) {
             packet_capture->stopCapture();
             LOG_INFO("Packet capture stopped");
         }
 
+        if (packet_pipeline) {
+            packet_pipeline->stop();
+
+            auto pipeline_stats = packet_pipeline->getStats();
+            LOG_INFO("Analysis pipeline stopped (%llu packets shed)",
+                     static_cast<unsigned long long>(pipeline_stats.packetsDropped()));
+        }
+
+        if (packet_analyzer) {
+            packet_analyzer->flushFlows();
+        }
+
+        if (flow_exporter) {
+            flow_exporter->stop();
+
+            auto export_stats = flow_exporter->getStats();
+            LOG_INFO("Flow exporter stopped (%llu records sent, %llu flows dropped)",
+                     static_cast<unsigned long long>(export_stats.records_exported),
+                     static_cast<unsigned long long>(export_stats.flows_dropped));
+        }
+
         LOG_INFO("NetSentry shutdown complete");
         return 0;
 
@@ -0,0 +1,156 @@
+#include "analyzer_collector.hpp"
+#include <algorithm>
+
+namespace netsentry {
+namespace network {
+
+AnalyzerCollector::AnalyzerCollector(std::chrono::seconds interval, const PacketAnalyzer& analyzer)
+    : CollectorBase(std::chrono::milliseconds(interval)),
+      analyzer_(analyzer),
+      prev_tcp_(analyzer.getTcpStats()),
+      prev_http_(analyzer.getHttpTotals()),
+      prev_time_(std::chrono::steady_clock::now()) {
+
+    flows_ = std::make_shared<metrics::GaugeMetric>("analysis.flows");
+    max_host_bytes_per_second_ = std::make_shared<metrics::GaugeMetric>("analysis.max_host_bytes_per_second");
+    max_host_packets_per_second_ = std::make_shared<metrics::GaugeMetric>("analysis.max_host_packets_per_second");
+    fanout_hosts_ = std::make_shared<metrics::GaugeMetric>("analysis.fanout_hosts");
+    max_host_peers_ = std::make_shared<metrics::GaugeMetric>("analysis.max_host_peers");
+    max_host_ports_ = std::make_shared<metrics::GaugeMetric>("analysis.max_host_ports");
+    tcp_half_open_ = std::make_shared<metrics::GaugeMetric>("analysis.tcp_half_open");
+    max_host_half_open_ = std::make_shared<metrics::GaugeMetric>("analysis.max_host_half_open");
+    tcp_syns_per_second_ = std::make_shared<metrics::GaugeMetric>("analysis.tcp_syns_per_second");
+    tcp_resets_per_second_ = std::make_shared<metrics::GaugeMetric>("analysis.tcp_resets_per_second");
+    tcp_rtt_p50_us_ = std::make_shared<metrics::GaugeMetric>("analysis.tcp_rtt_p50_us");
+    tcp_rtt_p99_us_ = std::make_shared<metrics::GaugeMetric>("analysis.tcp_rtt_p99_us");
+    tcp_retransmit_percent_ = std::make_shared<metrics::GaugeMetric>("analysis.tcp_retransmit_percent");
+    http_requests_per_second_ = std::make_shared<metrics::GaugeMetric>("analysis.http_requests_per_second");
+    http_latency_p50_us_ = std::make_shared<metrics::GaugeMetric>("analysis.http_latency_p50_us");
+    http_latency_p99_us_ = std::make_shared<metrics::GaugeMetric>("analysis.http_latency_p99_us");
+    http_error_percent_ = std::make_shared<metrics::GaugeMetric>("analysis.http_error_percent");
+
+    registerMetric(flows_);
+    registerMetric(max_host_bytes_per_second_);
+    registerMetric(max_host_packets_per_second_);
+    registerMetric(fanout_hosts_);
+    registerMetric(max_host_peers_);
+    registerMetric(max_host_ports_);
+    registerMetric(tcp_half_open_);
+    registerMetric(max_host_half_open_);
+    registerMetric(tcp_syns_per_second_);
+    registerMetric(tcp_resets_per_second_);
+    registerMetric(tcp_rtt_p50_us_);
+    registerMetric(tcp_rtt_p99_us_);
+    registerMetric(tcp_retransmit_percent_);
+    registerMetric(http_requests_per_second_);
+    registerMetric(http_latency_p50_us_);
+    registerMetric(http_latency_p99_us_);
+    registerMetric(http_error_percent_);
+}
+
+void AnalyzerCollector::collect() {
+    flows_->update(static_cast<double>(analyzer_.getConnectionCount()));
+
+    auto tcp = analyzer_.getTcpStats();
+    auto now = std::chrono::steady_clock::now();
+
+    tcp_half_open_->update(static_cast<double>(tcp.half_open));
+
+    auto top_half_open = analyzer_.getTopHalfOpenHosts(1);
+    max_host_half_open_->update(top_half_open.empty() ? 0.0 : static_cast<double>(top_half_open[0].second.half_open));
+
+    // Counters restart from zero when the analyzer is reset
+    double elapsed = std::chrono::duration<double>(now - prev_time_).count();
+    if (elapsed > 0 && tcp.syns >= prev_tcp_.syns && tcp.resets >= prev_tcp_.resets) {
+        tcp_syns_per_second_->update((tcp.syns - prev_tcp_.syns) / elapsed);
+        tcp_resets_per_second_->update((tcp.resets - prev_tcp_.resets) / elapsed);
+    }
+
+    // Round trips measured and segments seen since the last collection
+    data::LatencyHistogram::Buckets rtt_buckets;
+    for (size_t i = 0; i < rtt_buckets.size(); ++i) {
+        uint32_t current = tcp.rtt.buckets()[i];
+        uint32_t previous = prev_tcp_.rtt.buckets()[i];
+        rtt_buckets[i] = current > previous ? current - previous : 0;
+    }
+
+    tcp_rtt_p50_us_->update(data::LatencyHistogram::percentile(rtt_buckets, 0.50));
+    tcp_rtt_p99_us_->update(data::LatencyHistogram::percentile(rtt_buckets, 0.99));
+
+    if (tcp.segments > prev_tcp_.segments && tcp.retransmits >= prev_tcp_.retransmits) {
+        double segments = static_cast<double>(tcp.segments - prev_tcp_.segments);
+        double retransmits = static_cast<double>(tcp.retransmits - prev_tcp_.retransmits);
+        tcp_retransmit_percent_->update(100.0 * retransmits / segments);
+    } else {
+        tcp_retransmit_percent_->update(0.0);
+    }
+
+    prev_tcp_ = tcp;
+    prev_time_ = now;
+
+    if (analyzer_.isHttpTrackingEnabled()) {
+        collectHttp(elapsed);
+    }
+
+    // The host sketch does not keep per-host rates
+    if (!analyzer_.isHostSketchEnabled()) {
+        double max_bytes = 0.0;
+        double max_packets = 0.0;
+
+        for (const auto& entry : analyzer_.getHostTrafficEstimates()) {
+            max_bytes = std::max(max_bytes, entry.second.rates.last_10s.bytes_per_second);
+            max_packets = std::max(max_packets, entry.second.rates.last_10s.packets_per_second);
+        }
+
+        max_host_bytes_per_second_->update(max_bytes);
+        max_host_packets_per_second_->update(max_packets);
+    }
+
+    if (!analyzer_.isFanoutTrackingEnabled()) {
+        return;
+    }
+
+    auto fanout = analyzer_.getFanout();
+    uint64_t max_peers = 0;
+    uint64_t max_ports = 0;
+
+    for (const auto& entry : fanout) {
+        max_peers = std::max(max_peers, entry.second.peers);
+        max_ports = std::max(max_ports, entry.second.ports);
+    }
+
+    fanout_hosts_->update(static_cast<double>(fanout.size()));
+    max_host_peers_->update(static_cast<double>(max_peers));
+    max_host_ports_->update(static_cast<double>(max_ports));
+}
+
+void AnalyzerCollector::collectHttp(double elapsed) {
+    auto http = analyzer_.getHttpTotals();
+
+    if (elapsed > 0 && http.requests >= prev_http_.requests) {
+        http_requests_per_second_->update((http.requests - prev_http_.requests) / elapsed);
+    }
+
+    data::LatencyHistogram::Buckets latency_buckets;
+    for (size_t i = 0; i < latency_buckets.size(); ++i) {
+        uint32_t current = http.latency.buckets()[i];
+        uint32_t previous = prev_http_.latency.buckets()[i];
+        latency_buckets[i] = current > previous ? current - previous : 0;
+    }
+
+    http_latency_p50_us_->update(data::LatencyHistogram::percentile(latency_buckets, 0.50));
+    http_latency_p99_us_->update(data::LatencyHistogram::percentile(latency_buckets, 0.99));
+
+    if (http.responses > prev_http_.responses && http.status_classes[5] >= prev_http_.status_classes[5]) {
+        double responses = static_cast<double>(http.responses - prev_http_.responses);
+        double errors = static_cast<double>(http.status_classes[5] - prev_http_.status_classes[5]);
+        http_error_percent_->update(100.0 * errors / responses);
+    } else {
+        http_error_percent_->update(0.0);
+    }
+
+    prev_http_ = std::move(http);
+}
+
+}
+}
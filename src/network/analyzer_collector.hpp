@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include "../core/collectors/collector_base.hpp"
+#include "packet_analyzer.hpp"
+
+namespace netsentry {
+namespace network {
+
+// Publishes what the packet analyzer has derived from traffic as metrics:
+// active flows, the busiest host's traffic rate over the last 10 seconds
+// and, with fan-out tracking enabled, the largest number of distinct peers
+// and destination ports any single host has reached within the fan-out
+// window. TCP handshake state gives the number of half-open connections,
+// overall and at the most targeted host, SYN and RST rates, and the
+// handshake RTT percentiles and retransmission rate over the last interval.
+// With HTTP tracking enabled, request rate, response latency percentiles and
+// the share of 5xx responses are published over the last interval too.
+class AnalyzerCollector : public collectors::CollectorBase {
+public:
+    AnalyzerCollector(std::chrono::seconds interval, const PacketAnalyzer& analyzer);
+
+protected:
+    void collect() override;
+
+private:
+    const PacketAnalyzer& analyzer_;
+
+    void collectHttp(double elapsed);
+
+    std::shared_ptr<metrics::GaugeMetric> flows_;
+    std::shared_ptr<metrics::GaugeMetric> max_host_bytes_per_second_;
+    std::shared_ptr<metrics::GaugeMetric> max_host_packets_per_second_;
+    std::shared_ptr<metrics::GaugeMetric> fanout_hosts_;
+    std::shared_ptr<metrics::GaugeMetric> max_host_peers_;
+    std::shared_ptr<metrics::GaugeMetric> max_host_ports_;
+    std::shared_ptr<metrics::GaugeMetric> tcp_half_open_;
+    std::shared_ptr<metrics::GaugeMetric> max_host_half_open_;
+    std::shared_ptr<metrics::GaugeMetric> tcp_syns_per_second_;
+    std::shared_ptr<metrics::GaugeMetric> tcp_resets_per_second_;
+    std::shared_ptr<metrics::GaugeMetric> tcp_rtt_p50_us_;
+    std::shared_ptr<metrics::GaugeMetric> tcp_rtt_p99_us_;
+    std::shared_ptr<metrics::GaugeMetric> tcp_retransmit_percent_;
+    std::shared_ptr<metrics::GaugeMetric> http_requests_per_second_;
+    std::shared_ptr<metrics::GaugeMetric> http_latency_p50_us_;
+    std::shared_ptr<metrics::GaugeMetric> http_latency_p99_us_;
+    std::shared_ptr<metrics::GaugeMetric> http_error_percent_;
+
+    TcpStats prev_tcp_;
+    HttpEndpoint prev_http_;
+    std::chrono::steady_clock::time_point prev_time_;
+};
+
+}
+}
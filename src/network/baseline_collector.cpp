@@ -0,0 +1,32 @@
+#include "baseline_collector.hpp"
+
+namespace netsentry {
+namespace network {
+
+BaselineCollector::BaselineCollector(const BaselineOptions& options, const PacketAnalyzer& analyzer)
+    : CollectorBase(std::chrono::milliseconds(options.interval)),
+      analyzer_(analyzer),
+      baselines_(options) {
+
+    max_host_score_ = std::make_shared<metrics::GaugeMetric>("analysis.max_host_anomaly_score");
+    max_group_score_ = std::make_shared<metrics::GaugeMetric>("analysis.max_group_anomaly_score");
+    hosts_ = std::make_shared<metrics::GaugeMetric>("analysis.baseline_hosts");
+
+    registerMetric(max_host_score_);
+    registerMetric(max_group_score_);
+    registerMetric(hosts_);
+}
+
+void BaselineCollector::collect() {
+    uint64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    baselines_.update(analyzer_, now);
+
+    max_host_score_->update(baselines_.getMaxHostScore());
+    max_group_score_->update(baselines_.getMaxGroupScore());
+    hosts_->update(static_cast<double>(baselines_.getHostCount()));
+}
+
+}
+}
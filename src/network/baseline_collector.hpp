@@ -0,0 +1,34 @@
+#pragma once
+
+#include <memory>
+#include "../core/collectors/collector_base.hpp"
+#include "packet_analyzer.hpp"
+#include "traffic_baselines.hpp"
+
+namespace netsentry {
+namespace network {
+
+// Feeds the analyzer's per-host and per-group rates into TrafficBaselines
+// once per baseline interval and publishes the highest anomaly scores as
+// metrics, for alerting on traffic that departs from its usual level for
+// the time of day.
+class BaselineCollector : public collectors::CollectorBase {
+public:
+    BaselineCollector(const BaselineOptions& options, const PacketAnalyzer& analyzer);
+
+    const TrafficBaselines& getBaselines() const { return baselines_; }
+
+protected:
+    void collect() override;
+
+private:
+    const PacketAnalyzer& analyzer_;
+    TrafficBaselines baselines_;
+
+    std::shared_ptr<metrics::GaugeMetric> max_host_score_;
+    std::shared_ptr<metrics::GaugeMetric> max_group_score_;
+    std::shared_ptr<metrics::GaugeMetric> hosts_;
+};
+
+}
+}
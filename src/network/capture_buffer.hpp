@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include "../core/memory/memory_pool.hpp"
+
+namespace netsentry {
+namespace network {
+
+class CaptureBufferPool;
+
+// Fixed-size slab that captured frames are appended to back to back. Packet
+// views point into the slab and hold a reference to it; the slab goes back to
+// its pool once the last view referencing it is released.
+class CaptureBuffer {
+public:
+    static constexpr size_t SLAB_SIZE = 256 * 1024;
+
+    // Copies len bytes into the slab, returning where they landed or nullptr
+    // when the slab has no room left.
+    const uint8_t* append(const uint8_t* data, size_t len) {
+        if (len > capacity() - used_) {
+            return nullptr;
+        }
+
+        uint8_t* dest = storage() + used_;
+        memcpy(dest, data, len);
+        used_ += len;
+
+        return dest;
+    }
+
+    size_t used() const { return used_; }
+
+    static constexpr size_t capacity() {
+        return SLAB_SIZE - sizeof(CaptureBuffer);
+    }
+
+private:
+    friend class BufferRef;
+    friend class CaptureBufferPool;
+
+    std::atomic<uint32_t> refs_{1};
+    std::shared_ptr<CaptureBufferPool> pool_;
+    size_t used_{0};
+
+    explicit CaptureBuffer(std::shared_ptr<CaptureBufferPool> pool) : pool_(std::move(pool)) {}
+
+    uint8_t* storage() {
+        return reinterpret_cast<uint8_t*>(this) + sizeof(CaptureBuffer);
+    }
+
+    void release();
+};
+
+// Intrusive reference to a CaptureBuffer. Copying costs one atomic increment,
+// never an allocation.
+class BufferRef {
+public:
+    BufferRef() = default;
+
+    BufferRef(const BufferRef& other) : buffer_(other.buffer_) {
+        if (buffer_) {
+            buffer_->refs_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    BufferRef(BufferRef&& other) noexcept : buffer_(other.buffer_) {
+        other.buffer_ = nullptr;
+    }
+
+    BufferRef& operator=(const BufferRef& other) {
+        if (buffer_ != other.buffer_) {
+            BufferRef copy(other);
+            std::swap(buffer_, copy.buffer_);
+        }
+        return *this;
+    }
+
+    BufferRef& operator=(BufferRef&& other) noexcept {
+        if (this != &other) {
+            reset();
+            buffer_ = other.buffer_;
+            other.buffer_ = nullptr;
+        }
+        return *this;
+    }
+
+    ~BufferRef() {
+        reset();
+    }
+
+    void reset() {
+        if (buffer_ && buffer_->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            buffer_->release();
+        }
+        buffer_ = nullptr;
+    }
+
+    CaptureBuffer* get() const { return buffer_; }
+    CaptureBuffer* operator->() const { return buffer_; }
+    explicit operator bool() const { return buffer_ != nullptr; }
+
+private:
+    friend class CaptureBufferPool;
+
+    explicit BufferRef(CaptureBuffer* buffer) : buffer_(buffer) {}
+
+    CaptureBuffer* buffer_{nullptr};
+};
+
+class CaptureBufferPool : public std::enable_shared_from_this<CaptureBufferPool> {
+public:
+    static std::shared_ptr<CaptureBufferPool> create() {
+        return std::shared_ptr<CaptureBufferPool>(new CaptureBufferPool());
+    }
+
+    BufferRef acquire() {
+        void* memory = pool_.allocate();
+        return BufferRef(new(memory) CaptureBuffer(shared_from_this()));
+    }
+
+private:
+    friend class CaptureBuffer;
+
+    // Each slab keeps the pool alive, so views handed to other threads stay
+    // valid even after the capture that produced them has been destroyed.
+    memory::MemoryPool<CaptureBuffer::SLAB_SIZE, 8> pool_;
+
+    CaptureBufferPool() = default;
+
+    void recycle(CaptureBuffer* buffer) {
+        buffer->~CaptureBuffer();
+        pool_.deallocate(buffer);
+    }
+};
+
+inline void CaptureBuffer::release() {
+    std::shared_ptr<CaptureBufferPool> pool = std::move(pool_);
+    pool->recycle(this);
+}
+
+}
+}
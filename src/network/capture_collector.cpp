@@ -0,0 +1,152 @@
+#include "capture_collector.hpp"
+#include <algorithm>
+
+namespace netsentry {
+namespace network {
+
+namespace {
+
+std::atomic<size_t> next_latency_slot{0};
+
+void raiseMax(std::atomic<uint64_t>& max, uint64_t value) {
+    uint64_t current = max.load(std::memory_order_relaxed);
+    while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+}
+
+CaptureCollector::CaptureCollector(std::chrono::seconds interval, const PacketCapture& capture)
+    : CollectorBase(std::chrono::milliseconds(interval)),
+      capture_(capture),
+      prev_time_(std::chrono::steady_clock::now()) {
+
+    packets_ = std::make_shared<metrics::GaugeMetric>("capture.packets");
+    bytes_ = std::make_shared<metrics::GaugeMetric>("capture.bytes");
+    packets_per_second_ = std::make_shared<metrics::GaugeMetric>("capture.packets_per_second");
+    kernel_received_ = std::make_shared<metrics::GaugeMetric>("capture.kernel_received");
+    kernel_dropped_ = std::make_shared<metrics::GaugeMetric>("capture.kernel_dropped");
+    interface_dropped_ = std::make_shared<metrics::GaugeMetric>("capture.interface_dropped");
+    drop_percent_ = std::make_shared<metrics::GaugeMetric>("capture.drop_percent");
+    backlog_ = std::make_shared<metrics::GaugeMetric>("capture.analysis_backlog");
+    dropped_newest_ = std::make_shared<metrics::GaugeMetric>("capture.analysis_dropped_newest");
+    dropped_oldest_ = std::make_shared<metrics::GaugeMetric>("capture.analysis_dropped_oldest");
+    dropped_sampled_ = std::make_shared<metrics::GaugeMetric>("capture.analysis_dropped_sampled");
+    latency_ = std::make_shared<metrics::HistogramMetric>("capture.latency_us");
+    latency_p50_ = std::make_shared<metrics::GaugeMetric>("capture.latency_p50_us");
+    latency_p99_ = std::make_shared<metrics::GaugeMetric>("capture.latency_p99_us");
+    latency_max_ = std::make_shared<metrics::GaugeMetric>("capture.latency_max_us");
+
+    registerMetric(packets_);
+    registerMetric(bytes_);
+    registerMetric(packets_per_second_);
+    registerMetric(kernel_received_);
+    registerMetric(kernel_dropped_);
+    registerMetric(interface_dropped_);
+    registerMetric(drop_percent_);
+    registerMetric(backlog_);
+    registerMetric(dropped_newest_);
+    registerMetric(dropped_oldest_);
+    registerMetric(dropped_sampled_);
+    registerMetric(latency_);
+    registerMetric(latency_p50_);
+    registerMetric(latency_p99_);
+    registerMetric(latency_max_);
+}
+
+void CaptureCollector::recordAnalyzed(const PacketBatch& batch) {
+    thread_local size_t slot_index = next_latency_slot.fetch_add(1, std::memory_order_relaxed) % LATENCY_SLOTS;
+
+    uint64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    // Bucketed on the stack first so the slot sees one add per bucket
+    // touched rather than one per packet
+    metrics::HistogramMetric::Buckets counts{};
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    for (const auto& packet : batch) {
+        uint64_t latency = now > packet.timestamp ? now - packet.timestamp : 0;
+        counts[metrics::HistogramMetric::bucketFor(latency)]++;
+        sum += latency;
+        max = std::max(max, latency);
+    }
+
+    LatencySlot& slot = latency_slots_[slot_index];
+    for (size_t i = 0; i < counts.size(); ++i) {
+        if (counts[i] != 0) {
+            slot.buckets[i].fetch_add(counts[i], std::memory_order_relaxed);
+        }
+    }
+
+    slot.sum.fetch_add(sum, std::memory_order_relaxed);
+    raiseMax(slot.max, max);
+}
+
+void CaptureCollector::foldLatency() {
+    for (auto& slot : latency_slots_) {
+        metrics::HistogramMetric::Buckets counts;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            counts[i] = slot.buckets[i].exchange(0, std::memory_order_relaxed);
+        }
+
+        latency_->merge(counts, slot.sum.exchange(0, std::memory_order_relaxed),
+                        slot.max.exchange(0, std::memory_order_relaxed));
+    }
+}
+
+void CaptureCollector::collect() {
+    auto stats = capture_.getStats();
+    auto now = std::chrono::steady_clock::now();
+
+    packets_->update(static_cast<double>(stats.packets_captured));
+    bytes_->update(static_cast<double>(stats.bytes_captured));
+    kernel_received_->update(static_cast<double>(stats.kernel_received));
+    kernel_dropped_->update(static_cast<double>(stats.kernel_dropped));
+    interface_dropped_->update(static_cast<double>(stats.interface_dropped));
+
+    double elapsed = std::chrono::duration<double>(now - prev_time_).count();
+    if (elapsed > 0 && stats.packets_captured >= prev_stats_.packets_captured) {
+        packets_per_second_->update((stats.packets_captured - prev_stats_.packets_captured) / elapsed);
+    }
+
+    // Drop rate over the last interval rather than since startup, so a burst
+    // of drops shows up instead of being averaged away.
+    if (stats.kernel_received > prev_stats_.kernel_received &&
+        stats.kernel_dropped >= prev_stats_.kernel_dropped) {
+        double received = static_cast<double>(stats.kernel_received - prev_stats_.kernel_received);
+        double dropped = static_cast<double>(stats.kernel_dropped - prev_stats_.kernel_dropped);
+        drop_percent_->update(100.0 * dropped / received);
+    } else {
+        drop_percent_->update(0.0);
+    }
+
+    if (pipeline_) {
+        auto pipeline_stats = pipeline_->getStats();
+
+        backlog_->update(static_cast<double>(pipeline_stats.queued_batches));
+        dropped_newest_->update(static_cast<double>(pipeline_stats.packets_dropped_newest));
+        dropped_oldest_->update(static_cast<double>(pipeline_stats.packets_dropped_oldest));
+        dropped_sampled_->update(static_cast<double>(pipeline_stats.packets_dropped_sampled));
+    }
+
+    foldLatency();
+
+    auto buckets = latency_->getBuckets();
+    metrics::HistogramMetric::Buckets interval_buckets;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        interval_buckets[i] = buckets[i] - prev_latency_buckets_[i];
+    }
+
+    latency_p50_->update(metrics::HistogramMetric::percentile(interval_buckets, 0.50));
+    latency_p99_->update(metrics::HistogramMetric::percentile(interval_buckets, 0.99));
+    latency_max_->update(static_cast<double>(latency_->getMax()));
+
+    prev_stats_ = stats;
+    prev_time_ = now;
+    prev_latency_buckets_ = buckets;
+}
+
+}
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include "../core/collectors/collector_base.hpp"
+#include "packet_capture.hpp"
+#include "packet_pipeline.hpp"
+
+namespace netsentry {
+namespace network {
+
+// Publishes capture-path health as metrics: packets and bytes captured,
+// kernel and interface drops, the analysis pipeline's backlog and shed
+// packets, and the latency from capture timestamp to analyzer completion.
+class CaptureCollector : public collectors::CollectorBase {
+public:
+    CaptureCollector(std::chrono::seconds interval, const PacketCapture& capture);
+
+    // Set before start(); without a pipeline the backlog and shed-packet
+    // metrics stay at zero.
+    void setPipeline(const PacketPipeline* pipeline) { pipeline_ = pipeline; }
+
+    // Called once analysis of a batch has finished; the latency of every
+    // packet in it is measured against a single clock read. Safe from any
+    // number of analysis threads: each counts into its own slot, which
+    // collect() folds into the shared histogram, so that histogram is not
+    // written per packet and lags by up to one interval.
+    void recordAnalyzed(const PacketBatch& batch);
+
+    std::shared_ptr<metrics::HistogramMetric> getLatencyHistogram() const { return latency_; }
+
+protected:
+    void collect() override;
+
+private:
+    // Threads are spread over the slots round-robin; beyond this many
+    // analysis threads some share a slot.
+    static constexpr size_t LATENCY_SLOTS = 16;
+
+    struct alignas(64) LatencySlot {
+        std::array<std::atomic<uint64_t>, metrics::HistogramMetric::BUCKET_COUNT> buckets{};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> max{0};
+    };
+
+    const PacketCapture& capture_;
+    const PacketPipeline* pipeline_{nullptr};
+
+    std::shared_ptr<metrics::GaugeMetric> packets_;
+    std::shared_ptr<metrics::GaugeMetric> bytes_;
+    std::shared_ptr<metrics::GaugeMetric> packets_per_second_;
+    std::shared_ptr<metrics::GaugeMetric> kernel_received_;
+    std::shared_ptr<metrics::GaugeMetric> kernel_dropped_;
+    std::shared_ptr<metrics::GaugeMetric> interface_dropped_;
+    std::shared_ptr<metrics::GaugeMetric> drop_percent_;
+    std::shared_ptr<metrics::GaugeMetric> backlog_;
+    std::shared_ptr<metrics::GaugeMetric> dropped_newest_;
+    std::shared_ptr<metrics::GaugeMetric> dropped_oldest_;
+    std::shared_ptr<metrics::GaugeMetric> dropped_sampled_;
+    std::shared_ptr<metrics::HistogramMetric> latency_;
+    std::shared_ptr<metrics::GaugeMetric> latency_p50_;
+    std::shared_ptr<metrics::GaugeMetric> latency_p99_;
+    std::shared_ptr<metrics::GaugeMetric> latency_max_;
+
+    CaptureStats prev_stats_;
+    std::chrono::steady_clock::time_point prev_time_;
+    metrics::HistogramMetric::Buckets prev_latency_buckets_{};
+
+    std::array<LatencySlot, LATENCY_SLOTS> latency_slots_;
+
+    void foldLatency();
+};
+
+}
+}
@@ -0,0 +1,355 @@
+#include "capture_file.hpp"
+#include "packet_capture.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace netsentry {
+namespace network {
+
+namespace {
+
+constexpr uint32_t PCAP_MAGIC_USEC = 0xA1B2C3D4;
+constexpr uint32_t PCAP_MAGIC_NSEC = 0xA1B23C4D;
+constexpr uint32_t PCAP_MAGIC_USEC_SWAPPED = 0xD4C3B2A1;
+constexpr uint32_t PCAP_MAGIC_NSEC_SWAPPED = 0x4D3CB2A1;
+
+constexpr uint32_t PCAPNG_SECTION_HEADER = 0x0A0D0D0A;
+constexpr uint32_t PCAPNG_BYTE_ORDER_MAGIC = 0x1A2B3C4D;
+constexpr uint32_t PCAPNG_INTERFACE_DESCRIPTION = 0x00000001;
+constexpr uint32_t PCAPNG_SIMPLE_PACKET = 0x00000003;
+constexpr uint32_t PCAPNG_ENHANCED_PACKET = 0x00000006;
+
+constexpr uint16_t PCAPNG_OPTION_END = 0;
+constexpr uint16_t PCAPNG_OPTION_IF_TSRESOL = 9;
+
+constexpr uint16_t LINKTYPE_ETHERNET = 1;
+
+constexpr size_t PCAP_FILE_HEADER_SIZE = 24;
+constexpr size_t PCAP_RECORD_HEADER_SIZE = 16;
+
+uint32_t swap32(uint32_t value) {
+    return ((value & 0x000000FFu) << 24) | ((value & 0x0000FF00u) << 8) |
+           ((value & 0x00FF0000u) >> 8) | ((value & 0xFF000000u) >> 24);
+}
+
+uint16_t swap16(uint16_t value) {
+    return static_cast<uint16_t>((value << 8) | (value >> 8));
+}
+
+}
+
+CaptureFileReader::~CaptureFileReader() {
+    close();
+}
+
+CaptureError CaptureFileReader::open(const std::string& path) {
+    if (isOpen()) {
+        return CaptureError::ALREADY_RUNNING;
+    }
+
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return errno == EACCES ? CaptureError::PERMISSION_DENIED : CaptureError::INTERFACE_NOT_FOUND;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        ::close(fd);
+        return CaptureError::UNSUPPORTED_FORMAT;
+    }
+
+    void* map = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (map == MAP_FAILED) {
+        return CaptureError::SYSTEM_ERROR;
+    }
+
+    madvise(map, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+    data_ = static_cast<const uint8_t*>(map);
+    size_ = static_cast<size_t>(st.st_size);
+    mapped_ = true;
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return CaptureError::INTERFACE_NOT_FOUND;
+    }
+
+    fallback_buffer_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (fallback_buffer_.empty()) {
+        return CaptureError::UNSUPPORTED_FORMAT;
+    }
+
+    data_ = fallback_buffer_.data();
+    size_ = fallback_buffer_.size();
+#endif
+
+    offset_ = 0;
+
+    if (size_ < PCAP_FILE_HEADER_SIZE) {
+        close();
+        return CaptureError::UNSUPPORTED_FORMAT;
+    }
+
+    uint32_t magic;
+    memcpy(&magic, data_, sizeof(magic));
+
+    if (magic == PCAP_MAGIC_USEC || magic == PCAP_MAGIC_NSEC ||
+        magic == PCAP_MAGIC_USEC_SWAPPED || magic == PCAP_MAGIC_NSEC_SWAPPED) {
+        format_ = Format::PCAP;
+        swapped_ = (magic == PCAP_MAGIC_USEC_SWAPPED || magic == PCAP_MAGIC_NSEC_SWAPPED);
+        pcap_ticks_per_second_ = (magic == PCAP_MAGIC_NSEC || magic == PCAP_MAGIC_NSEC_SWAPPED)
+            ? 1000000000ULL : 1000000ULL;
+
+        uint32_t link_type = read32(data_ + 20) & 0x0FFFFFFF;
+        if (link_type != LINKTYPE_ETHERNET) {
+            close();
+            return CaptureError::UNSUPPORTED_FORMAT;
+        }
+
+        offset_ = PCAP_FILE_HEADER_SIZE;
+        return CaptureError::NONE;
+    }
+
+    if (magic == PCAPNG_SECTION_HEADER) {
+        format_ = Format::PCAPNG;
+        return CaptureError::NONE;
+    }
+
+    close();
+    return CaptureError::UNSUPPORTED_FORMAT;
+}
+
+void CaptureFileReader::close() {
+#ifndef _WIN32
+    if (mapped_ && data_) {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    }
+#endif
+
+    fallback_buffer_.clear();
+    fallback_buffer_.shrink_to_fit();
+
+    data_ = nullptr;
+    size_ = 0;
+    offset_ = 0;
+    mapped_ = false;
+    format_ = Format::NONE;
+    swapped_ = false;
+    interfaces_.clear();
+}
+
+bool CaptureFileReader::next(Frame& frame) {
+    switch (format_) {
+        case Format::PCAP:
+            return nextPcap(frame);
+        case Format::PCAPNG:
+            return nextPcapng(frame);
+        default:
+            return false;
+    }
+}
+
+uint16_t CaptureFileReader::read16(const uint8_t* p) const {
+    uint16_t value;
+    memcpy(&value, p, sizeof(value));
+    return swapped_ ? swap16(value) : value;
+}
+
+uint32_t CaptureFileReader::read32(const uint8_t* p) const {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return swapped_ ? swap32(value) : value;
+}
+
+bool CaptureFileReader::nextPcap(Frame& frame) {
+    if (offset_ + PCAP_RECORD_HEADER_SIZE > size_) {
+        return false;
+    }
+
+    const uint8_t* record = data_ + offset_;
+    uint64_t ts_sec = read32(record);
+    uint64_t ts_frac = read32(record + 4);
+    uint32_t caplen = read32(record + 8);
+    uint32_t len = read32(record + 12);
+
+    if (offset_ + PCAP_RECORD_HEADER_SIZE + caplen > size_) {
+        return false;
+    }
+
+    frame.data = record + PCAP_RECORD_HEADER_SIZE;
+    frame.caplen = caplen;
+    frame.len = len;
+    frame.timestamp = ts_sec * 1000000 + (pcap_ticks_per_second_ == 1000000 ? ts_frac : ts_frac / 1000);
+
+    offset_ += PCAP_RECORD_HEADER_SIZE + caplen;
+    return true;
+}
+
+bool CaptureFileReader::nextPcapng(Frame& frame) {
+    while (offset_ + 12 <= size_) {
+        const uint8_t* block = data_ + offset_;
+
+        uint32_t raw_type;
+        memcpy(&raw_type, block, sizeof(raw_type));
+
+        if (raw_type == PCAPNG_SECTION_HEADER) {
+            // Byte order is only known once the section header has been read
+            if (offset_ + 28 > size_) {
+                return false;
+            }
+
+            uint32_t magic;
+            memcpy(&magic, block + 8, sizeof(magic));
+            if (magic == PCAPNG_BYTE_ORDER_MAGIC) {
+                swapped_ = false;
+            } else if (magic == swap32(PCAPNG_BYTE_ORDER_MAGIC)) {
+                swapped_ = true;
+            } else {
+                return false;
+            }
+        }
+
+        uint32_t type = read32(block);
+        size_t block_len = read32(block + 4);
+
+        if (block_len < 12 || block_len % 4 != 0 || offset_ + block_len > size_) {
+            return false;
+        }
+
+        offset_ += block_len;
+
+        switch (type) {
+            case PCAPNG_SECTION_HEADER:
+                if (!parseSectionHeader(block, block_len)) {
+                    return false;
+                }
+                break;
+
+            case PCAPNG_INTERFACE_DESCRIPTION:
+                parseInterfaceDescription(block, block_len);
+                break;
+
+            case PCAPNG_ENHANCED_PACKET: {
+                if (block_len < 32) {
+                    return false;
+                }
+
+                uint32_t interface_id = read32(block + 8);
+                if (interface_id >= interfaces_.size() ||
+                    interfaces_[interface_id].link_type != LINKTYPE_ETHERNET) {
+                    continue;
+                }
+
+                uint64_t ticks = (static_cast<uint64_t>(read32(block + 12)) << 32) | read32(block + 16);
+                uint32_t caplen = read32(block + 20);
+                if (28 + static_cast<size_t>(caplen) > block_len - 4) {
+                    return false;
+                }
+
+                frame.data = block + 28;
+                frame.caplen = caplen;
+                frame.len = read32(block + 24);
+                frame.timestamp = toMicroseconds(ticks, interfaces_[interface_id].ticks_per_second);
+                return true;
+            }
+
+            case PCAPNG_SIMPLE_PACKET: {
+                if (block_len < 16 || interfaces_.empty() ||
+                    interfaces_[0].link_type != LINKTYPE_ETHERNET) {
+                    continue;
+                }
+
+                uint32_t len = read32(block + 8);
+                uint32_t caplen = std::min<uint32_t>(len, static_cast<uint32_t>(block_len - 16));
+
+                frame.data = block + 12;
+                frame.caplen = caplen;
+                frame.len = len;
+                frame.timestamp = 0;
+                return true;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    return false;
+}
+
+bool CaptureFileReader::parseSectionHeader(const uint8_t* block, size_t block_len) {
+    if (block_len < 28 || read16(block + 12) != 1) {
+        return false;
+    }
+
+    // Interface ids are scoped to their section
+    interfaces_.clear();
+    return true;
+}
+
+void CaptureFileReader::parseInterfaceDescription(const uint8_t* block, size_t block_len) {
+    Interface interface;
+    interface.link_type = block_len >= 20 ? read16(block + 8) : 0;
+    interface.ticks_per_second = 1000000;
+
+    size_t pos = 16;
+    while (pos + 4 <= block_len - 4) {
+        uint16_t code = read16(block + pos);
+        uint16_t length = read16(block + pos + 2);
+        pos += 4;
+
+        if (code == PCAPNG_OPTION_END || pos + length > block_len - 4) {
+            break;
+        }
+
+        if (code == PCAPNG_OPTION_IF_TSRESOL && length >= 1) {
+            uint8_t resolution = block[pos];
+            uint8_t exponent = resolution & 0x7F;
+
+            if (resolution & 0x80) {
+                interface.ticks_per_second = exponent < 64 ? (1ULL << exponent) : 1000000;
+            } else {
+                uint64_t ticks = 1;
+                for (uint8_t i = 0; i < exponent && i < 19; ++i) {
+                    ticks *= 10;
+                }
+                interface.ticks_per_second = ticks;
+            }
+        }
+
+        pos += (length + 3) & ~static_cast<size_t>(3);
+    }
+
+    interfaces_.push_back(interface);
+}
+
+uint64_t CaptureFileReader::toMicroseconds(uint64_t ticks, uint64_t ticks_per_second) {
+    if (ticks_per_second == 1000000) {
+        return ticks;
+    }
+
+    uint64_t seconds = ticks / ticks_per_second;
+    uint64_t remainder = ticks % ticks_per_second;
+
+    if (ticks_per_second > 1000000) {
+        return seconds * 1000000 + remainder / (ticks_per_second / 1000000);
+    }
+
+    return seconds * 1000000 + (remainder * 1000000) / ticks_per_second;
+}
+
+}
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace netsentry {
+namespace network {
+
+enum class CaptureError;
+
+// Sequential reader for pcap and pcapng capture files. The file is memory
+// mapped and frames are returned as pointers into the mapping, so reading a
+// trace costs no syscall or copy per packet. Only Ethernet link types are
+// delivered; frames from other pcapng interfaces are skipped.
+class CaptureFileReader {
+public:
+    struct Frame {
+        const uint8_t* data;
+        uint32_t caplen;
+        uint32_t len;
+        uint64_t timestamp;
+    };
+
+    CaptureFileReader() = default;
+    ~CaptureFileReader();
+
+    CaptureFileReader(const CaptureFileReader&) = delete;
+    CaptureFileReader& operator=(const CaptureFileReader&) = delete;
+
+    CaptureError open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return data_ != nullptr; }
+
+    // Returns false at end of file or at the first truncated/malformed record.
+    bool next(Frame& frame);
+
+private:
+    enum class Format {
+        NONE,
+        PCAP,
+        PCAPNG
+    };
+
+    struct Interface {
+        uint16_t link_type;
+        uint64_t ticks_per_second;
+    };
+
+    const uint8_t* data_{nullptr};
+    size_t size_{0};
+    size_t offset_{0};
+    bool mapped_{false};
+    std::vector<uint8_t> fallback_buffer_;
+
+    Format format_{Format::NONE};
+    bool swapped_{false};
+    uint64_t pcap_ticks_per_second_{1000000};
+    std::vector<Interface> interfaces_;
+
+    uint16_t read16(const uint8_t* p) const;
+    uint32_t read32(const uint8_t* p) const;
+
+    bool nextPcap(Frame& frame);
+    bool nextPcapng(Frame& frame);
+    bool parseSectionHeader(const uint8_t* block, size_t block_len);
+    void parseInterfaceDescription(const uint8_t* block, size_t block_len);
+
+    static uint64_t toMicroseconds(uint64_t ticks, uint64_t ticks_per_second);
+};
+
+}
+}
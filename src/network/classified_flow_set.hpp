@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+namespace netsentry {
+namespace network {
+
+// Lock-free set of flow hashes whose application protocol has already been
+// identified, written by the analyzer and read by the capture path to stop
+// copying payload for those flows. Slots are direct-mapped and overwritten
+// on collision; a flow that loses its entry has its payload captured again,
+// and the analyzer marks it once more on the next such packet.
+class ClassifiedFlowSet {
+public:
+    explicit ClassifiedFlowSet(size_t capacity = 1 << 16) {
+        size_t size = 2;
+        shift_ = 1;
+        while (size < capacity) {
+            size <<= 1;
+            ++shift_;
+        }
+
+        slots_ = std::make_unique<std::atomic<uint64_t>[]>(size);
+        mask_ = size - 1;
+        clear();
+    }
+
+    void insert(uint64_t flow_hash) {
+        slots_[flow_hash & mask_].store(tag(flow_hash), std::memory_order_relaxed);
+    }
+
+    // Forgets a flow that has ended, unless its slot was already reused.
+    void erase(uint64_t flow_hash) {
+        uint64_t expected = tag(flow_hash);
+        slots_[flow_hash & mask_].compare_exchange_strong(expected, 0, std::memory_order_relaxed);
+    }
+
+    bool contains(uint64_t flow_hash) const {
+        return slots_[flow_hash & mask_].load(std::memory_order_relaxed) == tag(flow_hash);
+    }
+
+    void clear() {
+        for (size_t i = 0; i <= mask_; ++i) {
+            slots_[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    std::unique_ptr<std::atomic<uint64_t>[]> slots_;
+    size_t mask_{0};
+    unsigned shift_{0};
+
+    // The hash bits above the slot index, offset so that zero marks an
+    // empty slot; two hashes only share a tag if they are equal.
+    uint64_t tag(uint64_t flow_hash) const {
+        return (flow_hash >> shift_) + 1;
+    }
+};
+
+}
+}
@@ -0,0 +1,440 @@
+#include "flow_exporter.hpp"
+#include <algorithm>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace netsentry {
+namespace network {
+
+namespace {
+
+constexpr uint16_t IPFIX_VERSION = 10;
+constexpr uint16_t NETFLOW_V9_VERSION = 9;
+constexpr size_t IPFIX_HEADER_SIZE = 16;
+constexpr size_t NETFLOW_V9_HEADER_SIZE = 20;
+constexpr size_t SET_HEADER_SIZE = 4;
+constexpr size_t MIN_MESSAGE_SIZE = 512;
+
+constexpr uint16_t IPFIX_TEMPLATE_SET = 2;
+constexpr uint16_t NETFLOW_V9_TEMPLATE_SET = 0;
+constexpr uint16_t IPV4_TEMPLATE_ID = 256;
+constexpr uint16_t IPV6_TEMPLATE_ID = 257;
+
+// Information elements; NetFlow v9 shares the numbering of those it has
+constexpr uint16_t OCTET_DELTA_COUNT = 1;
+constexpr uint16_t PACKET_DELTA_COUNT = 2;
+constexpr uint16_t PROTOCOL_IDENTIFIER = 4;
+constexpr uint16_t TCP_CONTROL_BITS = 6;
+constexpr uint16_t SOURCE_TRANSPORT_PORT = 7;
+constexpr uint16_t SOURCE_IPV4_ADDRESS = 8;
+constexpr uint16_t DESTINATION_TRANSPORT_PORT = 11;
+constexpr uint16_t DESTINATION_IPV4_ADDRESS = 12;
+constexpr uint16_t FLOW_END_SYS_UP_TIME = 21;
+constexpr uint16_t FLOW_START_SYS_UP_TIME = 22;
+constexpr uint16_t SOURCE_IPV6_ADDRESS = 27;
+constexpr uint16_t DESTINATION_IPV6_ADDRESS = 28;
+constexpr uint16_t FLOW_END_REASON = 136;
+constexpr uint16_t FLOW_START_MILLISECONDS = 152;
+constexpr uint16_t FLOW_END_MILLISECONDS = 153;
+
+struct TemplateField {
+    uint16_t id;
+    uint16_t length;
+};
+
+// tcpControlBits is sent in one byte (reduced-size encoding), which holds
+// every flag the analyzer records.
+const std::vector<TemplateField> IPFIX_IPV4_FIELDS = {
+    {SOURCE_IPV4_ADDRESS, 4}, {DESTINATION_IPV4_ADDRESS, 4},
+    {SOURCE_TRANSPORT_PORT, 2}, {DESTINATION_TRANSPORT_PORT, 2},
+    {PROTOCOL_IDENTIFIER, 1}, {TCP_CONTROL_BITS, 1},
+    {OCTET_DELTA_COUNT, 8}, {PACKET_DELTA_COUNT, 8},
+    {FLOW_START_MILLISECONDS, 8}, {FLOW_END_MILLISECONDS, 8},
+    {FLOW_END_REASON, 1}};
+
+const std::vector<TemplateField> IPFIX_IPV6_FIELDS = {
+    {SOURCE_IPV6_ADDRESS, 16}, {DESTINATION_IPV6_ADDRESS, 16},
+    {SOURCE_TRANSPORT_PORT, 2}, {DESTINATION_TRANSPORT_PORT, 2},
+    {PROTOCOL_IDENTIFIER, 1}, {TCP_CONTROL_BITS, 1},
+    {OCTET_DELTA_COUNT, 8}, {PACKET_DELTA_COUNT, 8},
+    {FLOW_START_MILLISECONDS, 8}, {FLOW_END_MILLISECONDS, 8},
+    {FLOW_END_REASON, 1}};
+
+// NetFlow v9 has no end reason and times flows against the exporter's uptime
+const std::vector<TemplateField> NETFLOW_V9_IPV4_FIELDS = {
+    {SOURCE_IPV4_ADDRESS, 4}, {DESTINATION_IPV4_ADDRESS, 4},
+    {SOURCE_TRANSPORT_PORT, 2}, {DESTINATION_TRANSPORT_PORT, 2},
+    {PROTOCOL_IDENTIFIER, 1}, {TCP_CONTROL_BITS, 1},
+    {OCTET_DELTA_COUNT, 8}, {PACKET_DELTA_COUNT, 8},
+    {FLOW_START_SYS_UP_TIME, 4}, {FLOW_END_SYS_UP_TIME, 4}};
+
+const std::vector<TemplateField> NETFLOW_V9_IPV6_FIELDS = {
+    {SOURCE_IPV6_ADDRESS, 16}, {DESTINATION_IPV6_ADDRESS, 16},
+    {SOURCE_TRANSPORT_PORT, 2}, {DESTINATION_TRANSPORT_PORT, 2},
+    {PROTOCOL_IDENTIFIER, 1}, {TCP_CONTROL_BITS, 1},
+    {OCTET_DELTA_COUNT, 8}, {PACKET_DELTA_COUNT, 8},
+    {FLOW_START_SYS_UP_TIME, 4}, {FLOW_END_SYS_UP_TIME, 4}};
+
+const std::vector<TemplateField>& templateFields(FlowExportFormat format, uint16_t template_id) {
+    if (format == FlowExportFormat::IPFIX) {
+        return template_id == IPV6_TEMPLATE_ID ? IPFIX_IPV6_FIELDS : IPFIX_IPV4_FIELDS;
+    }
+    return template_id == IPV6_TEMPLATE_ID ? NETFLOW_V9_IPV6_FIELDS : NETFLOW_V9_IPV4_FIELDS;
+}
+
+void put(std::vector<uint8_t>& out, uint64_t value, size_t length) {
+    for (size_t i = length; i > 0; --i) {
+        out.push_back(static_cast<uint8_t>(value >> ((i - 1) * 8)));
+    }
+}
+
+void set16(std::vector<uint8_t>& out, size_t offset, uint16_t value) {
+    out[offset] = static_cast<uint8_t>(value >> 8);
+    out[offset + 1] = static_cast<uint8_t>(value);
+}
+
+void set32(std::vector<uint8_t>& out, size_t offset, uint32_t value) {
+    set16(out, offset, static_cast<uint16_t>(value >> 16));
+    set16(out, offset + 2, static_cast<uint16_t>(value));
+}
+
+uint64_t wallClockMilliseconds() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+}
+
+FlowExporter::FlowExporter(const FlowExportOptions& options) : options_(options) {
+    options_.max_message_size = std::max(options_.max_message_size, MIN_MESSAGE_SIZE);
+    options_.max_pending = std::max<size_t>(options_.max_pending, 1);
+}
+
+FlowExporter::~FlowExporter() {
+    stop();
+}
+
+bool FlowExporter::start() {
+    if (running_) {
+        return true;
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    addrinfo* addresses = nullptr;
+    std::string port = std::to_string(options_.collector_port);
+    if (getaddrinfo(options_.collector_host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+        return false;
+    }
+
+    int fd = -1;
+    for (addrinfo* address = addresses; address && fd < 0; address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd >= 0 && connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> send_lock(send_mutex_);
+    socket_ = fd;
+    started_ = std::chrono::steady_clock::now();
+    templates_due_ = true;
+    running_ = true;
+    thread_ = std::thread(&FlowExporter::run, this);
+
+    return true;
+}
+
+void FlowExporter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        running_ = false;
+    }
+    wakeup_.notify_all();
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    sendPending();
+
+    std::lock_guard<std::mutex> send_lock(send_mutex_);
+    if (socket_ >= 0) {
+        close(socket_);
+        socket_ = -1;
+    }
+}
+
+void FlowExporter::addFlow(const ConnectionKey& key, const ConnectionStats& stats, FlowEndReason reason) {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+
+    if (pending_.size() >= options_.max_pending) {
+        flows_dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    pending_.push_back({key, stats, reason});
+    flows_queued_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FlowExporter::flush() {
+    sendPending();
+}
+
+FlowExportStats FlowExporter::getStats() const {
+    FlowExportStats stats;
+    stats.flows_queued = flows_queued_.load(std::memory_order_relaxed);
+    stats.flows_dropped = flows_dropped_.load(std::memory_order_relaxed);
+    stats.records_exported = records_exported_.load(std::memory_order_relaxed);
+    stats.messages_sent = messages_sent_.load(std::memory_order_relaxed);
+    stats.send_errors = send_errors_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void FlowExporter::run() {
+    std::unique_lock<std::mutex> lock(pending_mutex_);
+
+    while (running_) {
+        wakeup_.wait_for(lock, options_.interval, [this] { return !running_; });
+
+        lock.unlock();
+        sendPending();
+        lock.lock();
+    }
+}
+
+void FlowExporter::sendPending() {
+    std::lock_guard<std::mutex> send_lock(send_mutex_);
+
+    // Not started, or stopped
+    if (socket_ < 0) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        sending_.swap(pending_);
+    }
+
+    if (sending_.empty()) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - templates_sent_ >= options_.template_refresh) {
+        templates_due_ = true;
+    }
+
+    uint16_t open_set = 0;
+    beginMessage();
+
+    if (templates_due_) {
+        addTemplates();
+        templates_due_ = false;
+        templates_sent_ = now;
+    }
+
+    for (const Flow& flow : sending_) {
+        const ConnectionKey& key = flow.key;
+        const ConnectionStats& stats = flow.stats;
+
+        if (stats.packets_sent > 0) {
+            addRecord({&key.source_ip, &key.dest_ip, key.source_port, key.dest_port, key.protocol,
+                       stats.tcp_flags_sent, stats.bytes_sent, stats.packets_sent,
+                       stats.first_seen, stats.last_seen, flow.reason},
+                      open_set);
+        }
+
+        if (stats.packets_received > 0) {
+            addRecord({&key.dest_ip, &key.source_ip, key.dest_port, key.source_port, key.protocol,
+                       stats.tcp_flags_received, stats.bytes_received, stats.packets_received,
+                       stats.first_seen, stats.last_seen, flow.reason},
+                      open_set);
+        }
+    }
+
+    if (message_records_ > 0 || open_set != 0) {
+        sendMessage(open_set);
+    }
+
+    sending_.clear();
+}
+
+void FlowExporter::beginMessage() {
+    message_.clear();
+    message_.resize(options_.format == FlowExportFormat::IPFIX ? IPFIX_HEADER_SIZE : NETFLOW_V9_HEADER_SIZE);
+    message_records_ = 0;
+    message_data_records_ = 0;
+}
+
+void FlowExporter::addTemplates() {
+    size_t set_start = message_.size();
+    put(message_, options_.format == FlowExportFormat::IPFIX ? IPFIX_TEMPLATE_SET : NETFLOW_V9_TEMPLATE_SET, 2);
+    put(message_, 0, 2);
+
+    for (uint16_t template_id : {IPV4_TEMPLATE_ID, IPV6_TEMPLATE_ID}) {
+        const auto& fields = templateFields(options_.format, template_id);
+        put(message_, template_id, 2);
+        put(message_, fields.size(), 2);
+
+        for (const auto& field : fields) {
+            put(message_, field.id, 2);
+            put(message_, field.length, 2);
+        }
+        message_records_++;
+    }
+
+    set16(message_, set_start + 2, static_cast<uint16_t>(message_.size() - set_start));
+}
+
+void FlowExporter::addRecord(const Record& record, uint16_t& open_set) {
+    uint16_t template_id = record.source_ip->isV6() ? IPV6_TEMPLATE_ID : IPV4_TEMPLATE_ID;
+    const auto& fields = templateFields(options_.format, template_id);
+
+    size_t record_size = 0;
+    for (const auto& field : fields) {
+        record_size += field.length;
+    }
+
+    // Room for a new set header and NetFlow v9's padding
+    size_t needed = record_size + (open_set == template_id ? 0 : SET_HEADER_SIZE) + 3;
+    if (message_.size() + needed > options_.max_message_size && message_records_ > 0) {
+        sendMessage(open_set);
+        beginMessage();
+    }
+
+    if (open_set != template_id) {
+        closeSet(open_set);
+        set_start_ = message_.size();
+        put(message_, template_id, 2);
+        put(message_, 0, 2);
+        open_set = template_id;
+    }
+
+    uint64_t now_ms = wallClockMilliseconds();
+    uint64_t uptime_ms = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started_).count());
+
+    // Flow times (microseconds since the epoch) relative to the exporter's
+    // start, as NetFlow v9 expects; flows that began earlier start at 0.
+    auto sysUpTime = [&](uint64_t timestamp) {
+        uint64_t ago = now_ms - std::min(now_ms, timestamp / 1000);
+        return uptime_ms - std::min(uptime_ms, ago);
+    };
+
+    for (const auto& field : fields) {
+        switch (field.id) {
+        case SOURCE_IPV4_ADDRESS:
+        case SOURCE_IPV6_ADDRESS:
+            message_.insert(message_.end(), record.source_ip->bytes.begin(),
+                            record.source_ip->bytes.begin() + field.length);
+            break;
+        case DESTINATION_IPV4_ADDRESS:
+        case DESTINATION_IPV6_ADDRESS:
+            message_.insert(message_.end(), record.dest_ip->bytes.begin(),
+                            record.dest_ip->bytes.begin() + field.length);
+            break;
+        case SOURCE_TRANSPORT_PORT:
+            put(message_, record.source_port, field.length);
+            break;
+        case DESTINATION_TRANSPORT_PORT:
+            put(message_, record.dest_port, field.length);
+            break;
+        case PROTOCOL_IDENTIFIER:
+            put(message_, record.protocol, field.length);
+            break;
+        case TCP_CONTROL_BITS:
+            put(message_, record.tcp_flags, field.length);
+            break;
+        case OCTET_DELTA_COUNT:
+            put(message_, record.bytes, field.length);
+            break;
+        case PACKET_DELTA_COUNT:
+            put(message_, record.packets, field.length);
+            break;
+        case FLOW_START_MILLISECONDS:
+            put(message_, record.first_seen / 1000, field.length);
+            break;
+        case FLOW_END_MILLISECONDS:
+            put(message_, record.last_seen / 1000, field.length);
+            break;
+        case FLOW_START_SYS_UP_TIME:
+            put(message_, sysUpTime(record.first_seen), field.length);
+            break;
+        case FLOW_END_SYS_UP_TIME:
+            put(message_, sysUpTime(record.last_seen), field.length);
+            break;
+        case FLOW_END_REASON:
+            put(message_, static_cast<uint8_t>(record.reason), field.length);
+            break;
+        default:
+            put(message_, 0, field.length);
+            break;
+        }
+    }
+
+    message_records_++;
+    message_data_records_++;
+}
+
+void FlowExporter::closeSet(uint16_t& open_set) {
+    if (open_set == 0) {
+        return;
+    }
+
+    // NetFlow v9 flowsets are padded to a 4-byte boundary
+    if (options_.format == FlowExportFormat::NETFLOW_V9) {
+        while ((message_.size() - set_start_) % 4 != 0) {
+            message_.push_back(0);
+        }
+    }
+
+    set16(message_, set_start_ + 2, static_cast<uint16_t>(message_.size() - set_start_));
+    open_set = 0;
+}
+
+void FlowExporter::sendMessage(uint16_t& open_set) {
+    closeSet(open_set);
+
+    uint32_t export_seconds = static_cast<uint32_t>(wallClockMilliseconds() / 1000);
+
+    if (options_.format == FlowExportFormat::IPFIX) {
+        set16(message_, 0, IPFIX_VERSION);
+        set16(message_, 2, static_cast<uint16_t>(message_.size()));
+        set32(message_, 4, export_seconds);
+        // Counts data records sent before this message
+        set32(message_, 8, sequence_);
+        set32(message_, 12, options_.observation_domain);
+        sequence_ += static_cast<uint32_t>(message_data_records_);
+    } else {
+        uint64_t uptime_ms = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started_).count());
+
+        set16(message_, 0, NETFLOW_V9_VERSION);
+        set16(message_, 2, static_cast<uint16_t>(message_records_));
+        set32(message_, 4, static_cast<uint32_t>(uptime_ms));
+        set32(message_, 8, export_seconds);
+        // Counts messages
+        set32(message_, 12, sequence_++);
+        set32(message_, 16, options_.observation_domain);
+    }
+
+    if (::send(socket_, message_.data(), message_.size(), 0) < 0) {
+        send_errors_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        messages_sent_.fetch_add(1, std::memory_order_relaxed);
+        records_exported_.fetch_add(message_data_records_, std::memory_order_relaxed);
+    }
+}
+
+}
+}
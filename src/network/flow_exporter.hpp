@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "packet_analyzer.hpp"
+
+namespace netsentry {
+namespace network {
+
+enum class FlowExportFormat {
+    // RFC 7011
+    IPFIX,
+    // RFC 3954
+    NETFLOW_V9
+};
+
+struct FlowExportOptions {
+    std::string collector_host{"127.0.0.1"};
+    uint16_t collector_port{4739};
+    FlowExportFormat format{FlowExportFormat::IPFIX};
+
+    // How often queued records are sent
+    std::chrono::milliseconds interval{1000};
+
+    // Templates go out with the first message and again after this long, so
+    // that a collector that restarts or loses a datagram recovers.
+    std::chrono::seconds template_refresh{60};
+
+    // IPFIX observation domain, or NetFlow v9 source ID
+    uint32_t observation_domain{0};
+
+    // Largest UDP payload sent; keep it below the path MTU.
+    size_t max_message_size{1400};
+
+    // Flows held between sends; flows ending while it is full are dropped.
+    size_t max_pending{65536};
+};
+
+struct FlowExportStats {
+    uint64_t flows_queued{0};
+    uint64_t flows_dropped{0};
+    uint64_t records_exported{0};
+    uint64_t messages_sent{0};
+    uint64_t send_errors{0};
+};
+
+// Exports ended flows to a flow collector as IPFIX or NetFlow v9 over UDP.
+// Flows are queued by addFlow(), which is cheap enough to call from the
+// analyzer's flow expired handler, and sent by a background thread every
+// interval, packed into as few messages as fit max_message_size. Long-lived
+// flows reach the exporter periodically through the analyzer's active
+// timeout.
+//
+// Each flow becomes one record per direction that carried packets, since
+// both formats describe unidirectional flows. IPv4 and IPv6 flows use
+// separate templates.
+class FlowExporter {
+public:
+    explicit FlowExporter(const FlowExportOptions& options);
+    ~FlowExporter();
+
+    FlowExporter(const FlowExporter&) = delete;
+    FlowExporter& operator=(const FlowExporter&) = delete;
+
+    // Resolves the collector and starts the send thread. Returns false if
+    // the collector address cannot be resolved or the socket not opened.
+    bool start();
+
+    // Sends whatever is still queued first.
+    void stop();
+
+    bool isRunning() const { return running_; }
+
+    // Thread safe.
+    void addFlow(const ConnectionKey& key, const ConnectionStats& stats, FlowEndReason reason);
+
+    // Sends everything queued now instead of at the next interval.
+    void flush();
+
+    FlowExportStats getStats() const;
+
+private:
+    struct Flow {
+        ConnectionKey key;
+        ConnectionStats stats;
+        FlowEndReason reason;
+    };
+
+    // One direction of a flow, as encoded
+    struct Record {
+        const IpAddress* source_ip;
+        const IpAddress* dest_ip;
+        uint16_t source_port;
+        uint16_t dest_port;
+        uint8_t protocol;
+        uint8_t tcp_flags;
+        uint64_t bytes;
+        uint64_t packets;
+        uint64_t first_seen;
+        uint64_t last_seen;
+        FlowEndReason reason;
+    };
+
+    FlowExportOptions options_;
+    int socket_{-1};
+    std::chrono::steady_clock::time_point started_;
+    std::chrono::steady_clock::time_point templates_sent_;
+    bool templates_due_{true};
+    // Data records (IPFIX) or messages (NetFlow v9) sent so far
+    uint32_t sequence_{0};
+
+    std::vector<Flow> pending_;
+    mutable std::mutex pending_mutex_;
+
+    // Serializes encoding and sending between flush() and the send thread,
+    // and guards socket_ against start() and stop()
+    std::mutex send_mutex_;
+    std::vector<Flow> sending_;
+    std::vector<uint8_t> message_;
+    size_t set_start_{0};
+    // Template and data records in message_
+    size_t message_records_{0};
+    size_t message_data_records_{0};
+
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::condition_variable wakeup_;
+
+    std::atomic<uint64_t> flows_queued_{0};
+    std::atomic<uint64_t> flows_dropped_{0};
+    std::atomic<uint64_t> records_exported_{0};
+    std::atomic<uint64_t> messages_sent_{0};
+    std::atomic<uint64_t> send_errors_{0};
+
+    void run();
+    void sendPending();
+
+    void beginMessage();
+    void addTemplates();
+    void addRecord(const Record& record, uint16_t& open_set);
+    void closeSet(uint16_t& open_set);
+    void sendMessage(uint16_t& open_set);
+};
+
+}
+}
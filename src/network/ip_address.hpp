@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+namespace netsentry {
+namespace network {
+
+// Binary IPv4/IPv6 address. IPv4 addresses occupy the first four bytes and
+// the remaining bytes stay zero, so equality and hashing never need to look
+// at the family separately from the bytes.
+struct IpAddress {
+    uint8_t family{0};
+    std::array<uint8_t, 16> bytes{};
+
+    static IpAddress fromV4(const uint8_t* data) {
+        IpAddress address;
+        address.family = 4;
+        memcpy(address.bytes.data(), data, 4);
+        return address;
+    }
+
+    static IpAddress fromV6(const uint8_t* data) {
+        IpAddress address;
+        address.family = 6;
+        memcpy(address.bytes.data(), data, 16);
+        return address;
+    }
+
+    static std::optional<IpAddress> parse(const std::string& text) {
+        IpAddress address;
+        if (inet_pton(AF_INET, text.c_str(), address.bytes.data()) == 1) {
+            address.family = 4;
+            return address;
+        }
+        if (inet_pton(AF_INET6, text.c_str(), address.bytes.data()) == 1) {
+            address.family = 6;
+            return address;
+        }
+        return std::nullopt;
+    }
+
+    bool isV4() const { return family == 4; }
+    bool isV6() const { return family == 6; }
+    bool empty() const { return family == 0; }
+
+    size_t length() const { return family == 6 ? 16 : (family == 4 ? 4 : 0); }
+
+    std::string toString() const {
+        char buffer[INET6_ADDRSTRLEN];
+
+        if (family == 4 && inet_ntop(AF_INET, bytes.data(), buffer, sizeof(buffer))) {
+            return buffer;
+        }
+        if (family == 6 && inet_ntop(AF_INET6, bytes.data(), buffer, sizeof(buffer))) {
+            return buffer;
+        }
+
+        return std::string();
+    }
+
+    bool operator==(const IpAddress& other) const {
+        return family == other.family && bytes == other.bytes;
+    }
+
+    bool operator!=(const IpAddress& other) const {
+        return !(*this == other);
+    }
+
+    bool operator<(const IpAddress& other) const {
+        if (family != other.family) {
+            return family < other.family;
+        }
+        return memcmp(bytes.data(), other.bytes.data(), bytes.size()) < 0;
+    }
+
+    bool operator>(const IpAddress& other) const {
+        return other < *this;
+    }
+};
+
+struct IpAddressHash {
+    size_t operator()(const IpAddress& address) const {
+        uint64_t high;
+        uint64_t low;
+        memcpy(&high, address.bytes.data(), 8);
+        memcpy(&low, address.bytes.data() + 8, 8);
+
+        uint64_t h = high * 0x9E3779B97F4A7C15ULL;
+        h ^= (low + address.family) * 0xC2B2AE3D27D4EB4FULL;
+        h ^= h >> 32;
+
+        return static_cast<size_t>(h);
+    }
+};
+
+}
+}
@@ -1,117 +1,1815 @@
 #include "packet_analyzer.hpp"
 #include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <limits>
 #include <utility>
 
 namespace netsentry {
 namespace network {
 
-PacketAnalyzer::PacketAnalyzer() {
-    protocol_parsers_ = ProtocolParserFactory::createAllParsers();
+namespace {
+
+// Two-sided 95% normal quantile used for the sampling error bounds
+constexpr double CONFIDENCE_Z = 1.96;
+
+constexpr uint8_t IPPROTO_TCP_NUMBER = 6;
+constexpr uint8_t IPPROTO_UDP_NUMBER = 17;
+constexpr uint8_t IPPROTO_ICMP_NUMBER = 1;
+constexpr uint8_t IPPROTO_ICMPV6_NUMBER = 58;
+
+constexpr uint8_t TCP_FIN = 0x01;
+constexpr uint8_t TCP_SYN = 0x02;
+constexpr uint8_t TCP_RST = 0x04;
+constexpr uint8_t TCP_ACK = 0x10;
+
+constexpr uint64_t MICROSECONDS_PER_SECOND = 1000000;
+
+// Longest HTTP host and path kept per endpoint
+constexpr size_t HTTP_MAX_NAME_LENGTH = 128;
+
+uint64_t toMicroseconds(std::chrono::seconds duration) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+}
+
+HttpEndpoint otherHttpEndpoint() {
+    HttpEndpoint endpoint;
+    endpoint.host = "*";
+    endpoint.path = "*";
+    return endpoint;
+}
+
+void addHttpEndpoint(HttpEndpoint& total, const HttpEndpoint& endpoint) {
+    total.requests += endpoint.requests;
+    total.responses += endpoint.responses;
+    total.unanswered += endpoint.unanswered;
+    for (size_t i = 0; i < total.status_classes.size(); ++i) {
+        total.status_classes[i] += endpoint.status_classes[i];
+    }
+    total.latency.merge(endpoint.latency);
+}
+
+}
+
+PacketAnalyzer::PacketAnalyzer(size_t shard_count, size_t expected_flows) {
+    shard_count = std::max<size_t>(1, shard_count);
+    shards_.reserve(shard_count);
+
+    for (size_t i = 0; i < shard_count; ++i) {
+        auto shard = std::make_unique<Shard>(expected_flows / shard_count);
+        shard->classifier = std::make_unique<ProtocolClassifier>(ProtocolParserFactory::createAllParsers());
+        shard->top.reserve(top_k_);
+        shards_.push_back(std::move(shard));
+    }
+}
+
+void PacketAnalyzer::processPacket(const PacketView& packet) {
+    thread_local std::vector<ExpiredFlow> expired;
+
+    {
+        Shard& shard = *shards_[shardIndex(packet)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        processPacketLocked(shard, packet);
+        advanceLocked(shard, shard.clock);
+        expired.swap(shard.expired);
+    }
+
+    deliverExpired(expired);
+}
+
+void PacketAnalyzer::processBatch(const PacketBatch& batch) {
+    thread_local std::vector<ExpiredFlow> expired;
+    size_t i = 0;
+
+    while (i < batch.size()) {
+        {
+            size_t index = shardIndex(batch[i]);
+            Shard& shard = *shards_[index];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            do {
+                processPacketLocked(shard, batch[i++]);
+            } while (i < batch.size() && shardIndex(batch[i]) == index);
+
+            advanceLocked(shard, shard.clock);
+            expired.swap(shard.expired);
+        }
+
+        deliverExpired(expired);
+    }
 }
 
-void PacketAnalyzer::processPacket(const PacketInfo& packet) {
-    std::lock_guard<std::mutex> lock(mutex_);
+bool PacketAnalyzer::isSampled(Shard& shard, const PacketView& packet) {
+    switch (sampling_mode_) {
+    case SamplingMode::PACKET:
+        return shard.sample_counter++ % sampling_rate_ == 0;
+    case SamplingMode::FLOW:
+        // The high half of the hash is used so that the choice does not
+        // correlate with queue selection, which uses the low bits.
+        return (flowHash(packet) >> 32) % sampling_rate_ == 0;
+    default:
+        return true;
+    }
+}
 
-    recent_packets_.push(packet);
+void PacketAnalyzer::processPacketLocked(Shard& shard, const PacketView& packet) {
+    if (!isSampled(shard, packet)) {
+        return;
+    }
 
     ConnectionKey key = createConnectionKey(packet);
 
-    auto it = connections_.find(key);
-    if (it == connections_.end()) {
-        ConnectionStats stats;
+    auto entry = shard.connections.tryEmplace(key);
+    FlowEntry& flow = *entry.first;
+    ConnectionStats& stats = flow.stats;
+
+    if (entry.second) {
+        shard.connection_count.fetch_add(1, std::memory_order_relaxed);
         stats.first_seen = packet.timestamp;
         stats.last_seen = packet.timestamp;
 
-        if (packet.source_ip == key.source_ip && packet.source_port == key.source_port) {
-            stats.packets_sent = 1;
-            stats.packets_received = 0;
-            stats.bytes_sent = packet.size;
-            stats.bytes_received = 0;
-        } else {
-            stats.packets_sent = 0;
-            stats.packets_received = 1;
-            stats.bytes_sent = 0;
-            stats.bytes_received = packet.size;
+        if (!shard.heavy_hitters) {
+            auto& source = *shard.host_traffic_stats.tryEmplace(packet.source_ip).first;
+            source.flows++;
+            source.active_flows++;
+
+            auto& dest = *shard.host_traffic_stats.tryEmplace(packet.dest_ip).first;
+            dest.flows++;
+            dest.active_flows++;
+        }
+
+        if (fanout_window_ > 0) {
+            addFanoutLocked(shard, packet);
+        }
+    }
+
+    stats.last_seen = std::max(stats.last_seen, packet.timestamp);
+    shard.clock = std::max(shard.clock, packet.timestamp);
+
+    bool forward = packet.source_ip == key.source_ip && packet.source_port == key.source_port;
+
+    bool closing = false;
+    if (packet.protocol == IPPROTO_TCP_NUMBER && packet.transportHeaderSize() >= 14) {
+        closing = updateTcpStateLocked(shard, key, flow, packet, forward);
+        uint8_t flags = packet.transportHeader()[13];
+        stats.tcp_flags |= flags;
+        (forward ? stats.tcp_flags_sent : stats.tcp_flags_received) |= flags;
+
+        if (sampling_mode_ != SamplingMode::PACKET && packet.transportHeaderSize() >= 20) {
+            trackSequenceLocked(shard, key, flow, packet, forward);
         }
+    }
+
+    // A FIN or RST shortens the idle timeout, so the flow needs an earlier
+    // timer than the one it already has.
+    if (entry.second || closing) {
+        shard.timers.schedule(key, flowDeadline(key, stats));
+    }
 
-        analyzeProtocol(packet, stats);
+    flow.window.add(packet.size, packet.timestamp / MICROSECONDS_PER_SECOND);
 
-        connections_[key] = stats;
+    if (forward) {
+        stats.packets_sent++;
+        stats.bytes_sent += packet.size;
     } else {
-        auto& stats = it->second;
-        stats.last_seen = packet.timestamp;
+        stats.packets_received++;
+        stats.bytes_received += packet.size;
+    }
+
+    if (!stats.protocol_type.has_value()) {
+        analyzeProtocol(shard, packet, flow);
+    } else if (packet.payloadSize() > 0) {
+        // Payload on a classified flow means a colliding flow took its slot
+        markClassified(packet, stats);
+    }
+
+    if (stats.protocol_type == ProtocolType::HTTP && http_max_endpoints_ > 0 &&
+        sampling_mode_ != SamplingMode::PACKET && packet.payloadSize() > 0) {
+        trackHttpLocked(shard, flow, packet, forward);
+    }
+
+    updateTopLocked(shard, key, flow);
+    addHostTrafficLocked(shard, packet);
+
+    if (!shard.groups.empty()) {
+        addGroupTrafficLocked(shard, packet, entry.second);
+    }
+}
+
+bool PacketAnalyzer::updateTcpStateLocked(Shard& shard, const ConnectionKey& key, FlowEntry& flow,
+                                          const PacketView& packet, bool forward) {
+    uint8_t flags = packet.transportHeader()[13];
+    TcpState previous = flow.stats.tcp_state;
+    TcpState state = previous;
+    bool from_initiator = ((flow.tcp_track & TCP_INITIATOR_IS_SOURCE) != 0) == forward;
+
+    if (flags & TCP_RST) {
+        shard.tcp.resets++;
+        state = TcpState::RESET;
+
+        if (!shard.heavy_hitters) {
+            if (HostCounters* sender = shard.host_traffic_stats.find(forward ? key.source_ip : key.dest_ip)) {
+                sender->resets_sent++;
+            }
+
+            if (HostCounters* receiver = shard.host_traffic_stats.find(forward ? key.dest_ip : key.source_ip)) {
+                receiver->resets_received++;
+            }
+        }
+    } else if (previous == TcpState::RESET || previous == TcpState::CLOSED) {
+        // Stragglers and port reuse do not revive a finished connection
+    } else if (flags & TCP_SYN) {
+        if (!(flags & TCP_ACK)) {
+            shard.tcp.syns++;
+        }
 
-        if (packet.source_ip == key.source_ip && packet.source_port == key.source_port) {
-            stats.packets_sent++;
-            stats.bytes_sent += packet.size;
+        if (previous == TcpState::NONE) {
+            // A flow first seen at the SYN-ACK was started by the other side
+            bool initiator_is_source = (flags & TCP_ACK) ? !forward : forward;
+            flow.tcp_track |= initiator_is_source ? TCP_INITIATOR_IS_SOURCE : 0;
+            flow.tcp_track |= (flags & TCP_ACK) ? 0 : TCP_RTT_PENDING;
+            state = (flags & TCP_ACK) ? TcpState::SYN_RECEIVED : TcpState::SYN_SENT;
+        } else if (previous == TcpState::SYN_SENT && (flags & TCP_ACK) && !from_initiator) {
+            state = TcpState::SYN_RECEIVED;
         } else {
-            stats.packets_received++;
-            stats.bytes_received += packet.size;
+            // A retransmitted SYN or SYN-ACK leaves it unclear which one the
+            // handshake completed from
+            flow.tcp_track &= ~TCP_RTT_PENDING;
         }
+    } else {
+        if (previous == TcpState::SYN_RECEIVED && from_initiator && (flags & TCP_ACK)) {
+            state = TcpState::ESTABLISHED;
+
+            if ((flow.tcp_track & TCP_RTT_PENDING) && sampling_mode_ != SamplingMode::PACKET) {
+                uint64_t rtt = packet.timestamp - std::min(packet.timestamp, flow.stats.first_seen);
+                flow.stats.rtt_us = static_cast<uint32_t>(std::min<uint64_t>(rtt, std::numeric_limits<uint32_t>::max()));
+                addRttLocked(shard, key, rtt);
+            }
+            flow.tcp_track &= ~TCP_RTT_PENDING;
+        } else if (previous == TcpState::NONE) {
+            state = TcpState::ESTABLISHED;
+        }
+
+        if (flags & TCP_FIN) {
+            flow.tcp_track |= forward ? TCP_FIN_FROM_SOURCE : TCP_FIN_FROM_DEST;
+            bool both = (flow.tcp_track & TCP_FIN_FROM_SOURCE) && (flow.tcp_track & TCP_FIN_FROM_DEST);
+            state = both ? TcpState::CLOSED : TcpState::CLOSING;
+        }
+    }
+
+    if (state == previous) {
+        return false;
+    }
+
+    if (isHalfOpen(previous) != isHalfOpen(state)) {
+        addHalfOpenLocked(shard, key, flow, isHalfOpen(state) ? 1 : -1);
+    }
+
+    flow.stats.tcp_state = state;
+
+    auto ending = [](TcpState s) { return s == TcpState::CLOSING || s == TcpState::CLOSED || s == TcpState::RESET; };
+    return !ending(previous) && ending(state);
+}
+
+void PacketAnalyzer::addHalfOpenLocked(Shard& shard, const ConnectionKey& key, const FlowEntry& flow, int64_t delta) {
+    const IpAddress& responder = (flow.tcp_track & TCP_INITIATOR_IS_SOURCE) ? key.dest_ip : key.source_ip;
+
+    if (delta > 0) {
+        (*shard.half_open.tryEmplace(responder).first)++;
+        shard.tcp.half_open++;
+        return;
+    }
+
+    uint64_t* count = shard.half_open.find(responder);
+    if (count && --*count == 0) {
+        shard.half_open.erase(responder);
+    }
+    shard.tcp.half_open--;
+}
+
+void PacketAnalyzer::trackSequenceLocked(Shard& shard, const ConnectionKey& key, FlowEntry& flow,
+                                         const PacketView& packet, bool forward) {
+    const uint8_t* header = packet.transportHeader();
+    uint8_t flags = header[13];
+    uint32_t sequence = (static_cast<uint32_t>(header[4]) << 24) | (static_cast<uint32_t>(header[5]) << 16) |
+                        (static_cast<uint32_t>(header[6]) << 8) | header[7];
+
+    size_t header_length = (header[12] >> 4) * 4;
+    uint32_t payload = packet.transport_size > header_length
+                           ? static_cast<uint32_t>(packet.transport_size - header_length)
+                           : 0;
+
+    shard.tcp.segments++;
+
+    // SYN and FIN take up one sequence number each; pure ACKs take none
+    uint32_t end = sequence + payload + ((flags & TCP_SYN) ? 1 : 0) + ((flags & TCP_FIN) ? 1 : 0);
+    if (end == sequence || (flags & TCP_RST)) {
+        return;
+    }
+
+    uint8_t seen = forward ? TCP_SEQ_FROM_SOURCE : TCP_SEQ_FROM_DEST;
+    uint32_t& next = flow.tcp_next_seq[forward ? 0 : 1];
+
+    // Sequence numbers wrap, so ordering is by signed distance
+    if (!(flow.tcp_track & seen) || static_cast<int32_t>(end - next) > 0) {
+        flow.tcp_track |= seen;
+        next = end;
+        return;
+    }
+
+    flow.stats.retransmits++;
+    shard.tcp.retransmits++;
+
+    const IpAddress& sender = forward ? key.source_ip : key.dest_ip;
+
+    if (!shard.heavy_hitters) {
+        if (HostCounters* host = shard.host_traffic_stats.find(sender)) {
+            host->retransmits++;
+        }
+    }
 
-        if (!stats.protocol_type.has_value()) {
-            analyzeProtocol(packet, stats);
+    if (!shard.groups.empty()) {
+        uint32_t group = subnet_groups_->lookup(sender);
+        if (group != SubnetGroups::NO_GROUP) {
+            shard.groups[group].retransmits++;
         }
     }
+}
+
+void PacketAnalyzer::addRttLocked(Shard& shard, const ConnectionKey& key, uint64_t rtt) {
+    shard.tcp.rtt.add(rtt);
+
+    if (!shard.heavy_hitters) {
+        for (const IpAddress* address : {&key.source_ip, &key.dest_ip}) {
+            if (HostCounters* host = shard.host_traffic_stats.find(*address)) {
+                host->rtt.add(rtt);
+            }
+        }
+    }
+
+    if (!shard.groups.empty()) {
+        uint32_t source = subnet_groups_->lookup(key.source_ip);
+        uint32_t dest = subnet_groups_->lookup(key.dest_ip);
+
+        if (source != SubnetGroups::NO_GROUP) {
+            shard.groups[source].rtt.add(rtt);
+        }
+        if (dest != SubnetGroups::NO_GROUP && dest != source) {
+            shard.groups[dest].rtt.add(rtt);
+        }
+    }
+}
+
+bool PacketAnalyzer::isHalfOpen(TcpState state) {
+    return state == TcpState::SYN_SENT || state == TcpState::SYN_RECEIVED;
+}
+
+void PacketAnalyzer::addHostTrafficLocked(Shard& shard, const PacketView& packet) {
+    if (shard.heavy_hitters) {
+        for (const IpAddress* address : {&packet.source_ip, &packet.dest_ip}) {
+            uint64_t hash = mixHash(IpAddressHash{}(*address));
+            shard.host_bytes->add(hash, packet.size);
+            shard.host_packets->add(hash);
+            shard.heavy_hitters->add(*address, packet.size);
+        }
+        return;
+    }
 
-    host_traffic_stats_[packet.source_ip] += packet.size;
-    host_traffic_stats_[packet.dest_ip] += packet.size;
+    uint64_t second = packet.timestamp / MICROSECONDS_PER_SECOND;
+
+    auto& source = *shard.host_traffic_stats.tryEmplace(packet.source_ip).first;
+    source.bytes += packet.size;
+    source.packets++;
+    source.window.add(packet.size, second);
+
+    auto& dest = *shard.host_traffic_stats.tryEmplace(packet.dest_ip).first;
+    dest.bytes += packet.size;
+    dest.packets++;
+    dest.window.add(packet.size, second);
 }
 
 std::vector<std::pair<ConnectionKey, ConnectionStats>> PacketAnalyzer::getTopConnections(size_t limit) const {
-    std::lock_guard<std::mutex> lock(mutex_);
+    if (limit <= top_k_) {
+        if (auto snapshot = readSnapshot()) {
+            size_t count = std::min(limit, snapshot->top_connections.size());
+            return {snapshot->top_connections.begin(), snapshot->top_connections.begin() + count};
+        }
+    }
 
+    return collectTopConnections(limit);
+}
+
+std::vector<std::pair<ConnectionKey, ConnectionStats>> PacketAnalyzer::collectTopConnections(size_t limit) const {
     std::vector<std::pair<ConnectionKey, ConnectionStats>> result;
-    result.reserve(connections_.size());
 
-    for (const auto& entry : connections_) {
-        result.emplace_back(entry);
+    // A flow is only ever tracked by one shard, so the shards' own rankings
+    // can simply be concatenated.
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+
+        if (limit <= top_k_) {
+            result.reserve(result.size() + shard->top.size());
+
+            for (const auto& top : shard->top) {
+                const FlowEntry* flow = shard->connections.find(top.key);
+                if (flow) {
+                    result.emplace_back(top.key, flow->stats);
+                    result.back().second.rates = readRates(flow->window, shard->clock);
+                }
+            }
+        } else {
+            result.reserve(result.size() + shard->connections.size());
+
+            for (const auto& entry : shard->connections) {
+                result.emplace_back(entry.first, entry.second.stats);
+                result.back().second.rates = readRates(entry.second.window, shard->clock);
+            }
+        }
+    }
+
+    if (result.size() > limit) {
+        std::partial_sort(result.begin(), result.begin() + limit, result.end(), compareConnectionsByTraffic);
+        result.resize(limit);
+    } else {
+        std::sort(result.begin(), result.end(), compareConnectionsByTraffic);
+    }
+
+    for (auto& entry : result) {
+        entry.second = estimate(std::move(entry.second));
+    }
+
+    return result;
+}
+
+std::unordered_map<IpAddress, PacketAnalyzer::HostCounters, IpAddressHash> PacketAnalyzer::mergeHostCounters(
+    const IpAddress* address) const {
+
+    std::unordered_map<IpAddress, HostCounters, IpAddressHash> result;
+
+    if (isHostSketchEnabled()) {
+        // Candidates are the union of the shards' heavy hitters; their
+        // figures come from the shards' Count-Min sketches.
+        if (address) {
+            result.emplace(*address, HostCounters{});
+        } else {
+            for (const auto& shard : shards_) {
+                std::lock_guard<std::mutex> lock(shard->mutex);
+                for (const auto& counter : shard->heavy_hitters->counters()) {
+                    result.emplace(counter.key, HostCounters{});
+                }
+            }
+        }
+
+        uint64_t total = 0;
+        double epsilon = 0.0;
+
+        for (const auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total += shard->host_bytes->total();
+            epsilon = shard->host_bytes->epsilon();
+
+            for (auto& entry : result) {
+                uint64_t hash = mixHash(IpAddressHash{}(entry.first));
+                entry.second.bytes += shard->host_bytes->estimate(hash);
+                entry.second.packets += shard->host_packets->estimate(hash);
+            }
+        }
+
+        for (auto& entry : result) {
+            entry.second.sketch_error = static_cast<uint64_t>(epsilon * total);
+        }
+
+        return result;
+    }
+
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+
+        if (address) {
+            const HostCounters* host = shard->host_traffic_stats.find(*address);
+            if (!host) {
+                continue;
+            }
+
+            auto& counters = result[*address];
+            counters.bytes += host->bytes;
+            counters.packets += host->packets;
+            counters.flows += host->flows;
+            counters.resets_sent += host->resets_sent;
+            counters.resets_received += host->resets_received;
+            counters.retransmits += host->retransmits;
+            counters.rtt.merge(host->rtt);
+            addRates(counters.rates, readRates(host->window, shard->clock));
+            continue;
+        }
+
+        for (const auto& entry : shard->host_traffic_stats) {
+            auto& counters = result[entry.first];
+            counters.bytes += entry.second.bytes;
+            counters.packets += entry.second.packets;
+            counters.flows += entry.second.flows;
+            counters.resets_sent += entry.second.resets_sent;
+            counters.resets_received += entry.second.resets_received;
+            counters.retransmits += entry.second.retransmits;
+            counters.rtt.merge(entry.second.rtt);
+            addRates(counters.rates, readRates(entry.second.window, shard->clock));
+        }
+    }
+
+    return result;
+}
+
+HostTrafficEstimate PacketAnalyzer::hostEstimate(const HostCounters& counters) const {
+    HostTrafficEstimate host;
+    host.bytes = counters.bytes * sampling_rate_;
+    host.packets = counters.packets * sampling_rate_;
+    host.rates = scaleRates(counters.rates, sampling_rate_);
+    host.rtt = counters.rtt;
+    host.retransmits = counters.retransmits * sampling_rate_;
+
+    // Under flow sampling the independent draws are flows, not packets
+    host.error_bound = errorBound(sampling_mode_ == SamplingMode::FLOW ? counters.flows : counters.packets);
+
+    if (counters.bytes > 0) {
+        host.error_bound += static_cast<double>(counters.sketch_error) / counters.bytes;
     }
 
-    std::sort(result.begin(), result.end(), compareConnectionsByTraffic);
+    return host;
+}
+
+std::unordered_map<IpAddress, PacketAnalyzer::HostCounters, IpAddressHash> PacketAnalyzer::hostCounters() const {
+    if (auto snapshot = readSnapshot()) {
+        return snapshot->hosts;
+    }
+
+    return mergeHostCounters();
+}
+
+std::unordered_map<IpAddress, uint64_t, IpAddressHash> PacketAnalyzer::getHostTrafficStats() const {
+    std::unordered_map<IpAddress, uint64_t, IpAddressHash> result;
+
+    for (const auto& entry : hostCounters()) {
+        result.emplace(entry.first, entry.second.bytes * sampling_rate_);
+    }
+
+    return result;
+}
+
+std::unordered_map<IpAddress, HostTrafficEstimate, IpAddressHash> PacketAnalyzer::getHostTrafficEstimates() const {
+    std::unordered_map<IpAddress, HostTrafficEstimate, IpAddressHash> result;
+
+    for (const auto& entry : hostCounters()) {
+        result.emplace(entry.first, hostEstimate(entry.second));
+    }
+
+    return result;
+}
+
+std::vector<std::pair<IpAddress, HostTrafficEstimate>> PacketAnalyzer::getTopHosts(size_t limit) const {
+    std::vector<std::pair<IpAddress, HostTrafficEstimate>> result;
+
+    for (const auto& entry : hostCounters()) {
+        result.emplace_back(entry.first, hostEstimate(entry.second));
+    }
 
+    auto larger = [](const auto& a, const auto& b) { return a.second.bytes > b.second.bytes; };
     if (result.size() > limit) {
+        std::partial_sort(result.begin(), result.begin() + limit, result.end(), larger);
         result.resize(limit);
+    } else {
+        std::sort(result.begin(), result.end(), larger);
     }
 
     return result;
 }
 
-std::unordered_map<std::string, uint64_t> PacketAnalyzer::getHostTrafficStats() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return host_traffic_stats_;
+std::optional<HostTrafficEstimate> PacketAnalyzer::getHostTraffic(const IpAddress& address) const {
+    // The snapshot only holds the heavy hitters of a sketch, but the
+    // sketch itself answers for any host.
+    if (!isHostSketchEnabled()) {
+        if (auto snapshot = readSnapshot()) {
+            auto it = snapshot->hosts.find(address);
+            if (it == snapshot->hosts.end() || it->second.bytes == 0) {
+                return std::nullopt;
+            }
+            return hostEstimate(it->second);
+        }
+    }
+
+    auto merged = mergeHostCounters(&address);
+
+    auto it = merged.find(address);
+    if (it == merged.end() || it->second.bytes == 0) {
+        return std::nullopt;
+    }
+
+    return hostEstimate(it->second);
 }
 
-std::optional<ConnectionStats> PacketAnalyzer::getConnectionStats(const ConnectionKey& key) const {
-    std::lock_guard<std::mutex> lock(mutex_);
+void PacketAnalyzer::addFanoutLocked(Shard& shard, const PacketView& packet) {
+    uint32_t* slot = shard.fanout.find(packet.source_ip);
+    if (!slot) {
+        if (shard.fanout.size() >= fanout_max_hosts_) {
+            pruneFanoutLocked(shard);
+            if (shard.fanout.size() >= fanout_max_hosts_) {
+                return;
+            }
+        }
+
+        slot = shard.fanout.tryEmplace(packet.source_ip).first;
+        if (!shard.fanout_free.empty()) {
+            *slot = shard.fanout_free.back();
+            shard.fanout_free.pop_back();
+            shard.fanout_slots[*slot].peers.clear();
+            shard.fanout_slots[*slot].ports.clear();
+        } else {
+            data::SlidingHyperLogLog sketch(FANOUT_PRECISION, fanout_window_, FANOUT_BUCKETS);
+            *slot = static_cast<uint32_t>(shard.fanout_slots.size());
+            shard.fanout_slots.push_back(FanoutCounters{sketch, sketch});
+        }
+    }
+
+    FanoutCounters& counters = shard.fanout_slots[*slot];
+    counters.peers.add(mixHash(IpAddressHash{}(packet.dest_ip)), packet.timestamp);
+
+    // Ports only mean something for TCP and UDP
+    if (packet.source_port != 0 || packet.dest_port != 0) {
+        counters.ports.add(mixHash(packet.dest_port), packet.timestamp);
+    }
+}
+
+void PacketAnalyzer::pruneFanoutLocked(Shard& shard) {
+    // A host can only go idle once per window slice, so scan at most that often
+    uint64_t span = fanout_window_ / FANOUT_BUCKETS;
+    if (shard.clock < shard.fanout_pruned + span) {
+        return;
+    }
+    shard.fanout_pruned = shard.clock;
+
+    // Erasing leaves every other entry in place, so the scan can go on
+    for (auto& entry : shard.fanout) {
+        if (shard.fanout_slots[entry.second].peers.idle(shard.clock)) {
+            shard.fanout_free.push_back(entry.second);
+            IpAddress address = entry.first;
+            shard.fanout.erase(address);
+        }
+    }
+}
+
+std::unordered_map<IpAddress, PacketAnalyzer::FanoutUnion, IpAddressHash> PacketAnalyzer::mergeFanout(
+    const IpAddress* address) const {
+
+    std::unordered_map<IpAddress, FanoutUnion, IpAddressHash> result;
+
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+
+        if (address) {
+            const uint32_t* slot = shard->fanout.find(*address);
+            if (slot && !shard->fanout_slots[*slot].peers.idle(shard->clock)) {
+                const FanoutCounters& host = shard->fanout_slots[*slot];
+                auto& counters = result[*address];
+                host.peers.mergeInto(counters.peers, shard->clock);
+                host.ports.mergeInto(counters.ports, shard->clock);
+            }
+            continue;
+        }
+
+        for (const auto& entry : shard->fanout) {
+            const FanoutCounters& host = shard->fanout_slots[entry.second];
+            if (host.peers.idle(shard->clock)) {
+                continue;
+            }
+
+            auto& counters = result[entry.first];
+            host.peers.mergeInto(counters.peers, shard->clock);
+            host.ports.mergeInto(counters.ports, shard->clock);
+        }
+    }
+
+    return result;
+}
+
+HostFanout PacketAnalyzer::fanoutEstimate(const FanoutUnion& counters) {
+    HostFanout fanout;
+    fanout.peers = counters.peers.estimate();
+    fanout.ports = counters.ports.estimate();
+    fanout.error_bound = 1.96 * counters.peers.standardError();
+    return fanout;
+}
+
+std::unordered_map<IpAddress, HostFanout, IpAddressHash> PacketAnalyzer::getFanout() const {
+    if (auto snapshot = readSnapshot()) {
+        return snapshot->fanout;
+    }
+
+    return collectFanout();
+}
+
+std::unordered_map<IpAddress, HostFanout, IpAddressHash> PacketAnalyzer::collectFanout() const {
+    std::unordered_map<IpAddress, HostFanout, IpAddressHash> result;
+
+    for (const auto& entry : mergeFanout()) {
+        result.emplace(entry.first, fanoutEstimate(entry.second));
+    }
+
+    return result;
+}
+
+std::vector<std::pair<IpAddress, HostFanout>> PacketAnalyzer::getTopFanout(size_t limit, bool by_ports) const {
+    std::vector<std::pair<IpAddress, HostFanout>> result;
+
+    for (const auto& entry : getFanout()) {
+        result.emplace_back(entry.first, entry.second);
+    }
+
+    auto larger = [by_ports](const auto& a, const auto& b) {
+        return by_ports ? a.second.ports > b.second.ports : a.second.peers > b.second.peers;
+    };
+    if (result.size() > limit) {
+        std::partial_sort(result.begin(), result.begin() + limit, result.end(), larger);
+        result.resize(limit);
+    } else {
+        std::sort(result.begin(), result.end(), larger);
+    }
+
+    return result;
+}
+
+std::optional<HostFanout> PacketAnalyzer::getHostFanout(const IpAddress& address) const {
+    if (auto snapshot = readSnapshot()) {
+        auto it = snapshot->fanout.find(address);
+        if (it == snapshot->fanout.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
 
-    auto it = connections_.find(key);
-    if (it == connections_.end()) {
+    auto merged = mergeFanout(&address);
+
+    auto it = merged.find(address);
+    if (it == merged.end()) {
         return std::nullopt;
     }
 
-    return it->second;
+    return fanoutEstimate(it->second);
 }
 
-void PacketAnalyzer::reset() {
-    std::lock_guard<std::mutex> lock(mutex_);
+TcpStats PacketAnalyzer::collectTcpStats() const {
+    TcpStats total;
 
-    connections_.clear();
-    host_traffic_stats_.clear();
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total.half_open += shard->tcp.half_open;
+        total.syns += shard->tcp.syns;
+        total.resets += shard->tcp.resets;
+        total.handshake_timeouts += shard->tcp.handshake_timeouts;
+        total.segments += shard->tcp.segments;
+        total.retransmits += shard->tcp.retransmits;
+        total.rtt.merge(shard->tcp.rtt);
+    }
+
+    return total;
 }
 
-void PacketAnalyzer::analyzeProtocol(const PacketInfo& packet, ConnectionStats& stats) {
-    for (const auto& parser : protocol_parsers_) {
-        auto protocol_data = parser->parse(packet);
-        if (protocol_data) {
-            stats.protocol_type = protocol_data->type;
-            stats.protocol_data = std::move(protocol_data);
-            break;
+std::unordered_map<IpAddress, uint64_t, IpAddressHash> PacketAnalyzer::mergeHalfOpen() const {
+    std::unordered_map<IpAddress, uint64_t, IpAddressHash> result;
+
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        for (const auto& entry : shard->half_open) {
+            result[entry.first] += entry.second;
         }
     }
+
+    return result;
+}
+
+TcpStats PacketAnalyzer::getTcpStats() const {
+    TcpStats stats;
+    if (auto snapshot = readSnapshot()) {
+        stats = snapshot->tcp;
+    } else {
+        stats = collectTcpStats();
+    }
+
+    stats.half_open *= sampling_rate_;
+    stats.syns *= sampling_rate_;
+    stats.resets *= sampling_rate_;
+    stats.handshake_timeouts *= sampling_rate_;
+    stats.segments *= sampling_rate_;
+    stats.retransmits *= sampling_rate_;
+
+    return stats;
+}
+
+std::vector<std::pair<IpAddress, HostTcpStats>> PacketAnalyzer::getTopHalfOpenHosts(size_t limit) const {
+    std::unordered_map<IpAddress, uint64_t, IpAddressHash> half_open;
+    std::unordered_map<IpAddress, HostCounters, IpAddressHash> hosts;
+
+    if (auto snapshot = readSnapshot()) {
+        half_open = snapshot->half_open;
+        hosts = snapshot->hosts;
+    } else {
+        half_open = mergeHalfOpen();
+        hosts = mergeHostCounters();
+    }
+
+    std::vector<std::pair<IpAddress, uint64_t>> ranked(half_open.begin(), half_open.end());
+    auto larger = [](const auto& a, const auto& b) { return a.second > b.second; };
+    if (ranked.size() > limit) {
+        std::partial_sort(ranked.begin(), ranked.begin() + limit, ranked.end(), larger);
+        ranked.resize(limit);
+    } else {
+        std::sort(ranked.begin(), ranked.end(), larger);
+    }
+
+    std::vector<std::pair<IpAddress, HostTcpStats>> result;
+    result.reserve(ranked.size());
+
+    for (const auto& entry : ranked) {
+        HostTcpStats host;
+        host.half_open = entry.second * sampling_rate_;
+
+        auto counters = hosts.find(entry.first);
+        if (counters != hosts.end()) {
+            host.resets_sent = counters->second.resets_sent * sampling_rate_;
+            host.resets_received = counters->second.resets_received * sampling_rate_;
+        }
+
+        result.emplace_back(entry.first, host);
+    }
+
+    return result;
+}
+
+void PacketAnalyzer::addGroupTrafficLocked(Shard& shard, const PacketView& packet, bool new_flow) {
+    uint32_t source = subnet_groups_->lookup(packet.source_ip);
+    uint32_t dest = subnet_groups_->lookup(packet.dest_ip);
+    uint64_t second = packet.timestamp / MICROSECONDS_PER_SECOND;
+
+    if (source != SubnetGroups::NO_GROUP) {
+        GroupCounters& group = shard.groups[source];
+        group.bytes_sent += packet.size;
+        group.packets_sent++;
+        group.flows += new_flow;
+        group.window.add(packet.size, second);
+    }
+
+    if (dest != SubnetGroups::NO_GROUP) {
+        GroupCounters& group = shard.groups[dest];
+        group.bytes_received += packet.size;
+        group.packets_received++;
+
+        if (dest != source) {
+            group.flows += new_flow;
+            group.window.add(packet.size, second);
+        }
+    }
+}
+
+std::vector<PacketAnalyzer::GroupCounters> PacketAnalyzer::mergeGroupCounters() const {
+    std::vector<GroupCounters> result(subnet_groups_ ? subnet_groups_->groupCount() : 0);
+
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+
+        for (size_t i = 0; i < shard->groups.size() && i < result.size(); ++i) {
+            const GroupCounters& counters = shard->groups[i];
+            result[i].bytes_sent += counters.bytes_sent;
+            result[i].bytes_received += counters.bytes_received;
+            result[i].packets_sent += counters.packets_sent;
+            result[i].packets_received += counters.packets_received;
+            result[i].flows += counters.flows;
+            result[i].retransmits += counters.retransmits;
+            result[i].rtt.merge(counters.rtt);
+            addRates(result[i].rates, readRates(counters.window, shard->clock));
+        }
+    }
+
+    return result;
+}
+
+std::vector<PacketAnalyzer::GroupCounters> PacketAnalyzer::groupCounters() const {
+    if (auto snapshot = readSnapshot()) {
+        return snapshot->groups;
+    }
+
+    return mergeGroupCounters();
+}
+
+SubnetGroupStats PacketAnalyzer::groupEstimate(uint32_t group, const GroupCounters& counters) const {
+    SubnetGroupStats stats;
+    stats.name = subnet_groups_->names()[group];
+    stats.bytes_sent = counters.bytes_sent * sampling_rate_;
+    stats.bytes_received = counters.bytes_received * sampling_rate_;
+    stats.packets_sent = counters.packets_sent * sampling_rate_;
+    stats.packets_received = counters.packets_received * sampling_rate_;
+    stats.flows = counters.flows * sampling_rate_;
+    stats.rates = scaleRates(counters.rates, sampling_rate_);
+    stats.rtt = counters.rtt;
+    stats.retransmits = counters.retransmits * sampling_rate_;
+    stats.error_bound = errorBound(sampling_mode_ == SamplingMode::FLOW
+                                       ? counters.flows
+                                       : counters.packets_sent + counters.packets_received);
+    return stats;
+}
+
+std::vector<SubnetGroupStats> PacketAnalyzer::getSubnetGroupStats() const {
+    std::vector<SubnetGroupStats> result;
+    if (!isSubnetGroupingEnabled()) {
+        return result;
+    }
+
+    auto counters = groupCounters();
+    result.reserve(counters.size());
+
+    for (size_t i = 0; i < counters.size(); ++i) {
+        result.push_back(groupEstimate(static_cast<uint32_t>(i), counters[i]));
+    }
+
+    return result;
+}
+
+std::optional<SubnetGroupStats> PacketAnalyzer::getSubnetGroupStats(const std::string& name) const {
+    if (!isSubnetGroupingEnabled()) {
+        return std::nullopt;
+    }
+
+    const auto& names = subnet_groups_->names();
+    auto it = std::find(names.begin(), names.end(), name);
+    if (it == names.end()) {
+        return std::nullopt;
+    }
+
+    uint32_t group = static_cast<uint32_t>(it - names.begin());
+    return groupEstimate(group, groupCounters()[group]);
+}
+
+void PacketAnalyzer::trackHttpLocked(Shard& shard, FlowEntry& flow, const PacketView& packet, bool forward) {
+    const uint8_t* data = packet.payload();
+    size_t size = packet.payloadSize();
+
+    // Only a request opens the exchange, and only at the start of a segment
+    if (!flow.http) {
+        auto line = HttpParser::readStartLine(data, size);
+        if (!line || !line->is_request) {
+            return;
+        }
+        flow.http = std::make_unique<HttpExchanges>();
+        flow.http->client_is_source = forward;
+    }
+
+    HttpExchanges& http = *flow.http;
+    bool from_client = http.client_is_source == forward;
+    HttpExchanges::Stream& stream = http.streams[from_client ? 0 : 1];
+    size_t offset = 0;
+
+    while (offset < size) {
+        offset += continueHttpMessage(stream, data + offset, size - offset, from_client);
+        if (offset >= size || stream.state != HttpExchanges::Stream::State::START) {
+            return;
+        }
+
+        // Responses to requests that were not seen cannot be attributed,
+        // so the server side is only parsed while one is outstanding
+        if (!from_client && http.count == 0) {
+            return;
+        }
+
+        auto line = HttpParser::readStartLine(data + offset, size - offset);
+        if (!line || line->is_request != from_client) {
+            return;
+        }
+
+        beginHttpMessageLocked(shard, http, *line, packet);
+    }
+}
+
+void PacketAnalyzer::beginHttpMessageLocked(Shard& shard, HttpExchanges& http, const HttpStartLine& line,
+                                            const PacketView& packet) {
+    using State = HttpExchanges::Stream::State;
+    HttpExchanges::Stream& client = http.streams[0];
+    HttpExchanges::Stream& server = http.streams[1];
+
+    if (line.is_request) {
+        uint32_t endpoint = httpEndpointLocked(shard, line, packet);
+        shard.http_endpoints[endpoint].requests++;
+
+        if (http.count == HTTP_MAX_PENDING) {
+            shard.http_endpoints[http.pending[http.first].endpoint].unanswered++;
+            http.first = (http.first + 1) % HTTP_MAX_PENDING;
+            http.count--;
+        }
+
+        http.pending[(http.first + http.count) % HTTP_MAX_PENDING] = {packet.timestamp, endpoint, line.is_head};
+        http.count++;
+
+        // A response of unknown length has ended if the client moved on
+        if (server.state == State::OPAQUE) {
+            server = {};
+        }
+
+        client = {};
+        client.state = State::HEADERS;
+        return;
+    }
+
+    const HttpExchanges::Request& request = http.pending[http.first];
+    HttpEndpoint& endpoint = shard.http_endpoints[request.endpoint];
+
+    int status_class = line.status_code / 100;
+    endpoint.status_classes[status_class >= 1 && status_class <= 5 ? status_class : 0]++;
+
+    server = {};
+    server.state = State::HEADERS;
+    server.no_body = request.head || status_class == 1 || line.status_code == 204 || line.status_code == 304;
+
+    // 101 Switching Protocols is the last HTTP response on the connection
+    if (status_class == 1 && line.status_code != 101) {
+        return;
+    }
+
+    endpoint.responses++;
+    endpoint.latency.add(packet.timestamp - std::min(packet.timestamp, request.timestamp));
+    http.first = (http.first + 1) % HTTP_MAX_PENDING;
+    http.count--;
+
+    if (line.status_code == 101) {
+        client.state = State::OPAQUE;
+        server.state = State::OPAQUE;
+    } else if (http.count == 0 && (client.state == State::HEADERS || client.state == State::OPAQUE)) {
+        // Once every request is answered, a request whose headers or body
+        // length were never seen has ended as well
+        client = {};
+    }
+}
+
+size_t PacketAnalyzer::continueHttpMessage(HttpExchanges::Stream& stream, const uint8_t* data, size_t size,
+                                           bool from_client) {
+    using State = HttpExchanges::Stream::State;
+    size_t offset = 0;
+
+    if (stream.state == State::HEADERS) {
+        HttpFraming framing = HttpParser::readFraming(data, size);
+        if (framing.content_length) {
+            stream.content_length = framing.content_length;
+        }
+        stream.chunked = stream.chunked || framing.chunked;
+
+        if (framing.header_end == 0) {
+            return size;
+        }
+        offset = framing.header_end;
+
+        if (stream.no_body) {
+            stream.state = State::START;
+        } else if (stream.chunked) {
+            stream.state = State::OPAQUE;
+        } else if (stream.content_length) {
+            stream.remaining = *stream.content_length;
+            stream.state = stream.remaining > 0 ? State::BODY : State::START;
+        } else {
+            // Requests without a length have no body; responses run to the close
+            stream.state = from_client ? State::START : State::OPAQUE;
+        }
+    }
+
+    if (stream.state == State::BODY) {
+        uint64_t body = std::min<uint64_t>(stream.remaining, size - offset);
+        stream.remaining -= body;
+        offset += static_cast<size_t>(body);
+        if (stream.remaining == 0) {
+            stream.state = State::START;
+        }
+    }
+
+    return stream.state == State::OPAQUE ? size : offset;
+}
+
+uint32_t PacketAnalyzer::httpEndpointLocked(Shard& shard, const HttpStartLine& request,
+                                            const PacketView& packet) const {
+    std::string host = request.host;
+    std::string path = request.uri;
+
+    // Absolute-form targets, as sent to proxies, carry the host themselves
+    size_t scheme = path.find("://");
+    if (scheme != std::string::npos && scheme < path.find('/')) {
+        size_t authority = scheme + 3;
+        size_t authority_end = path.find('/', authority);
+        if (host.empty()) {
+            host = path.substr(authority, authority_end - authority);
+        }
+        path = authority_end == std::string::npos ? "/" : path.substr(authority_end);
+    }
+
+    if (host.empty()) {
+        host = packet.dest_ip.toString();
+    }
+    std::transform(host.begin(), host.end(), host.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    path.resize(std::min(path.size(), path.find_first_of("?#")));
+
+    size_t segments = 0;
+    for (size_t i = 0; i < path.size(); ++i) {
+        if (path[i] == '/' && segments++ == http_uri_depth_) {
+            path.resize(i);
+            break;
+        }
+    }
+    if (path.empty()) {
+        path = "/";
+    }
+
+    host.resize(std::min(host.size(), HTTP_MAX_NAME_LENGTH));
+    path.resize(std::min(path.size(), HTTP_MAX_NAME_LENGTH));
+
+    std::string name = host + ' ' + path;
+    auto it = shard.http_endpoint_index.find(name);
+    if (it != shard.http_endpoint_index.end()) {
+        return it->second;
+    }
+
+    // The overflow endpoint does not count against the limit
+    if (shard.http_endpoints.size() > http_max_endpoints_) {
+        return HTTP_OTHER_ENDPOINT;
+    }
+
+    uint32_t index = static_cast<uint32_t>(shard.http_endpoints.size());
+    HttpEndpoint endpoint;
+    endpoint.host = std::move(host);
+    endpoint.path = std::move(path);
+    shard.http_endpoints.push_back(std::move(endpoint));
+    shard.http_endpoint_index.emplace(std::move(name), index);
+
+    return index;
+}
+
+void PacketAnalyzer::endHttpLocked(Shard& shard, FlowEntry& flow) {
+    if (!flow.http) {
+        return;
+    }
+
+    const HttpExchanges& http = *flow.http;
+    for (size_t i = 0; i < http.count; ++i) {
+        uint32_t endpoint = http.pending[(http.first + i) % HTTP_MAX_PENDING].endpoint;
+        shard.http_endpoints[endpoint].unanswered++;
+    }
+
+    flow.http.reset();
+}
+
+std::vector<HttpEndpoint> PacketAnalyzer::mergeHttpEndpoints() const {
+    std::unordered_map<std::string, HttpEndpoint> merged;
+
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+
+        for (const HttpEndpoint& endpoint : shard->http_endpoints) {
+            HttpEndpoint& total = merged[endpoint.host + ' ' + endpoint.path];
+            if (total.host.empty()) {
+                total.host = endpoint.host;
+                total.path = endpoint.path;
+            }
+            addHttpEndpoint(total, endpoint);
+        }
+    }
+
+    std::vector<HttpEndpoint> result;
+    result.reserve(merged.size());
+    for (auto& entry : merged) {
+        result.push_back(std::move(entry.second));
+    }
+
+    return result;
+}
+
+HttpEndpoint PacketAnalyzer::httpEstimate(HttpEndpoint endpoint) const {
+    endpoint.requests *= sampling_rate_;
+    endpoint.responses *= sampling_rate_;
+    endpoint.unanswered *= sampling_rate_;
+    for (uint64_t& count : endpoint.status_classes) {
+        count *= sampling_rate_;
+    }
+    return endpoint;
+}
+
+std::vector<HttpEndpoint> PacketAnalyzer::getHttpEndpoints(size_t limit) const {
+    std::vector<HttpEndpoint> endpoints;
+    if (!isHttpTrackingEnabled()) {
+        return endpoints;
+    }
+
+    if (auto snapshot = readSnapshot()) {
+        endpoints = snapshot->http;
+    } else {
+        endpoints = mergeHttpEndpoints();
+    }
+
+    // The overflow endpoint stays listed only once used
+    endpoints.erase(std::remove_if(endpoints.begin(), endpoints.end(),
+                                   [](const HttpEndpoint& e) { return e.requests == 0 && e.responses == 0; }),
+                    endpoints.end());
+
+    auto busier = [](const HttpEndpoint& a, const HttpEndpoint& b) { return a.requests > b.requests; };
+    if (endpoints.size() > limit) {
+        std::partial_sort(endpoints.begin(), endpoints.begin() + limit, endpoints.end(), busier);
+        endpoints.resize(limit);
+    } else {
+        std::sort(endpoints.begin(), endpoints.end(), busier);
+    }
+
+    for (HttpEndpoint& endpoint : endpoints) {
+        endpoint = httpEstimate(std::move(endpoint));
+    }
+
+    return endpoints;
+}
+
+HttpEndpoint PacketAnalyzer::getHttpTotals() const {
+    HttpEndpoint total;
+    if (!isHttpTrackingEnabled()) {
+        return total;
+    }
+
+    if (auto snapshot = readSnapshot()) {
+        for (const HttpEndpoint& endpoint : snapshot->http) {
+            addHttpEndpoint(total, endpoint);
+        }
+    } else {
+        for (const HttpEndpoint& endpoint : mergeHttpEndpoints()) {
+            addHttpEndpoint(total, endpoint);
+        }
+    }
+
+    return httpEstimate(std::move(total));
+}
+
+PacketAnalyzer::SnapshotGuard PacketAnalyzer::readSnapshot() const {
+    if (snapshot_interval_.count() == 0) {
+        return {};
+    }
+
+    return snapshot_.read();
+}
+
+void PacketAnalyzer::refreshSnapshot() {
+    if (snapshot_interval_.count() == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+
+    {
+        auto snapshot = snapshot_.read();
+        if (snapshot && std::chrono::steady_clock::now() - snapshot->taken < snapshot_interval_) {
+            return;
+        }
+    }
+
+    snapshot_.publish(buildSnapshot());
+}
+
+std::unique_ptr<PacketAnalyzer::Snapshot> PacketAnalyzer::buildSnapshot() const {
+    auto snapshot = std::make_unique<Snapshot>();
+    snapshot->taken = std::chrono::steady_clock::now();
+    snapshot->top_connections = collectTopConnections(top_k_);
+    snapshot->hosts = mergeHostCounters();
+
+    if (isFanoutTrackingEnabled()) {
+        snapshot->fanout = collectFanout();
+    }
+
+    if (isSubnetGroupingEnabled()) {
+        snapshot->groups = mergeGroupCounters();
+    }
+
+    snapshot->tcp = collectTcpStats();
+    snapshot->half_open = mergeHalfOpen();
+
+    if (isHttpTrackingEnabled()) {
+        snapshot->http = mergeHttpEndpoints();
+    }
+
+    return snapshot;
+}
+
+std::optional<ConnectionStats> PacketAnalyzer::getConnectionStats(const ConnectionKey& key) const {
+    const Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    const FlowEntry* flow = shard.connections.find(key);
+    if (!flow) {
+        return std::nullopt;
+    }
+
+    ConnectionStats stats = flow->stats;
+    stats.rates = readRates(flow->window, shard.clock);
+
+    return estimate(std::move(stats));
+}
+
+size_t PacketAnalyzer::getConnectionCount() const {
+    size_t count = 0;
+    for (const auto& shard : shards_) {
+        count += shard->connection_count.load(std::memory_order_relaxed);
+    }
+
+    return count;
+}
+
+void PacketAnalyzer::setFlowExpiredHandler(FlowExpiredHandler handler) {
+    expired_handler_ = std::move(handler);
+}
+
+void PacketAnalyzer::setFlowTimeouts(const FlowTimeouts& timeouts) {
+    timeouts_ = timeouts;
+}
+
+void PacketAnalyzer::setHostSketch(double epsilon, double delta) {
+    host_sketch_epsilon_ = epsilon;
+
+    for (auto& shard : shards_) {
+        if (epsilon > 0) {
+            shard->host_bytes = std::make_unique<data::CountMinSketch>(epsilon, delta);
+            shard->host_packets = std::make_unique<data::CountMinSketch>(epsilon, delta);
+            shard->heavy_hitters = std::make_unique<HostSummary>(static_cast<size_t>(std::ceil(1.0 / epsilon)));
+        } else {
+            shard->host_bytes.reset();
+            shard->host_packets.reset();
+            shard->heavy_hitters.reset();
+        }
+    }
+}
+
+void PacketAnalyzer::setSubnetGroups(std::shared_ptr<const SubnetGroups> groups) {
+    subnet_groups_ = std::move(groups);
+
+    for (auto& shard : shards_) {
+        shard->groups.assign(subnet_groups_ ? subnet_groups_->groupCount() : 0, GroupCounters{});
+    }
+}
+
+void PacketAnalyzer::setFanoutTracking(std::chrono::seconds window, size_t max_hosts) {
+    fanout_window_ = toMicroseconds(window);
+    fanout_max_hosts_ = max_hosts;
+
+    for (auto& shard : shards_) {
+        shard->fanout.reserve(max_hosts);
+        shard->fanout_slots.reserve(max_hosts);
+        shard->fanout_free.reserve(max_hosts);
+    }
+}
+
+void PacketAnalyzer::setHttpTracking(size_t max_endpoints, size_t uri_depth) {
+    http_max_endpoints_ = max_endpoints;
+    http_uri_depth_ = uri_depth;
+
+    for (auto& shard : shards_) {
+        shard->http_endpoints.clear();
+        shard->http_endpoint_index.clear();
+
+        if (max_endpoints > 0) {
+            shard->http_endpoints.push_back(otherHttpEndpoint());
+        }
+    }
+}
+
+void PacketAnalyzer::setSnapshotInterval(std::chrono::milliseconds interval) {
+    snapshot_interval_ = interval;
+
+    // Readers never build the snapshot, so start them off with one
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    snapshot_.publish(interval.count() > 0 ? buildSnapshot() : nullptr);
+}
+
+void PacketAnalyzer::setClassificationLimit(uint16_t packets) {
+    classify_limit_ = packets;
+}
+
+void PacketAnalyzer::setTopConnectionsTracked(size_t count) {
+    top_k_ = count;
+
+    for (auto& shard : shards_) {
+        shard->top.reserve(count);
+    }
+}
+
+void PacketAnalyzer::expireFlows(uint64_t now) {
+    std::vector<ExpiredFlow> expired;
+
+    for (auto& shard : shards_) {
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+
+            shard->clock = std::max(shard->clock, now);
+            advanceLocked(*shard, shard->clock);
+
+            if (fanout_window_ > 0) {
+                pruneFanoutLocked(*shard);
+            }
+            expired.swap(shard->expired);
+        }
+
+        deliverExpired(expired);
+    }
+}
+
+void PacketAnalyzer::flushFlows() {
+    std::vector<ExpiredFlow> expired;
+
+    for (auto& shard : shards_) {
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+
+            for (auto& entry : shard->connections) {
+                shard->expired.push_back({entry.first, std::move(entry.second.stats), FlowEndReason::FORCED_END});
+            }
+
+            clearLocked(*shard);
+            expired.swap(shard->expired);
+        }
+
+        deliverExpired(expired);
+    }
+
+    if (classified_flows_) {
+        classified_flows_->clear();
+    }
+}
+
+void PacketAnalyzer::advanceLocked(Shard& shard, uint64_t now) {
+    shard.timers.advance(now, [this, &shard, now](const ConnectionKey& key) {
+        FlowEntry* flow = shard.connections.find(key);
+        if (!flow) {
+            return;
+        }
+
+        const ConnectionStats* stats = &flow->stats;
+
+        // Timers are not moved on every packet, so a firing timer only means
+        // the flow may have expired.
+        uint64_t deadline = flowDeadline(key, *stats);
+        if (deadline > now) {
+            shard.timers.schedule(key, deadline);
+            return;
+        }
+
+        FlowEndReason reason = FlowEndReason::IDLE_TIMEOUT;
+        if (now >= stats->first_seen + toMicroseconds(timeouts_.active)) {
+            reason = FlowEndReason::ACTIVE_TIMEOUT;
+        } else if (stats->tcp_flags & (TCP_FIN | TCP_RST)) {
+            reason = FlowEndReason::END_OF_FLOW;
+        }
+
+        endFlowLocked(shard, key, *flow, reason);
+    });
+
+    // Flows that were not ranked may now belong in the top-K
+    if (shard.top_backfill || shard.top_scanning) {
+        backfillTopLocked(shard);
+    }
+}
+
+void PacketAnalyzer::endFlowLocked(Shard& shard, const ConnectionKey& key, FlowEntry& flow, FlowEndReason reason) {
+    removeTopLocked(shard, flow);
+
+    if (isHalfOpen(flow.stats.tcp_state)) {
+        addHalfOpenLocked(shard, key, flow, -1);
+        if (reason != FlowEndReason::FORCED_END) {
+            shard.tcp.handshake_timeouts++;
+        }
+    }
+
+    endHttpLocked(shard, flow);
+
+    for (const IpAddress* address : {&key.source_ip, &key.dest_ip}) {
+        HostCounters* host = shard.host_traffic_stats.find(*address);
+        if (host && --host->active_flows == 0) {
+            shard.host_traffic_stats.erase(*address);
+        }
+    }
+
+    if (classified_flows_) {
+        classified_flows_->erase(flowHash(key.source_ip, key.source_port, key.dest_ip, key.dest_port, key.protocol));
+    }
+
+    shard.expired.push_back({key, std::move(flow.stats), reason});
+    shard.connections.erase(key);
+    shard.connection_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void PacketAnalyzer::updateTopLocked(Shard& shard, const ConnectionKey& key, FlowEntry& flow) {
+    uint64_t bytes = flow.stats.bytes_sent + flow.stats.bytes_received;
+
+    // Byte counts only grow, so a tracked flow can only move away from the root
+    if (flow.top_index >= 0) {
+        shard.top[flow.top_index].bytes = bytes;
+        siftTopDown(shard, static_cast<size_t>(flow.top_index));
+        return;
+    }
+
+    if (shard.top.size() < top_k_) {
+        flow.top_index = static_cast<int32_t>(shard.top.size());
+        shard.top.push_back({key, bytes});
+        siftTopUp(shard, shard.top.size() - 1);
+        return;
+    }
+
+    if (top_k_ == 0 || bytes <= shard.top[0].bytes) {
+        return;
+    }
+
+    // Take the smallest tracked flow's place at the root
+    FlowEntry* evicted = shard.connections.find(shard.top[0].key);
+    if (evicted) {
+        evicted->top_index = -1;
+    }
+
+    shard.top[0] = {key, bytes};
+    flow.top_index = 0;
+    siftTopDown(shard, 0);
+}
+
+void PacketAnalyzer::removeTopLocked(Shard& shard, FlowEntry& flow) {
+    if (flow.top_index < 0) {
+        return;
+    }
+
+    size_t index = static_cast<size_t>(flow.top_index);
+    flow.top_index = -1;
+
+    if (index + 1 != shard.top.size()) {
+        shard.top[index] = shard.top.back();
+        shard.top.pop_back();
+        siftTopUp(shard, index);
+        siftTopDown(shard, index);
+    } else {
+        shard.top.pop_back();
+    }
+
+    shard.top_backfill = true;
+}
+
+void PacketAnalyzer::backfillTopLocked(Shard& shard) {
+    // A pass refills every slot freed before it started; slots freed during
+    // it are left to the next one. Growing the table reshuffles it, so the
+    // pass then starts over.
+    if (!shard.top_scanning || shard.top_scan_capacity != shard.connections.capacity()) {
+        shard.top_backfill = false;
+        shard.top_scanning = false;
+
+        if (shard.top.size() >= top_k_ || shard.top.size() == shard.connections.size()) {
+            return;
+        }
+
+        shard.top_scanning = true;
+        shard.top_cursor = 0;
+        shard.top_scan_capacity = shard.connections.capacity();
+    }
+
+    // Spread over batches so that expiring a ranked flow never costs a
+    // walk of the whole table on the packet path
+    shard.top_cursor = shard.connections.scan(shard.top_cursor, TOP_BACKFILL_SLOTS,
+                                              [this, &shard](const ConnectionKey& key, FlowEntry& flow) {
+        if (flow.top_index < 0) {
+            updateTopLocked(shard, key, flow);
+        }
+    });
+
+    if (shard.top_cursor >= shard.connections.capacity() || shard.top.size() == shard.connections.size()) {
+        shard.top_scanning = false;
+    }
+}
+
+void PacketAnalyzer::placeTop(Shard& shard, size_t position) {
+    FlowEntry* flow = shard.connections.find(shard.top[position].key);
+    if (flow) {
+        flow->top_index = static_cast<int32_t>(position);
+    }
+}
+
+void PacketAnalyzer::siftTopUp(Shard& shard, size_t position) {
+    while (position > 0) {
+        size_t parent = (position - 1) / 2;
+        if (shard.top[parent].bytes <= shard.top[position].bytes) {
+            break;
+        }
+        std::swap(shard.top[parent], shard.top[position]);
+        placeTop(shard, position);
+        position = parent;
+    }
+    placeTop(shard, position);
+}
+
+void PacketAnalyzer::siftTopDown(Shard& shard, size_t position) {
+    while (true) {
+        size_t smallest = position;
+        size_t left = 2 * position + 1;
+        size_t right = left + 1;
+
+        if (left < shard.top.size() && shard.top[left].bytes < shard.top[smallest].bytes) {
+            smallest = left;
+        }
+        if (right < shard.top.size() && shard.top[right].bytes < shard.top[smallest].bytes) {
+            smallest = right;
+        }
+        if (smallest == position) {
+            break;
+        }
+
+        std::swap(shard.top[smallest], shard.top[position]);
+        placeTop(shard, position);
+        position = smallest;
+    }
+    placeTop(shard, position);
+}
+
+void PacketAnalyzer::clearLocked(Shard& shard) {
+    shard.connections.clear();
+    shard.host_traffic_stats.clear();
+    shard.timers.clear();
+
+    if (shard.heavy_hitters) {
+        shard.host_bytes->clear();
+        shard.host_packets->clear();
+        shard.heavy_hitters->clear();
+    }
+
+    shard.fanout.clear();
+    shard.fanout_free.clear();
+    for (uint32_t slot = static_cast<uint32_t>(shard.fanout_slots.size()); slot > 0; --slot) {
+        shard.fanout_free.push_back(slot - 1);
+    }
+    shard.groups.assign(shard.groups.size(), GroupCounters{});
+    shard.half_open.clear();
+    shard.tcp = TcpStats{};
+
+    shard.http_endpoint_index.clear();
+    if (!shard.http_endpoints.empty()) {
+        shard.http_endpoints.assign(1, otherHttpEndpoint());
+    }
+
+    shard.top.clear();
+    shard.top_backfill = false;
+    shard.top_scanning = false;
+    shard.connection_count.store(0, std::memory_order_relaxed);
+}
+
+void PacketAnalyzer::deliverExpired(std::vector<ExpiredFlow>& expired) {
+    if (expired_handler_) {
+        for (auto& flow : expired) {
+            flow.stats = estimate(std::move(flow.stats));
+            expired_handler_(flow.key, flow.stats, flow.reason);
+        }
+    }
+
+    expired.clear();
+}
+
+uint64_t PacketAnalyzer::idleTimeout(const ConnectionKey& key, const ConnectionStats& stats) const {
+    switch (key.protocol) {
+    case IPPROTO_TCP_NUMBER:
+        if (stats.tcp_flags & (TCP_FIN | TCP_RST)) {
+            return toMicroseconds(timeouts_.tcp_closed);
+        }
+        return toMicroseconds(isHalfOpen(stats.tcp_state) ? timeouts_.tcp_half_open : timeouts_.tcp_idle);
+    case IPPROTO_UDP_NUMBER:
+        return toMicroseconds(timeouts_.udp_idle);
+    case IPPROTO_ICMP_NUMBER:
+    case IPPROTO_ICMPV6_NUMBER:
+        return toMicroseconds(timeouts_.icmp_idle);
+    default:
+        return toMicroseconds(timeouts_.other_idle);
+    }
+}
+
+uint64_t PacketAnalyzer::flowDeadline(const ConnectionKey& key, const ConnectionStats& stats) const {
+    return std::min(stats.last_seen + idleTimeout(key, stats),
+                    stats.first_seen + toMicroseconds(timeouts_.active));
+}
+
+void PacketAnalyzer::reset() {
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+
+        clearLocked(*shard);
+        shard->sample_counter = 0;
+        shard->expired.clear();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(snapshot_mutex_);
+        snapshot_.publish(snapshot_interval_.count() > 0 ? buildSnapshot() : nullptr);
+    }
+
+    if (classified_flows_) {
+        classified_flows_->clear();
+    }
+}
+
+void PacketAnalyzer::setSampling(SamplingMode mode, uint32_t rate) {
+    sampling_mode_ = rate > 1 ? mode : SamplingMode::NONE;
+    sampling_rate_ = sampling_mode_ == SamplingMode::NONE ? 1 : rate;
+}
+
+double PacketAnalyzer::errorBound(uint64_t samples) const {
+    if (sampling_rate_ <= 1 || samples == 0) {
+        return 0.0;
+    }
+
+    // Each unit is kept with probability p = 1/N, so the sampled count k is
+    // binomial and the relative standard error of N * k is sqrt((1 - p) / k).
+    double p = 1.0 / sampling_rate_;
+    return CONFIDENCE_Z * std::sqrt((1.0 - p) / static_cast<double>(samples));
+}
+
+ConnectionStats PacketAnalyzer::estimate(ConnectionStats stats) const {
+    // A flow picked by flow sampling is seen in full, so only packet
+    // sampling needs its counters scaled.
+    if (sampling_mode_ != SamplingMode::PACKET) {
+        return stats;
+    }
+
+    uint64_t samples = stats.packets_sent + stats.packets_received;
+
+    stats.packets_sent *= sampling_rate_;
+    stats.packets_received *= sampling_rate_;
+    stats.bytes_sent *= sampling_rate_;
+    stats.bytes_received *= sampling_rate_;
+    stats.rates = scaleRates(stats.rates, sampling_rate_);
+    stats.sampling_rate = sampling_rate_;
+    stats.error_bound = errorBound(samples);
+
+    return stats;
+}
+
+TrafficRates PacketAnalyzer::readRates(const data::RateWindow& window, uint64_t now) {
+    uint64_t second = now / MICROSECONDS_PER_SECOND;
+
+    auto read = [&](uint64_t seconds) {
+        auto totals = window.sum(seconds, second);
+        return TrafficRate{static_cast<double>(totals.bytes) / seconds,
+                           static_cast<double>(totals.packets) / seconds};
+    };
+
+    return TrafficRates{read(1), read(10), read(60)};
+}
+
+void PacketAnalyzer::addRates(TrafficRates& total, const TrafficRates& rates) {
+    auto add = [](TrafficRate& sum, const TrafficRate& rate) {
+        sum.bytes_per_second += rate.bytes_per_second;
+        sum.packets_per_second += rate.packets_per_second;
+    };
+
+    add(total.last_1s, rates.last_1s);
+    add(total.last_10s, rates.last_10s);
+    add(total.last_60s, rates.last_60s);
+}
+
+TrafficRates PacketAnalyzer::scaleRates(TrafficRates rates, double factor) {
+    for (TrafficRate* rate : {&rates.last_1s, &rates.last_10s, &rates.last_60s}) {
+        rate->bytes_per_second *= factor;
+        rate->packets_per_second *= factor;
+    }
+    return rates;
+}
+
+void PacketAnalyzer::setClassifiedFlowSet(std::shared_ptr<ClassifiedFlowSet> classified_flows) {
+    classified_flows_ = std::move(classified_flows);
+}
+
+void PacketAnalyzer::analyzeProtocol(Shard& shard, const PacketView& packet, FlowEntry& flow) {
+    // Handshakes and bare ACKs carry nothing to classify
+    if (packet.payloadSize() == 0) {
+        return;
+    }
+
+    ConnectionStats& stats = flow.stats;
+
+    auto protocol_data = shard.classifier->classify(packet);
+    if (protocol_data) {
+        stats.protocol_type = protocol_data->type;
+        stats.protocol_data = std::move(protocol_data);
+    } else if (classify_limit_ == 0 || ++flow.classify_attempts < classify_limit_) {
+        return;
+    } else {
+        stats.protocol_type = ProtocolType::UNKNOWN;
+    }
+
+    markClassified(packet, stats);
+}
+
+void PacketAnalyzer::markClassified(const PacketView& packet, const ConnectionStats& stats) {
+    // HTTP flows are followed past classification to pair their exchanges
+    if (classified_flows_ && !(isHttpTrackingEnabled() && stats.protocol_type == ProtocolType::HTTP)) {
+        classified_flows_->insert(flowHash(packet));
+    }
 }
 
-ConnectionKey PacketAnalyzer::createConnectionKey(const PacketInfo& packet, bool normalize) {
+ConnectionKey PacketAnalyzer::createConnectionKey(const PacketView& packet, bool normalize) {
     ConnectionKey key;
 
     if (normalize &&
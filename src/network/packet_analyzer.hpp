@@ -3,20 +3,31 @@
 #include <unordered_map>
 #include <string>
 #include <chrono>
+#include <functional>
 #include <memory>
 #include <vector>
 #include <optional>
 #include <mutex>
+#include <atomic>
+#include <array>
+#include "../core/data/count_min_sketch.hpp"
+#include "../core/data/flat_hash_map.hpp"
+#include "../core/data/hyper_log_log.hpp"
+#include "../core/data/latency_histogram.hpp"
+#include "../core/data/rate_window.hpp"
+#include "../core/data/rcu_cell.hpp"
+#include "../core/data/space_saving.hpp"
+#include "../core/data/timer_wheel.hpp"
 #include "packet_capture.hpp"
-#include "../core/data/circular_buffer.hpp"
 #include "protocol_handlers/protocol_parser.hpp"
+#include "subnet_groups.hpp"
 
 namespace netsentry {
 namespace network {
 
 struct ConnectionKey {
-    std::string source_ip;
-    std::string dest_ip;
+    IpAddress source_ip;
+    IpAddress dest_ip;
     uint16_t source_port;
     uint16_t dest_port;
     uint8_t protocol;
@@ -32,16 +43,45 @@ struct ConnectionKey {
 
 struct ConnectionKeyHash {
     size_t operator()(const ConnectionKey& key) const {
-        size_t h1 = std::hash<std::string>{}(key.source_ip);
-        size_t h2 = std::hash<std::string>{}(key.dest_ip);
-        size_t h3 = std::hash<uint16_t>{}(key.source_port);
-        size_t h4 = std::hash<uint16_t>{}(key.dest_port);
-        size_t h5 = std::hash<uint8_t>{}(key.protocol);
-
-        return h1 ^ (h2 << 1) ^ (h3 << 2) ^ (h4 << 3) ^ (h5 << 4);
+        return flowHash(key.source_ip, key.source_port, key.dest_ip, key.dest_port, key.protocol);
     }
 };
 
+enum class SamplingMode {
+    NONE,
+    // Systematic 1-in-N packet sampling
+    PACKET,
+    // Every packet of 1-in-N flows, chosen by symmetric flow hash
+    FLOW
+};
+
+struct TrafficRate {
+    double bytes_per_second{0.0};
+    double packets_per_second{0.0};
+};
+
+// Averages over the last complete 1, 10 and 60 seconds of traffic
+struct TrafficRates {
+    TrafficRate last_1s;
+    TrafficRate last_10s;
+    TrafficRate last_60s;
+};
+
+// Connection state as seen from the packets of both directions
+enum class TcpState : uint8_t {
+    // Not TCP, or no packet seen yet
+    NONE,
+    // Handshake in progress: SYN seen, then SYN-ACK
+    SYN_SENT,
+    SYN_RECEIVED,
+    // Handshake completed, or connection picked up mid-stream
+    ESTABLISHED,
+    // FIN from one side, then from both
+    CLOSING,
+    CLOSED,
+    RESET
+};
+
 struct ConnectionStats {
     uint64_t packets_sent{0};
     uint64_t packets_received{0};
@@ -51,31 +91,597 @@ struct ConnectionStats {
     uint64_t last_seen{0};
     std::optional<ProtocolType> protocol_type;
     std::shared_ptr<ProtocolData> protocol_data;
+
+    // Union of the TCP flags seen in either direction, then per direction
+    uint8_t tcp_flags{0};
+    uint8_t tcp_flags_sent{0};
+    uint8_t tcp_flags_received{0};
+    TcpState tcp_state{TcpState::NONE};
+
+    // Handshake round trip from the SYN to the ACK completing it, as seen
+    // at the capture point; zero until measured, or if the SYN or SYN-ACK
+    // was retransmitted.
+    uint32_t rtt_us{0};
+    // Segments, in either direction, that carried only sequence space
+    // already seen. Reordered segments count too.
+    uint32_t retransmits{0};
+
+    // Filled in when a live flow is read; zero in expired flow records
+    TrafficRates rates;
+
+    // When sampling, the counters above are scaled estimates and error_bound
+    // is the relative half-width of their 95% confidence interval.
+    uint32_t sampling_rate{1};
+    double error_bound{0.0};
+};
+
+struct HostTrafficEstimate {
+    uint64_t bytes{0};
+    uint64_t packets{0};
+    double error_bound{0.0};
+    // Not tracked with the host sketch enabled
+    TrafficRates rates;
+    // Handshake RTTs of flows the host took part in, and segments it
+    // retransmitted; also not tracked with the host sketch
+    data::LatencyHistogram rtt;
+    uint64_t retransmits{0};
+};
+
+// Distinct counterparts a host opened flows to within the fan-out window
+struct HostFanout {
+    uint64_t peers{0};
+    uint64_t ports{0};
+    // Relative half-width of the 95% confidence interval of both counts
+    double error_bound{0.0};
+};
+
+// Totals over all TCP flows, scaled when sampling
+struct TcpStats {
+    // Flows whose handshake has started but not completed
+    uint64_t half_open{0};
+    // Counted since the analyzer started or was reset
+    uint64_t syns{0};
+    uint64_t resets{0};
+    // Flows that expired without completing the handshake
+    uint64_t handshake_timeouts{0};
+    // Segments seen and those among them that were retransmissions
+    uint64_t segments{0};
+    uint64_t retransmits{0};
+    // Handshake RTTs, unscaled
+    data::LatencyHistogram rtt;
+};
+
+struct HostTcpStats {
+    // Half-open flows this host is the responder of
+    uint64_t half_open{0};
+    // RST packets from and to this host; not tracked with the host sketch
+    uint64_t resets_sent{0};
+    uint64_t resets_received{0};
+};
+
+// Traffic attributed to a subnet group: sent when the source address falls
+// in it, received when the destination does. Traffic within a group counts
+// as both.
+struct SubnetGroupStats {
+    std::string name;
+    uint64_t bytes_sent{0};
+    uint64_t bytes_received{0};
+    uint64_t packets_sent{0};
+    uint64_t packets_received{0};
+    // Flows started with either end in the group
+    uint64_t flows{0};
+    // Packets to or from the group, each counted once
+    TrafficRates rates;
+    double error_bound{0.0};
+    // Handshake RTTs of flows with either end in the group, and segments
+    // retransmitted from it
+    data::LatencyHistogram rtt;
+    uint64_t retransmits{0};
+};
+
+// Requests to one Host and URI prefix, paired with their responses in
+// order per connection, as HTTP/1.x answers them. Latency runs from the
+// first packet of the request to the first packet of its response, as seen
+// at the capture point.
+struct HttpEndpoint {
+    // Both "*" for the requests beyond the endpoint limit
+    std::string host;
+    std::string path;
+    uint64_t requests{0};
+    uint64_t responses{0};
+    // Requests still without a response when their flow ended, or pushed
+    // out by later ones
+    uint64_t unanswered{0};
+    // Responses by status class, 1xx to 5xx, with anything else under 0.
+    // Interim 1xx responses count here but do not answer the request.
+    std::array<uint64_t, 6> status_classes{};
+    // Unscaled when sampling
+    data::LatencyHistogram latency;
+};
+
+// Values match IPFIX flowEndReason (RFC 5102)
+enum class FlowEndReason : uint8_t {
+    IDLE_TIMEOUT = 1,
+    ACTIVE_TIMEOUT = 2,
+    END_OF_FLOW = 3,
+    FORCED_END = 4
+};
+
+struct FlowTimeouts {
+    std::chrono::seconds tcp_idle{300};
+    // Applies once a FIN or RST has been seen
+    std::chrono::seconds tcp_closed{5};
+    // Applies until the handshake completes, so that SYN floods do not fill
+    // the flow table
+    std::chrono::seconds tcp_half_open{30};
+    std::chrono::seconds udp_idle{60};
+    std::chrono::seconds icmp_idle{30};
+    std::chrono::seconds other_idle{60};
+    // Long-lived flows are ended and start over as a new record after this
+    std::chrono::seconds active{1800};
 };
 
 class PacketAnalyzer {
 public:
-    PacketAnalyzer();
+    // Packets are routed to a shard by their symmetric 5-tuple hash, so both
+    // directions of a flow land in the same shard and every flow lives in
+    // exactly one. Ingest workers that are partitioned the same way (see
+    // flowShard()) each write to their own shard and never contend; the
+    // shard lock is then only shared with readers.
+    //
+    // Each shard's flow, host and half-open tables are sized up front for
+    // expected_flows / shards entries, so new flows do not allocate until
+    // that is exceeded.
+    explicit PacketAnalyzer(size_t shard_count = 1, size_t expected_flows = 0);
+
+    void processPacket(const PacketView& packet);
 
-    void processPacket(const PacketInfo& packet);
+    // Takes each shard lock once per run of consecutive packets that map to
+    // it, which is once per batch for batches from the analysis pipeline.
+    void processBatch(const PacketBatch& batch);
 
+    // Served from the per-shard top-K sets when limit is within
+    // getTopConnectionsTracked(); larger limits scan every flow under the
+    // shard locks, even when snapshots are enabled.
     std::vector<std::pair<ConnectionKey, ConnectionStats>> getTopConnections(size_t limit) const;
 
-    std::unordered_map<std::string, uint64_t> getHostTrafficStats() const;
+    size_t getConnectionCount() const;
 
+    // With the host sketch enabled these only cover the hosts currently
+    // tracked as heavy hitters.
+    std::unordered_map<IpAddress, uint64_t, IpAddressHash> getHostTrafficStats() const;
+
+    std::unordered_map<IpAddress, HostTrafficEstimate, IpAddressHash> getHostTrafficEstimates() const;
+
+    std::vector<std::pair<IpAddress, HostTrafficEstimate>> getTopHosts(size_t limit) const;
+
+    std::optional<HostTrafficEstimate> getHostTraffic(const IpAddress& address) const;
+
+    // A single-key lookup that holds one shard lock briefly; never served
+    // from the snapshot.
     std::optional<ConnectionStats> getConnectionStats(const ConnectionKey& key) const;
 
     void reset();
 
+    // With a non-zero interval, top connections, host traffic, fan-out,
+    // subnet group, TCP and HTTP figures are read from an immutable snapshot
+    // published through an RCU cell instead of from the shards, so readers
+    // never take the locks that ingest holds. The snapshot is rebuilt on the
+    // writer side by refreshSnapshot(); results may be up to one interval
+    // (or one refreshSnapshot() period, if longer) old. Zero reads live state.
+    //
+    // Exceptions that still lock shards: getConnectionStats() (one shard,
+    // briefly), getTopConnections() with a limit above
+    // getTopConnectionsTracked() (every shard, a full scan), and the
+    // single-host lookups that fall back to the host sketch.
+    void setSnapshotInterval(std::chrono::milliseconds interval);
+
+    // Rebuilds and publishes the snapshot once the current one is at least
+    // one interval old. Meant to be called periodically by the thread that
+    // drives expiry, never by readers; a no-op with a zero interval.
+    void refreshSnapshot();
+
+    std::chrono::milliseconds getSnapshotInterval() const { return snapshot_interval_; }
+
+    using FlowExpiredHandler =
+        std::function<void(const ConnectionKey&, const ConnectionStats&, FlowEndReason)>;
+
+    // Flows are removed once they time out and handed to this handler as a
+    // final record. It is called from whichever thread advanced the clock,
+    // outside the shard lock.
+    void setFlowExpiredHandler(FlowExpiredHandler handler);
+
+    // Must be set before packets are processed.
+    void setFlowTimeouts(const FlowTimeouts& timeouts);
+
+    // Number of largest flows (by bytes) each shard keeps ranked as packets
+    // arrive. Must be set before packets are processed.
+    void setTopConnectionsTracked(size_t count);
+
+    size_t getTopConnectionsTracked() const { return top_k_; }
+
+    // Replaces the exact per-host table with fixed-memory sketches: a
+    // Count-Min sketch per shard for any host's bytes and packets, and a
+    // Space-Saving summary of 1/epsilon heavy hitters for the top hosts.
+    // Host figures then overcount by at most epsilon of all traffic, with
+    // probability 1 - delta. Must be set before packets are processed.
+    void setHostSketch(double epsilon, double delta);
+
+    bool isHostSketchEnabled() const { return host_sketch_epsilon_ > 0; }
+
+    // Counts, per host, the distinct peers and destination ports it started
+    // flows towards over a sliding window, with HyperLogLog sketches of a
+    // few KB per host instead of exact sets. Each shard tracks at most
+    // max_hosts hosts; hosts idle for a whole window are dropped. Counts
+    // cover the analyzed traffic and are not scaled when sampling. Must be
+    // set before packets are processed.
+    void setFanoutTracking(std::chrono::seconds window, size_t max_hosts);
+
+    bool isFanoutTrackingEnabled() const { return fanout_window_ > 0; }
+
+    std::unordered_map<IpAddress, HostFanout, IpAddressHash> getFanout() const;
+
+    // Hosts with the most distinct destination ports, or peers
+    std::vector<std::pair<IpAddress, HostFanout>> getTopFanout(size_t limit, bool by_ports) const;
+
+    std::optional<HostFanout> getHostFanout(const IpAddress& address) const;
+
+    // Each TCP flow follows the handshake and teardown through TcpState.
+    // Under packet sampling states are approximate, as the packets that
+    // move a flow on may not be sampled. Handshake RTTs and retransmissions
+    // need every packet of a flow, so they are only measured without
+    // sampling or with flow sampling.
+    TcpStats getTcpStats() const;
+
+    // Hosts with the most half-open connections as responder, the typical
+    // sign of a SYN flood against them
+    std::vector<std::pair<IpAddress, HostTcpStats>> getTopHalfOpenHosts(size_t limit) const;
+
+    // Attributes every analyzed packet to the groups its source and
+    // destination addresses fall in, by longest prefix match. Must be set
+    // before packets are processed.
+    void setSubnetGroups(std::shared_ptr<const SubnetGroups> groups);
+
+    bool isSubnetGroupingEnabled() const { return subnet_groups_ && subnet_groups_->groupCount() > 0; }
+
+    // Every configured group, in the order they were defined
+    std::vector<SubnetGroupStats> getSubnetGroupStats() const;
+
+    std::optional<SubnetGroupStats> getSubnetGroupStats(const std::string& name) const;
+
+    // Pairs the requests and responses of HTTP flows and aggregates them per
+    // Host and the first uri_depth segments of the path. Each shard tracks
+    // at most max_endpoints endpoints and counts further ones under a
+    // single overflow endpoint. HTTP flows then keep their payload captured
+    // when running headers-only. Needs every packet of a flow, so nothing
+    // is paired under packet sampling. Must be set before packets are
+    // processed.
+    void setHttpTracking(size_t max_endpoints, size_t uri_depth);
+
+    bool isHttpTrackingEnabled() const { return http_max_endpoints_ > 0; }
+
+    // Endpoints with the most requests first
+    std::vector<HttpEndpoint> getHttpEndpoints(size_t limit) const;
+
+    // Every endpoint added together, with an empty host and path
+    HttpEndpoint getHttpTotals() const;
+
+    // Each shard's clock follows the timestamps of the packets it analyzes;
+    // this moves idle shards forward as well. now is in packet timestamp
+    // units (microseconds since the epoch for live capture).
+    void expireFlows(uint64_t now);
+
+    // Ends every tracked flow, e.g. on shutdown.
+    void flushFlows();
+
+    size_t getShardCount() const { return shards_.size(); }
+
+    // Flows are added to this set once a protocol parser has identified them,
+    // letting a headers-only capture stop copying their payload.
+    void setClassifiedFlowSet(std::shared_ptr<ClassifiedFlowSet> classified_flows);
+
+    // A flow whose first packets with payload match no parser is marked
+    // ProtocolType::UNKNOWN after this many of them, and is neither parsed
+    // again nor has its payload captured. Zero keeps trying for the life
+    // of the flow. Must be set before packets are processed.
+    void setClassificationLimit(uint16_t packets);
+
+    uint16_t getClassificationLimit() const { return classify_limit_; }
+
+    // Only the sampled packets reach the connection tables; everything read
+    // back is scaled up by the rate. Must be set before packets are processed.
+    void setSampling(SamplingMode mode, uint32_t rate);
+
+    SamplingMode getSamplingMode() const { return sampling_mode_; }
+    uint32_t getSamplingRate() const { return sampling_rate_; }
+
+    static ConnectionKey createConnectionKey(const PacketView& packet, bool normalize = true);
+
 private:
-    std::unordered_map<ConnectionKey, ConnectionStats, ConnectionKeyHash> connections_;
-    std::unordered_map<std::string, uint64_t> host_traffic_stats_;
-    data::CircularBuffer<PacketInfo, 1000> recent_packets_;
-    std::vector<std::unique_ptr<ProtocolParser>> protocol_parsers_;
-    mutable std::mutex mutex_;
-
-    void analyzeProtocol(const PacketInfo& packet, ConnectionStats& stats);
-    ConnectionKey createConnectionKey(const PacketInfo& packet, bool normalize = true);
+    struct HostCounters {
+        uint64_t bytes{0};
+        uint64_t packets{0};
+        uint64_t flows{0};
+        uint64_t active_flows{0};
+        // Upper bound on the sketch's overcount of bytes
+        uint64_t sketch_error{0};
+        uint64_t resets_sent{0};
+        uint64_t resets_received{0};
+        uint64_t retransmits{0};
+        data::LatencyHistogram rtt;
+        // Kept per shard entry; rates holds its reading once merged
+        data::RateWindow window;
+        TrafficRates rates;
+    };
+
+    using HostSummary = data::SpaceSaving<IpAddress, IpAddressHash>;
+
+    // 256-byte registers, ~6.5% standard error
+    static constexpr uint8_t FANOUT_PRECISION = 8;
+    static constexpr size_t FANOUT_BUCKETS = 6;
+
+    struct FanoutCounters {
+        data::SlidingHyperLogLog peers;
+        data::SlidingHyperLogLog ports;
+    };
+
+    struct FanoutUnion {
+        data::HyperLogLog peers{FANOUT_PRECISION};
+        data::HyperLogLog ports{FANOUT_PRECISION};
+    };
+
+    struct GroupCounters {
+        uint64_t bytes_sent{0};
+        uint64_t bytes_received{0};
+        uint64_t packets_sent{0};
+        uint64_t packets_received{0};
+        uint64_t flows{0};
+        uint64_t retransmits{0};
+        data::LatencyHistogram rtt;
+        data::RateWindow window;
+        TrafficRates rates;
+    };
+
+    static constexpr uint8_t TCP_INITIATOR_IS_SOURCE = 0x01;
+    static constexpr uint8_t TCP_FIN_FROM_SOURCE = 0x02;
+    static constexpr uint8_t TCP_FIN_FROM_DEST = 0x04;
+    // The flow began with a SYN that has not been retransmitted
+    static constexpr uint8_t TCP_RTT_PENDING = 0x08;
+    // tcp_next_seq holds the direction's highest sequence number
+    static constexpr uint8_t TCP_SEQ_FROM_SOURCE = 0x10;
+    static constexpr uint8_t TCP_SEQ_FROM_DEST = 0x20;
+
+    static constexpr uint64_t TIMER_TICK_US = 1000000;
+    // Flow table slots the top-K refill visits per batch
+    static constexpr size_t TOP_BACKFILL_SLOTS = 1024;
+
+    // Requests a connection may have outstanding before the oldest is
+    // given up on
+    static constexpr size_t HTTP_MAX_PENDING = 8;
+    // Index of the overflow endpoint in each shard's table
+    static constexpr uint32_t HTTP_OTHER_ENDPOINT = 0;
+
+    // Requests of an HTTP flow waiting for their response, oldest first
+    struct HttpExchanges {
+        struct Request {
+            uint64_t timestamp;
+            uint32_t endpoint;
+            bool head;
+        };
+
+        // Where the next payload byte of one direction falls, so start
+        // lines are only looked for where a message can begin
+        struct Stream {
+            enum class State : uint8_t {
+                START,
+                HEADERS,
+                BODY,
+                // Chunked, read-until-close or switched protocol: the next
+                // message is not located until the other side resets it
+                OPAQUE
+            };
+
+            // Body bytes left in BODY
+            uint64_t remaining{0};
+            std::optional<uint64_t> content_length;
+            State state{State::START};
+            bool chunked{false};
+            bool no_body{false};
+        };
+
+        std::array<Request, HTTP_MAX_PENDING> pending;
+        // Client stream first
+        Stream streams[2];
+        uint8_t first{0};
+        uint8_t count{0};
+        // Direction requests travel in, known from the first one
+        bool client_is_source{true};
+    };
+
+    struct FlowEntry {
+        ConnectionStats stats;
+        // Position in the shard's top-K set, or -1
+        int32_t top_index{-1};
+        // Payload packets the classifier has failed to identify so far
+        uint16_t classify_attempts{0};
+        // TCP_* bits above
+        uint8_t tcp_track{0};
+        // End of the sequence space seen from the source, then the destination
+        uint32_t tcp_next_seq[2]{};
+        data::RateWindow window;
+        // Only for HTTP flows once a request has been seen
+        std::unique_ptr<HttpExchanges> http;
+    };
+
+    struct TopEntry {
+        ConnectionKey key;
+        uint64_t bytes;
+    };
+
+    using ConnectionTable = data::FlatHashMap<ConnectionKey, FlowEntry, ConnectionKeyHash>;
+
+    struct Snapshot {
+        std::chrono::steady_clock::time_point taken;
+        // The top_k_ largest flows, largest first, already scaled
+        std::vector<std::pair<ConnectionKey, ConnectionStats>> top_connections;
+        std::unordered_map<IpAddress, HostCounters, IpAddressHash> hosts;
+        std::unordered_map<IpAddress, HostFanout, IpAddressHash> fanout;
+        std::vector<GroupCounters> groups;
+        TcpStats tcp;
+        std::unordered_map<IpAddress, uint64_t, IpAddressHash> half_open;
+        std::vector<HttpEndpoint> http;
+    };
+
+    using SnapshotGuard = data::RcuCell<Snapshot>::ReadGuard;
+
+    struct ExpiredFlow {
+        ConnectionKey key;
+        ConnectionStats stats;
+        FlowEndReason reason;
+    };
+
+    struct Shard {
+        // A flow adds at most two hosts and one half-open responder
+        explicit Shard(size_t expected_flows)
+            : connections(expected_flows), host_traffic_stats(expected_flows), half_open(expected_flows),
+              timers(TIMER_TICK_US) {}
+
+        ConnectionTable connections;
+        data::FlatHashMap<IpAddress, HostCounters, IpAddressHash> host_traffic_stats;
+        uint64_t sample_counter{0};
+
+        // Only with the host sketch enabled, in place of host_traffic_stats
+        std::unique_ptr<data::CountMinSketch> host_bytes;
+        std::unique_ptr<data::CountMinSketch> host_packets;
+        std::unique_ptr<HostSummary> heavy_hitters;
+
+        // Hosts map to a slot in fanout_slots. Slots are recycled through
+        // fanout_free when their host goes idle, so sketches are only
+        // allocated while the pool grows towards fanout_max_hosts_.
+        data::FlatHashMap<IpAddress, uint32_t, IpAddressHash> fanout;
+        std::vector<FanoutCounters> fanout_slots;
+        std::vector<uint32_t> fanout_free;
+        uint64_t fanout_pruned{0};
+
+        // Indexed like subnet_groups_->names()
+        std::vector<GroupCounters> groups;
+
+        // Half-open flows per responder; hosts are dropped at zero. The
+        // totals are unscaled.
+        data::FlatHashMap<IpAddress, uint64_t, IpAddressHash> half_open;
+        TcpStats tcp;
+
+        // Starts with the overflow endpoint; indexed by "host path"
+        std::vector<HttpEndpoint> http_endpoints;
+        std::unordered_map<std::string, uint32_t> http_endpoint_index;
+
+        // Every tracked flow has at least one pending timer
+        data::TimerWheel<ConnectionKey> timers;
+        uint64_t clock{0};
+        std::vector<ExpiredFlow> expired;
+
+        // The top_k_ largest flows as a min-heap on bytes, positions mirrored
+        // in FlowEntry::top_index, so most packets are rejected by comparing
+        // against the root. top_backfill is set when an expired flow left a
+        // slot to refill; the refill pass then walks the flow table
+        // TOP_BACKFILL_SLOTS slots per batch from top_cursor.
+        std::vector<TopEntry> top;
+        bool top_backfill{false};
+        bool top_scanning{false};
+        size_t top_cursor{0};
+        size_t top_scan_capacity{0};
+        std::atomic<size_t> connection_count{0};
+        std::unique_ptr<ProtocolClassifier> classifier;
+        mutable std::mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::shared_ptr<ClassifiedFlowSet> classified_flows_;
+    SamplingMode sampling_mode_{SamplingMode::NONE};
+    uint32_t sampling_rate_{1};
+    FlowTimeouts timeouts_;
+    size_t top_k_{100};
+    uint16_t classify_limit_{8};
+    double host_sketch_epsilon_{0.0};
+    uint64_t fanout_window_{0};
+    size_t fanout_max_hosts_{0};
+    std::shared_ptr<const SubnetGroups> subnet_groups_;
+    size_t http_max_endpoints_{0};
+    size_t http_uri_depth_{1};
+    FlowExpiredHandler expired_handler_;
+
+    std::chrono::milliseconds snapshot_interval_{0};
+    mutable data::RcuCell<Snapshot> snapshot_;
+    // Serializes snapshot publication; neither ingest nor readers take it
+    std::mutex snapshot_mutex_;
+
+    size_t shardIndex(const PacketView& packet) const {
+        return flowShard(flowHash(packet), shards_.size());
+    }
+
+    const Shard& shardFor(const ConnectionKey& key) const {
+        uint64_t hash = flowHash(key.source_ip, key.source_port, key.dest_ip, key.dest_port, key.protocol);
+        return *shards_[flowShard(hash, shards_.size())];
+    }
+
+    SnapshotGuard readSnapshot() const;
+    std::unique_ptr<Snapshot> buildSnapshot() const;
+    std::vector<std::pair<ConnectionKey, ConnectionStats>> collectTopConnections(size_t limit) const;
+    std::unordered_map<IpAddress, HostCounters, IpAddressHash> hostCounters() const;
+    std::unordered_map<IpAddress, HostFanout, IpAddressHash> collectFanout() const;
+
+    bool isSampled(Shard& shard, const PacketView& packet);
+    double errorBound(uint64_t samples) const;
+    ConnectionStats estimate(ConnectionStats stats) const;
+    // All hosts, or only address when given
+    std::unordered_map<IpAddress, HostCounters, IpAddressHash> mergeHostCounters(const IpAddress* address = nullptr) const;
+    HostTrafficEstimate hostEstimate(const HostCounters& counters) const;
+    void addHostTrafficLocked(Shard& shard, const PacketView& packet);
+    void addFanoutLocked(Shard& shard, const PacketView& packet);
+    void pruneFanoutLocked(Shard& shard);
+    std::unordered_map<IpAddress, FanoutUnion, IpAddressHash> mergeFanout(const IpAddress* address = nullptr) const;
+    static HostFanout fanoutEstimate(const FanoutUnion& counters);
+    bool updateTcpStateLocked(Shard& shard, const ConnectionKey& key, FlowEntry& flow, const PacketView& packet,
+                              bool forward);
+    void trackSequenceLocked(Shard& shard, const ConnectionKey& key, FlowEntry& flow, const PacketView& packet,
+                             bool forward);
+    void addRttLocked(Shard& shard, const ConnectionKey& key, uint64_t rtt);
+    static void addHalfOpenLocked(Shard& shard, const ConnectionKey& key, const FlowEntry& flow, int64_t delta);
+    static bool isHalfOpen(TcpState state);
+    TcpStats collectTcpStats() const;
+    std::unordered_map<IpAddress, uint64_t, IpAddressHash> mergeHalfOpen() const;
+    void addGroupTrafficLocked(Shard& shard, const PacketView& packet, bool new_flow);
+    std::vector<GroupCounters> mergeGroupCounters() const;
+    std::vector<GroupCounters> groupCounters() const;
+    SubnetGroupStats groupEstimate(uint32_t group, const GroupCounters& counters) const;
+    void trackHttpLocked(Shard& shard, FlowEntry& flow, const PacketView& packet, bool forward);
+    uint32_t httpEndpointLocked(Shard& shard, const HttpStartLine& request, const PacketView& packet) const;
+    void beginHttpMessageLocked(Shard& shard, HttpExchanges& http, const HttpStartLine& line,
+                                const PacketView& packet);
+    static size_t continueHttpMessage(HttpExchanges::Stream& stream, const uint8_t* data, size_t size,
+                                      bool from_client);
+    static void endHttpLocked(Shard& shard, FlowEntry& flow);
+    std::vector<HttpEndpoint> mergeHttpEndpoints() const;
+    HttpEndpoint httpEstimate(HttpEndpoint endpoint) const;
+    static TrafficRates readRates(const data::RateWindow& window, uint64_t now);
+    static void addRates(TrafficRates& total, const TrafficRates& rates);
+    static TrafficRates scaleRates(TrafficRates rates, double factor);
+
+    void processPacketLocked(Shard& shard, const PacketView& packet);
+    void advanceLocked(Shard& shard, uint64_t now);
+    void endFlowLocked(Shard& shard, const ConnectionKey& key, FlowEntry& flow, FlowEndReason reason);
+    void updateTopLocked(Shard& shard, const ConnectionKey& key, FlowEntry& flow);
+    void removeTopLocked(Shard& shard, FlowEntry& flow);
+    void backfillTopLocked(Shard& shard);
+    static void siftTopUp(Shard& shard, size_t position);
+    static void siftTopDown(Shard& shard, size_t position);
+    static void placeTop(Shard& shard, size_t position);
+    static void clearLocked(Shard& shard);
+    void deliverExpired(std::vector<ExpiredFlow>& expired);
+    uint64_t idleTimeout(const ConnectionKey& key, const ConnectionStats& stats) const;
+    uint64_t flowDeadline(const ConnectionKey& key, const ConnectionStats& stats) const;
+    void analyzeProtocol(Shard& shard, const PacketView& packet, FlowEntry& flow);
+    void markClassified(const PacketView& packet, const ConnectionStats& stats);
 
     static bool compareConnectionsByTraffic(
         const std::pair<ConnectionKey, ConnectionStats>& a,
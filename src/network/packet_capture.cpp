@@ -1,8 +1,10 @@
 #include "packet_capture.hpp"
+#include "../core/utils/logger.hpp"
 #include <chrono>
 #include <cstring>
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -18,52 +20,278 @@
 #include <arpa/inet.h>
 #endif
 
+#include "capture_file.hpp"
+
+#ifdef __linux__
+#include "tpacket_ring.hpp"
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
 namespace netsentry {
 namespace network {
 
 class PacketCapture::Impl {
 public:
-    Impl() : pcap_handle_(nullptr) {}
+    Impl() : pcap_handle_(nullptr), buffer_pool_(CaptureBufferPool::create()) {}
     ~Impl() {
-        if (pcap_handle_) {
-            pcap_close(pcap_handle_);
-        }
+        close();
     }
 
-    CaptureError openInterface(const std::string& interface_name) {
+    CaptureError openInterface(const std::string& interface_name, const CaptureOptions& options) {
+        backend_ = options.backend;
+        link_type_ = DLT_EN10MB;
+        snaplen_ = static_cast<int>(std::min<uint64_t>(
+            65535, static_cast<uint64_t>(CaptureOptions::HEADER_SNAPLEN) + options.payload_max_size));
+        payload_max_size_ = options.payload_max_size;
+        trim_classified_ = !options.capture_payload;
+        classified_flows_ = options.classified_flows;
+        applied_filter_generation_ = 0;
+        file_filter_.reset();
+        kernel_received_ = 0;
+        kernel_dropped_ = 0;
+        interface_dropped_ = 0;
+        pin_workers_ = options.pin_fanout_workers;
+        batch_size_ = std::max<size_t>(1, options.batch_size);
+
+        // Fan-out needs one AF_PACKET socket per worker, which libpcap does
+        // not expose, so it always runs on TPACKET_V3 rings.
+        if (options.fanout_workers > 0) {
+            backend_ = CaptureBackend::TPACKET_V3;
+        }
+
+        if (backend_ == CaptureBackend::FILE) {
+            replay_speed_ = std::max(0.0, options.replay_speed);
+            replay_started_ = false;
+            has_pending_frame_ = false;
+
+            auto error = file_reader_.open(interface_name);
+            if (error == CaptureError::NONE) {
+                pcap_batch_.packets.resize(batch_size_);
+            }
+            return error;
+        }
+
+        if (backend_ == CaptureBackend::TPACKET_V3) {
+#ifdef __linux__
+            RingConfig config;
+            config.block_size = options.ring_block_size;
+            config.block_count = options.ring_block_count;
+            config.frame_size = options.ring_frame_size;
+            config.block_timeout_ms = options.ring_block_timeout_ms;
+
+            // Each ring attaches the filter before binding, so no frame
+            // reaches it unfiltered; startCapture() then records it as the
+            // current filter.
+            CaptureError status = CaptureError::NONE;
+            auto filter = compileFilter(options.filter, nullptr, status);
+            if (!filter) {
+                return status;
+            }
+            config.filter = ringFilter(*filter);
+            config.filter_length = ringFilterLength(*filter, options.filter);
+
+            size_t queue_count = 1;
+            if (options.fanout_workers > 0) {
+                queue_count = options.fanout_workers;
+                config.fanout_type = toFanoutType(options.fanout_mode);
+                config.fanout_group = options.fanout_group != 0
+                    ? options.fanout_group
+                    : static_cast<uint16_t>(getpid() & 0xFFFF);
+            }
+
+            for (size_t i = 0; i < queue_count; ++i) {
+                auto queue = std::make_unique<RingQueue>();
+                queue->batch.packets.resize(batch_size_);
+                auto error = queue->ring.open(interface_name, config);
+                if (error != CaptureError::NONE) {
+                    close();
+                    return error;
+                }
+                rings_.push_back(std::move(queue));
+            }
+
+            return CaptureError::NONE;
+#else
+            return CaptureError::SYSTEM_ERROR;
+#endif
+        }
+
         char errbuf[PCAP_ERRBUF_SIZE];
 
-        pcap_handle_ = pcap_open_live(interface_name.c_str(), 65536, 1, 1000, errbuf);
+        pcap_handle_ = pcap_create(interface_name.c_str(), errbuf);
         if (!pcap_handle_) {
-            if (strstr(errbuf, "permission")) {
-                return CaptureError::PERMISSION_DENIED;
-            } else if (strstr(errbuf, "exist") || strstr(errbuf, "found")) {
-                return CaptureError::INTERFACE_NOT_FOUND;
-            } else {
+            return CaptureError::INTERFACE_NOT_FOUND;
+        }
+
+        pcap_set_snaplen(pcap_handle_, snaplen_);
+        pcap_set_promisc(pcap_handle_, 1);
+        pcap_set_timeout(pcap_handle_, static_cast<int>(std::max<uint32_t>(1, options.read_timeout_ms)));
+        if (options.buffer_size_kb > 0) {
+            pcap_set_buffer_size(pcap_handle_, static_cast<int>(options.buffer_size_kb) * 1024);
+        }
+
+        int status = pcap_activate(pcap_handle_);
+        if (status < 0) {
+            pcap_close(pcap_handle_);
+            pcap_handle_ = nullptr;
+
+            switch (status) {
+                case PCAP_ERROR_PERM_DENIED:
+                    return CaptureError::PERMISSION_DENIED;
+                case PCAP_ERROR_NO_SUCH_DEVICE:
+                    return CaptureError::INTERFACE_NOT_FOUND;
+                default:
+                    return CaptureError::SYSTEM_ERROR;
+            }
+        }
+
+        link_type_ = pcap_datalink(pcap_handle_);
+        snaplen_ = pcap_snapshot(pcap_handle_);
+        pcap_batch_.packets.resize(batch_size_);
+
+        return CaptureError::NONE;
+    }
+
+    // Compiles expression against the link type of the open source. Ring
+    // sockets get the program attached straight away; the libpcap handle and
+    // the file reader are not thread-safe, so their capture thread picks the
+    // new program up before its next read (see refreshFilter()).
+    CaptureError setFilter(const std::string& expression, std::string* error) {
+        std::lock_guard<std::mutex> lock(filter_mutex_);
+
+        CaptureError status = CaptureError::NONE;
+        auto compiled = compileFilter(expression, error, status);
+        if (!compiled) {
+            return status;
+        }
+
+#ifdef __linux__
+        uint16_t count = ringFilterLength(*compiled, expression);
+
+        for (size_t i = 0; i < rings_.size(); ++i) {
+            if (!rings_[i]->ring.setFilter(ringFilter(*compiled), count)) {
+                if (error) {
+                    *error = strerror(errno);
+                }
+
+                // Every ring keeps filtering on the expression getFilter() reports
+                restoreRingFilters(i);
                 return CaptureError::SYSTEM_ERROR;
             }
         }
+#endif
+
+        filter_ = std::move(compiled);
+        filter_expression_ = expression;
+        filter_error_.clear();
+        filter_generation_.fetch_add(1, std::memory_order_release);
 
         return CaptureError::NONE;
     }
 
-    PacketInfo capturePacket() {
-        struct pcap_pkthdr* header;
-        const u_char* packet_data;
-        int result = pcap_next_ex(pcap_handle_, &header, &packet_data);
+    std::string getFilter() const {
+        std::lock_guard<std::mutex> lock(filter_mutex_);
+        return filter_expression_;
+    }
+
+    std::string getFilterError() const {
+        std::lock_guard<std::mutex> lock(filter_mutex_);
+        return filter_error_;
+    }
 
-        PacketInfo packet;
-        if (result <= 0) {
-            return packet;
+    void fillKernelStats(CaptureStats& stats) const {
+        stats.kernel_received = kernel_received_.load(std::memory_order_relaxed);
+        stats.kernel_dropped = kernel_dropped_.load(std::memory_order_relaxed);
+        stats.interface_dropped = interface_dropped_.load(std::memory_order_relaxed);
+    }
+
+    size_t getQueueCount() const {
+        if (backend_ == CaptureBackend::FILE) {
+            return 1;
         }
 
-        packet.timestamp = static_cast<uint64_t>(header->ts.tv_sec) * 1000000 + header->ts.tv_usec;
-        packet.size = header->len;
-        packet.data.assign(packet_data, packet_data + header->caplen);
+#ifdef __linux__
+        if (backend_ == CaptureBackend::TPACKET_V3) {
+            return rings_.size();
+        }
+#endif
+        return 1;
+    }
+
+    // Pins the calling capture worker to one CPU so its socket, ring and
+    // analyzer shard stay in that core's cache.
+    void pinWorker(size_t queue) {
+#ifdef __linux__
+        if (!pin_workers_ || getQueueCount() < 2) {
+            return;
+        }
 
-        parsePacket(packet, packet_data, header->caplen);
+        unsigned int cpu_count = std::max(1u, std::thread::hardware_concurrency());
 
-        return packet;
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(queue % cpu_count, &cpu_set);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+#else
+        (void)queue;
+#endif
+    }
+
+    // Waits for the next pcap_dispatch() round, the next retired ring block
+    // (TPACKET_V3) or the next due frames of a replayed file and hands them
+    // to on_batch in batches of up to batch_size packets. Frames are copied
+    // once into a pooled CaptureBuffer slab and the batch slots are reused,
+    // so steady-state capture performs no heap allocation per packet.
+    // Returns false once an offline source is exhausted.
+    template <typename F>
+    bool capture(size_t queue, F&& on_batch) {
+        if (backend_ != CaptureBackend::TPACKET_V3) {
+            refreshFilter();
+        }
+
+        if (backend_ == CaptureBackend::FILE) {
+            return replayFile(on_batch);
+        }
+
+#ifdef __linux__
+        if (backend_ == CaptureBackend::TPACKET_V3) {
+            auto& ring_queue = *rings_[queue];
+            pollRingStats(ring_queue);
+
+            if (!ring_queue.ring.waitForBlock(RING_POLL_TIMEOUT_MS)) {
+                return true;
+            }
+
+            BatchBuffer& batch = ring_queue.batch;
+            ring_queue.ring.consumeBlock([this, &batch, queue, &on_batch](const TpacketRing::Frame& frame) {
+                PacketView& packet = fillPacket(batch, frame.data, frame.caplen, frame.len, frame.timestamp);
+                packet.queue_id = static_cast<uint16_t>(queue);
+
+                if (batch.count == batch.packets.size()) {
+                    flushBatch(batch, on_batch);
+                }
+            });
+
+            flushBatch(batch, on_batch);
+            return true;
+        }
+#endif
+
+        (void)queue;
+
+        pollPcapStats();
+
+        DispatchContext context{this, &pcap_batch_};
+        int result = pcap_dispatch(pcap_handle_, static_cast<int>(pcap_batch_.packets.size()),
+                                   &Impl::onPcapPacket, reinterpret_cast<u_char*>(&context));
+
+        if (result > 0) {
+            flushBatch(pcap_batch_, on_batch);
+        }
+
+        return true;
     }
 
     void close() {
@@ -71,45 +299,442 @@ public:
             pcap_close(pcap_handle_);
             pcap_handle_ = nullptr;
         }
+
+#ifdef __linux__
+        rings_.clear();
+#endif
+
+        file_reader_.close();
     }
 
 private:
+    static constexpr int RING_POLL_TIMEOUT_MS = 100;
+
+    struct BatchBuffer {
+        std::vector<PacketView> packets;
+        size_t count{0};
+        BufferRef slab;
+    };
+
+    struct DispatchContext {
+        Impl* impl;
+        BatchBuffer* batch;
+    };
+
+    struct CompiledFilter {
+        bpf_program program{};
+
+        ~CompiledFilter() {
+            pcap_freecode(&program);
+        }
+    };
+
+    std::shared_ptr<CompiledFilter> compileFilter(const std::string& expression, std::string* error,
+                                                  CaptureError& status) const {
+        pcap_t* compiler = pcap_open_dead(link_type_, snaplen_);
+        if (!compiler) {
+            status = CaptureError::SYSTEM_ERROR;
+            return nullptr;
+        }
+
+        auto compiled = std::make_shared<CompiledFilter>();
+        if (pcap_compile(compiler, &compiled->program, expression.c_str(), 1, PCAP_NETMASK_UNKNOWN) < 0) {
+            if (error) {
+                *error = pcap_geterr(compiler);
+            }
+            pcap_close(compiler);
+            status = CaptureError::INVALID_FILTER;
+            return nullptr;
+        }
+        pcap_close(compiler);
+
+        return compiled;
+    }
+
+#ifdef __linux__
+    // bpf_insn and sock_filter share the same layout.
+    static const sock_filter* ringFilter(const CompiledFilter& compiled) {
+        return reinterpret_cast<const sock_filter*>(compiled.program.bf_insns);
+    }
+
+    // The program's return value is the snaplen, so even an empty expression
+    // is attached when the snaplen needs enforcing; rings have no other way
+    // to truncate.
+    uint16_t ringFilterLength(const CompiledFilter& compiled, const std::string& expression) const {
+        return expression.empty() && snaplen_ >= 65535 ? 0 : static_cast<uint16_t>(compiled.program.bf_len);
+    }
+
+    // Reattaches the current program to the first count rings after a
+    // failed update. Called with filter_mutex_ held.
+    void restoreRingFilters(size_t count) {
+        if (!filter_) {
+            return;
+        }
+
+        uint16_t length = ringFilterLength(*filter_, filter_expression_);
+        for (size_t i = 0; i < count; ++i) {
+            if (!rings_[i]->ring.setFilter(ringFilter(*filter_), length)) {
+                filter_error_ = std::string("Failed to restore the filter on queue ") + std::to_string(i) +
+                                ": " + strerror(errno);
+                LOG_ERROR("%s", filter_error_.c_str());
+            }
+        }
+    }
+#endif
+
     pcap_t* pcap_handle_;
+    std::shared_ptr<CaptureBufferPool> buffer_pool_;
+    CaptureBackend backend_{CaptureBackend::PCAP};
+    bool pin_workers_{true};
+    size_t batch_size_{64};
+    BatchBuffer pcap_batch_;
+
+    int link_type_{DLT_EN10MB};
+    int snaplen_{65535};
+    uint32_t payload_max_size_{65535};
+    bool trim_classified_{false};
+    std::shared_ptr<ClassifiedFlowSet> classified_flows_;
+    mutable std::mutex filter_mutex_;
+    std::shared_ptr<CompiledFilter> filter_;
+    std::string filter_expression_;
+    // Why the last update did not take effect, if it did not
+    std::string filter_error_;
+    std::atomic<uint64_t> filter_generation_{0};
+
+    // Owned by the single libpcap/file capture thread
+    uint64_t applied_filter_generation_{0};
+    std::shared_ptr<CompiledFilter> file_filter_;
+    // What the libpcap handle filters on, under filter_mutex_
+    std::shared_ptr<CompiledFilter> applied_filter_;
+    std::string applied_expression_;
+
+    void refreshFilter() {
+        if (filter_generation_.load(std::memory_order_acquire) == applied_filter_generation_) {
+            return;
+        }
 
-    void parsePacket(PacketInfo& packet, const u_char* packet_data, size_t len) {
-        if (len < 14) {
+        std::lock_guard<std::mutex> lock(filter_mutex_);
+        applied_filter_generation_ = filter_generation_.load(std::memory_order_relaxed);
+
+        if (backend_ == CaptureBackend::FILE) {
+            file_filter_ = filter_expression_.empty() ? nullptr : filter_;
+        } else if (pcap_handle_ && filter_) {
+            if (pcap_setfilter(pcap_handle_, &filter_->program) < 0) {
+                // libpcap keeps the previous program, so report that one
+                filter_error_ = std::string("Failed to apply '") + filter_expression_ + "': " +
+                                pcap_geterr(pcap_handle_);
+                LOG_ERROR("Capture filter: %s", filter_error_.c_str());
+
+                filter_ = applied_filter_;
+                filter_expression_ = applied_expression_;
+            } else {
+                applied_filter_ = filter_;
+                applied_expression_ = filter_expression_;
+            }
+        }
+    }
+
+    // Kernel counters are read by the capture threads themselves: libpcap
+    // handles are not thread-safe and PACKET_STATISTICS resets on read.
+    static constexpr std::chrono::seconds STATS_INTERVAL{1};
+
+    std::atomic<uint64_t> kernel_received_{0};
+    std::atomic<uint64_t> kernel_dropped_{0};
+    std::atomic<uint64_t> interface_dropped_{0};
+    std::chrono::steady_clock::time_point last_pcap_stats_;
+
+    void pollPcapStats() {
+        auto now = std::chrono::steady_clock::now();
+        if (!pcap_handle_ || now - last_pcap_stats_ < STATS_INTERVAL) {
+            return;
+        }
+        last_pcap_stats_ = now;
+
+        pcap_stat stats;
+        if (pcap_stats(pcap_handle_, &stats) == 0) {
+            kernel_received_.store(stats.ps_recv, std::memory_order_relaxed);
+            kernel_dropped_.store(stats.ps_drop, std::memory_order_relaxed);
+            interface_dropped_.store(stats.ps_ifdrop, std::memory_order_relaxed);
+        }
+    }
+
+    CaptureFileReader file_reader_;
+    double replay_speed_{1.0};
+    bool replay_started_{false};
+    uint64_t replay_first_timestamp_{0};
+    std::chrono::steady_clock::time_point replay_start_time_;
+    CaptureFileReader::Frame pending_frame_{};
+    bool has_pending_frame_{false};
+
+    // Reads up to one batch of frames from the capture file. When pacing,
+    // a frame that is not yet due is kept pending and the call sleeps for at
+    // most RING_POLL_TIMEOUT_MS, so stopCapture() is never held up by long
+    // gaps in the trace.
+    template <typename F>
+    bool replayFile(F& on_batch) {
+        while (pcap_batch_.count < pcap_batch_.packets.size()) {
+            if (!has_pending_frame_) {
+                if (!file_reader_.next(pending_frame_)) {
+                    flushBatch(pcap_batch_, on_batch);
+                    return false;
+                }
+                has_pending_frame_ = true;
+
+                if (file_filter_ && !matchesFileFilter(pending_frame_)) {
+                    has_pending_frame_ = false;
+                    continue;
+                }
+            }
+
+            if (replay_speed_ > 0.0) {
+                auto now = std::chrono::steady_clock::now();
+
+                if (!replay_started_) {
+                    replay_started_ = true;
+                    replay_first_timestamp_ = pending_frame_.timestamp;
+                    replay_start_time_ = now;
+                }
+
+                uint64_t offset_us = pending_frame_.timestamp > replay_first_timestamp_
+                    ? pending_frame_.timestamp - replay_first_timestamp_ : 0;
+                auto due = replay_start_time_ + std::chrono::microseconds(
+                    static_cast<int64_t>(static_cast<double>(offset_us) / replay_speed_));
+
+                if (due > now) {
+                    flushBatch(pcap_batch_, on_batch);
+                    std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+                        due - now, std::chrono::milliseconds(RING_POLL_TIMEOUT_MS)));
+                    return true;
+                }
+            }
+
+            fillPacket(pcap_batch_, pending_frame_.data, pending_frame_.caplen,
+                       pending_frame_.len, pending_frame_.timestamp);
+            has_pending_frame_ = false;
+        }
+
+        flushBatch(pcap_batch_, on_batch);
+        return true;
+    }
+
+    bool matchesFileFilter(const CaptureFileReader::Frame& frame) const {
+        pcap_pkthdr header;
+        header.ts.tv_sec = static_cast<time_t>(frame.timestamp / 1000000);
+        header.ts.tv_usec = static_cast<suseconds_t>(frame.timestamp % 1000000);
+        header.caplen = frame.caplen;
+        header.len = frame.len;
+
+        return pcap_offline_filter(&file_filter_->program, &header, frame.data) != 0;
+    }
+
+#ifdef __linux__
+    struct RingQueue {
+        TpacketRing ring;
+        BatchBuffer batch;
+        std::chrono::steady_clock::time_point last_stats;
+    };
+
+    void pollRingStats(RingQueue& ring_queue) {
+        auto now = std::chrono::steady_clock::now();
+        if (now - ring_queue.last_stats < STATS_INTERVAL) {
+            return;
+        }
+        ring_queue.last_stats = now;
+
+        uint64_t received = 0;
+        uint64_t dropped = 0;
+        if (ring_queue.ring.readStatistics(received, dropped)) {
+            kernel_received_.fetch_add(received, std::memory_order_relaxed);
+            kernel_dropped_.fetch_add(dropped, std::memory_order_relaxed);
+        }
+    }
+
+    std::vector<std::unique_ptr<RingQueue>> rings_;
+
+    static int toFanoutType(FanoutMode mode) {
+        switch (mode) {
+            case FanoutMode::CPU:
+                return PACKET_FANOUT_CPU;
+            case FanoutMode::ROLLOVER:
+                return PACKET_FANOUT_ROLLOVER;
+            case FanoutMode::HASH:
+            default:
+                // The kernel flow hash is symmetric, so both directions of a
+                // flow land on the same queue; DEFRAG keeps fragments together.
+                return PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG;
+        }
+    }
+#endif
+
+    static void onPcapPacket(u_char* user, const struct pcap_pkthdr* header, const u_char* packet_data) {
+        auto* context = reinterpret_cast<DispatchContext*>(user);
+        BatchBuffer& batch = *context->batch;
+
+        if (batch.count == batch.packets.size()) {
             return;
         }
 
-        const u_char* ip_header = packet_data + 14;
-        size_t ip_header_len = (ip_header[0] & 0x0F) * 4;
+        context->impl->fillPacket(batch, packet_data, header->caplen, header->len,
+                                  static_cast<uint64_t>(header->ts.tv_sec) * 1000000 + header->ts.tv_usec);
+    }
 
-        if (len < 14 + ip_header_len) {
+    template <typename F>
+    static void flushBatch(BatchBuffer& batch, F& on_batch) {
+        if (batch.count == 0) {
             return;
         }
 
-        packet.protocol = ip_header[9];
+        on_batch(PacketBatch{batch.packets.data(), batch.count});
+        batch.count = 0;
+    }
+
+    // Claims the next slot of the batch, copies the frame into the batch's
+    // current slab (starting a new one when it is full) and decodes headers.
+    // Headers are parsed in place first so that only the bytes worth keeping
+    // are copied: up to payload_max_size of payload, or none at all for flows
+    // the analyzer has already classified when running headers-only.
+    PacketView& fillPacket(BatchBuffer& batch, const u_char* frame, size_t caplen, size_t len, uint64_t timestamp) {
+        caplen = std::min({caplen, static_cast<size_t>(snaplen_), CaptureBuffer::capacity()});
+
+        PacketView& packet = batch.packets[batch.count++];
+        packet.data = frame;
+        packet.caplen = static_cast<uint32_t>(caplen);
+        packet.size = static_cast<uint32_t>(len);
+        packet.timestamp = timestamp;
+        packet.source_ip = IpAddress();
+        packet.dest_ip = IpAddress();
+        packet.source_port = 0;
+        packet.dest_port = 0;
+        packet.protocol = 0;
+        packet.queue_id = 0;
+
+        parsePacket(packet);
+
+        size_t keep = std::min<size_t>(caplen, static_cast<size_t>(packet.payload_offset) + payload_max_size_);
+        if (trim_classified_ && (!classified_flows_ || classified_flows_->contains(flowHash(packet)))) {
+            keep = packet.payload_offset;
+        }
+
+        const uint8_t* data = batch.slab ? batch.slab->append(frame, keep) : nullptr;
+        if (!data) {
+            batch.slab = buffer_pool_->acquire();
+            data = batch.slab->append(frame, keep);
+        }
+
+        packet.data = data;
+        packet.caplen = static_cast<uint32_t>(keep);
+        packet.buffer = batch.slab;
+
+        return packet;
+    }
+
+    static uint16_t readU16(const uint8_t* p) {
+        return static_cast<uint16_t>((p[0] << 8) | p[1]);
+    }
+
+    static void parsePacket(PacketView& packet) {
+        const uint8_t* frame = packet.data;
+        const size_t len = packet.caplen;
+
+        packet.l4_offset = static_cast<uint32_t>(len);
+        packet.payload_offset = static_cast<uint32_t>(len);
+        packet.transport_size = 0;
+
+        if (len < 14) {
+            return;
+        }
+
+        size_t offset = 14;
+        uint16_t ether_type = readU16(frame + 12);
+
+        // 802.1Q / 802.1ad tags
+        while ((ether_type == 0x8100 || ether_type == 0x88A8) && len >= offset + 4) {
+            ether_type = readU16(frame + offset + 2);
+            offset += 4;
+        }
+
+        size_t l4 = 0;
+        size_t ip_end = 0;
+
+        if (ether_type == 0x0800) {
+            if (len < offset + 20) {
+                return;
+            }
+
+            const uint8_t* ip_header = frame + offset;
+            size_t ip_header_len = (ip_header[0] & 0x0F) * 4;
+
+            if (ip_header_len < 20 || len < offset + ip_header_len) {
+                return;
+            }
+
+            packet.protocol = ip_header[9];
+            packet.source_ip = IpAddress::fromV4(ip_header + 12);
+            packet.dest_ip = IpAddress::fromV4(ip_header + 16);
 
-        struct in_addr src_addr, dst_addr;
-        memcpy(&src_addr, ip_header + 12, 4);
-        memcpy(&dst_addr, ip_header + 16, 4);
+            // Non-first fragments carry no transport header
+            if ((readU16(ip_header + 6) & 0x1FFF) != 0) {
+                return;
+            }
 
-        packet.source_ip = inet_ntoa(src_addr);
-        char dst_ip[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &dst_addr, dst_ip, INET_ADDRSTRLEN);
-        packet.dest_ip = dst_ip;
+            l4 = offset + ip_header_len;
+            ip_end = offset + readU16(ip_header + 2);
+        } else if (ether_type == 0x86DD) {
+            if (len < offset + 40) {
+                return;
+            }
 
-        const u_char* transport_header = ip_header + ip_header_len;
+            const uint8_t* ip_header = frame + offset;
+            uint8_t next_header = ip_header[6];
+            packet.source_ip = IpAddress::fromV6(ip_header + 8);
+            packet.dest_ip = IpAddress::fromV6(ip_header + 24);
+
+            l4 = offset + 40;
+            ip_end = l4 + readU16(ip_header + 4);
+
+            // Skip hop-by-hop, routing, fragment and destination options headers
+            while ((next_header == 0 || next_header == 43 || next_header == 44 || next_header == 60) &&
+                   len >= l4 + 8) {
+                // Non-first fragments carry no transport header
+                if (next_header == 44 && (readU16(frame + l4 + 2) & 0xFFF8) != 0) {
+                    packet.protocol = frame[l4];
+                    return;
+                }
+
+                size_t ext_len = next_header == 44 ? 8 : (static_cast<size_t>(frame[l4 + 1]) + 1) * 8;
+                next_header = frame[l4];
+                l4 += ext_len;
+            }
 
-        if (packet.protocol == IPPROTO_TCP && len >= 14 + ip_header_len + 20) {
-            packet.source_port = ntohs(*reinterpret_cast<const uint16_t*>(transport_header));
-            packet.dest_port = ntohs(*reinterpret_cast<const uint16_t*>(transport_header + 2));
-        } else if (packet.protocol == IPPROTO_UDP && len >= 14 + ip_header_len + 8) {
-            packet.source_port = ntohs(*reinterpret_cast<const uint16_t*>(transport_header));
-            packet.dest_port = ntohs(*reinterpret_cast<const uint16_t*>(transport_header + 2));
+            packet.protocol = next_header;
+
+            if (l4 > len) {
+                return;
+            }
         } else {
-            packet.source_port = 0;
-            packet.dest_port = 0;
+            return;
+        }
+
+        const uint8_t* transport_header = frame + l4;
+        packet.l4_offset = static_cast<uint32_t>(l4);
+
+        // Segmentation offload can leave the IP length zero
+        if (ip_end > l4) {
+            packet.transport_size = static_cast<uint32_t>(ip_end - l4);
+        }
+
+        if (packet.protocol == IPPROTO_TCP && len >= l4 + 20) {
+            packet.source_port = readU16(transport_header);
+            packet.dest_port = readU16(transport_header + 2);
+
+            size_t data_offset = (transport_header[12] >> 4) * 4;
+            packet.payload_offset = static_cast<uint32_t>(std::min(len, l4 + std::max<size_t>(20, data_offset)));
+        } else if (packet.protocol == IPPROTO_UDP && len >= l4 + 8) {
+            packet.source_port = readU16(transport_header);
+            packet.dest_port = readU16(transport_header + 2);
+            packet.payload_offset = static_cast<uint32_t>(l4 + 8);
+        } else if (packet.protocol != IPPROTO_TCP && packet.protocol != IPPROTO_UDP) {
+            packet.payload_offset = static_cast<uint32_t>(l4);
         }
     }
 };
@@ -125,7 +750,8 @@ PacketCapture::PacketCapture(PacketCapture&& other) noexcept
       is_capturing_(other.is_capturing_.load()),
       packets_captured_(other.packets_captured_.load()),
       bytes_captured_(other.bytes_captured_.load()),
-      handlers_(std::move(other.handlers_)) {
+      handlers_(std::move(other.handlers_)),
+      batch_handlers_(std::move(other.batch_handlers_)) {
 
     other.is_capturing_ = false;
     other.packets_captured_ = 0;
@@ -143,6 +769,8 @@ PacketCapture& PacketCapture::operator=(PacketCapture&& other) noexcept {
 
         std::lock_guard<std::mutex> lock(handlers_mutex_);
         handlers_ = std::move(other.handlers_);
+        batch_handlers_ = std::move(other.batch_handlers_);
+        handlers_version_++;
 
         other.is_capturing_ = false;
         other.packets_captured_ = 0;
@@ -151,35 +779,53 @@ PacketCapture& PacketCapture::operator=(PacketCapture&& other) noexcept {
     return *this;
 }
 
-CaptureError PacketCapture::startCapture(const std::string& interface_name) {
+CaptureError PacketCapture::startCapture(const std::string& source, const CaptureOptions& options) {
     if (is_capturing_) {
         return CaptureError::ALREADY_RUNNING;
     }
 
-    auto error = pimpl_->openInterface(interface_name);
+    auto error = pimpl_->openInterface(source, options);
     if (error != CaptureError::NONE) {
         return error;
     }
 
+    std::string filter_error;
+    error = pimpl_->setFilter(options.filter, &filter_error);
+    if (error != CaptureError::NONE) {
+        LOG_ERROR("Invalid capture filter '%s': %s", options.filter.c_str(), filter_error.c_str());
+        pimpl_->close();
+        return error;
+    }
+
     is_capturing_ = true;
+    is_finished_ = false;
     packets_captured_ = 0;
     bytes_captured_ = 0;
 
-    capture_thread_ = std::thread(&PacketCapture::captureThreadFunc, this);
+    size_t queue_count = pimpl_->getQueueCount();
+    capture_threads_.reserve(queue_count);
+    for (size_t queue = 0; queue < queue_count; ++queue) {
+        capture_threads_.emplace_back(&PacketCapture::captureThreadFunc, this, queue);
+    }
 
     return CaptureError::NONE;
 }
 
 void PacketCapture::stopCapture() {
-    if (!is_capturing_) {
+    // An offline replay clears is_capturing_ itself when it reaches the end
+    // of the file, so the threads may still need joining here.
+    if (capture_threads_.empty()) {
         return;
     }
 
     is_capturing_ = false;
 
-    if (capture_thread_.joinable()) {
-        capture_thread_.join();
+    for (auto& thread : capture_threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
     }
+    capture_threads_.clear();
 
     pimpl_->close();
 }
@@ -187,12 +833,39 @@ void PacketCapture::stopCapture() {
 void PacketCapture::registerHandler(PacketHandler handler) {
     std::lock_guard<std::mutex> lock(handlers_mutex_);
     handlers_.push_back(std::move(handler));
+    handlers_version_++;
+}
+
+void PacketCapture::registerBatchHandler(BatchHandler handler) {
+    std::lock_guard<std::mutex> lock(handlers_mutex_);
+    batch_handlers_.push_back(std::move(handler));
+    handlers_version_++;
 }
 
 bool PacketCapture::isCapturing() const {
     return is_capturing_;
 }
 
+CaptureError PacketCapture::setFilter(const std::string& expression, std::string* error) {
+    if (!pimpl_) {
+        return CaptureError::SYSTEM_ERROR;
+    }
+
+    return pimpl_->setFilter(expression, error);
+}
+
+std::string PacketCapture::getFilter() const {
+    return pimpl_ ? pimpl_->getFilter() : std::string();
+}
+
+std::string PacketCapture::getFilterError() const {
+    return pimpl_ ? pimpl_->getFilterError() : std::string();
+}
+
+bool PacketCapture::isFinished() const {
+    return is_finished_;
+}
+
 uint64_t PacketCapture::getPacketsCaptured() const {
     return packets_captured_;
 }
@@ -201,26 +874,70 @@ uint64_t PacketCapture::getBytesCaptured() const {
     return bytes_captured_;
 }
 
-void PacketCapture::captureThreadFunc() {
+CaptureStats PacketCapture::getStats() const {
+    CaptureStats stats;
+    stats.packets_captured = packets_captured_.load(std::memory_order_relaxed);
+    stats.bytes_captured = bytes_captured_.load(std::memory_order_relaxed);
+
+    if (pimpl_) {
+        pimpl_->fillKernelStats(stats);
+    }
+
+    return stats;
+}
+
+size_t PacketCapture::getQueueCount() const {
+    return pimpl_ ? pimpl_->getQueueCount() : 0;
+}
+
+void PacketCapture::captureThreadFunc(size_t queue) {
+    pimpl_->pinWorker(queue);
+
+    // Each worker dispatches from its own copy of the handler lists so
+    // concurrent fan-out queues never contend on handlers_mutex_; the copies
+    // are refreshed whenever a registration bumps the version.
+    std::vector<PacketHandler> handlers;
+    std::vector<BatchHandler> batch_handlers;
+    uint64_t handlers_version = ~handlers_version_.load();
+
     while (is_capturing_) {
-        auto packet = pimpl_->capturePacket();
+        if (handlers_version != handlers_version_) {
+            std::lock_guard<std::mutex> lock(handlers_mutex_);
+            handlers = handlers_;
+            batch_handlers = batch_handlers_;
+            handlers_version = handlers_version_;
+        }
 
-        if (packet.size > 0) {
-            processPacket(std::move(packet));
+        bool more = pimpl_->capture(queue, [this, &handlers, &batch_handlers](const PacketBatch& batch) {
+            processBatch(batch, handlers, batch_handlers);
+        });
+
+        if (!more) {
+            is_finished_ = true;
+            is_capturing_ = false;
         }
     }
 }
 
-void PacketCapture::processPacket(PacketInfo&& packet) {
-    packets_captured_++;
-    bytes_captured_ += packet.size;
+void PacketCapture::processBatch(const PacketBatch& batch,
+                                 const std::vector<PacketHandler>& handlers,
+                                 const std::vector<BatchHandler>& batch_handlers) {
+    uint64_t bytes = 0;
 
-    std::lock_guard<std::mutex> lock(handlers_mutex_);
-    for (const auto& handler : handlers_) {
-        handler(packet);
+    for (const auto& packet : batch) {
+        bytes += packet.size;
+
+        for (const auto& handler : handlers) {
+            handler(packet);
+        }
+    }
+
+    for (const auto& handler : batch_handlers) {
+        handler(batch);
     }
 
-    packet_buffer_.push(std::move(packet));
+    packets_captured_.fetch_add(batch.size(), std::memory_order_relaxed);
+    bytes_captured_.fetch_add(bytes, std::memory_order_relaxed);
 }
 
 }
@@ -7,20 +7,24 @@
 #include <thread>
 #include <atomic>
 #include <mutex>
-#include "../core/data/circular_buffer.hpp"
+#include "packet_view.hpp"
+#include "classified_flow_set.hpp"
 
 namespace netsentry {
 namespace network {
 
-struct PacketInfo {
-    std::vector<uint8_t> data;
-    size_t size;
-    std::string source_ip;
-    std::string dest_ip;
-    uint16_t source_port;
-    uint16_t dest_port;
-    uint8_t protocol;
-    uint64_t timestamp;
+// Non-owning span of consecutive packets handed to a batch handler. The span
+// itself is only valid for the duration of the handler call; copy the
+// PacketViews out of it to keep packets beyond that.
+struct PacketBatch {
+    const PacketView* packets;
+    size_t count;
+
+    const PacketView* begin() const { return packets; }
+    const PacketView* end() const { return packets + count; }
+    const PacketView& operator[](size_t index) const { return packets[index]; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
 };
 
 enum class CaptureError {
@@ -28,12 +32,95 @@ enum class CaptureError {
     PERMISSION_DENIED,
     INTERFACE_NOT_FOUND,
     ALREADY_RUNNING,
+    UNSUPPORTED_FORMAT,
+    INVALID_FILTER,
     SYSTEM_ERROR
 };
 
+enum class CaptureBackend {
+    PCAP,
+    // AF_PACKET mmap ring. Headers are parsed straight from the ring, but
+    // the kept bytes of each frame (headers plus up to payload_max_size of
+    // payload) are still copied into a pooled slab so that the block can be
+    // handed back to the kernel as soon as it is read, however long analysis
+    // takes. That is one memcpy of at most the kept bytes per packet, the
+    // same copy the libpcap backend makes.
+    TPACKET_V3,
+    FILE
+};
+
+enum class FanoutMode {
+    HASH,
+    CPU,
+    ROLLOVER
+};
+
+struct CaptureOptions {
+    // Bytes reserved for link, network and transport headers when deciding
+    // how much of a frame to keep (VLAN tags, IPv6 extension headers and TCP
+    // options included).
+    static constexpr uint32_t HEADER_SNAPLEN = 160;
+
+    CaptureBackend backend{CaptureBackend::PCAP};
+
+    // Transport payload bytes kept per packet. The kernel snaplen becomes
+    // HEADER_SNAPLEN + payload_max_size, so bulk transfers are truncated
+    // before they are copied out of the kernel.
+    uint32_t payload_max_size{65535};
+
+    // When false, payload is kept only for flows that are not yet in
+    // classified_flows (i.e. still need an L7 parser); packets of all other
+    // flows are stored headers-only.
+    bool capture_payload{true};
+    std::shared_ptr<ClassifiedFlowSet> classified_flows;
+
+    // libpcap backend: kernel buffer size in KiB (0 keeps the libpcap
+    // default) and how long a read may wait to fill a batch.
+    uint32_t buffer_size_kb{0};
+    uint32_t read_timeout_ms{100};
+
+    // TPACKET_V3 ring geometry; ignored by the libpcap backend.
+    uint32_t ring_block_size{1u << 22};
+    uint32_t ring_block_count{64};
+    uint32_t ring_frame_size{2048};
+    uint32_t ring_block_timeout_ms{100};
+
+    // Number of PACKET_FANOUT sockets, each served by its own capture worker.
+    // 0 keeps the single capture thread.
+    uint32_t fanout_workers{0};
+    FanoutMode fanout_mode{FanoutMode::HASH};
+    uint16_t fanout_group{0};
+    bool pin_fanout_workers{true};
+
+    // Upper bound on packets per PacketBatch (per pcap_dispatch() round or
+    // per slice of a ring block).
+    uint32_t batch_size{64};
+
+    // Offline replay (FILE backend): 1.0 replays at the original timing, N
+    // replays N times faster, 0 replays as fast as possible.
+    double replay_speed{1.0};
+
+    // pcap-filter(7) expression compiled to BPF and attached in the kernel;
+    // empty captures everything.
+    std::string filter;
+};
+
+struct CaptureStats {
+    uint64_t packets_captured{0};
+    uint64_t bytes_captured{0};
+
+    // Kernel-side counters, refreshed by the capture threads about once a
+    // second: packets that reached the socket, packets dropped because the
+    // socket buffer or ring was full, and packets dropped by the interface.
+    uint64_t kernel_received{0};
+    uint64_t kernel_dropped{0};
+    uint64_t interface_dropped{0};
+};
+
 class PacketCapture {
 public:
-    using PacketHandler = std::function<void(const PacketInfo&)>;
+    using PacketHandler = std::function<void(const PacketView&)>;
+    using BatchHandler = std::function<void(const PacketBatch&)>;
 
     PacketCapture();
     ~PacketCapture();
@@ -44,32 +131,62 @@ public:
     PacketCapture(PacketCapture&&) noexcept;
     PacketCapture& operator=(PacketCapture&&) noexcept;
 
-    CaptureError startCapture(const std::string& interface_name);
+    // For the FILE backend, source is the path of a pcap/pcapng file rather
+    // than an interface name.
+    CaptureError startCapture(const std::string& source,
+                              const CaptureOptions& options = CaptureOptions{});
     void stopCapture();
 
+    // Replaces the capture filter of the running capture. The expression is
+    // compiled before anything is changed, so on INVALID_FILTER the previous
+    // filter stays in place and error (if given) receives the reason; the
+    // same holds when a ring socket rejects the program (SYSTEM_ERROR). The
+    // libpcap backend applies the filter on its capture thread after this
+    // returns: if that fails, getFilter() goes back to the previous
+    // expression and getFilterError() says why.
+    CaptureError setFilter(const std::string& expression, std::string* error = nullptr);
+    std::string getFilter() const;
+    std::string getFilterError() const;
+
     void registerHandler(PacketHandler handler);
 
+    // Batch handlers are invoked once per batch of up to
+    // CaptureOptions::batch_size packets, all from the same capture queue.
+    void registerBatchHandler(BatchHandler handler);
+
     bool isCapturing() const;
 
+    // True once an offline source has been replayed to its end.
+    bool isFinished() const;
+
+    // Number of capture queues (fan-out sockets); PacketView::queue_id is
+    // always below this value.
+    size_t getQueueCount() const;
+
     uint64_t getPacketsCaptured() const;
     uint64_t getBytesCaptured() const;
+    CaptureStats getStats() const;
 
 private:
     class Impl;
     std::unique_ptr<Impl> pimpl_;
 
     std::atomic<bool> is_capturing_{false};
+    std::atomic<bool> is_finished_{false};
     std::atomic<uint64_t> packets_captured_{0};
     std::atomic<uint64_t> bytes_captured_{0};
 
-    std::thread capture_thread_;
-    data::CircularBuffer<PacketInfo, 1024> packet_buffer_;
+    std::vector<std::thread> capture_threads_;
 
     std::vector<PacketHandler> handlers_;
+    std::vector<BatchHandler> batch_handlers_;
+    std::atomic<uint64_t> handlers_version_{0};
     std::mutex handlers_mutex_;
 
-    void captureThreadFunc();
-    void processPacket(PacketInfo&& packet);
+    void captureThreadFunc(size_t queue);
+    void processBatch(const PacketBatch& batch,
+                      const std::vector<PacketHandler>& handlers,
+                      const std::vector<BatchHandler>& batch_handlers);
 };
 
 }
@@ -0,0 +1,208 @@
+#include "packet_pipeline.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace netsentry {
+namespace network {
+
+namespace {
+
+// Polls spent spinning before an idle worker starts sleeping between polls
+constexpr int IDLE_SPINS = 64;
+constexpr auto IDLE_SLEEP = std::chrono::microseconds(200);
+
+}
+
+PacketPipeline::PacketPipeline(const PipelineOptions& options, BatchHandler handler)
+    : producer_count_(std::max<size_t>(1, options.producers)),
+      worker_count_(std::max<size_t>(1, options.workers)),
+      policy_(options.overflow_policy),
+      sample_rate_(std::max<uint32_t>(1, options.sample_rate)),
+      batch_min_packets_(std::max<size_t>(1, options.batch_min_packets)),
+      batch_timeout_(std::chrono::milliseconds(options.batch_timeout_ms)),
+      handler_(std::move(handler)),
+      producers_(producer_count_) {
+
+    lanes_.reserve(producer_count_ * worker_count_);
+    for (size_t i = 0; i < producer_count_ * worker_count_; ++i) {
+        lanes_.push_back(std::make_unique<Lane>(std::max<size_t>(2, options.queue_capacity)));
+    }
+
+    for (auto& producer : producers_) {
+        producer.partitions.resize(worker_count_);
+    }
+}
+
+PacketPipeline::~PacketPipeline() {
+    stop();
+}
+
+void PacketPipeline::start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+
+    workers_.reserve(worker_count_);
+    for (size_t worker = 0; worker < worker_count_; ++worker) {
+        workers_.emplace_back(&PacketPipeline::workerLoop, this, worker);
+    }
+}
+
+void PacketPipeline::stop() {
+    flush();
+    running_ = false;
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    workers_.clear();
+}
+
+void PacketPipeline::submit(size_t producer_index, const PacketBatch& batch) {
+    if (batch.empty()) {
+        return;
+    }
+
+    producer_index %= producer_count_;
+    Producer& producer = producers_[producer_index];
+
+    if (worker_count_ == 1) {
+        producer.partitions[0].assign(batch.begin(), batch.end());
+        handOver(producer_index, 0);
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (producer.held == 0) {
+        producer.holding_since = now;
+    }
+
+    for (const auto& packet : batch) {
+        producer.partitions[flowShard(flowHash(packet), worker_count_)].push_back(packet);
+    }
+    producer.held += batch.size();
+
+    // Once the oldest packet is due everything goes, so the clock restarts
+    // with the next batch
+    bool due = now - producer.holding_since >= batch_timeout_;
+
+    for (size_t worker = 0; worker < worker_count_; ++worker) {
+        size_t size = producer.partitions[worker].size();
+        if (size >= batch_min_packets_ || (due && size > 0)) {
+            producer.held -= size;
+            handOver(producer_index, worker);
+        }
+    }
+}
+
+void PacketPipeline::flush() {
+    for (size_t producer_index = 0; producer_index < producer_count_; ++producer_index) {
+        Producer& producer = producers_[producer_index];
+
+        for (size_t worker = 0; worker < worker_count_; ++worker) {
+            if (!producer.partitions[worker].empty()) {
+                handOver(producer_index, worker);
+            }
+        }
+
+        producer.held = 0;
+    }
+}
+
+void PacketPipeline::handOver(size_t producer_index, size_t worker) {
+    Producer& producer = producers_[producer_index];
+    Batch& partition = producer.partitions[worker];
+
+    enqueue(lane(producer_index, worker), partition, producer);
+
+    // Whatever was not handed over is released here so that its slab
+    // references are not held any longer.
+    partition.clear();
+}
+
+void PacketPipeline::enqueue(Lane& lane, Batch& batch, Producer& producer) {
+    uint64_t packets = batch.size();
+
+    if (policy_ == OverflowPolicy::SAMPLE && lane.queue.size() >= lane.queue.capacity() / 2) {
+        if (++lane.sample_counter % sample_rate_ != 0) {
+            lane.packets_dropped_sampled.fetch_add(packets, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    if (!lane.queue.tryPush(batch)) {
+        if (policy_ != OverflowPolicy::DROP_OLDEST) {
+            lane.packets_dropped_newest.fetch_add(packets, std::memory_order_relaxed);
+            return;
+        }
+
+        // Make room by discarding the batch at the head of the queue
+        if (lane.queue.tryPop(producer.discarded)) {
+            lane.packets_dropped_oldest.fetch_add(producer.discarded.size(), std::memory_order_relaxed);
+            producer.discarded.clear();
+        }
+
+        if (!lane.queue.tryPush(batch)) {
+            lane.packets_dropped_newest.fetch_add(packets, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    lane.batches_enqueued.fetch_add(1, std::memory_order_relaxed);
+    lane.packets_enqueued.fetch_add(packets, std::memory_order_relaxed);
+}
+
+void PacketPipeline::workerLoop(size_t worker) {
+    Batch batch;
+    int idle_polls = 0;
+
+    while (true) {
+        bool found = false;
+
+        // One batch per lane per round keeps a busy capture queue from
+        // starving the others.
+        for (size_t producer = 0; producer < producer_count_; ++producer) {
+            if (lane(producer, worker).queue.tryPop(batch)) {
+                handler_(PacketBatch{batch.data(), batch.size()});
+                batch.clear();
+                found = true;
+            }
+        }
+
+        if (found) {
+            idle_polls = 0;
+            continue;
+        }
+
+        if (!running_) {
+            break;
+        }
+
+        if (++idle_polls < IDLE_SPINS) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(IDLE_SLEEP);
+        }
+    }
+}
+
+PipelineStats PacketPipeline::getStats() const {
+    PipelineStats stats;
+
+    for (const auto& lane : lanes_) {
+        stats.batches_enqueued += lane->batches_enqueued.load(std::memory_order_relaxed);
+        stats.packets_enqueued += lane->packets_enqueued.load(std::memory_order_relaxed);
+        stats.packets_dropped_newest += lane->packets_dropped_newest.load(std::memory_order_relaxed);
+        stats.packets_dropped_oldest += lane->packets_dropped_oldest.load(std::memory_order_relaxed);
+        stats.packets_dropped_sampled += lane->packets_dropped_sampled.load(std::memory_order_relaxed);
+        stats.queued_batches += lane->queue.size();
+    }
+
+    return stats;
+}
+
+}
+}
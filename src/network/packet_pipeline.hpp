@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "../core/data/bounded_queue.hpp"
+#include "packet_capture.hpp"
+
+namespace netsentry {
+namespace network {
+
+enum class OverflowPolicy {
+    DROP_NEWEST,
+    DROP_OLDEST,
+    SAMPLE
+};
+
+struct PipelineOptions {
+    size_t producers{1};
+    size_t workers{1};
+
+    // Capacity of each producer-to-worker queue, in batches. Memory held by
+    // the pipeline is bounded by producers * workers * queue_capacity batches.
+    size_t queue_capacity{1024};
+
+    // With more than one worker, a producer holds each worker's share of its
+    // batches until it has batch_min_packets packets or the oldest has been
+    // held for batch_timeout_ms, so that queue entries stay close to a full
+    // capture batch instead of one worker's slice of it. The timeout is only
+    // checked on submit; what an idle producer holds is handed over by flush().
+    size_t batch_min_packets{64};
+    uint32_t batch_timeout_ms{1};
+
+    OverflowPolicy overflow_policy{OverflowPolicy::DROP_NEWEST};
+
+    // SAMPLE: once a queue is half full, only one batch in sample_rate is
+    // admitted, so an overload thins the stream evenly instead of cutting
+    // out whole bursts.
+    uint32_t sample_rate{8};
+};
+
+struct PipelineStats {
+    uint64_t batches_enqueued{0};
+    uint64_t packets_enqueued{0};
+    uint64_t packets_dropped_newest{0};
+    uint64_t packets_dropped_oldest{0};
+    uint64_t packets_dropped_sampled{0};
+    size_t queued_batches{0};
+
+    uint64_t packetsDropped() const {
+        return packets_dropped_newest + packets_dropped_oldest + packets_dropped_sampled;
+    }
+};
+
+// Hands capture batches to a fixed set of analysis workers over bounded
+// single-producer/single-consumer queues, one per (capture queue, worker)
+// pair. Batches are split by flowShard(), so every packet of a flow goes to
+// the same worker in capture order. Submitting never blocks and never
+// allocates once the queues are warm: when a worker falls behind, the
+// overflow policy decides what is shed and every shed packet is counted.
+class PacketPipeline {
+public:
+    using BatchHandler = PacketCapture::BatchHandler;
+
+    PacketPipeline(const PipelineOptions& options, BatchHandler handler);
+    ~PacketPipeline();
+
+    PacketPipeline(const PacketPipeline&) = delete;
+    PacketPipeline& operator=(const PacketPipeline&) = delete;
+
+    void start();
+
+    // Hands over what the producers hold and waits for the workers to drain
+    // the queues. Producers must have stopped submitting first.
+    void stop();
+
+    // Must only be called from the thread that owns capture queue producer.
+    void submit(size_t producer, const PacketBatch& batch);
+
+    // Hands over every partially filled batch that producers are holding.
+    // Producers must have stopped submitting first.
+    void flush();
+
+    PipelineStats getStats() const;
+
+    size_t getWorkerCount() const { return worker_count_; }
+
+private:
+    using Batch = std::vector<PacketView>;
+
+    struct Lane {
+        explicit Lane(size_t capacity) : queue(capacity) {}
+
+        data::BoundedQueue<Batch> queue;
+        uint64_t sample_counter{0};
+
+        std::atomic<uint64_t> batches_enqueued{0};
+        std::atomic<uint64_t> packets_enqueued{0};
+        std::atomic<uint64_t> packets_dropped_newest{0};
+        std::atomic<uint64_t> packets_dropped_oldest{0};
+        std::atomic<uint64_t> packets_dropped_sampled{0};
+    };
+
+    struct Producer {
+        std::vector<Batch> partitions;
+        Batch discarded;
+
+        // Packets held across all partitions, and when the first of them
+        // was taken in
+        size_t held{0};
+        std::chrono::steady_clock::time_point holding_since;
+    };
+
+    size_t producer_count_;
+    size_t worker_count_;
+    OverflowPolicy policy_;
+    uint32_t sample_rate_;
+    size_t batch_min_packets_;
+    std::chrono::steady_clock::duration batch_timeout_;
+    BatchHandler handler_;
+
+    std::vector<std::unique_ptr<Lane>> lanes_;
+    std::vector<Producer> producers_;
+    std::vector<std::thread> workers_;
+    std::atomic<bool> running_{false};
+
+    Lane& lane(size_t producer, size_t worker) {
+        return *lanes_[producer * worker_count_ + worker];
+    }
+
+    void handOver(size_t producer_index, size_t worker);
+    void enqueue(Lane& lane, Batch& batch, Producer& producer);
+    void workerLoop(size_t worker);
+};
+
+}
+}
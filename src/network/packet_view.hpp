@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include "ip_address.hpp"
+#include "capture_buffer.hpp"
+
+namespace netsentry {
+namespace network {
+
+// Non-owning, fixed-size description of a captured frame. The frame bytes
+// live in a pooled CaptureBuffer slab that the view holds a reference to, so
+// a view can be copied or queued without allocating and stays valid for as
+// long as any copy of it exists.
+struct PacketView {
+    const uint8_t* data{nullptr};
+    uint32_t caplen{0};
+    uint32_t size{0};
+    uint64_t timestamp{0};
+
+    IpAddress source_ip;
+    IpAddress dest_ip;
+    uint16_t source_port{0};
+    uint16_t dest_port{0};
+    uint8_t protocol{0};
+    uint16_t queue_id{0};
+
+    // Offsets into data of the transport header and of the transport payload;
+    // both equal caplen when the frame was too short to contain them.
+    uint32_t l4_offset{0};
+    uint32_t payload_offset{0};
+
+    // Length of the transport header and payload as the IP header gives it,
+    // however much was captured; zero when unknown.
+    uint32_t transport_size{0};
+
+    BufferRef buffer;
+
+    const uint8_t* payload() const { return data + payload_offset; }
+    size_t payloadSize() const { return caplen - payload_offset; }
+
+    const uint8_t* transportHeader() const { return data + l4_offset; }
+    size_t transportHeaderSize() const { return payload_offset - l4_offset; }
+};
+
+inline uint64_t mixHash(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Hash of the 5-tuple that is the same for both directions of a flow.
+inline uint64_t flowHash(const IpAddress& source_ip, uint16_t source_port,
+                         const IpAddress& dest_ip, uint16_t dest_port, uint8_t protocol) {
+    auto endpoint = [](const IpAddress& address, uint16_t port) {
+        uint64_t high;
+        uint64_t low;
+        memcpy(&high, address.bytes.data(), 8);
+        memcpy(&low, address.bytes.data() + 8, 8);
+        return mixHash(high ^ mixHash(low ^ (static_cast<uint64_t>(port) << 8 | address.family)));
+    };
+
+    uint64_t a = endpoint(source_ip, source_port);
+    uint64_t b = endpoint(dest_ip, dest_port);
+
+    return mixHash((a + b) ^ protocol);
+}
+
+inline uint64_t flowHash(const PacketView& packet) {
+    return flowHash(packet.source_ip, packet.source_port, packet.dest_ip, packet.dest_port, packet.protocol);
+}
+
+// Partition of a flow among count workers or shards. Everything that splits
+// traffic by flow uses this, so worker i of the analysis pipeline only ever
+// feeds analyzer shard i.
+inline size_t flowShard(uint64_t flow_hash, size_t count) {
+    return flow_hash % count;
+}
+
+}
+}
@@ -3,54 +3,216 @@
 #include <string>
 #include <cstring>
 #include <array>
+#include <cctype>
+#include "../../core/data/bit_ops.hpp"
 
 namespace netsentry {
 namespace network {
 
-std::unique_ptr<ProtocolData> HttpParser::parse(const PacketInfo& packet) {
+namespace {
+
+// Request methods with their trailing space
+constexpr std::array<const char*, 9> HTTP_METHODS = {
+    "GET ", "POST ", "PUT ", "DELETE ", "HEAD ", "OPTIONS ", "PATCH ", "CONNECT ", "TRACE "
+};
+
+constexpr char HTTP_RESPONSE_PREFIX[] = "HTTP/";
+
+bool startsWith(const uint8_t* data, size_t size, const char* prefix) {
+    size_t length = std::strlen(prefix);
+    return size >= length && std::memcmp(data, prefix, length) == 0;
+}
+
+// Position of the first CR, LF or stop character from begin, or size
+size_t lineToken(const uint8_t* data, size_t size, size_t begin, char stop) {
+    while (begin < size && data[begin] != '\r' && data[begin] != '\n' && data[begin] != stop) {
+        ++begin;
+    }
+    return begin;
+}
+
+// Whether the line [line, end) is the header name (lowercase, with its
+// colon), and if so the bounds of its value without surrounding blanks
+bool matchHeader(const uint8_t* data, size_t line, size_t end, const char* name,
+                 size_t& value, size_t& value_end) {
+    size_t length = std::strlen(name);
+    if (end - line <= length ||
+        !std::equal(name, name + length, data + line, [](char a, uint8_t b) { return a == std::tolower(b); })) {
+        return false;
+    }
+
+    value = line + length;
+    while (value < end && (data[value] == ' ' || data[value] == '\t')) {
+        ++value;
+    }
+    value_end = end;
+    while (value_end > value && (data[value_end - 1] == ' ' || data[value_end - 1] == '\t')) {
+        --value_end;
+    }
+    return true;
+}
+
+// Value of the Host header among the headers following the start line
+std::string findHost(const uint8_t* data, size_t size, size_t line_end) {
+    size_t line = line_end;
+    while (line < size) {
+        // Skip the line break; an empty line ends the headers
+        if (data[line] == '\r') {
+            ++line;
+        }
+        if (line >= size || data[line] != '\n') {
+            break;
+        }
+        ++line;
+        if (line >= size || data[line] == '\r' || data[line] == '\n') {
+            break;
+        }
+
+        size_t end = lineToken(data, size, line, '\r');
+        size_t value = 0;
+        size_t value_end = 0;
+        if (matchHeader(data, line, end, "host:", value, value_end)) {
+            return std::string(reinterpret_cast<const char*>(data + value), value_end - value);
+        }
+
+        line = end;
+    }
+
+    return {};
+}
+
+}
+
+std::unique_ptr<ProtocolData> HttpParser::parse(const PacketView& packet) {
     if (!isHttpPacket(packet)) {
         return nullptr;
     }
 
-    if (packet.source_port == 80 || packet.source_port == 8080) {
-        return parseHttpResponse(packet.data);
-    } else if (packet.dest_port == 80 || packet.dest_port == 8080) {
-        return parseHttpRequest(packet.data);
+    // The start line tells requests from responses on any port
+    if (startsWith(packet.payload(), packet.payloadSize(), HTTP_RESPONSE_PREFIX)) {
+        return parseHttpResponse(packet.payload(), packet.payloadSize());
     }
 
-    return nullptr;
+    return parseHttpRequest(packet.payload(), packet.payloadSize());
+}
+
+std::vector<uint8_t> HttpParser::getLeadingBytes() const {
+    std::vector<uint8_t> bytes = {static_cast<uint8_t>(HTTP_RESPONSE_PREFIX[0])};
+    for (const char* method : HTTP_METHODS) {
+        bytes.push_back(static_cast<uint8_t>(method[0]));
+    }
+    return bytes;
+}
+
+std::optional<HttpStartLine> HttpParser::readStartLine(const uint8_t* data, size_t size) {
+    HttpStartLine line;
+
+    if (startsWith(data, size, HTTP_RESPONSE_PREFIX)) {
+        size_t code = lineToken(data, size, 0, ' ') + 1;
+        if (code + 3 > size) {
+            return std::nullopt;
+        }
+
+        for (size_t i = code; i < code + 3; ++i) {
+            if (data[i] < '0' || data[i] > '9') {
+                return std::nullopt;
+            }
+            line.status_code = line.status_code * 10 + (data[i] - '0');
+        }
+
+        return line;
+    }
+
+    for (const char* method : HTTP_METHODS) {
+        if (startsWith(data, size, method)) {
+            size_t uri = std::strlen(method);
+            size_t uri_end = lineToken(data, size, uri, ' ');
+
+            line.is_request = true;
+            line.is_head = std::strcmp(method, "HEAD ") == 0;
+            line.uri.assign(reinterpret_cast<const char*>(data + uri), uri_end - uri);
+            line.host = findHost(data, size, lineToken(data, size, uri_end, '\n'));
+            return line;
+        }
+    }
+
+    return std::nullopt;
 }
 
-bool HttpParser::isHttpPacket(const PacketInfo& packet) const {
+HttpFraming HttpParser::readFraming(const uint8_t* data, size_t size) {
+    HttpFraming framing;
+    size_t line = 0;
+
+    while (line < size) {
+        size_t end = lineToken(data, size, line, '\r');
+        if (end >= size) {
+            break;
+        }
+
+        size_t next = end + (data[end] == '\r' ? 1 : 0);
+        if (next < size && data[next] == '\n') {
+            ++next;
+        }
+
+        if (end == line) {
+            framing.header_end = next;
+            break;
+        }
+
+        size_t value = 0;
+        size_t value_end = 0;
+        if (matchHeader(data, line, end, "content-length:", value, value_end)) {
+            uint64_t length = 0;
+            bool valid = value < value_end;
+            for (size_t i = value; i < value_end && valid; ++i) {
+                valid = data[i] >= '0' && data[i] <= '9' && length < (1ULL << 56);
+                length = length * 10 + (data[i] - '0');
+            }
+            if (valid) {
+                framing.content_length = length;
+            }
+        } else if (matchHeader(data, line, end, "transfer-encoding:", value, value_end)) {
+            // Chunked is always the last coding when present
+            static constexpr char CHUNKED[] = "chunked";
+            size_t length = sizeof(CHUNKED) - 1;
+            framing.chunked = value_end - value >= length &&
+                std::equal(CHUNKED, CHUNKED + length, data + value_end - length,
+                           [](char a, uint8_t b) { return a == std::tolower(b); });
+        }
+
+        line = next;
+    }
+
+    return framing;
+}
+
+bool HttpParser::isHttpPacket(const PacketView& packet) const {
     if (packet.protocol != IPPROTO_TCP) {
         return false;
     }
 
-    if (packet.data.size() < 16) {
+    if (packet.payloadSize() < 16) {
         return false;
     }
 
-    static const std::array<std::string, 9> http_methods = {
-        "GET", "POST", "PUT", "DELETE", "HEAD", "OPTIONS", "PATCH", "CONNECT", "TRACE"
-    };
-
-    std::string start(packet.data.begin(), packet.data.begin() + std::min<size_t>(8, packet.data.size()));
+    const uint8_t* payload = packet.payload();
+    size_t size = packet.payloadSize();
 
-    for (const auto& method : http_methods) {
-        if (start.find(method) == 0 && start.find(" ") == method.length()) {
+    for (const char* method : HTTP_METHODS) {
+        if (startsWith(payload, size, method)) {
             return true;
         }
     }
 
-    return start.find("HTTP/") == 0;
+    return startsWith(payload, size, HTTP_RESPONSE_PREFIX);
 }
 
-std::unique_ptr<HttpData> HttpParser::parseHttpRequest(const std::vector<uint8_t>& data) {
+std::unique_ptr<HttpData> HttpParser::parseHttpRequest(const uint8_t* data, size_t size) {
     auto http_data = std::make_unique<HttpData>();
     http_data->type = ProtocolType::HTTP;
     http_data->is_request = true;
 
-    std::string raw_data(data.begin(), data.end());
+    std::string raw_data(reinterpret_cast<const char*>(data), size);
     size_t end_of_headers = raw_data.find("\r\n\r\n");
 
     if (end_of_headers == std::string::npos) {
@@ -59,9 +221,10 @@ std::unique_ptr<HttpData> HttpParser::parseHttpRequest(const std::vector<uint8_t
 
     std::string headers = raw_data.substr(0, end_of_headers);
 
+    // A segment holding only the start line still carries the fields
     size_t line_end = headers.find("\r\n");
     if (line_end == std::string::npos) {
-        return http_data;
+        line_end = headers.length();
     }
 
     std::string request_line = headers.substr(0, line_end);
@@ -108,12 +271,12 @@ std::unique_ptr<HttpData> HttpParser::parseHttpRequest(const std::vector<uint8_t
     return http_data;
 }
 
-std::unique_ptr<HttpData> HttpParser::parseHttpResponse(const std::vector<uint8_t>& data) {
+std::unique_ptr<HttpData> HttpParser::parseHttpResponse(const uint8_t* data, size_t size) {
     auto http_data = std::make_unique<HttpData>();
     http_data->type = ProtocolType::HTTP;
     http_data->is_request = false;
 
-    std::string raw_data(data.begin(), data.end());
+    std::string raw_data(reinterpret_cast<const char*>(data), size);
     size_t end_of_headers = raw_data.find("\r\n\r\n");
 
     if (end_of_headers == std::string::npos) {
@@ -122,9 +285,10 @@ std::unique_ptr<HttpData> HttpParser::parseHttpResponse(const std::vector<uint8_
 
     std::string headers = raw_data.substr(0, end_of_headers);
 
+    // A segment holding only the start line still carries the fields
     size_t line_end = headers.find("\r\n");
     if (line_end == std::string::npos) {
-        return http_data;
+        line_end = headers.length();
     }
 
     std::string status_line = headers.substr(0, line_end);
@@ -175,26 +339,26 @@ std::unique_ptr<HttpData> HttpParser::parseHttpResponse(const std::vector<uint8_
     return http_data;
 }
 
-std::unique_ptr<ProtocolData> DnsParser::parse(const PacketInfo& packet) {
+std::unique_ptr<ProtocolData> DnsParser::parse(const PacketView& packet) {
     if (!isDnsPacket(packet)) {
         return nullptr;
     }
 
-    return parseDnsPacket(packet.data);
+    return parseDnsPacket(packet.payload(), packet.payloadSize());
 }
 
-bool DnsParser::isDnsPacket(const PacketInfo& packet) const {
+bool DnsParser::isDnsPacket(const PacketView& packet) const {
     return (packet.protocol == IPPROTO_UDP &&
             (packet.source_port == 53 || packet.dest_port == 53)) ||
            (packet.protocol == IPPROTO_TCP &&
             (packet.source_port == 53 || packet.dest_port == 53));
 }
 
-std::unique_ptr<DnsData> DnsParser::parseDnsPacket(const std::vector<uint8_t>& data) {
+std::unique_ptr<DnsData> DnsParser::parseDnsPacket(const uint8_t* data, size_t size) {
     auto dns_data = std::make_unique<DnsData>();
     dns_data->type = ProtocolType::DNS;
 
-    if (data.size() < 12) {
+    if (size < 12) {
         return dns_data;
     }
 
@@ -209,35 +373,36 @@ std::unique_ptr<DnsData> DnsParser::parseDnsPacket(const std::vector<uint8_t>& d
     return dns_data;
 }
 
-std::unique_ptr<ProtocolData> TlsParser::parse(const PacketInfo& packet) {
+std::unique_ptr<ProtocolData> TlsParser::parse(const PacketView& packet) {
     if (!isTlsPacket(packet)) {
         return nullptr;
     }
 
-    return parseTlsPacket(packet.data);
+    return parseTlsPacket(packet.payload(), packet.payloadSize());
 }
 
-bool TlsParser::isTlsPacket(const PacketInfo& packet) const {
+bool TlsParser::isTlsPacket(const PacketView& packet) const {
     if (packet.protocol != IPPROTO_TCP) {
         return false;
     }
 
-    if (packet.data.size() < 5) {
+    if (packet.payloadSize() < 5) {
         return false;
     }
 
-    uint8_t content_type = packet.data[0];
-    uint16_t version = (packet.data[1] << 8) | packet.data[2];
+    const uint8_t* payload = packet.payload();
+    uint8_t content_type = payload[0];
+    uint16_t version = (payload[1] << 8) | payload[2];
 
     return (content_type >= 20 && content_type <= 23) &&
            ((version >= 0x0300 && version <= 0x0304) || version == 0x0100);
 }
 
-std::unique_ptr<TlsData> TlsParser::parseTlsPacket(const std::vector<uint8_t>& data) {
+std::unique_ptr<TlsData> TlsParser::parseTlsPacket(const uint8_t* data, size_t size) {
     auto tls_data = std::make_unique<TlsData>();
     tls_data->type = ProtocolType::TLS;
 
-    if (data.size() < 5) {
+    if (size < 5) {
         return tls_data;
     }
 
@@ -246,28 +411,28 @@ std::unique_ptr<TlsData> TlsParser::parseTlsPacket(const std::vector<uint8_t>& d
 
     tls_data->is_handshake = (tls_data->content_type == 22);
 
-    if (tls_data->is_handshake && data.size() >= 6) {
+    if (tls_data->is_handshake && size >= 6) {
         uint8_t handshake_type = data[5];
         tls_data->is_client_hello = (handshake_type == 1);
         tls_data->is_server_hello = (handshake_type == 2);
 
-        if (tls_data->is_client_hello && data.size() > 43) {
+        if (tls_data->is_client_hello && size > 43) {
             uint16_t session_id_length = data[43];
             size_t extensions_offset = 44 + session_id_length;
 
-            if (data.size() > extensions_offset + 2) {
+            if (size > extensions_offset + 2) {
                 uint16_t cipher_suites_length = (data[extensions_offset] << 8) | data[extensions_offset + 1];
                 extensions_offset += 2 + cipher_suites_length;
 
-                if (data.size() > extensions_offset + 1) {
+                if (size > extensions_offset + 1) {
                     uint8_t compression_methods_length = data[extensions_offset];
                     extensions_offset += 1 + compression_methods_length;
 
-                    if (data.size() > extensions_offset + 2) {
+                    if (size > extensions_offset + 2) {
                         uint16_t extensions_length = (data[extensions_offset] << 8) | data[extensions_offset + 1];
                         extensions_offset += 2;
 
-                        tls_data->server_name = extractServerName(data, extensions_offset, extensions_length);
+                        tls_data->server_name = extractServerName(data, size, extensions_offset, extensions_length);
                     }
                 }
             }
@@ -277,8 +442,8 @@ std::unique_ptr<TlsData> TlsParser::parseTlsPacket(const std::vector<uint8_t>& d
     return tls_data;
 }
 
-std::optional<std::string> TlsParser::extractServerName(const std::vector<uint8_t>& data, size_t offset, size_t length) {
-    size_t end_offset = offset + length;
+std::optional<std::string> TlsParser::extractServerName(const uint8_t* data, size_t size, size_t offset, size_t length) {
+    size_t end_offset = std::min(offset + length, size);
     size_t pos = offset;
 
     while (pos + 4 <= end_offset) {
@@ -296,7 +461,7 @@ std::optional<std::string> TlsParser::extractServerName(const std::vector<uint8_
                 pos += 3;
 
                 if (name_type == 0 && pos + name_length <= end_offset) {
-                    return std::string(data.begin() + pos, data.begin() + pos + name_length);
+                    return std::string(reinterpret_cast<const char*>(data) + pos, name_length);
                 }
             }
         }
@@ -307,6 +472,44 @@ std::optional<std::string> TlsParser::extractServerName(const std::vector<uint8_
     return std::nullopt;
 }
 
+ProtocolClassifier::ProtocolClassifier(std::vector<std::unique_ptr<ProtocolParser>> parsers)
+    : port_parsers_(65536, 0) {
+
+    for (auto& parser : parsers) {
+        if (!parser || parsers_.size() == MAX_PARSERS) {
+            continue;
+        }
+
+        ParserMask bit = static_cast<ParserMask>(1u << parsers_.size());
+
+        for (uint16_t port : parser->getPorts()) {
+            port_parsers_[port] |= bit;
+        }
+        for (uint8_t byte : parser->getLeadingBytes()) {
+            leading_byte_parsers_[byte] |= bit;
+        }
+
+        parsers_.push_back(std::move(parser));
+    }
+}
+
+std::unique_ptr<ProtocolData> ProtocolClassifier::classify(const PacketView& packet) {
+    ParserMask candidates = port_parsers_[packet.source_port] | port_parsers_[packet.dest_port];
+    if (packet.payloadSize() > 0) {
+        candidates |= leading_byte_parsers_[packet.payload()[0]];
+    }
+
+    // Parsers are tried in the order they were given
+    for (; candidates != 0; candidates &= candidates - 1) {
+        auto protocol_data = parsers_[data::bit_ops::countTrailingZeros(candidates)]->parse(packet);
+        if (protocol_data) {
+            return protocol_data;
+        }
+    }
+
+    return nullptr;
+}
+
 std::vector<std::unique_ptr<ProtocolParser>> ProtocolParserFactory::createAllParsers() {
     std::vector<std::unique_ptr<ProtocolParser>> parsers;
 
@@ -5,7 +5,9 @@
 #include <memory>
 #include <unordered_map>
 #include <optional>
-#include "../packet_capture.hpp"
+#include <array>
+#include <cstdint>
+#include "../packet_view.hpp"
 
 namespace netsentry {
 namespace network {
@@ -35,6 +37,26 @@ struct HttpData : public ProtocolData {
     int status_code{0};
 };
 
+// What following a flow's HTTP exchanges needs from each message
+struct HttpStartLine {
+    bool is_request{false};
+    // HEAD responses carry no body whatever their headers say
+    bool is_head{false};
+    int status_code{0};
+    // Request target, and Host header if it lies within the data
+    std::string uri;
+    std::string host;
+};
+
+// How an HTTP message's body is delimited, as far as its headers go
+struct HttpFraming {
+    // Offset just past the empty line that ends the headers, or 0 if that
+    // line is not within the data
+    size_t header_end{0};
+    std::optional<uint64_t> content_length;
+    bool chunked{false};
+};
+
 struct DnsData : public ProtocolData {
     uint16_t transaction_id{0};
     bool is_query{true};
@@ -55,39 +77,81 @@ class ProtocolParser {
 public:
     virtual ~ProtocolParser() = default;
     virtual ProtocolType getProtocolType() const = 0;
-    virtual std::unique_ptr<ProtocolData> parse(const PacketInfo& packet) = 0;
+    virtual std::unique_ptr<ProtocolData> parse(const PacketView& packet) = 0;
+
+    // Dispatch hints for ProtocolClassifier: the parser is only tried on
+    // packets to or from one of these ports, or whose payload starts with
+    // one of these bytes.
+    virtual std::vector<uint16_t> getPorts() const { return {}; }
+    virtual std::vector<uint8_t> getLeadingBytes() const { return {}; }
 };
 
 class HttpParser : public ProtocolParser {
 public:
     ProtocolType getProtocolType() const override { return ProtocolType::HTTP; }
-    std::unique_ptr<ProtocolData> parse(const PacketInfo& packet) override;
+    std::unique_ptr<ProtocolData> parse(const PacketView& packet) override;
+    std::vector<uint16_t> getPorts() const override { return {80, 8080}; }
+    std::vector<uint8_t> getLeadingBytes() const override;
+
+    // Reads the start line of a request or response, and a request's Host
+    // header, without building the header map; cheap enough to run on every
+    // payload of a flow already known to be HTTP. Empty for anything else,
+    // such as a body segment.
+    static std::optional<HttpStartLine> readStartLine(const uint8_t* data, size_t size);
+
+    // Scans header lines from the start of data, which may be a start line
+    // or the continuation of a header block split across segments.
+    static HttpFraming readFraming(const uint8_t* data, size_t size);
 
 private:
-    bool isHttpPacket(const PacketInfo& packet) const;
-    std::unique_ptr<HttpData> parseHttpRequest(const std::vector<uint8_t>& data);
-    std::unique_ptr<HttpData> parseHttpResponse(const std::vector<uint8_t>& data);
+    bool isHttpPacket(const PacketView& packet) const;
+    std::unique_ptr<HttpData> parseHttpRequest(const uint8_t* data, size_t size);
+    std::unique_ptr<HttpData> parseHttpResponse(const uint8_t* data, size_t size);
 };
 
 class DnsParser : public ProtocolParser {
 public:
     ProtocolType getProtocolType() const override { return ProtocolType::DNS; }
-    std::unique_ptr<ProtocolData> parse(const PacketInfo& packet) override;
+    std::unique_ptr<ProtocolData> parse(const PacketView& packet) override;
+    std::vector<uint16_t> getPorts() const override { return {53}; }
 
 private:
-    bool isDnsPacket(const PacketInfo& packet) const;
-    std::unique_ptr<DnsData> parseDnsPacket(const std::vector<uint8_t>& data);
+    bool isDnsPacket(const PacketView& packet) const;
+    std::unique_ptr<DnsData> parseDnsPacket(const uint8_t* data, size_t size);
 };
 
 class TlsParser : public ProtocolParser {
 public:
     ProtocolType getProtocolType() const override { return ProtocolType::TLS; }
-    std::unique_ptr<ProtocolData> parse(const PacketInfo& packet) override;
+    std::unique_ptr<ProtocolData> parse(const PacketView& packet) override;
+    std::vector<uint16_t> getPorts() const override { return {443, 8443}; }
+    // Record content types 20-23
+    std::vector<uint8_t> getLeadingBytes() const override { return {20, 21, 22, 23}; }
 
 private:
-    bool isTlsPacket(const PacketInfo& packet) const;
-    std::unique_ptr<TlsData> parseTlsPacket(const std::vector<uint8_t>& data);
-    std::optional<std::string> extractServerName(const std::vector<uint8_t>& data, size_t offset, size_t length);
+    bool isTlsPacket(const PacketView& packet) const;
+    std::unique_ptr<TlsData> parseTlsPacket(const uint8_t* data, size_t size);
+    std::optional<std::string> extractServerName(const uint8_t* data, size_t size, size_t offset, size_t length);
+};
+
+// Front end to a set of parsers that only tries the ones a packet could
+// plausibly belong to, found through a table indexed by port and one
+// indexed by the first payload byte, instead of running every parser on
+// every packet. Holds up to MAX_PARSERS parsers.
+class ProtocolClassifier {
+public:
+    static constexpr size_t MAX_PARSERS = 16;
+
+    explicit ProtocolClassifier(std::vector<std::unique_ptr<ProtocolParser>> parsers);
+
+    std::unique_ptr<ProtocolData> classify(const PacketView& packet);
+
+private:
+    using ParserMask = uint16_t;
+
+    std::vector<std::unique_ptr<ProtocolParser>> parsers_;
+    std::vector<ParserMask> port_parsers_;
+    std::array<ParserMask, 256> leading_byte_parsers_{};
 };
 
 class ProtocolParserFactory {
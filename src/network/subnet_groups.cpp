@@ -0,0 +1,132 @@
+#include "subnet_groups.hpp"
+#include <fstream>
+#include <sstream>
+
+namespace netsentry {
+namespace network {
+
+namespace {
+
+std::string trim(const std::string& text) {
+    size_t begin = text.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) {
+        return std::string();
+    }
+
+    size_t end = text.find_last_not_of(" \t\r\n");
+    return text.substr(begin, end - begin + 1);
+}
+
+}
+
+SubnetGroups::SubnetGroups() : v4_(4), v6_(16) {}
+
+bool SubnetGroups::add(const std::string& group, const std::string& cidr) {
+    if (group.empty()) {
+        return false;
+    }
+
+    size_t slash = cidr.find('/');
+    auto address = IpAddress::parse(cidr.substr(0, slash));
+    if (!address) {
+        return false;
+    }
+
+    size_t max_length = address->length() * 8;
+    size_t length = max_length;
+
+    if (slash != std::string::npos) {
+        std::string digits = cidr.substr(slash + 1);
+        if (digits.empty() || digits.size() > 3 || digits.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+
+        length = std::stoul(digits);
+        if (length > max_length) {
+            return false;
+        }
+    }
+
+    auto it = index_.find(group);
+    if (it == index_.end()) {
+        if (names_.size() >= NO_GROUP) {
+            return false;
+        }
+        it = index_.emplace(group, static_cast<uint32_t>(names_.size())).first;
+        names_.push_back(group);
+    }
+
+    data::PrefixTable& table = address->isV4() ? v4_ : v6_;
+    return table.insert(address->bytes.data(), static_cast<uint8_t>(length), it->second);
+}
+
+bool SubnetGroups::parse(const std::string& spec, std::string& error) {
+    std::istringstream groups(spec);
+    std::string entry;
+
+    while (std::getline(groups, entry, ';')) {
+        entry = trim(entry);
+        if (entry.empty()) {
+            continue;
+        }
+
+        size_t equals = entry.find('=');
+        if (equals == std::string::npos) {
+            error = "missing '=' in \"" + entry + "\"";
+            return false;
+        }
+
+        std::string name = trim(entry.substr(0, equals));
+        std::istringstream prefixes(entry.substr(equals + 1));
+        std::string cidr;
+
+        while (prefixes >> cidr) {
+            if (!add(name, cidr)) {
+                error = "invalid prefix \"" + cidr + "\" for group \"" + name + "\"";
+                return false;
+            }
+        }
+    }
+
+    build();
+    return true;
+}
+
+bool SubnetGroups::loadFile(const std::string& path, std::string& error) {
+    std::ifstream file(path);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    std::string line;
+    size_t line_number = 0;
+
+    while (std::getline(file, line)) {
+        ++line_number;
+
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+
+        std::istringstream fields(line);
+        std::string cidr;
+        std::string name;
+
+        if (!(fields >> cidr)) {
+            continue;
+        }
+
+        if (!(fields >> name) || !add(name, cidr)) {
+            error = path + ":" + std::to_string(line_number) + ": expected \"<cidr> <group>\"";
+            return false;
+        }
+    }
+
+    build();
+    return true;
+}
+
+}
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../core/data/prefix_table.hpp"
+#include "ip_address.hpp"
+
+namespace netsentry {
+namespace network {
+
+// Named groups of CIDR prefixes (subnets, customer ranges, RFC 1918 blocks)
+// that addresses are attributed to by longest prefix match. A prefix
+// belongs to one group; adding it again moves it. Built once and then only
+// read, so lookups need no locking.
+class SubnetGroups {
+public:
+    static constexpr uint32_t NO_GROUP = data::PrefixTable::NONE;
+
+    SubnetGroups();
+
+    // cidr is "address/length" or a bare address. Returns false if it does
+    // not parse. Lookups only see it after the next build().
+    bool add(const std::string& group, const std::string& cidr);
+
+    // "name=cidr cidr;name2=cidr", as in the subnet_groups setting. Stops at
+    // the first invalid entry and describes it in error; builds on success.
+    bool parse(const std::string& spec, std::string& error);
+
+    // One "cidr group" pair per line; blank lines and # comments are
+    // skipped. Builds on success like parse().
+    bool loadFile(const std::string& path, std::string& error);
+
+    void build() {
+        v4_.build();
+        v6_.build();
+    }
+
+    // Index into names() of the group holding the longest prefix that
+    // matches address, or NO_GROUP.
+    uint32_t lookup(const IpAddress& address) const {
+        if (address.isV4()) {
+            return v4_.lookup(address.bytes.data());
+        }
+        if (address.isV6()) {
+            return v6_.lookup(address.bytes.data());
+        }
+        return NO_GROUP;
+    }
+
+    const std::vector<std::string>& names() const { return names_; }
+
+    size_t groupCount() const { return names_.size(); }
+    size_t prefixCount() const { return v4_.size() + v6_.size(); }
+    size_t memoryUsage() const { return v4_.memoryUsage() + v6_.memoryUsage(); }
+
+private:
+    data::PrefixTable v4_;
+    data::PrefixTable v6_;
+    std::vector<std::string> names_;
+    std::unordered_map<std::string, uint32_t> index_;
+};
+
+}
+}
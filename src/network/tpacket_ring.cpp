@@ -0,0 +1,218 @@
+#include "tpacket_ring.hpp"
+
+#ifdef __linux__
+
+#include "packet_capture.hpp"
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <net/ethernet.h>
+#include <arpa/inet.h>
+
+namespace netsentry {
+namespace network {
+
+namespace {
+
+CaptureError errorFromErrno(int err) {
+    switch (err) {
+        case EPERM:
+        case EACCES:
+            return CaptureError::PERMISSION_DENIED;
+        case ENODEV:
+        case ENXIO:
+            return CaptureError::INTERFACE_NOT_FOUND;
+        default:
+            return CaptureError::SYSTEM_ERROR;
+    }
+}
+
+}
+
+TpacketRing::~TpacketRing() {
+    close();
+}
+
+CaptureError TpacketRing::open(const std::string& interface_name, const RingConfig& config) {
+    if (fd_ >= 0) {
+        return CaptureError::ALREADY_RUNNING;
+    }
+
+    if (config.block_count == 0 || config.frame_size == 0 ||
+        config.block_size < config.frame_size || config.block_size % getpagesize() != 0) {
+        return CaptureError::SYSTEM_ERROR;
+    }
+
+    unsigned int ifindex = if_nametoindex(interface_name.c_str());
+    if (ifindex == 0) {
+        return CaptureError::INTERFACE_NOT_FOUND;
+    }
+
+    // Protocol 0 receives nothing until bind() sets ETH_P_ALL, so frames
+    // cannot slip into the ring before the filter is attached.
+    fd_ = socket(AF_PACKET, SOCK_RAW, 0);
+    if (fd_ < 0) {
+        int err = errno;
+        fd_ = -1;
+        return errorFromErrno(err);
+    }
+
+    int version = TPACKET_V3;
+    if (setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        int err = errno;
+        close();
+        return errorFromErrno(err);
+    }
+
+    tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = config.block_size;
+    req.tp_block_nr = config.block_count;
+    req.tp_frame_size = config.frame_size;
+    req.tp_frame_nr = (config.block_size / config.frame_size) * config.block_count;
+    req.tp_retire_blk_tov = config.block_timeout_ms;
+    req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+
+    if (setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        int err = errno;
+        close();
+        return errorFromErrno(err);
+    }
+
+    map_size_ = static_cast<size_t>(config.block_size) * config.block_count;
+    void* map = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, fd_, 0);
+    if (map == MAP_FAILED) {
+        // MAP_LOCKED needs RLIMIT_MEMLOCK headroom; fall back to a pageable ring.
+        map = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    }
+    if (map == MAP_FAILED) {
+        int err = errno;
+        map_size_ = 0;
+        close();
+        return errorFromErrno(err);
+    }
+
+    map_ = static_cast<uint8_t*>(map);
+    block_size_ = config.block_size;
+    block_count_ = config.block_count;
+    current_block_ = 0;
+
+    if (config.filter_length > 0 && !setFilter(config.filter, config.filter_length)) {
+        int err = errno;
+        close();
+        return errorFromErrno(err);
+    }
+
+    sockaddr_ll addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = static_cast<int>(ifindex);
+
+    if (bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        int err = errno;
+        close();
+        return errorFromErrno(err);
+    }
+
+    if (config.promiscuous) {
+        packet_mreq mreq;
+        memset(&mreq, 0, sizeof(mreq));
+        mreq.mr_ifindex = static_cast<int>(ifindex);
+        mreq.mr_type = PACKET_MR_PROMISC;
+        setsockopt(fd_, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+    }
+
+    if (config.fanout_type >= 0) {
+        int fanout_arg = static_cast<int>(config.fanout_group) | (config.fanout_type << 16);
+        if (setsockopt(fd_, SOL_PACKET, PACKET_FANOUT, &fanout_arg, sizeof(fanout_arg)) < 0) {
+            int err = errno;
+            close();
+            return errorFromErrno(err);
+        }
+    }
+
+    return CaptureError::NONE;
+}
+
+void TpacketRing::close() {
+    if (map_) {
+        munmap(map_, map_size_);
+        map_ = nullptr;
+        map_size_ = 0;
+    }
+
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    block_size_ = 0;
+    block_count_ = 0;
+    current_block_ = 0;
+}
+
+bool TpacketRing::waitForBlock(int timeout_ms) {
+    if (fd_ < 0) {
+        return false;
+    }
+
+    if (blockReady(currentBlock())) {
+        return true;
+    }
+
+    pollfd pfd;
+    pfd.fd = fd_;
+    pfd.events = POLLIN | POLLERR;
+    pfd.revents = 0;
+
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        return false;
+    }
+
+    return blockReady(currentBlock());
+}
+
+bool TpacketRing::setFilter(const sock_filter* instructions, uint16_t count) {
+    if (fd_ < 0) {
+        return false;
+    }
+
+    if (count == 0) {
+        int dummy = 0;
+        return setsockopt(fd_, SOL_SOCKET, SO_DETACH_FILTER, &dummy, sizeof(dummy)) == 0 || errno == ENOENT;
+    }
+
+    sock_fprog program;
+    program.len = count;
+    program.filter = const_cast<sock_filter*>(instructions);
+
+    // The kernel swaps the program atomically, so this is safe while the
+    // capture worker is polling the ring.
+    return setsockopt(fd_, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) == 0;
+}
+
+bool TpacketRing::readStatistics(uint64_t& received, uint64_t& dropped) {
+    if (fd_ < 0) {
+        return false;
+    }
+
+    tpacket_stats_v3 stats;
+    socklen_t len = sizeof(stats);
+    if (getsockopt(fd_, SOL_PACKET, PACKET_STATISTICS, &stats, &len) < 0) {
+        return false;
+    }
+
+    received += stats.tp_packets;
+    dropped += stats.tp_drops;
+    return true;
+}
+
+}
+}
+
+#endif
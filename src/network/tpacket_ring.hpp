@@ -0,0 +1,132 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+
+namespace netsentry {
+namespace network {
+
+enum class CaptureError;
+
+struct RingConfig {
+    uint32_t block_size{1u << 22};
+    uint32_t block_count{64};
+    uint32_t frame_size{2048};
+    uint32_t block_timeout_ms{100};
+    bool promiscuous{true};
+
+    // PACKET_FANOUT type (plus flags) to join after binding; -1 disables fan-out.
+    int fanout_type{-1};
+    uint16_t fanout_group{0};
+
+    // Classic BPF program attached before the socket is bound, so that no
+    // frame enters the ring unfiltered. Only read during open().
+    const sock_filter* filter{nullptr};
+    uint16_t filter_length{0};
+};
+
+// AF_PACKET TPACKET_V3 receive ring. The kernel fills whole blocks of frames
+// and hands them over by flipping the block status; frames are read in place
+// and a block is returned to the kernel only once every frame in it has been
+// consumed, so the steady-state cost is one poll() per block, not per packet.
+// Frames are only valid inside consumeBlock(); callers that keep them copy
+// them out.
+class TpacketRing {
+public:
+    struct Frame {
+        const uint8_t* data;
+        uint32_t caplen;
+        uint32_t len;
+        uint64_t timestamp;
+    };
+
+    TpacketRing() = default;
+    ~TpacketRing();
+
+    TpacketRing(const TpacketRing&) = delete;
+    TpacketRing& operator=(const TpacketRing&) = delete;
+
+    CaptureError open(const std::string& interface_name, const RingConfig& config);
+    void close();
+
+    bool isOpen() const { return fd_ >= 0; }
+    int getFd() const { return fd_; }
+
+    // Attaches a classic BPF program to the socket so that non-matching frames
+    // are dropped by the kernel before they are copied into the ring. An
+    // empty program detaches the current filter.
+    bool setFilter(const sock_filter* instructions, uint16_t count);
+
+    // Adds the kernel's PACKET_STATISTICS counters (packets seen by the
+    // socket, and those dropped because the ring was full) to received and
+    // dropped. The kernel resets them on every read.
+    bool readStatistics(uint64_t& received, uint64_t& dropped);
+
+    // Blocks for up to timeout_ms until the current block belongs to user space.
+    bool waitForBlock(int timeout_ms);
+
+    // Hands every frame of the current block to on_frame and retires the block.
+    // Returns the number of frames consumed, 0 if the block is still owned by
+    // the kernel.
+    template <typename F>
+    size_t consumeBlock(F&& on_frame) {
+        auto* desc = currentBlock();
+        if (!blockReady(desc)) {
+            return 0;
+        }
+
+        const uint32_t num_packets = desc->hdr.bh1.num_pkts;
+        auto* hdr = reinterpret_cast<const tpacket3_hdr*>(
+            reinterpret_cast<const uint8_t*>(desc) + desc->hdr.bh1.offset_to_first_pkt);
+
+        for (uint32_t i = 0; i < num_packets; ++i) {
+            Frame frame;
+            frame.data = reinterpret_cast<const uint8_t*>(hdr) + hdr->tp_mac;
+            frame.caplen = hdr->tp_snaplen;
+            frame.len = hdr->tp_len;
+            frame.timestamp = static_cast<uint64_t>(hdr->tp_sec) * 1000000 + hdr->tp_nsec / 1000;
+
+            on_frame(frame);
+
+            hdr = reinterpret_cast<const tpacket3_hdr*>(
+                reinterpret_cast<const uint8_t*>(hdr) + hdr->tp_next_offset);
+        }
+
+        retireBlock(desc);
+        return num_packets;
+    }
+
+private:
+    int fd_{-1};
+    uint8_t* map_{nullptr};
+    size_t map_size_{0};
+    uint32_t block_size_{0};
+    uint32_t block_count_{0};
+    uint32_t current_block_{0};
+
+    tpacket_block_desc* currentBlock() const {
+        return reinterpret_cast<tpacket_block_desc*>(map_ + static_cast<size_t>(current_block_) * block_size_);
+    }
+
+    static bool blockReady(const tpacket_block_desc* desc) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return (desc->hdr.bh1.block_status & TP_STATUS_USER) != 0;
+    }
+
+    void retireBlock(tpacket_block_desc* desc) {
+        std::atomic_thread_fence(std::memory_order_release);
+        desc->hdr.bh1.block_status = TP_STATUS_KERNEL;
+        current_block_ = (current_block_ + 1) % block_count_;
+    }
+};
+
+}
+}
+
+#endif
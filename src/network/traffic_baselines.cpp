@@ -0,0 +1,182 @@
+#include "traffic_baselines.hpp"
+#include <algorithm>
+
+namespace netsentry {
+namespace network {
+
+TrafficBaselines::TrafficBaselines(const BaselineOptions& options)
+    : options_(options),
+      retention_ticks_(static_cast<uint32_t>(
+          std::max<int64_t>(1, options.idle_retention.count() / std::max<int64_t>(1, options.interval.count())))) {}
+
+void TrafficBaselines::update(const PacketAnalyzer& analyzer, uint64_t now) {
+    auto read = [this](const TrafficRates& rates) {
+        if (options_.interval.count() >= 60) {
+            return rates.last_60s.bytes_per_second;
+        }
+        if (options_.interval.count() >= 10) {
+            return rates.last_10s.bytes_per_second;
+        }
+        return rates.last_1s.bytes_per_second;
+    };
+
+    std::unordered_map<IpAddress, double, IpAddressHash> host_rates;
+    if (!analyzer.isHostSketchEnabled()) {
+        for (const auto& entry : analyzer.getHostTrafficEstimates()) {
+            host_rates.emplace(entry.first, read(entry.second.rates));
+        }
+    }
+
+    std::vector<std::pair<std::string, double>> group_rates;
+    for (const auto& group : analyzer.getSubnetGroupStats()) {
+        group_rates.emplace_back(group.name, read(group.rates));
+    }
+
+    update(host_rates, group_rates, now);
+}
+
+void TrafficBaselines::update(const std::unordered_map<IpAddress, double, IpAddressHash>& host_rates,
+                              const std::vector<std::pair<std::string, double>>& group_rates, uint64_t now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    tick_++;
+    slot_ = slotFor(now);
+    max_host_score_ = 0.0;
+    max_group_score_ = 0.0;
+
+    for (const auto& entry : host_rates) {
+        Baseline* baseline = hosts_.find(entry.first);
+        if (!baseline) {
+            if (hosts_.size() >= options_.max_hosts) {
+                hosts_dropped_++;
+                continue;
+            }
+            baseline = hosts_.tryEmplace(entry.first).first;
+        }
+
+        max_host_score_ = std::max(max_host_score_, observe(*baseline, entry.second, slot_));
+    }
+
+    // Hosts that have gone quiet
+    std::vector<IpAddress> idle;
+
+    for (auto& entry : hosts_) {
+        Baseline& baseline = entry.second;
+        if (baseline.updated == tick_) {
+            continue;
+        }
+
+        max_host_score_ = std::max(max_host_score_, observe(baseline, 0.0, slot_));
+
+        if (tick_ - baseline.active >= retention_ticks_) {
+            idle.push_back(entry.first);
+        }
+    }
+
+    for (const auto& address : idle) {
+        hosts_.erase(address);
+    }
+
+    // Groups start over if they are reconfigured
+    bool regrouped = group_names_.size() != group_rates.size();
+    for (size_t i = 0; i < group_rates.size() && !regrouped; ++i) {
+        regrouped = group_names_[i] != group_rates[i].first;
+    }
+
+    if (regrouped) {
+        group_names_.clear();
+        for (const auto& group : group_rates) {
+            group_names_.push_back(group.first);
+        }
+        groups_.assign(group_rates.size(), Baseline{});
+    }
+
+    for (size_t i = 0; i < group_rates.size(); ++i) {
+        max_group_score_ = std::max(max_group_score_, observe(groups_[i], group_rates[i].second, slot_));
+    }
+}
+
+double TrafficBaselines::observe(Baseline& baseline, double value, size_t slot) {
+    double score = baseline.model.update(value, slot, options_.parameters);
+
+    baseline.observed = static_cast<float>(value);
+    baseline.updated = tick_;
+    if (value > 0.0 || baseline.active == 0) {
+        baseline.active = tick_;
+    }
+
+    return score;
+}
+
+TrafficAnomaly TrafficBaselines::anomaly(std::string name, const Baseline& baseline, size_t slot) {
+    TrafficAnomaly result;
+    result.name = std::move(name);
+    result.observed_bytes_per_second = baseline.observed;
+    result.expected_bytes_per_second = baseline.model.forecast(slot);
+    result.score = baseline.model.score();
+    return result;
+}
+
+std::vector<TrafficAnomaly> TrafficBaselines::getTopHostAnomalies(size_t limit) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<std::pair<double, const std::pair<IpAddress, Baseline>*>> ranked;
+    ranked.reserve(hosts_.size());
+
+    for (const auto& entry : hosts_) {
+        ranked.emplace_back(entry.second.model.score(), &entry);
+    }
+
+    auto higher = [](const auto& a, const auto& b) { return a.first > b.first; };
+    if (ranked.size() > limit) {
+        std::partial_sort(ranked.begin(), ranked.begin() + limit, ranked.end(), higher);
+        ranked.resize(limit);
+    } else {
+        std::sort(ranked.begin(), ranked.end(), higher);
+    }
+
+    std::vector<TrafficAnomaly> result;
+    result.reserve(ranked.size());
+
+    for (const auto& entry : ranked) {
+        result.push_back(anomaly(entry.second->first.toString(), entry.second->second, slot_));
+    }
+
+    return result;
+}
+
+std::vector<TrafficAnomaly> TrafficBaselines::getGroupAnomalies() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<TrafficAnomaly> result;
+    result.reserve(groups_.size());
+
+    for (size_t i = 0; i < groups_.size(); ++i) {
+        result.push_back(anomaly(group_names_[i], groups_[i], slot_));
+    }
+
+    return result;
+}
+
+double TrafficBaselines::getMaxHostScore() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return max_host_score_;
+}
+
+double TrafficBaselines::getMaxGroupScore() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return max_group_score_;
+}
+
+size_t TrafficBaselines::getHostCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hosts_.size();
+}
+
+uint64_t TrafficBaselines::getHostsDropped() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hosts_dropped_;
+}
+
+}
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../core/data/flat_hash_map.hpp"
+#include "../core/data/seasonal_baseline.hpp"
+#include "packet_analyzer.hpp"
+
+namespace netsentry {
+namespace network {
+
+struct BaselineOptions {
+    // Time between observations. The rate window read is the longest of
+    // 1, 10 and 60 seconds that fits in it.
+    std::chrono::seconds interval{60};
+    data::SeasonalBaseline::Parameters parameters;
+    // New hosts are not tracked once this many have a baseline
+    size_t max_hosts{262144};
+    // Baselines of hosts without traffic for this long are dropped
+    std::chrono::seconds idle_retention{86400};
+};
+
+// A host or subnet group's byte rate against its baseline
+struct TrafficAnomaly {
+    // Host address, or group name
+    std::string name;
+    double observed_bytes_per_second{0.0};
+    double expected_bytes_per_second{0.0};
+    // Deviations above (or, if negative, below) the expected rate
+    double score{0.0};
+};
+
+// Per-host and per-subnet-group baselines of traffic, kept by update()
+// from the analyzer's rate windows at a steady tick. Each baseline is a
+// data::SeasonalBaseline with one seasonal slot per hour of the day, so the
+// usual daily rhythm is not scored as anomalous. Hosts missing from a tick
+// are fed a zero rate. Per-host baselines need the exact host table, since
+// the host sketch keeps no rates.
+class TrafficBaselines {
+public:
+    explicit TrafficBaselines(const BaselineOptions& options);
+
+    // Feeds every host and group one observation; O(1) per baseline. now is
+    // in seconds since the epoch and picks the hour of the day.
+    void update(const PacketAnalyzer& analyzer, uint64_t now);
+
+    // The same from rates already read, in bytes per second
+    void update(const std::unordered_map<IpAddress, double, IpAddressHash>& host_rates,
+                const std::vector<std::pair<std::string, double>>& group_rates, uint64_t now);
+
+    // Highest scoring hosts first
+    std::vector<TrafficAnomaly> getTopHostAnomalies(size_t limit) const;
+
+    // In the order the groups were defined
+    std::vector<TrafficAnomaly> getGroupAnomalies() const;
+
+    // Largest scores of the latest tick
+    double getMaxHostScore() const;
+    double getMaxGroupScore() const;
+
+    size_t getHostCount() const;
+    // Hosts left without a baseline because max_hosts was reached
+    uint64_t getHostsDropped() const;
+
+    const BaselineOptions& getOptions() const { return options_; }
+
+private:
+    struct Baseline {
+        data::SeasonalBaseline model;
+        float observed{0.0f};
+        // Ticks, counted from 1
+        uint32_t updated{0};
+        uint32_t active{0};
+    };
+
+    BaselineOptions options_;
+    uint32_t retention_ticks_;
+    uint32_t tick_{0};
+    size_t slot_{0};
+
+    data::FlatHashMap<IpAddress, Baseline, IpAddressHash> hosts_;
+    std::vector<std::string> group_names_;
+    std::vector<Baseline> groups_;
+
+    double max_host_score_{0.0};
+    double max_group_score_{0.0};
+    uint64_t hosts_dropped_{0};
+
+    mutable std::mutex mutex_;
+
+    double observe(Baseline& baseline, double value, size_t slot);
+    static TrafficAnomaly anomaly(std::string name, const Baseline& baseline, size_t slot);
+    static size_t slotFor(uint64_t now) { return (now / 3600) % data::SeasonalBaseline::SEASON_SLOTS; }
+};
+
+}
+}
@@ -0,0 +1,105 @@
+#include "catch2/catch.hpp"
+#include "../src/core/data/bounded_queue.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace netsentry::data;
+
+TEST_CASE("BoundedQueue basic operations", "[bounded_queue]") {
+    BoundedQueue<int> queue(4);
+
+    SECTION("Capacity is rounded up to a power of two") {
+        BoundedQueue<int> odd(5);
+        REQUIRE(odd.capacity() == 8);
+        REQUIRE(queue.capacity() == 4);
+    }
+
+    SECTION("Initial state is empty") {
+        int value = 0;
+        REQUIRE(queue.empty());
+        REQUIRE_FALSE(queue.tryPop(value));
+    }
+
+    SECTION("Items come out in FIFO order") {
+        for (int i = 1; i <= 3; ++i) {
+            int value = i;
+            REQUIRE(queue.tryPush(value));
+        }
+
+        int value = 0;
+        REQUIRE(queue.tryPop(value));
+        REQUIRE(value == 1);
+        REQUIRE(queue.tryPop(value));
+        REQUIRE(value == 2);
+        REQUIRE(queue.size() == 1);
+    }
+
+    SECTION("Push fails when full") {
+        for (int i = 0; i < 4; ++i) {
+            int value = i;
+            REQUIRE(queue.tryPush(value));
+        }
+
+        int value = 99;
+        REQUIRE_FALSE(queue.tryPush(value));
+        REQUIRE(queue.size() == 4);
+
+        REQUIRE(queue.tryPop(value));
+        REQUIRE(value == 0);
+
+        value = 99;
+        REQUIRE(queue.tryPush(value));
+    }
+
+    SECTION("Push swaps storage back to the caller") {
+        BoundedQueue<std::vector<int>> vectors(2);
+
+        std::vector<int> item{1, 2, 3};
+        REQUIRE(vectors.tryPush(item));
+        REQUIRE(item.empty());
+
+        std::vector<int> out;
+        REQUIRE(vectors.tryPop(out));
+        REQUIRE(out.size() == 3);
+    }
+}
+
+TEST_CASE("BoundedQueue concurrent hand-off", "[bounded_queue]") {
+    BoundedQueue<int> queue(64);
+    const int count = 100000;
+
+    std::atomic<long long> consumed_sum{0};
+    std::atomic<int> consumed{0};
+    std::atomic<int> shed{0};
+
+    std::thread consumer([&]() {
+        int value = 0;
+        while (consumed + shed < count) {
+            if (queue.tryPop(value)) {
+                consumed_sum += value;
+                consumed++;
+            }
+        }
+    });
+
+    // The producer sheds the oldest item whenever the queue is full, which
+    // races its own pops against the consumer's.
+    long long shed_sum = 0;
+    for (int i = 1; i <= count; ++i) {
+        int value = i;
+        while (!queue.tryPush(value)) {
+            int dropped = 0;
+            if (queue.tryPop(dropped)) {
+                shed_sum += dropped;
+                shed++;
+            }
+        }
+    }
+
+    consumer.join();
+
+    long long expected = static_cast<long long>(count) * (count + 1) / 2;
+    REQUIRE(consumed + shed == count);
+    REQUIRE(consumed_sum + shed_sum == expected);
+}
@@ -0,0 +1,322 @@
+#include "catch2/catch.hpp"
+#include "../src/network/capture_file.hpp"
+#include "../src/network/packet_capture.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace netsentry::network;
+
+namespace {
+
+void put32(std::vector<uint8_t>& out, uint32_t value) {
+    uint8_t bytes[4];
+    memcpy(bytes, &value, sizeof(bytes));
+    out.insert(out.end(), bytes, bytes + 4);
+}
+
+void put16(std::vector<uint8_t>& out, uint16_t value) {
+    uint8_t bytes[2];
+    memcpy(bytes, &value, sizeof(bytes));
+    out.insert(out.end(), bytes, bytes + 2);
+}
+
+std::string writeFile(const std::string& name, const std::vector<uint8_t>& data) {
+    std::string path = "netsentry_test_" + name;
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    return path;
+}
+
+std::vector<uint8_t> pcapFile(uint32_t magic, uint32_t link_type) {
+    std::vector<uint8_t> out;
+    put32(out, magic);
+    put16(out, 2);
+    put16(out, 4);
+    put32(out, 0);
+    put32(out, 0);
+    put32(out, 65535);
+    put32(out, link_type);
+    return out;
+}
+
+void pcapRecord(std::vector<uint8_t>& out, uint32_t sec, uint32_t frac, const std::vector<uint8_t>& frame) {
+    put32(out, sec);
+    put32(out, frac);
+    put32(out, static_cast<uint32_t>(frame.size()));
+    put32(out, static_cast<uint32_t>(frame.size()));
+    out.insert(out.end(), frame.begin(), frame.end());
+}
+
+// Ethernet, IPv4 10.0.0.1 -> 10.0.1.1, TCP source_port -> 80 and payload
+std::vector<uint8_t> tcpFrame(uint16_t source_port, size_t payload) {
+    std::vector<uint8_t> frame(14 + 20 + 20 + payload, 0x55);
+
+    frame[12] = 0x08;
+    frame[13] = 0x00;
+
+    uint8_t* ip = frame.data() + 14;
+    uint16_t ip_length = static_cast<uint16_t>(20 + 20 + payload);
+    ip[0] = 0x45;
+    ip[2] = static_cast<uint8_t>(ip_length >> 8);
+    ip[3] = static_cast<uint8_t>(ip_length);
+    ip[6] = 0;
+    ip[7] = 0;
+    ip[9] = 6;
+    const uint8_t addresses[8] = {10, 0, 0, 1, 10, 0, 1, 1};
+    memcpy(ip + 12, addresses, sizeof(addresses));
+
+    uint8_t* tcp = ip + 20;
+    tcp[0] = static_cast<uint8_t>(source_port >> 8);
+    tcp[1] = static_cast<uint8_t>(source_port);
+    tcp[2] = 0;
+    tcp[3] = 80;
+    tcp[12] = 5 << 4;
+
+    return frame;
+}
+
+// Ethernet, IPv6 with a Fragment header at fragment_offset (in 8-byte
+// units), then eight bytes that look like a UDP header 5353 -> 53
+std::vector<uint8_t> ipv6FragmentFrame(uint16_t fragment_offset) {
+    std::vector<uint8_t> frame(14 + 40 + 8 + 8 + 16, 0);
+
+    frame[12] = 0x86;
+    frame[13] = 0xDD;
+
+    uint8_t* ip = frame.data() + 14;
+    ip[0] = 0x60;
+    ip[5] = 8 + 8 + 16;
+    ip[6] = 44;
+    ip[7] = 64;
+    ip[23] = 1;
+    ip[39] = 2;
+
+    uint8_t* fragment = ip + 40;
+    fragment[0] = 17;
+    uint16_t offset_field = static_cast<uint16_t>(fragment_offset << 3);
+    fragment[2] = static_cast<uint8_t>(offset_field >> 8);
+    fragment[3] = static_cast<uint8_t>(offset_field);
+
+    uint8_t* udp = fragment + 8;
+    udp[0] = 5353 >> 8;
+    udp[1] = 5353 & 0xFF;
+    udp[2] = 0;
+    udp[3] = 53;
+    udp[5] = 8 + 16;
+
+    return frame;
+}
+
+std::vector<PacketView> replay(const std::string& path, CaptureOptions options) {
+    options.backend = CaptureBackend::FILE;
+    options.replay_speed = 0.0;
+
+    std::vector<PacketView> packets;
+    PacketCapture capture;
+    capture.registerBatchHandler([&packets](const PacketBatch& batch) {
+        packets.insert(packets.end(), batch.begin(), batch.end());
+    });
+
+    if (capture.startCapture(path, options) != CaptureError::NONE) {
+        return packets;
+    }
+    for (int i = 0; i < 200 && !capture.isFinished(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    capture.stopCapture();
+
+    return packets;
+}
+
+}
+
+TEST_CASE("CaptureFileReader reads pcap files", "[capture_file]") {
+    std::vector<uint8_t> frame_a(60, 0xAA);
+    std::vector<uint8_t> frame_b(42, 0xBB);
+
+    SECTION("Microsecond records are returned in order") {
+        auto data = pcapFile(0xA1B2C3D4, 1);
+        pcapRecord(data, 10, 500, frame_a);
+        pcapRecord(data, 11, 0, frame_b);
+        auto path = writeFile("usec.pcap", data);
+
+        CaptureFileReader reader;
+        REQUIRE(reader.open(path) == CaptureError::NONE);
+
+        CaptureFileReader::Frame frame;
+        REQUIRE(reader.next(frame));
+        REQUIRE(frame.caplen == 60);
+        REQUIRE(frame.data[0] == 0xAA);
+        REQUIRE(frame.timestamp == 10000500);
+
+        REQUIRE(reader.next(frame));
+        REQUIRE(frame.caplen == 42);
+        REQUIRE(frame.timestamp == 11000000);
+
+        REQUIRE_FALSE(reader.next(frame));
+
+        reader.close();
+        std::remove(path.c_str());
+    }
+
+    SECTION("Nanosecond timestamps are converted to microseconds") {
+        auto data = pcapFile(0xA1B23C4D, 1);
+        pcapRecord(data, 1, 2500, frame_a);
+        auto path = writeFile("nsec.pcap", data);
+
+        CaptureFileReader reader;
+        REQUIRE(reader.open(path) == CaptureError::NONE);
+
+        CaptureFileReader::Frame frame;
+        REQUIRE(reader.next(frame));
+        REQUIRE(frame.timestamp == 1000002);
+
+        reader.close();
+        std::remove(path.c_str());
+    }
+
+    SECTION("Truncated records end the stream") {
+        auto data = pcapFile(0xA1B2C3D4, 1);
+        pcapRecord(data, 1, 0, frame_a);
+        data.resize(data.size() - 10);
+        auto path = writeFile("truncated.pcap", data);
+
+        CaptureFileReader reader;
+        REQUIRE(reader.open(path) == CaptureError::NONE);
+
+        CaptureFileReader::Frame frame;
+        REQUIRE_FALSE(reader.next(frame));
+
+        reader.close();
+        std::remove(path.c_str());
+    }
+
+    SECTION("Non-Ethernet link types are rejected") {
+        auto path = writeFile("raw.pcap", pcapFile(0xA1B2C3D4, 101));
+
+        CaptureFileReader reader;
+        REQUIRE(reader.open(path) == CaptureError::UNSUPPORTED_FORMAT);
+
+        std::remove(path.c_str());
+    }
+
+    SECTION("Missing files report INTERFACE_NOT_FOUND") {
+        CaptureFileReader reader;
+        REQUIRE(reader.open("netsentry_test_missing.pcap") == CaptureError::INTERFACE_NOT_FOUND);
+    }
+}
+
+TEST_CASE("CaptureFileReader reads pcapng files", "[capture_file]") {
+    std::vector<uint8_t> data;
+
+    // Section header block
+    put32(data, 0x0A0D0D0A);
+    put32(data, 28);
+    put32(data, 0x1A2B3C4D);
+    put16(data, 1);
+    put16(data, 0);
+    put32(data, 0xFFFFFFFF);
+    put32(data, 0xFFFFFFFF);
+    put32(data, 28);
+
+    // Interface description block with if_tsresol = 10^-9
+    put32(data, 1);
+    put32(data, 32);
+    put16(data, 1);
+    put16(data, 0);
+    put32(data, 65535);
+    put16(data, 9);
+    put16(data, 1);
+    data.insert(data.end(), {9, 0, 0, 0});
+    put32(data, 0);
+    put32(data, 32);
+
+    // Enhanced packet block carrying a 60-byte frame
+    uint64_t ticks = 3000000000ULL + 7000;
+    put32(data, 6);
+    put32(data, 32 + 60);
+    put32(data, 0);
+    put32(data, static_cast<uint32_t>(ticks >> 32));
+    put32(data, static_cast<uint32_t>(ticks));
+    put32(data, 60);
+    put32(data, 60);
+    data.insert(data.end(), 60, 0xCC);
+    put32(data, 32 + 60);
+
+    auto path = writeFile("capture.pcapng", data);
+
+    CaptureFileReader reader;
+    REQUIRE(reader.open(path) == CaptureError::NONE);
+
+    CaptureFileReader::Frame frame;
+    REQUIRE(reader.next(frame));
+    REQUIRE(frame.caplen == 60);
+    REQUIRE(frame.data[0] == 0xCC);
+    REQUIRE(frame.timestamp == 3000007);
+
+    REQUIRE_FALSE(reader.next(frame));
+
+    reader.close();
+    std::remove(path.c_str());
+}
+
+TEST_CASE("PacketCapture keeps headers only for classified flows", "[capture_file]") {
+    auto data = pcapFile(0xA1B2C3D4, 1);
+    pcapRecord(data, 1, 0, tcpFrame(40000, 100));
+    pcapRecord(data, 1, 1, tcpFrame(40001, 100));
+    auto path = writeFile("classified.pcap", data);
+
+    const uint8_t client[4] = {10, 0, 0, 1};
+    const uint8_t server[4] = {10, 0, 1, 1};
+    auto classified = std::make_shared<ClassifiedFlowSet>();
+    classified->insert(flowHash(IpAddress::fromV4(client), 40000, IpAddress::fromV4(server), 80, 6));
+
+    CaptureOptions options;
+    options.capture_payload = false;
+    options.classified_flows = classified;
+    options.payload_max_size = 64;
+
+    auto packets = replay(path, options);
+    REQUIRE(packets.size() == 2);
+
+    // The classified flow is trimmed to its headers; the other keeps up to
+    // payload_max_size bytes of payload for its parser
+    REQUIRE(packets[0].source_port == 40000);
+    REQUIRE(packets[0].payloadSize() == 0);
+    REQUIRE(packets[0].caplen == 54);
+    REQUIRE(packets[0].size == 154);
+
+    REQUIRE(packets[1].source_port == 40001);
+    REQUIRE(packets[1].payloadSize() == 64);
+    REQUIRE(packets[1].payload()[0] == 0x55);
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("PacketCapture parses only the first IPv6 fragment's transport header", "[capture_file]") {
+    auto data = pcapFile(0xA1B2C3D4, 1);
+    pcapRecord(data, 1, 0, ipv6FragmentFrame(0));
+    pcapRecord(data, 1, 1, ipv6FragmentFrame(185));
+    auto path = writeFile("ipv6_fragments.pcap", data);
+
+    auto packets = replay(path, CaptureOptions{});
+    REQUIRE(packets.size() == 2);
+
+    REQUIRE(packets[0].protocol == 17);
+    REQUIRE(packets[0].source_port == 5353);
+    REQUIRE(packets[0].dest_port == 53);
+
+    // A later fragment starts mid-datagram; its bytes are not ports
+    REQUIRE(packets[1].protocol == 17);
+    REQUIRE(packets[1].source_port == 0);
+    REQUIRE(packets[1].dest_port == 0);
+    REQUIRE(packets[1].payloadSize() == 0);
+
+    std::remove(path.c_str());
+}
@@ -0,0 +1,59 @@
+#include "catch2/catch.hpp"
+#include "../src/network/classified_flow_set.hpp"
+
+using namespace netsentry::network;
+
+TEST_CASE("ClassifiedFlowSet membership", "[classified_flow_set]") {
+    ClassifiedFlowSet flows(8);
+    REQUIRE(flows.capacity() == 8);
+
+    SECTION("Inserted flows are found until erased") {
+        flows.insert(0x1234);
+        REQUIRE(flows.contains(0x1234));
+        REQUIRE_FALSE(flows.contains(0x1235));
+
+        flows.erase(0x1234);
+        REQUIRE_FALSE(flows.contains(0x1234));
+
+        flows.insert(0x1234);
+        REQUIRE(flows.contains(0x1234));
+
+        flows.clear();
+        REQUIRE_FALSE(flows.contains(0x1234));
+    }
+
+    SECTION("Zero is a valid hash") {
+        REQUIRE_FALSE(flows.contains(0));
+        flows.insert(0);
+        REQUIRE(flows.contains(0));
+    }
+
+    SECTION("A colliding flow takes over the slot") {
+        // Same slot, different upper bits
+        uint64_t first = 0x100 | 3;
+        uint64_t second = 0x200 | 3;
+
+        flows.insert(first);
+        flows.insert(second);
+        REQUIRE(flows.contains(second));
+        REQUIRE_FALSE(flows.contains(first));
+
+        // Erasing the evicted flow leaves the slot's new owner alone
+        flows.erase(first);
+        REQUIRE(flows.contains(second));
+
+        flows.erase(second);
+        REQUIRE_FALSE(flows.contains(second));
+    }
+
+    SECTION("Hashes differing in any bit are told apart") {
+        uint64_t hash = 0xDEADBEEFCAFEF00DULL;
+        flows.insert(hash);
+
+        for (unsigned bit = 0; bit < 64; ++bit) {
+            REQUIRE_FALSE(flows.contains(hash ^ (1ULL << bit)));
+        }
+        REQUIRE(flows.contains(hash));
+        REQUIRE_FALSE(flows.contains(~0ULL));
+    }
+}
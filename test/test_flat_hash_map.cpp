@@ -0,0 +1,154 @@
+#include "catch2/catch.hpp"
+#include "../src/core/data/flat_hash_map.hpp"
+#include <string>
+#include <unordered_map>
+
+using namespace netsentry::data;
+
+namespace {
+
+struct MixHash {
+    uint64_t operator()(uint64_t key) const {
+        key ^= key >> 33;
+        key *= 0xFF51AFD7ED558CCDULL;
+        key ^= key >> 33;
+        return key;
+    }
+};
+
+// Collapses every key onto one group to exercise long probe chains
+struct CollidingHash {
+    uint64_t operator()(uint64_t key) const {
+        return (key & 1) << 57;
+    }
+};
+
+}
+
+TEST_CASE("FlatHashMap basic operations", "[flat_hash_map]") {
+    FlatHashMap<uint64_t, std::string, MixHash> map;
+
+    SECTION("Initial state is empty") {
+        REQUIRE(map.empty());
+        REQUIRE(map.find(1) == nullptr);
+        REQUIRE(map.begin() == map.end());
+    }
+
+    SECTION("Emplace inserts once") {
+        auto inserted = map.tryEmplace(7);
+        REQUIRE(inserted.second);
+        *inserted.first = "seven";
+
+        auto again = map.tryEmplace(7);
+        REQUIRE_FALSE(again.second);
+        REQUIRE(*again.first == "seven");
+        REQUIRE(map.size() == 1);
+    }
+
+    SECTION("Erased values are released and can be reinserted") {
+        *map.tryEmplace(3).first = "three";
+        REQUIRE(map.erase(3));
+        REQUIRE_FALSE(map.erase(3));
+        REQUIRE(map.find(3) == nullptr);
+
+        auto inserted = map.tryEmplace(3);
+        REQUIRE(inserted.second);
+        REQUIRE(inserted.first->empty());
+    }
+
+    SECTION("Reserve avoids growth") {
+        map.reserve(1000);
+        size_t capacity = map.capacity();
+
+        for (uint64_t i = 0; i < 1000; ++i) {
+            map.tryEmplace(i);
+        }
+
+        REQUIRE(map.capacity() == capacity);
+    }
+}
+
+TEST_CASE("FlatHashMap resumable scan", "[flat_hash_map]") {
+    FlatHashMap<uint64_t, uint64_t, MixHash> map(1000);
+    for (uint64_t key = 0; key < 1000; ++key) {
+        *map.tryEmplace(key).first = key;
+    }
+
+    // Each call covers at most the given number of slots
+    size_t cursor = 0;
+    size_t calls = 0;
+    std::unordered_map<uint64_t, int> seen;
+    while (cursor < map.capacity()) {
+        size_t visited = 0;
+        size_t next = map.scan(cursor, 100, [&](uint64_t key, uint64_t& value) {
+            REQUIRE(key == value);
+            ++seen[key];
+            ++visited;
+        });
+        REQUIRE(next - cursor <= 100);
+        REQUIRE(visited <= 100);
+        cursor = next;
+        ++calls;
+    }
+
+    REQUIRE(calls == (map.capacity() + 99) / 100);
+    REQUIRE(seen.size() == 1000);
+    for (const auto& entry : seen) {
+        REQUIRE(entry.second == 1);
+    }
+}
+
+TEST_CASE("FlatHashMap matches a reference map", "[flat_hash_map]") {
+    SECTION("Well-distributed hash") {
+        FlatHashMap<uint64_t, uint64_t, MixHash> map;
+        std::unordered_map<uint64_t, uint64_t> reference;
+
+        uint64_t state = 1;
+        for (int i = 0; i < 200000; ++i) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            uint64_t key = (state >> 33) % 5000;
+
+            if ((state >> 20) % 3 == 0) {
+                REQUIRE(map.erase(key) == (reference.erase(key) == 1));
+            } else {
+                *map.tryEmplace(key).first += i;
+                reference[key] += i;
+            }
+        }
+
+        REQUIRE(map.size() == reference.size());
+
+        size_t visited = 0;
+        for (const auto& entry : map) {
+            REQUIRE(reference.at(entry.first) == entry.second);
+            ++visited;
+        }
+        REQUIRE(visited == reference.size());
+    }
+
+    SECTION("Every key colliding") {
+        FlatHashMap<uint64_t, uint64_t, CollidingHash> map;
+
+        for (uint64_t key = 0; key < 100; ++key) {
+            *map.tryEmplace(key).first = key * 2;
+        }
+        for (uint64_t key = 0; key < 100; key += 2) {
+            REQUIRE(map.erase(key));
+        }
+
+        REQUIRE(map.size() == 50);
+        for (uint64_t key = 0; key < 100; ++key) {
+            auto value = map.find(key);
+            if (key % 2 == 0) {
+                REQUIRE(value == nullptr);
+            } else {
+                REQUIRE(value != nullptr);
+                REQUIRE(*value == key * 2);
+            }
+        }
+
+        map.clear();
+        REQUIRE(map.empty());
+        REQUIRE(map.find(1) == nullptr);
+    }
+}
@@ -0,0 +1,225 @@
+#include "catch2/catch.hpp"
+#include "../src/network/flow_exporter.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace netsentry::network;
+
+namespace {
+
+// Local UDP socket standing in for the collector
+class Listener {
+public:
+    Listener() {
+        fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+
+        socklen_t length = sizeof(address);
+        getsockname(fd_, reinterpret_cast<sockaddr*>(&address), &length);
+        port_ = ntohs(address.sin_port);
+
+        timeval timeout{2, 0};
+        setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+
+    ~Listener() { close(fd_); }
+
+    uint16_t port() const { return port_; }
+
+    std::vector<uint8_t> receive() {
+        std::vector<uint8_t> message(65536);
+        ssize_t size = recv(fd_, message.data(), message.size(), 0);
+        message.resize(size > 0 ? static_cast<size_t>(size) : 0);
+        return message;
+    }
+
+private:
+    int fd_;
+    uint16_t port_;
+};
+
+uint64_t read(const std::vector<uint8_t>& message, size_t offset, size_t length) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < length; ++i) {
+        value = (value << 8) | message[offset + i];
+    }
+    return value;
+}
+
+ConnectionKey makeKey(uint8_t host) {
+    const uint8_t client[4] = {10, 0, 0, host};
+    const uint8_t server[4] = {192, 0, 2, 1};
+
+    ConnectionKey key;
+    key.source_ip = IpAddress::fromV4(client);
+    key.dest_ip = IpAddress::fromV4(server);
+    key.source_port = 40000;
+    key.dest_port = 443;
+    key.protocol = 6;
+    return key;
+}
+
+ConnectionStats makeStats() {
+    ConnectionStats stats;
+    stats.bytes_sent = 1200;
+    stats.packets_sent = 10;
+    stats.bytes_received = 64000;
+    stats.packets_received = 50;
+    stats.first_seen = 1700000000000000ULL;
+    stats.last_seen = 1700000005000000ULL;
+    stats.tcp_flags = 0x1B;
+    stats.tcp_flags_sent = 0x1A;
+    stats.tcp_flags_received = 0x13;
+    return stats;
+}
+
+}
+
+TEST_CASE("FlowExporter sends IPFIX", "[flow_exporter]") {
+    Listener listener;
+
+    FlowExportOptions options;
+    options.collector_port = listener.port();
+    options.observation_domain = 7;
+    options.interval = std::chrono::hours(1);
+
+    FlowExporter exporter(options);
+    REQUIRE(exporter.start());
+
+    exporter.addFlow(makeKey(1), makeStats(), FlowEndReason::END_OF_FLOW);
+    exporter.flush();
+
+    auto message = listener.receive();
+    REQUIRE(message.size() > 16);
+
+    // Message header
+    REQUIRE(read(message, 0, 2) == 10);
+    REQUIRE(read(message, 2, 2) == message.size());
+    REQUIRE(read(message, 8, 4) == 0);
+    REQUIRE(read(message, 12, 4) == 7);
+
+    // Template set with the IPv4 and IPv6 templates
+    size_t offset = 16;
+    REQUIRE(read(message, offset, 2) == 2);
+    REQUIRE(read(message, offset + 4, 2) == 256);
+    REQUIRE(read(message, offset + 6, 2) == 11);
+    offset += read(message, offset + 2, 2);
+
+    // Data set with one record per direction, 47 bytes each
+    REQUIRE(read(message, offset, 2) == 256);
+    REQUIRE(read(message, offset + 2, 2) == 4 + 2 * 47);
+
+    size_t record = offset + 4;
+    REQUIRE(read(message, record, 4) == 0x0A000001);
+    REQUIRE(read(message, record + 4, 4) == 0xC0000201);
+    REQUIRE(read(message, record + 8, 2) == 40000);
+    REQUIRE(read(message, record + 10, 2) == 443);
+    REQUIRE(read(message, record + 12, 1) == 6);
+    REQUIRE(read(message, record + 13, 1) == 0x1A);
+    REQUIRE(read(message, record + 14, 8) == 1200);
+    REQUIRE(read(message, record + 22, 8) == 10);
+    REQUIRE(read(message, record + 30, 8) == 1700000000000ULL);
+    REQUIRE(read(message, record + 38, 8) == 1700000005000ULL);
+    REQUIRE(read(message, record + 46, 1) == 3);
+
+    // The reverse direction
+    record += 47;
+    REQUIRE(read(message, record, 4) == 0xC0000201);
+    REQUIRE(read(message, record + 8, 2) == 443);
+    REQUIRE(read(message, record + 13, 1) == 0x13);
+    REQUIRE(read(message, record + 14, 8) == 64000);
+
+    // Later messages carry no templates and count the records sent before
+    exporter.addFlow(makeKey(2), makeStats(), FlowEndReason::IDLE_TIMEOUT);
+    exporter.flush();
+
+    message = listener.receive();
+    REQUIRE(read(message, 8, 4) == 2);
+    REQUIRE(read(message, 16, 2) == 256);
+
+    exporter.stop();
+    REQUIRE(exporter.getStats().records_exported == 4);
+    REQUIRE(exporter.getStats().messages_sent == 2);
+}
+
+TEST_CASE("FlowExporter sends NetFlow v9", "[flow_exporter]") {
+    Listener listener;
+
+    FlowExportOptions options;
+    options.collector_port = listener.port();
+    options.format = FlowExportFormat::NETFLOW_V9;
+    options.interval = std::chrono::hours(1);
+
+    FlowExporter exporter(options);
+    REQUIRE(exporter.start());
+
+    ConnectionStats stats = makeStats();
+    stats.packets_received = 0;
+    stats.bytes_received = 0;
+
+    exporter.addFlow(makeKey(1), stats, FlowEndReason::END_OF_FLOW);
+    exporter.flush();
+
+    auto message = listener.receive();
+
+    // Two template records and one data record
+    REQUIRE(read(message, 0, 2) == 9);
+    REQUIRE(read(message, 2, 2) == 3);
+    REQUIRE(read(message, 12, 4) == 0);
+
+    size_t offset = 20;
+    REQUIRE(read(message, offset, 2) == 0);
+    offset += read(message, offset + 2, 2);
+
+    // 38-byte record padded to 40
+    REQUIRE(read(message, offset, 2) == 256);
+    REQUIRE(read(message, offset + 2, 2) == 4 + 40);
+    REQUIRE(offset + 44 == message.size());
+    REQUIRE(read(message, offset + 4 + 14, 8) == 1200);
+}
+
+TEST_CASE("FlowExporter splits large batches", "[flow_exporter]") {
+    Listener listener;
+
+    FlowExportOptions options;
+    options.collector_port = listener.port();
+    options.max_message_size = 512;
+    options.interval = std::chrono::hours(1);
+
+    FlowExporter exporter(options);
+    REQUIRE(exporter.start());
+
+    for (int i = 0; i < 50; ++i) {
+        exporter.addFlow(makeKey(static_cast<uint8_t>(i)), makeStats(), FlowEndReason::IDLE_TIMEOUT);
+    }
+    exporter.flush();
+
+    size_t records = 0;
+    uint64_t expected_sequence = 0;
+
+    while (records < 100) {
+        auto message = listener.receive();
+        REQUIRE(!message.empty());
+        REQUIRE(message.size() <= 512);
+        REQUIRE(read(message, 8, 4) == expected_sequence);
+
+        for (size_t offset = 16; offset < message.size(); offset += read(message, offset + 2, 2)) {
+            if (read(message, offset, 2) == 256) {
+                size_t count = (read(message, offset + 2, 2) - 4) / 47;
+                records += count;
+                expected_sequence += count;
+            }
+        }
+    }
+
+    REQUIRE(records == 100);
+    REQUIRE(exporter.getStats().records_exported == 100);
+}
@@ -0,0 +1,66 @@
+#include "catch2/catch.hpp"
+#include "../src/core/data/latency_histogram.hpp"
+
+using namespace netsentry::data;
+
+TEST_CASE("LatencyHistogram buckets by powers of two", "[latency_histogram]") {
+    REQUIRE(LatencyHistogram::bucketFor(0) == 0);
+    REQUIRE(LatencyHistogram::bucketFor(1) == 1);
+    REQUIRE(LatencyHistogram::bucketFor(2) == 2);
+    REQUIRE(LatencyHistogram::bucketFor(3) == 2);
+    REQUIRE(LatencyHistogram::bucketFor(1000) == 10);
+    REQUIRE(LatencyHistogram::lowerBound(10) == 512);
+
+    // Everything from 2^22 us up shares the last bucket
+    REQUIRE(LatencyHistogram::bucketFor(1ULL << 22) == LatencyHistogram::BUCKET_COUNT - 1);
+    REQUIRE(LatencyHistogram::bucketFor(~0ULL) == LatencyHistogram::BUCKET_COUNT - 1);
+
+    // Wider bucket sets share the same boundaries
+    REQUIRE(log2_buckets::bucketFor(1000, 65) == 10);
+    REQUIRE(log2_buckets::bucketFor(1ULL << 40, 65) == 41);
+    REQUIRE(log2_buckets::bucketFor(~0ULL, 65) == 64);
+}
+
+TEST_CASE("LatencyHistogram percentiles", "[latency_histogram]") {
+    LatencyHistogram histogram;
+    REQUIRE(histogram.count() == 0);
+    REQUIRE(histogram.percentile(0.5) == 0.0);
+
+    SECTION("Percentiles stay within the bucket holding them") {
+        for (int i = 0; i < 90; ++i) {
+            histogram.add(1000);
+        }
+        for (int i = 0; i < 10; ++i) {
+            histogram.add(100000);
+        }
+
+        REQUIRE(histogram.count() == 100);
+
+        double median = histogram.percentile(0.5);
+        REQUIRE(median >= 512.0);
+        REQUIRE(median < 1024.0);
+
+        double p99 = histogram.percentile(0.99);
+        REQUIRE(p99 >= 65536.0);
+        REQUIRE(p99 < 131072.0);
+    }
+
+    SECTION("The last bucket reports its lower bound") {
+        histogram.add(60000000);
+        REQUIRE(histogram.percentile(1.0) == static_cast<double>(1ULL << 22));
+    }
+
+    SECTION("Merging adds bucket counts") {
+        LatencyHistogram other;
+        histogram.add(10);
+        other.add(10);
+        other.add(5000);
+
+        histogram.merge(other);
+        REQUIRE(histogram.count() == 3);
+        REQUIRE(histogram.buckets()[LatencyHistogram::bucketFor(10)] == 2);
+
+        histogram.clear();
+        REQUIRE(histogram.count() == 0);
+    }
+}
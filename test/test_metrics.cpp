@@ -79,3 +79,59 @@ TEST_CASE("CounterMetric operations", "[metrics]") {
         REQUIRE(*time_point == 10.0);
     }
 }
+
+TEST_CASE("HistogramMetric operations", "[metrics]") {
+    HistogramMetric histogram("test.histogram");
+
+    SECTION("Initial state is empty") {
+        REQUIRE(histogram.getCount() == 0);
+        REQUIRE(histogram.getCurrentValue() == 0.0);
+        REQUIRE_FALSE(histogram.getValueAt(std::chrono::system_clock::now()).has_value());
+    }
+
+    SECTION("Current value is the mean") {
+        histogram.observe(10);
+        histogram.observe(30);
+
+        REQUIRE(histogram.getCount() == 2);
+        REQUIRE(histogram.getCurrentValue() == 20.0);
+        REQUIRE(histogram.getMax() == 30);
+    }
+
+    SECTION("Percentiles fall in the right power-of-two bucket") {
+        for (int i = 0; i < 99; ++i) {
+            histogram.observe(100);
+        }
+        histogram.observe(5000);
+
+        auto buckets = histogram.getBuckets();
+        double p50 = HistogramMetric::percentile(buckets, 0.50);
+        double p999 = HistogramMetric::percentile(buckets, 0.999);
+
+        REQUIRE(p50 >= 64.0);
+        REQUIRE(p50 <= 128.0);
+        REQUIRE(p999 >= 4096.0);
+        REQUIRE(p999 <= 8192.0);
+    }
+
+    SECTION("Merged buckets count like observations") {
+        histogram.observe(100);
+
+        HistogramMetric::Buckets buckets{};
+        buckets[HistogramMetric::bucketFor(10)] = 2;
+        buckets[HistogramMetric::bucketFor(5000)] = 1;
+        histogram.merge(buckets, 5020, 5000);
+
+        REQUIRE(histogram.getCount() == 4);
+        REQUIRE(histogram.getCurrentValue() == 1280.0);
+        REQUIRE(histogram.getMax() == 5000);
+        REQUIRE(histogram.getBuckets()[HistogramMetric::bucketFor(10)] == 2);
+    }
+
+    SECTION("Zero is recorded in its own bucket") {
+        histogram.observe(0);
+
+        REQUIRE(histogram.getBuckets()[0] == 1);
+        REQUIRE(HistogramMetric::percentile(histogram.getBuckets(), 0.5) == 0.0);
+    }
+}
@@ -0,0 +1,1014 @@
+#include "catch2/catch.hpp"
+#include "../src/network/packet_analyzer.hpp"
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace netsentry::network;
+
+namespace {
+
+PacketView makePacket(uint8_t host, uint16_t source_port, uint32_t size) {
+    const uint8_t client[4] = {10, 0, 0, host};
+    const uint8_t server[4] = {10, 0, 1, 1};
+
+    PacketView packet;
+    packet.size = size;
+    packet.source_ip = IpAddress::fromV4(client);
+    packet.dest_ip = IpAddress::fromV4(server);
+    packet.source_port = source_port;
+    packet.dest_port = 9;
+    packet.protocol = 17;
+    return packet;
+}
+
+}
+
+TEST_CASE("PacketAnalyzer sampling", "[packet_analyzer]") {
+    PacketAnalyzer analyzer;
+
+    SECTION("Unsampled counters are exact") {
+        for (int i = 0; i < 10; ++i) {
+            analyzer.processPacket(makePacket(1, 1000, 100));
+        }
+
+        auto stats = analyzer.getConnectionStats(
+            PacketAnalyzer::createConnectionKey(makePacket(1, 1000, 100)));
+        REQUIRE(stats);
+        REQUIRE(stats->packets_sent + stats->packets_received == 10);
+        REQUIRE(stats->sampling_rate == 1);
+        REQUIRE(stats->error_bound == 0.0);
+    }
+
+    SECTION("Packet sampling scales counters and reports a bound") {
+        analyzer.setSampling(SamplingMode::PACKET, 4);
+        REQUIRE(analyzer.getSamplingRate() == 4);
+
+        for (int i = 0; i < 400; ++i) {
+            analyzer.processPacket(makePacket(1, 1000, 100));
+        }
+
+        auto stats = analyzer.getConnectionStats(
+            PacketAnalyzer::createConnectionKey(makePacket(1, 1000, 100)));
+        REQUIRE(stats);
+        REQUIRE(stats->packets_sent + stats->packets_received == 400);
+        REQUIRE(stats->bytes_sent + stats->bytes_received == 40000);
+        REQUIRE(stats->sampling_rate == 4);
+        REQUIRE(stats->error_bound > 0.0);
+        REQUIRE(stats->error_bound < 0.25);
+
+        auto hosts = analyzer.getHostTrafficEstimates();
+        REQUIRE(hosts.size() == 2);
+        for (const auto& host : hosts) {
+            REQUIRE(host.second.bytes == 40000);
+            REQUIRE(host.second.error_bound == Approx(stats->error_bound));
+        }
+    }
+
+    SECTION("Flow sampling keeps whole flows") {
+        analyzer.setSampling(SamplingMode::FLOW, 4);
+
+        const int flows = 2000;
+        for (int flow = 0; flow < flows; ++flow) {
+            for (int i = 0; i < 3; ++i) {
+                analyzer.processPacket(makePacket(1, static_cast<uint16_t>(1024 + flow), 100));
+            }
+        }
+
+        auto connections = analyzer.getTopConnections(flows);
+        REQUIRE(connections.size() > flows / 8);
+        REQUIRE(connections.size() < flows / 2);
+
+        for (const auto& connection : connections) {
+            REQUIRE(connection.second.packets_sent + connection.second.packets_received == 3);
+            REQUIRE(connection.second.error_bound == 0.0);
+        }
+
+        auto hosts = analyzer.getHostTrafficStats();
+        double expected = flows * 3 * 100.0;
+        for (const auto& host : hosts) {
+            REQUIRE(host.second == Approx(expected).epsilon(0.2));
+        }
+    }
+
+    SECTION("A rate of one disables sampling") {
+        analyzer.setSampling(SamplingMode::PACKET, 1);
+        REQUIRE(analyzer.getSamplingMode() == SamplingMode::NONE);
+    }
+}
+
+TEST_CASE("PacketAnalyzer flow sharding", "[packet_analyzer]") {
+    PacketAnalyzer analyzer(4);
+
+    std::vector<PacketView> packets;
+    for (int flow = 0; flow < 64; ++flow) {
+        PacketView request = makePacket(static_cast<uint8_t>(flow), 2000, 60);
+
+        PacketView reply = request;
+        std::swap(reply.source_ip, reply.dest_ip);
+        std::swap(reply.source_port, reply.dest_port);
+        reply.size = 1500;
+
+        packets.push_back(request);
+        packets.push_back(reply);
+    }
+
+    analyzer.processBatch(PacketBatch{packets.data(), packets.size()});
+
+    SECTION("Both directions of a flow share one entry") {
+        auto connections = analyzer.getTopConnections(1000);
+        REQUIRE(connections.size() == 64);
+
+        for (const auto& connection : connections) {
+            REQUIRE(connection.second.packets_sent == 1);
+            REQUIRE(connection.second.packets_received == 1);
+        }
+    }
+
+    SECTION("Lookups find the owning shard from either direction") {
+        auto stats = analyzer.getConnectionStats(PacketAnalyzer::createConnectionKey(packets[1]));
+        REQUIRE(stats);
+        REQUIRE(stats->bytes_sent + stats->bytes_received == 1560);
+    }
+
+    SECTION("Host totals are merged across shards") {
+        const uint8_t server[4] = {10, 0, 1, 1};
+        auto hosts = analyzer.getHostTrafficStats();
+        REQUIRE(hosts.size() == 65);
+        REQUIRE(hosts[IpAddress::fromV4(server)] == 64 * 1560);
+    }
+}
+
+TEST_CASE("PacketAnalyzer flow expiry", "[packet_analyzer]") {
+    const uint64_t second = 1000000;
+
+    PacketAnalyzer analyzer(2);
+    std::vector<std::pair<ConnectionKey, FlowEndReason>> ended;
+    analyzer.setFlowExpiredHandler([&ended](const ConnectionKey& key, const ConnectionStats&, FlowEndReason reason) {
+        ended.emplace_back(key, reason);
+    });
+
+    FlowTimeouts timeouts;
+    timeouts.udp_idle = std::chrono::seconds(10);
+    timeouts.tcp_idle = std::chrono::seconds(100);
+    timeouts.tcp_closed = std::chrono::seconds(2);
+    timeouts.active = std::chrono::seconds(60);
+    analyzer.setFlowTimeouts(timeouts);
+
+    PacketView udp = makePacket(1, 1000, 100);
+    udp.timestamp = 1000 * second;
+
+    SECTION("Idle flows expire and release host entries") {
+        analyzer.processPacket(udp);
+        REQUIRE(analyzer.getHostTrafficStats().size() == 2);
+
+        analyzer.expireFlows(udp.timestamp + 9 * second);
+        REQUIRE(ended.empty());
+
+        analyzer.expireFlows(udp.timestamp + 11 * second);
+        REQUIRE(ended.size() == 1);
+        REQUIRE(ended[0].second == FlowEndReason::IDLE_TIMEOUT);
+        REQUIRE(analyzer.getTopConnections(10).empty());
+        REQUIRE(analyzer.getHostTrafficStats().empty());
+    }
+
+    SECTION("Traffic keeps a flow alive until the active timeout") {
+        for (int i = 0; i <= 70; i += 5) {
+            PacketView packet = udp;
+            packet.timestamp += i * second;
+            analyzer.processPacket(packet);
+        }
+
+        REQUIRE(ended.size() == 1);
+        REQUIRE(ended[0].second == FlowEndReason::ACTIVE_TIMEOUT);
+
+        // The packets after the split started a new record
+        REQUIRE(analyzer.getTopConnections(10).size() == 1);
+    }
+
+    SECTION("TCP flows end shortly after a FIN") {
+        uint8_t tcp_header[20] = {};
+        tcp_header[13] = 0x11;
+
+        PacketView fin = udp;
+        fin.protocol = 6;
+        fin.data = tcp_header;
+        fin.caplen = sizeof(tcp_header);
+        fin.payload_offset = sizeof(tcp_header);
+        analyzer.processPacket(fin);
+
+        analyzer.expireFlows(fin.timestamp + 3 * second);
+        REQUIRE(ended.size() == 1);
+        REQUIRE(ended[0].second == FlowEndReason::END_OF_FLOW);
+    }
+
+    SECTION("Flushing ends every flow") {
+        for (int flow = 0; flow < 20; ++flow) {
+            PacketView packet = makePacket(static_cast<uint8_t>(flow), 1000, 100);
+            analyzer.processPacket(packet);
+        }
+
+        analyzer.flushFlows();
+        REQUIRE(ended.size() == 20);
+        REQUIRE(ended[0].second == FlowEndReason::FORCED_END);
+        REQUIRE(analyzer.getTopConnections(100).empty());
+    }
+}
+
+TEST_CASE("PacketAnalyzer TCP state", "[packet_analyzer]") {
+    const uint64_t second = 1000000;
+
+    PacketAnalyzer analyzer(2);
+    analyzer.setSnapshotInterval(std::chrono::milliseconds(0));
+
+    std::vector<ConnectionStats> ended;
+    analyzer.setFlowExpiredHandler([&ended](const ConnectionKey&, const ConnectionStats& stats, FlowEndReason) {
+        ended.push_back(stats);
+    });
+
+    FlowTimeouts timeouts;
+    timeouts.tcp_half_open = std::chrono::seconds(5);
+    analyzer.setFlowTimeouts(timeouts);
+
+    // Header storage outlives the packets referring to it
+    std::vector<std::unique_ptr<uint8_t[]>> headers;
+    auto segment = [&headers](uint8_t host, bool from_client, uint8_t flags, uint64_t timestamp) {
+        headers.emplace_back(new uint8_t[20]());
+        headers.back()[13] = flags;
+
+        PacketView packet = makePacket(host, 40000, 60);
+        packet.protocol = 6;
+        packet.timestamp = timestamp;
+        packet.data = headers.back().get();
+        packet.caplen = 20;
+        packet.payload_offset = 20;
+        if (!from_client) {
+            std::swap(packet.source_ip, packet.dest_ip);
+            std::swap(packet.source_port, packet.dest_port);
+        }
+        return packet;
+    };
+
+    const uint8_t SYN = 0x02;
+    const uint8_t ACK = 0x10;
+    const uint8_t RST = 0x04;
+    const uint8_t FIN = 0x01;
+    uint64_t start = 1000 * second;
+
+    SECTION("The handshake completes and the flow closes") {
+        analyzer.processPacket(segment(1, true, SYN, start));
+        auto connections = analyzer.getTopConnections(1);
+        REQUIRE(connections[0].second.tcp_state == TcpState::SYN_SENT);
+        REQUIRE(analyzer.getTcpStats().half_open == 1);
+
+        analyzer.processPacket(segment(1, false, SYN | ACK, start));
+        connections = analyzer.getTopConnections(1);
+        REQUIRE(connections[0].second.tcp_state == TcpState::SYN_RECEIVED);
+
+        // Flags are kept per direction as well as together
+        REQUIRE(connections[0].second.tcp_flags == (SYN | ACK));
+        REQUIRE(connections[0].second.tcp_flags_sent == SYN);
+        REQUIRE(connections[0].second.tcp_flags_received == (SYN | ACK));
+
+        analyzer.processPacket(segment(1, true, ACK, start));
+        REQUIRE(analyzer.getTopConnections(1)[0].second.tcp_state == TcpState::ESTABLISHED);
+        REQUIRE(analyzer.getTcpStats().half_open == 0);
+        REQUIRE(analyzer.getTopHalfOpenHosts(10).empty());
+
+        analyzer.processPacket(segment(1, false, FIN | ACK, start));
+        REQUIRE(analyzer.getTopConnections(1)[0].second.tcp_state == TcpState::CLOSING);
+
+        analyzer.processPacket(segment(1, true, FIN | ACK, start));
+        REQUIRE(analyzer.getTopConnections(1)[0].second.tcp_state == TcpState::CLOSED);
+        REQUIRE(analyzer.getTcpStats().syns == 1);
+    }
+
+    SECTION("Unanswered SYNs count against the responder until they expire") {
+        for (uint8_t host = 1; host <= 20; ++host) {
+            analyzer.processPacket(segment(host, true, SYN, start));
+        }
+
+        auto stats = analyzer.getTcpStats();
+        REQUIRE(stats.half_open == 20);
+        REQUIRE(stats.syns == 20);
+
+        auto hosts = analyzer.getTopHalfOpenHosts(10);
+        REQUIRE(hosts.size() == 1);
+        REQUIRE(hosts[0].first.toString() == "10.0.1.1");
+        REQUIRE(hosts[0].second.half_open == 20);
+
+        // The half-open timeout applies rather than the idle one
+        analyzer.expireFlows(start + 6 * second);
+        REQUIRE(ended.size() == 20);
+        REQUIRE(ended[0].tcp_state == TcpState::SYN_SENT);
+
+        stats = analyzer.getTcpStats();
+        REQUIRE(stats.half_open == 0);
+        REQUIRE(stats.handshake_timeouts == 20);
+        REQUIRE(analyzer.getTopHalfOpenHosts(10).empty());
+    }
+
+    SECTION("A reset ends the handshake and is counted per host") {
+        analyzer.processPacket(segment(1, true, SYN, start));
+        analyzer.processPacket(segment(2, true, SYN, start));
+        analyzer.processPacket(segment(1, false, RST | ACK, start));
+
+        auto stats = analyzer.getTcpStats();
+        REQUIRE(stats.half_open == 1);
+        REQUIRE(stats.resets == 1);
+
+        auto hosts = analyzer.getTopHalfOpenHosts(10);
+        REQUIRE(hosts.size() == 1);
+        REQUIRE(hosts[0].second.half_open == 1);
+        REQUIRE(hosts[0].second.resets_sent == 1);
+        REQUIRE(hosts[0].second.resets_received == 0);
+
+        // Only the flow still in its handshake counts as a timeout
+        analyzer.expireFlows(start + 6 * second);
+        REQUIRE(ended.size() == 2);
+        REQUIRE(analyzer.getTcpStats().handshake_timeouts == 1);
+    }
+
+    SECTION("Flows picked up mid-stream are established") {
+        analyzer.processPacket(segment(1, true, ACK, start));
+        REQUIRE(analyzer.getTopConnections(1)[0].second.tcp_state == TcpState::ESTABLISHED);
+        REQUIRE(analyzer.getTcpStats().half_open == 0);
+    }
+}
+
+TEST_CASE("PacketAnalyzer TCP round trips and retransmissions", "[packet_analyzer]") {
+    const uint64_t ms = 1000;
+
+    PacketAnalyzer analyzer(2);
+    analyzer.setSnapshotInterval(std::chrono::milliseconds(0));
+
+    auto groups = std::make_shared<SubnetGroups>();
+    std::string error;
+    REQUIRE(groups->parse("clients=10.0.0.0/24; servers=10.0.1.0/24", error));
+    analyzer.setSubnetGroups(groups);
+
+    std::vector<std::unique_ptr<uint8_t[]>> headers;
+    auto segment = [&headers](bool from_client, uint8_t flags, uint32_t sequence, uint32_t payload,
+                              uint64_t timestamp) {
+        headers.emplace_back(new uint8_t[20]());
+        uint8_t* header = headers.back().get();
+        header[4] = static_cast<uint8_t>(sequence >> 24);
+        header[5] = static_cast<uint8_t>(sequence >> 16);
+        header[6] = static_cast<uint8_t>(sequence >> 8);
+        header[7] = static_cast<uint8_t>(sequence);
+        header[12] = 5 << 4;
+        header[13] = flags;
+
+        PacketView packet = makePacket(1, 40000, 60 + payload);
+        packet.protocol = 6;
+        packet.timestamp = timestamp;
+        packet.data = header;
+        packet.caplen = 20;
+        packet.payload_offset = 20;
+        packet.transport_size = 20 + payload;
+        if (!from_client) {
+            std::swap(packet.source_ip, packet.dest_ip);
+            std::swap(packet.source_port, packet.dest_port);
+        }
+        return packet;
+    };
+
+    const uint8_t SYN = 0x02;
+    const uint8_t ACK = 0x10;
+    uint64_t start = 1000000 * ms;
+
+    SECTION("The handshake gives the round trip") {
+        // Sequence numbers near the wrap point
+        analyzer.processPacket(segment(true, SYN, 0xFFFFFFF0, 0, start));
+        analyzer.processPacket(segment(false, SYN | ACK, 5000, 0, start + 20 * ms));
+        analyzer.processPacket(segment(true, ACK, 0xFFFFFFF1, 0, start + 30 * ms));
+
+        auto connection = analyzer.getTopConnections(1)[0].second;
+        REQUIRE(connection.rtt_us == 30 * ms);
+        REQUIRE(connection.retransmits == 0);
+
+        auto tcp = analyzer.getTcpStats();
+        REQUIRE(tcp.rtt.count() == 1);
+        REQUIRE(tcp.rtt.percentile(0.5) >= 16384.0);
+        REQUIRE(tcp.rtt.percentile(0.5) < 32768.0);
+
+        for (const auto& host : analyzer.getHostTrafficEstimates()) {
+            REQUIRE(host.second.rtt.count() == 1);
+        }
+        for (const auto& group : analyzer.getSubnetGroupStats()) {
+            REQUIRE(group.rtt.count() == 1);
+        }
+
+        // Data crossing the wrap point is new, sending it again is not
+        analyzer.processPacket(segment(true, ACK, 0xFFFFFFF1, 1000, start + 40 * ms));
+        analyzer.processPacket(segment(true, ACK, 0xFFFFFFF1 + 1000, 1000, start + 41 * ms));
+        REQUIRE(analyzer.getTcpStats().retransmits == 0);
+
+        analyzer.processPacket(segment(true, ACK, 0xFFFFFFF1 + 1000, 1000, start + 300 * ms));
+        REQUIRE(analyzer.getTopConnections(1)[0].second.retransmits == 1);
+
+        // Pure ACKs repeat sequence numbers without being retransmissions
+        analyzer.processPacket(segment(false, ACK, 5001, 0, start + 301 * ms));
+        analyzer.processPacket(segment(false, ACK, 5001, 0, start + 302 * ms));
+
+        tcp = analyzer.getTcpStats();
+        REQUIRE(tcp.retransmits == 1);
+        REQUIRE(tcp.segments == 8);
+
+        auto client = analyzer.getHostTraffic(analyzer.getTopConnections(1)[0].first.source_ip);
+        REQUIRE(client);
+        REQUIRE(client->retransmits == 1);
+
+        auto clients = analyzer.getSubnetGroupStats("clients");
+        REQUIRE(clients);
+        REQUIRE(clients->retransmits == 1);
+        REQUIRE(analyzer.getSubnetGroupStats("servers")->retransmits == 0);
+    }
+
+    SECTION("A retransmitted SYN leaves the round trip unmeasured") {
+        analyzer.processPacket(segment(true, SYN, 100, 0, start));
+        analyzer.processPacket(segment(true, SYN, 100, 0, start + 1000 * ms));
+        analyzer.processPacket(segment(false, SYN | ACK, 5000, 0, start + 1020 * ms));
+        analyzer.processPacket(segment(true, ACK, 101, 0, start + 1030 * ms));
+
+        auto connection = analyzer.getTopConnections(1)[0].second;
+        REQUIRE(connection.tcp_state == TcpState::ESTABLISHED);
+        REQUIRE(connection.rtt_us == 0);
+        REQUIRE(connection.retransmits == 1);
+        REQUIRE(analyzer.getTcpStats().rtt.count() == 0);
+    }
+}
+
+TEST_CASE("PacketAnalyzer top connections", "[packet_analyzer]") {
+    PacketAnalyzer analyzer(2);
+    analyzer.setTopConnectionsTracked(16);
+
+    // Flow sizes that keep reshuffling the ranking as traffic arrives
+    uint64_t state = 7;
+    for (int i = 0; i < 20000; ++i) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint16_t port = static_cast<uint16_t>(1024 + (state >> 33) % 300);
+        uint32_t size = static_cast<uint32_t>(40 + (state >> 50) % 1400);
+        analyzer.processPacket(makePacket(1, port, size));
+    }
+
+    REQUIRE(analyzer.getConnectionCount() == 300);
+
+    auto ranked = analyzer.getTopConnections(10);
+    auto scanned = analyzer.getTopConnections(1000);
+
+    REQUIRE(ranked.size() == 10);
+    REQUIRE(scanned.size() == 300);
+
+    for (size_t i = 0; i < ranked.size(); ++i) {
+        REQUIRE(ranked[i].second.bytes_sent == scanned[i].second.bytes_sent);
+    }
+}
+
+TEST_CASE("PacketAnalyzer top connections after expiry", "[packet_analyzer]") {
+    PacketAnalyzer analyzer;
+    analyzer.setTopConnectionsTracked(2);
+    const uint64_t second = 1000000;
+
+    auto send = [&analyzer](uint16_t port, uint32_t size, uint64_t timestamp) {
+        PacketView packet = makePacket(1, port, size);
+        packet.timestamp = timestamp;
+        analyzer.processPacket(packet);
+    };
+
+    send(1000, 5000, 1000 * second);
+    send(2000, 3000, 1050 * second);
+    send(3000, 2000, 1050 * second);
+
+    auto before = analyzer.getTopConnections(2);
+    REQUIRE(before.size() == 2);
+    REQUIRE(before[0].first.source_port == 1000);
+    REQUIRE(before[1].first.source_port == 2000);
+
+    // The largest flow idles out and the untracked one takes its slot
+    // without needing another packet
+    analyzer.expireFlows(1061 * second);
+    REQUIRE(analyzer.getConnectionCount() == 2);
+
+    auto after = analyzer.getTopConnections(2);
+    REQUIRE(after.size() == 2);
+    REQUIRE(after[0].first.source_port == 2000);
+    REQUIRE(after[1].first.source_port == 3000);
+}
+
+TEST_CASE("PacketAnalyzer refills top connections incrementally", "[packet_analyzer]") {
+    const uint64_t second = 1000000;
+    const int flows = 20000;
+
+    PacketAnalyzer analyzer(1, flows);
+    analyzer.setTopConnectionsTracked(1);
+
+    PacketView largest = makePacket(1, 1000, 5000);
+    largest.timestamp = 1000 * second;
+    analyzer.processPacket(largest);
+
+    std::vector<PacketView> packets;
+    for (int flow = 0; flow < flows; ++flow) {
+        PacketView packet = makePacket(static_cast<uint8_t>(2 + flow % 200), static_cast<uint16_t>(2000 + flow / 200),
+                                       flow == flows / 2 ? 3000 : 100);
+        packet.timestamp = 1050 * second;
+        packets.push_back(packet);
+    }
+    analyzer.processBatch(PacketBatch{packets.data(), packets.size()});
+
+    const PacketView& runner_up = packets[flows / 2];
+    REQUIRE(analyzer.getTopConnections(1)[0].first == PacketAnalyzer::createConnectionKey(largest));
+
+    // The largest flow idles out; its slot is refilled a bounded stretch of
+    // the table per batch, so it takes several batches to see every flow
+    analyzer.expireFlows(1061 * second);
+    REQUIRE(analyzer.getConnectionCount() == flows);
+
+    size_t batches = 1;
+    while (analyzer.getTopConnections(1).empty() ||
+           !(analyzer.getTopConnections(1)[0].first == PacketAnalyzer::createConnectionKey(runner_up))) {
+        REQUIRE(batches < 64);
+        analyzer.expireFlows(1061 * second);
+        ++batches;
+    }
+
+    // No single batch walked the whole table
+    REQUIRE(batches > 1);
+
+    // Further batches leave the refilled slot alone
+    for (int i = 0; i < 64; ++i) {
+        analyzer.expireFlows(1061 * second);
+    }
+    auto top = analyzer.getTopConnections(1);
+    REQUIRE(top.size() == 1);
+    REQUIRE(top[0].first == PacketAnalyzer::createConnectionKey(runner_up));
+    REQUIRE(top[0].second.bytes_sent + top[0].second.bytes_received == 3000);
+}
+
+TEST_CASE("PacketAnalyzer host sketch", "[packet_analyzer]") {
+    PacketAnalyzer exact(2);
+    PacketAnalyzer sketched(2);
+    sketched.setHostSketch(0.01, 0.01);
+    REQUIRE(sketched.isHostSketchEnabled());
+
+    // Three heavy clients among a long tail of light ones
+    for (int round = 0; round < 20; ++round) {
+        for (uint8_t host = 1; host < 250; ++host) {
+            uint32_t size = host <= 3 ? 4000 + 1000 * host : 100;
+            exact.processPacket(makePacket(host, 1000, size));
+            sketched.processPacket(makePacket(host, 1000, size));
+        }
+    }
+
+    auto expected = exact.getTopHosts(4);
+    auto top = sketched.getTopHosts(4);
+    REQUIRE(top.size() == 4);
+
+    for (size_t i = 0; i < top.size(); ++i) {
+        REQUIRE(top[i].first == expected[i].first);
+        REQUIRE(top[i].second.bytes >= expected[i].second.bytes);
+        REQUIRE(top[i].second.bytes <= expected[i].second.bytes * (1.0 + top[i].second.error_bound));
+    }
+
+    // Any host can be queried, tracked as a heavy hitter or not
+    const uint8_t light[4] = {10, 0, 0, 200};
+    auto host = sketched.getHostTraffic(IpAddress::fromV4(light));
+    REQUIRE(host);
+    REQUIRE(host->bytes >= 2000);
+    REQUIRE(host->packets >= 20);
+
+    REQUIRE(sketched.getHostTrafficStats().size() <= 2 * 100);
+}
+
+TEST_CASE("PacketAnalyzer host fan-out", "[packet_analyzer]") {
+    PacketAnalyzer analyzer(2);
+    analyzer.setFanoutTracking(std::chrono::seconds(60), 1024);
+    REQUIRE(analyzer.isFanoutTrackingEnabled());
+
+    const uint64_t second = 1000000;
+
+    // Host 1 probes 500 ports on one server; host 2 talks to it on one port
+    for (uint16_t port = 1; port <= 500; ++port) {
+        PacketView probe = makePacket(1, 40000, 60);
+        probe.dest_port = port;
+        probe.timestamp = 10 * second;
+        analyzer.processPacket(probe);
+    }
+    for (uint16_t source_port = 1000; source_port < 1010; ++source_port) {
+        PacketView packet = makePacket(2, source_port, 60);
+        packet.timestamp = 10 * second;
+        analyzer.processPacket(packet);
+    }
+
+    auto top = analyzer.getTopFanout(2, true);
+    REQUIRE(top.size() == 2);
+
+    const uint8_t scanner[4] = {10, 0, 0, 1};
+    REQUIRE(top[0].first == IpAddress::fromV4(scanner));
+    REQUIRE(top[0].second.peers == 1);
+    REQUIRE(top[0].second.ports >= 500 * (1.0 - top[0].second.error_bound));
+    REQUIRE(top[0].second.ports <= 500 * (1.0 + top[0].second.error_bound));
+    REQUIRE(top[1].second.ports == 1);
+
+    // Only hosts that start flows are tracked
+    const uint8_t server[4] = {10, 0, 1, 1};
+    REQUIRE_FALSE(analyzer.getHostFanout(IpAddress::fromV4(server)));
+
+    // A window later the scan has aged out and the host is dropped
+    analyzer.expireFlows(100 * second);
+    REQUIRE_FALSE(analyzer.getHostFanout(IpAddress::fromV4(scanner)));
+    REQUIRE(analyzer.getFanout().empty());
+}
+
+TEST_CASE("PacketAnalyzer host fan-out reuses idle slots", "[packet_analyzer]") {
+    PacketAnalyzer analyzer(1);
+    analyzer.setFanoutTracking(std::chrono::seconds(60), 1);
+
+    const uint64_t second = 1000000;
+
+    for (uint16_t port = 1; port <= 500; ++port) {
+        PacketView probe = makePacket(1, 40000, 60);
+        probe.dest_port = port;
+        probe.timestamp = 10 * second;
+        analyzer.processPacket(probe);
+    }
+
+    // The table is full until the scanner has been idle for a window
+    PacketView early = makePacket(2, 1000, 60);
+    early.timestamp = 20 * second;
+    analyzer.processPacket(early);
+
+    const uint8_t scanner[4] = {10, 0, 0, 1};
+    const uint8_t client[4] = {10, 0, 0, 2};
+    REQUIRE(analyzer.getHostFanout(IpAddress::fromV4(scanner)));
+    REQUIRE_FALSE(analyzer.getHostFanout(IpAddress::fromV4(client)));
+
+    // Once it has aged out, its slot is handed over without its old registers
+    analyzer.expireFlows(100 * second);
+
+    PacketView late = makePacket(2, 1001, 60);
+    late.timestamp = 100 * second;
+    analyzer.processPacket(late);
+
+    REQUIRE_FALSE(analyzer.getHostFanout(IpAddress::fromV4(scanner)));
+    auto fanout = analyzer.getHostFanout(IpAddress::fromV4(client));
+    REQUIRE(fanout);
+    REQUIRE(fanout->ports == 1);
+    REQUIRE(fanout->peers == 1);
+}
+
+TEST_CASE("PacketAnalyzer snapshot reads", "[packet_analyzer]") {
+    PacketAnalyzer analyzer(2);
+
+    for (uint16_t port = 1000; port < 1010; ++port) {
+        analyzer.processPacket(makePacket(1, port, 100 + port));
+    }
+
+    // Enabling snapshots publishes the first one
+    analyzer.setSnapshotInterval(std::chrono::hours(1));
+
+    auto before = analyzer.getTopConnections(5);
+    REQUIRE(before.size() == 5);
+    REQUIRE(analyzer.getHostTrafficStats().size() == 2);
+
+    // Later traffic is not visible until the snapshot is rebuilt, and
+    // refreshing within the interval keeps the current one
+    for (uint16_t port = 2000; port < 2010; ++port) {
+        analyzer.processPacket(makePacket(2, port, 5000));
+    }
+    analyzer.refreshSnapshot();
+
+    auto cached = analyzer.getTopConnections(5);
+    REQUIRE(cached.size() == 5);
+    for (size_t i = 0; i < cached.size(); ++i) {
+        REQUIRE(cached[i].first == before[i].first);
+    }
+    REQUIRE(analyzer.getHostTrafficStats().size() == 2);
+
+    // Readers never rebuild a stale snapshot themselves
+    analyzer.setSnapshotInterval(std::chrono::milliseconds(1));
+    analyzer.processPacket(makePacket(3, 3000, 100));
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    REQUIRE(analyzer.getHostTrafficStats().size() == 3);
+
+    analyzer.refreshSnapshot();
+    REQUIRE(analyzer.getHostTrafficStats().size() == 4);
+    analyzer.setSnapshotInterval(std::chrono::hours(1));
+
+    // Single-flow lookups and the flow count are always live
+    REQUIRE(analyzer.getConnectionCount() == 21);
+    REQUIRE(analyzer.getConnectionStats(PacketAnalyzer::createConnectionKey(makePacket(2, 2000, 5000))));
+
+    analyzer.setSnapshotInterval(std::chrono::milliseconds(0));
+    REQUIRE(analyzer.getTopConnections(5)[0].second.bytes_sent == 5000);
+    REQUIRE(analyzer.getHostTrafficStats().size() == 4);
+
+    // A reset drops the snapshot along with the flows
+    analyzer.setSnapshotInterval(std::chrono::hours(1));
+    analyzer.reset();
+    REQUIRE(analyzer.getTopConnections(5).empty());
+}
+
+TEST_CASE("PacketAnalyzer traffic rates", "[packet_analyzer]") {
+    PacketAnalyzer analyzer;
+    const uint64_t second = 1000000;
+
+    // 10 packets of 100 bytes per second for 30 seconds
+    for (uint64_t t = 0; t < 30; ++t) {
+        for (int i = 0; i < 10; ++i) {
+            PacketView packet = makePacket(1, 1000, 100);
+            packet.timestamp = (1000 + t) * second + i * 1000;
+            analyzer.processPacket(packet);
+        }
+    }
+
+    analyzer.expireFlows(1030 * second);
+
+    auto stats = analyzer.getConnectionStats(PacketAnalyzer::createConnectionKey(makePacket(1, 1000, 100)));
+    REQUIRE(stats);
+    REQUIRE(stats->rates.last_1s.bytes_per_second == Approx(1000));
+    REQUIRE(stats->rates.last_10s.packets_per_second == Approx(10));
+    // Only 30 of the last 60 seconds carried traffic
+    REQUIRE(stats->rates.last_60s.bytes_per_second == Approx(500));
+
+    auto hosts = analyzer.getTopHosts(1);
+    REQUIRE(hosts.size() == 1);
+    REQUIRE(hosts[0].second.rates.last_10s.bytes_per_second == Approx(1000));
+
+    // Rates fall off once traffic stops
+    analyzer.expireFlows(1045 * second);
+    stats = analyzer.getConnectionStats(PacketAnalyzer::createConnectionKey(makePacket(1, 1000, 100)));
+    REQUIRE(stats);
+    REQUIRE(stats->rates.last_10s.bytes_per_second == 0);
+    REQUIRE(stats->rates.last_60s.bytes_per_second == Approx(500));
+}
+
+TEST_CASE("PacketAnalyzer stops classifying unknown flows", "[packet_analyzer]") {
+    auto classified = std::make_shared<ClassifiedFlowSet>();
+
+    PacketAnalyzer analyzer;
+    analyzer.setClassifiedFlowSet(classified);
+    analyzer.setClassificationLimit(3);
+
+    // Eight header bytes then a payload no parser recognizes
+    std::vector<uint8_t> frame(8, 0);
+    const std::string payload = "SSH-2.0-OpenSSH_9.6";
+    frame.insert(frame.end(), payload.begin(), payload.end());
+
+    PacketView packet = makePacket(1, 40000, static_cast<uint32_t>(frame.size()));
+    packet.data = frame.data();
+    packet.caplen = static_cast<uint32_t>(frame.size());
+    packet.payload_offset = 8;
+
+    // Packets without payload do not count towards the limit
+    PacketView empty = makePacket(1, 40000, 40);
+    analyzer.processPacket(empty);
+    analyzer.processPacket(packet);
+    analyzer.processPacket(packet);
+
+    auto key = PacketAnalyzer::createConnectionKey(packet);
+    REQUIRE_FALSE(analyzer.getConnectionStats(key)->protocol_type);
+    REQUIRE_FALSE(classified->contains(flowHash(packet)));
+
+    analyzer.processPacket(packet);
+
+    auto stats = analyzer.getConnectionStats(key);
+    REQUIRE(stats->protocol_type == ProtocolType::UNKNOWN);
+    REQUIRE(classified->contains(flowHash(packet)));
+
+    // Once the flow ends its payload is captured again, and a new flow on
+    // the same ports goes through classification from scratch
+    analyzer.expireFlows(3600ULL * 1000000);
+    REQUIRE_FALSE(analyzer.getConnectionStats(key));
+    REQUIRE_FALSE(classified->contains(flowHash(packet)));
+
+    packet.timestamp = 3601ULL * 1000000;
+    analyzer.processPacket(packet);
+    analyzer.processPacket(packet);
+    REQUIRE_FALSE(classified->contains(flowHash(packet)));
+
+    analyzer.processPacket(packet);
+    REQUIRE(classified->contains(flowHash(packet)));
+}
+
+TEST_CASE("PacketAnalyzer re-marks flows evicted from the classified set", "[packet_analyzer]") {
+    auto classified = std::make_shared<ClassifiedFlowSet>(8);
+
+    PacketAnalyzer analyzer;
+    analyzer.setClassifiedFlowSet(classified);
+    analyzer.setClassificationLimit(1);
+
+    std::vector<uint8_t> frame(8, 0);
+    const std::string payload = "SSH-2.0-OpenSSH_9.6";
+    frame.insert(frame.end(), payload.begin(), payload.end());
+
+    PacketView packet = makePacket(1, 40000, static_cast<uint32_t>(frame.size()));
+    packet.data = frame.data();
+    packet.caplen = static_cast<uint32_t>(frame.size());
+    packet.payload_offset = 8;
+
+    analyzer.processPacket(packet);
+    uint64_t hash = flowHash(packet);
+    REQUIRE(classified->contains(hash));
+
+    // A colliding flow overwrites the slot, so payload is captured again
+    classified->insert(hash ^ (uint64_t{1} << 40));
+    REQUIRE_FALSE(classified->contains(hash));
+
+    // Header-only packets leave the slot to its new owner
+    PacketView empty = makePacket(1, 40000, 40);
+    analyzer.processPacket(empty);
+    REQUIRE_FALSE(classified->contains(hash));
+
+    analyzer.processPacket(packet);
+    REQUIRE(classified->contains(hash));
+}
+
+TEST_CASE("PacketAnalyzer HTTP exchanges", "[packet_analyzer]") {
+    const uint64_t ms = 1000;
+
+    auto classified = std::make_shared<ClassifiedFlowSet>();
+
+    PacketAnalyzer analyzer;
+    analyzer.setClassifiedFlowSet(classified);
+    analyzer.setHttpTracking(2, 1);
+
+    // Eight header bytes then the message
+    std::vector<std::unique_ptr<std::vector<uint8_t>>> frames;
+    auto message = [&frames](uint16_t client_port, bool from_client, const std::string& text, uint64_t timestamp) {
+        frames.emplace_back(new std::vector<uint8_t>(8, 0));
+        std::vector<uint8_t>& frame = *frames.back();
+        frame.insert(frame.end(), text.begin(), text.end());
+
+        PacketView packet = makePacket(1, client_port, static_cast<uint32_t>(frame.size()));
+        packet.protocol = 6;
+        packet.timestamp = timestamp;
+        packet.data = frame.data();
+        packet.caplen = static_cast<uint32_t>(frame.size());
+        packet.payload_offset = 8;
+        if (!from_client) {
+            std::swap(packet.source_ip, packet.dest_ip);
+            std::swap(packet.source_port, packet.dest_port);
+        }
+        return packet;
+    };
+
+    uint64_t start = 1000000 * ms;
+
+    SECTION("Pipelined responses answer requests in order") {
+        analyzer.processPacket(message(40000, true, "GET /api/users/1 HTTP/1.1\r\nHost: Example.com\r\n\r\n", start));
+        analyzer.processPacket(message(40000, true, "GET /api/orders?page=2 HTTP/1.1\r\nhost: example.com\r\n\r\n",
+                                       start + 1 * ms));
+        analyzer.processPacket(message(40000, false, "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\n{}",
+                                       start + 10 * ms));
+        analyzer.processPacket(message(40000, false, "HTTP/1.1 503 Service Unavailable\r\n\r\n", start + 40 * ms));
+
+        auto endpoints = analyzer.getHttpEndpoints(10);
+        REQUIRE(endpoints.size() == 1);
+        REQUIRE(endpoints[0].host == "example.com");
+        REQUIRE(endpoints[0].path == "/api");
+        REQUIRE(endpoints[0].requests == 2);
+        REQUIRE(endpoints[0].responses == 2);
+        REQUIRE(endpoints[0].status_classes[2] == 1);
+        REQUIRE(endpoints[0].status_classes[5] == 1);
+
+        // 10 ms for the first, 39 ms for the second
+        REQUIRE(endpoints[0].latency.count() == 2);
+        REQUIRE(endpoints[0].latency.percentile(0.25) >= 8192.0);
+        REQUIRE(endpoints[0].latency.percentile(0.25) < 16384.0);
+        REQUIRE(endpoints[0].latency.percentile(1.0) >= 32768.0);
+
+        // The flow keeps its payload for the responses to come
+        REQUIRE_FALSE(classified->contains(flowHash(message(40000, true, "", start))));
+    }
+
+    SECTION("Interim responses and unanswered requests") {
+        // Without a Host header the endpoint is the server address
+        analyzer.processPacket(message(40001, true, "POST /upload HTTP/1.1", start));
+        analyzer.processPacket(message(40001, false, "HTTP/1.1 100 Continue\r\n\r\n", start + 1 * ms));
+        analyzer.processPacket(message(40001, true, "Content-Type: text/plain", start + 2 * ms));
+        analyzer.processPacket(message(40001, false, "HTTP/1.1 404 Not Found\r\n\r\n", start + 5 * ms));
+        analyzer.processPacket(message(40001, true, "GET /upload/2 HTTP/1.1\r\n\r\n", start + 6 * ms));
+        analyzer.expireFlows(start + 3600 * 1000 * ms);
+
+        auto endpoints = analyzer.getHttpEndpoints(10);
+        REQUIRE(endpoints.size() == 1);
+        REQUIRE(endpoints[0].host == "10.0.1.1");
+        REQUIRE(endpoints[0].path == "/upload");
+        REQUIRE(endpoints[0].requests == 2);
+        REQUIRE(endpoints[0].responses == 1);
+        REQUIRE(endpoints[0].unanswered == 1);
+        REQUIRE(endpoints[0].status_classes[1] == 1);
+        REQUIRE(endpoints[0].status_classes[4] == 1);
+        REQUIRE(endpoints[0].latency.count() == 1);
+    }
+
+    SECTION("Start lines inside bodies are skipped") {
+        analyzer.processPacket(message(40003, true, "GET /files/1 HTTP/1.1\r\n\r\n", start));
+        analyzer.processPacket(message(40003, true, "POST /files/2 HTTP/1.1\r\nContent-Length: 12\r\n\r\n",
+                                       start + 1 * ms));
+        analyzer.processPacket(message(40003, true, "GET /x HTTP/", start + 2 * ms));
+
+        // The second segment of the body looks like a response, and the
+        // real response follows it in the same segment
+        std::string tail = "HTTP/1.1 500 Oops\r\n";
+        analyzer.processPacket(message(40003, false,
+                                       "HTTP/1.1 200 OK\r\ncontent-length: 30\r\n\r\n" +
+                                           std::string(30 - tail.size(), 'x'),
+                                       start + 10 * ms));
+        analyzer.processPacket(message(40003, false, tail + "HTTP/1.1 201 Created\r\n\r\n", start + 20 * ms));
+        analyzer.expireFlows(start + 3600 * 1000 * ms);
+
+        auto endpoints = analyzer.getHttpEndpoints(10);
+        REQUIRE(endpoints.size() == 1);
+        REQUIRE(endpoints[0].path == "/files");
+        REQUIRE(endpoints[0].requests == 2);
+        REQUIRE(endpoints[0].responses == 2);
+        REQUIRE(endpoints[0].unanswered == 0);
+        REQUIRE(endpoints[0].status_classes[2] == 2);
+        REQUIRE(endpoints[0].status_classes[5] == 0);
+    }
+
+    SECTION("Endpoints beyond the limit share the overflow endpoint") {
+        for (const char* path : {"/a", "/b", "/c", "/d", "/a"}) {
+            analyzer.processPacket(message(40002, true, std::string("GET ") + path + " HTTP/1.1\r\n\r\n", start));
+            analyzer.processPacket(message(40002, false, "HTTP/1.1 204 No Content\r\n\r\n", start + ms));
+        }
+
+        auto endpoints = analyzer.getHttpEndpoints(10);
+        REQUIRE(endpoints.size() == 3);
+        REQUIRE(endpoints[0].path == "/a");
+        REQUIRE(endpoints[0].requests == 2);
+
+        auto other = std::find_if(endpoints.begin(), endpoints.end(),
+                                  [](const HttpEndpoint& endpoint) { return endpoint.host == "*"; });
+        REQUIRE(other != endpoints.end());
+        REQUIRE(other->requests == 2);
+
+        auto totals = analyzer.getHttpTotals();
+        REQUIRE(totals.requests == 5);
+        REQUIRE(totals.responses == 5);
+        REQUIRE(totals.status_classes[2] == 5);
+        REQUIRE(totals.latency.count() == 5);
+    }
+}
+
+TEST_CASE("PacketAnalyzer subnet groups", "[packet_analyzer]") {
+    auto groups = std::make_shared<SubnetGroups>();
+    std::string error;
+    REQUIRE(groups->parse("clients=10.0.0.0/24; servers=10.0.1.0/24; lab=10.0.0.128/25; private=10.0.0.0/8", error));
+
+    PacketAnalyzer analyzer(2);
+    analyzer.setSubnetGroups(groups);
+
+    analyzer.processPacket(makePacket(1, 1000, 100));
+    analyzer.processPacket(makePacket(1, 1000, 100));
+    analyzer.processPacket(makePacket(200, 1000, 50));
+
+    auto stats = analyzer.getSubnetGroupStats();
+    REQUIRE(stats.size() == 4);
+
+    REQUIRE(stats[0].name == "clients");
+    REQUIRE(stats[0].bytes_sent == 200);
+    REQUIRE(stats[0].packets_sent == 2);
+    REQUIRE(stats[0].flows == 1);
+
+    // The longer prefix wins
+    REQUIRE(stats[2].name == "lab");
+    REQUIRE(stats[2].bytes_sent == 50);
+
+    REQUIRE(stats[1].bytes_received == 250);
+    REQUIRE(stats[1].packets_received == 3);
+    REQUIRE(stats[1].flows == 2);
+
+    // Covered entirely by the more specific groups
+    REQUIRE(stats[3].bytes_sent == 0);
+
+    REQUIRE(analyzer.getSubnetGroupStats("servers")->bytes_received == 250);
+    REQUIRE_FALSE(analyzer.getSubnetGroupStats("unknown"));
+
+    analyzer.reset();
+    REQUIRE(analyzer.getSubnetGroupStats("servers")->bytes_received == 0);
+}
+
+TEST_CASE("SubnetGroups parsing", "[packet_analyzer]") {
+    SubnetGroups groups;
+    std::string error;
+
+    REQUIRE(groups.parse("v4=192.168.0.0/16 10.1.2.3; v6=2001:db8::/32", error));
+    REQUIRE(groups.groupCount() == 2);
+    REQUIRE(groups.prefixCount() == 3);
+
+    REQUIRE(groups.lookup(*IpAddress::parse("192.168.7.1")) == 0);
+    REQUIRE(groups.lookup(*IpAddress::parse("10.1.2.3")) == 0);
+    REQUIRE(groups.lookup(*IpAddress::parse("10.1.2.4")) == SubnetGroups::NO_GROUP);
+    REQUIRE(groups.lookup(*IpAddress::parse("2001:db8:1::1")) == 1);
+    REQUIRE(groups.lookup(*IpAddress::parse("2001:db9::1")) == SubnetGroups::NO_GROUP);
+
+    REQUIRE_FALSE(groups.parse("bad=10.0.0.0/33", error));
+    REQUIRE_FALSE(groups.parse("10.0.0.0/8", error));
+    REQUIRE_FALSE(groups.add("v4", "not-an-address/8"));
+}
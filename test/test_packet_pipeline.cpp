@@ -0,0 +1,163 @@
+#include "catch2/catch.hpp"
+#include "../src/network/packet_pipeline.hpp"
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+using namespace netsentry::network;
+
+namespace {
+
+// Workers are not started until the queues have been filled, so every
+// overflow below is deterministic.
+PipelineOptions options(OverflowPolicy policy, size_t capacity) {
+    PipelineOptions result;
+    result.queue_capacity = capacity;
+    result.overflow_policy = policy;
+    return result;
+}
+
+void submit(PacketPipeline& pipeline, size_t packets) {
+    std::vector<PacketView> batch(packets);
+    pipeline.submit(0, PacketBatch{batch.data(), batch.size()});
+}
+
+}
+
+TEST_CASE("PacketPipeline overflow policies", "[packet_pipeline]") {
+    std::vector<size_t> handled;
+    auto handler = [&handled](const PacketBatch& batch) { handled.push_back(batch.size()); };
+
+    SECTION("DROP_NEWEST rejects batches once the queue is full") {
+        PacketPipeline pipeline(options(OverflowPolicy::DROP_NEWEST, 2), handler);
+
+        submit(pipeline, 1);
+        submit(pipeline, 2);
+        submit(pipeline, 3);
+
+        auto stats = pipeline.getStats();
+        REQUIRE(stats.batches_enqueued == 2);
+        REQUIRE(stats.packets_enqueued == 3);
+        REQUIRE(stats.packets_dropped_newest == 3);
+        REQUIRE(stats.packetsDropped() == 3);
+        REQUIRE(stats.queued_batches == 2);
+
+        pipeline.start();
+        pipeline.stop();
+        REQUIRE(handled == std::vector<size_t>{1, 2});
+    }
+
+    SECTION("DROP_OLDEST discards the head of the queue to admit new batches") {
+        PacketPipeline pipeline(options(OverflowPolicy::DROP_OLDEST, 2), handler);
+
+        submit(pipeline, 1);
+        submit(pipeline, 2);
+        submit(pipeline, 3);
+        submit(pipeline, 4);
+
+        auto stats = pipeline.getStats();
+        REQUIRE(stats.batches_enqueued == 4);
+        REQUIRE(stats.packets_enqueued == 10);
+        REQUIRE(stats.packets_dropped_oldest == 3);
+        REQUIRE(stats.packets_dropped_newest == 0);
+        REQUIRE(stats.queued_batches == 2);
+
+        pipeline.start();
+        pipeline.stop();
+        REQUIRE(handled == std::vector<size_t>{3, 4});
+    }
+
+    SECTION("SAMPLE admits one batch in sample_rate once half full") {
+        PipelineOptions sampled = options(OverflowPolicy::SAMPLE, 4);
+        sampled.sample_rate = 2;
+        PacketPipeline pipeline(sampled, handler);
+
+        // Two batches below half capacity, then every other one until the
+        // queue is full and the admitted batch is dropped as well
+        for (size_t i = 1; i <= 8; ++i) {
+            submit(pipeline, i);
+        }
+
+        auto stats = pipeline.getStats();
+        REQUIRE(stats.batches_enqueued == 4);
+        REQUIRE(stats.packets_enqueued == 1 + 2 + 4 + 6);
+        REQUIRE(stats.packets_dropped_sampled == 3 + 5 + 7);
+        REQUIRE(stats.packets_dropped_newest == 8);
+        REQUIRE(stats.packetsDropped() + stats.packets_enqueued == 36);
+
+        pipeline.start();
+        pipeline.stop();
+        REQUIRE(handled == std::vector<size_t>{1, 2, 4, 6});
+    }
+}
+
+TEST_CASE("PacketPipeline collects each worker's share into fuller batches", "[packet_pipeline]") {
+    std::mutex mutex;
+    std::vector<size_t> handled;
+    auto handler = [&mutex, &handled](const PacketBatch& batch) {
+        std::lock_guard<std::mutex> lock(mutex);
+        handled.push_back(batch.size());
+    };
+
+    PipelineOptions collected = options(OverflowPolicy::DROP_NEWEST, 16);
+    collected.workers = 2;
+    collected.batch_min_packets = 8;
+    collected.batch_timeout_ms = 60000;
+
+    // Two flows that are split to different workers
+    PacketView first;
+    first.source_port = 1000;
+    PacketView second = first;
+    while (flowShard(flowHash(second), 2) == flowShard(flowHash(first), 2)) {
+        ++second.source_port;
+    }
+
+    auto submitFlows = [&first, &second](PacketPipeline& pipeline, size_t first_packets, size_t second_packets) {
+        std::vector<PacketView> batch(first_packets, first);
+        batch.insert(batch.end(), second_packets, second);
+        pipeline.submit(0, PacketBatch{batch.data(), batch.size()});
+    };
+
+    SECTION("Partitions are held until they reach batch_min_packets") {
+        PacketPipeline pipeline(collected, handler);
+
+        submitFlows(pipeline, 3, 1);
+        submitFlows(pipeline, 3, 1);
+        REQUIRE(pipeline.getStats().batches_enqueued == 0);
+
+        submitFlows(pipeline, 3, 1);
+        auto stats = pipeline.getStats();
+        REQUIRE(stats.batches_enqueued == 1);
+        REQUIRE(stats.packets_enqueued == 9);
+
+        // The other worker's three packets go on flush
+        pipeline.flush();
+        stats = pipeline.getStats();
+        REQUIRE(stats.batches_enqueued == 2);
+        REQUIRE(stats.packets_enqueued == 12);
+
+        pipeline.start();
+        pipeline.stop();
+        std::sort(handled.begin(), handled.end());
+        REQUIRE(handled == std::vector<size_t>{3, 9});
+    }
+
+    SECTION("stop() hands over what is still held") {
+        PacketPipeline pipeline(collected, handler);
+
+        submitFlows(pipeline, 2, 0);
+        pipeline.start();
+        pipeline.stop();
+        REQUIRE(handled == std::vector<size_t>{2});
+    }
+
+    SECTION("Partitions held past batch_timeout_ms go on the next submit") {
+        collected.batch_timeout_ms = 0;
+        PacketPipeline pipeline(collected, handler);
+
+        submitFlows(pipeline, 1, 2);
+        auto stats = pipeline.getStats();
+        REQUIRE(stats.batches_enqueued == 2);
+        REQUIRE(stats.packets_enqueued == 3);
+    }
+}
@@ -0,0 +1,169 @@
+#include "catch2/catch.hpp"
+#include "../src/core/data/prefix_table.hpp"
+#include <array>
+#include <vector>
+
+using namespace netsentry::data;
+
+namespace {
+
+template <size_t N>
+struct Prefix {
+    std::array<uint8_t, N> bytes;
+    uint8_t length;
+    uint32_t value;
+};
+
+template <size_t N>
+bool covers(const Prefix<N>& prefix, const std::array<uint8_t, N>& key) {
+    for (size_t bit = 0; bit < prefix.length; ++bit) {
+        uint8_t mask = static_cast<uint8_t>(0x80 >> (bit % 8));
+        if ((prefix.bytes[bit / 8] & mask) != (key[bit / 8] & mask)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Longest match by scanning every prefix; the last one inserted wins a tie
+template <size_t N>
+uint32_t linearLookup(const std::vector<Prefix<N>>& prefixes, const std::array<uint8_t, N>& key) {
+    uint32_t value = PrefixTable::NONE;
+    int best = -1;
+
+    for (const auto& prefix : prefixes) {
+        if (prefix.length >= best && covers(prefix, key)) {
+            best = prefix.length;
+            value = prefix.value;
+        }
+    }
+    return value;
+}
+
+struct Random {
+    uint64_t state;
+
+    uint32_t next() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<uint32_t>(state >> 33);
+    }
+};
+
+// Keys share a few leading bytes so that prefixes overlap heavily
+template <size_t N>
+std::array<uint8_t, N> randomKey(Random& random) {
+    std::array<uint8_t, N> key{};
+    key[0] = static_cast<uint8_t>(10 + random.next() % 2);
+    key[1] = static_cast<uint8_t>(random.next() % 4);
+    for (size_t i = 2; i < N; ++i) {
+        key[i] = static_cast<uint8_t>(random.next() % (i < 4 ? 8 : 2));
+    }
+    return key;
+}
+
+template <size_t N>
+void compareWithLinearScan(uint64_t seed) {
+    Random random{seed};
+    PrefixTable table(N);
+    std::vector<Prefix<N>> prefixes;
+
+    for (uint32_t i = 0; i < 400; ++i) {
+        Prefix<N> prefix{randomKey<N>(random), static_cast<uint8_t>(random.next() % (N * 8 + 1)), i % 50};
+        prefixes.push_back(prefix);
+        REQUIRE(table.insert(prefix.bytes.data(), prefix.length, prefix.value));
+
+        // Rebuilding partway must give the same result as building once
+        if (i == 200) {
+            table.build();
+        }
+    }
+    table.build();
+
+    for (int i = 0; i < 20000; ++i) {
+        auto key = randomKey<N>(random);
+        REQUIRE(table.lookup(key.data()) == linearLookup(prefixes, key));
+    }
+}
+
+}
+
+TEST_CASE("PrefixTable longest prefix match", "[prefix_table]") {
+    PrefixTable table(4);
+    const uint8_t ten[4] = {10, 0, 0, 0};
+    const uint8_t ten_one[4] = {10, 1, 0, 0};
+    const uint8_t host[4] = {10, 1, 2, 3};
+
+    SECTION("Empty table matches nothing") {
+        REQUIRE(table.lookup(host) == PrefixTable::NONE);
+    }
+
+    SECTION("The most specific prefix wins regardless of insert order") {
+        REQUIRE(table.insert(host, 32, 3));
+        REQUIRE(table.insert(ten, 8, 1));
+        REQUIRE(table.insert(ten_one, 16, 2));
+        table.build();
+
+        REQUIRE(table.lookup(host) == 3);
+
+        const uint8_t neighbour[4] = {10, 1, 2, 4};
+        REQUIRE(table.lookup(neighbour) == 2);
+
+        const uint8_t other[4] = {10, 200, 0, 1};
+        REQUIRE(table.lookup(other) == 1);
+
+        const uint8_t outside[4] = {192, 168, 0, 1};
+        REQUIRE(table.lookup(outside) == PrefixTable::NONE);
+    }
+
+    SECTION("A default route covers everything else") {
+        REQUIRE(table.insert(ten, 0, 7));
+        REQUIRE(table.insert(ten, 8, 1));
+        table.build();
+
+        const uint8_t outside[4] = {192, 168, 0, 1};
+        REQUIRE(table.lookup(outside) == 7);
+        REQUIRE(table.lookup(host) == 1);
+    }
+
+    SECTION("Reinserting a prefix replaces its value") {
+        REQUIRE(table.insert(ten, 8, 1));
+        REQUIRE(table.insert(host, 32, 3));
+        REQUIRE(table.insert(ten, 8, 5));
+        table.build();
+        REQUIRE(table.size() == 2);
+
+        REQUIRE(table.lookup(ten_one) == 5);
+        REQUIRE(table.lookup(host) == 3);
+    }
+
+    SECTION("Invalid prefixes are rejected") {
+        REQUIRE_FALSE(table.insert(ten, 33, 1));
+        REQUIRE_FALSE(table.insert(ten, 8, PrefixTable::NONE));
+    }
+
+    SECTION("Prefixes are only visible once built") {
+        REQUIRE(table.insert(host, 32, 3));
+        REQUIRE(table.lookup(host) == PrefixTable::NONE);
+        table.build();
+        REQUIRE(table.lookup(host) == 3);
+    }
+
+    SECTION("Clear removes every prefix") {
+        REQUIRE(table.insert(host, 32, 3));
+        table.build();
+        table.clear();
+        REQUIRE(table.lookup(host) == PrefixTable::NONE);
+        REQUIRE(table.size() == 0);
+    }
+}
+
+TEST_CASE("PrefixTable agrees with a linear scan", "[prefix_table]") {
+    SECTION("IPv4") {
+        compareWithLinearScan<4>(1);
+        compareWithLinearScan<4>(2);
+    }
+
+    SECTION("IPv6") {
+        compareWithLinearScan<16>(3);
+    }
+}
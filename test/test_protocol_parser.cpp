@@ -0,0 +1,184 @@
+#include "catch2/catch.hpp"
+#include "../src/network/protocol_handlers/protocol_parser.hpp"
+#include <string>
+#include <vector>
+
+using namespace netsentry::network;
+
+namespace {
+
+constexpr uint8_t TCP = 6;
+constexpr uint8_t UDP = 17;
+constexpr uint32_t HEADER_SIZE = 20;
+
+// A transport header of zeros followed by payload; frame must outlive the view
+PacketView makePacket(std::vector<uint8_t>& frame, const std::string& payload,
+                      uint8_t protocol, uint16_t source_port, uint16_t dest_port) {
+    frame.assign(HEADER_SIZE, 0);
+    frame.insert(frame.end(), payload.begin(), payload.end());
+
+    PacketView packet;
+    packet.data = frame.data();
+    packet.caplen = static_cast<uint32_t>(frame.size());
+    packet.size = packet.caplen;
+    packet.l4_offset = 0;
+    packet.payload_offset = HEADER_SIZE;
+    packet.protocol = protocol;
+    packet.source_port = source_port;
+    packet.dest_port = dest_port;
+    return packet;
+}
+
+// Counts the packets it is asked to parse and never matches
+class CountingParser : public ProtocolParser {
+public:
+    explicit CountingParser(int& calls) : calls_(calls) {}
+
+    ProtocolType getProtocolType() const override { return ProtocolType::UNKNOWN; }
+    std::unique_ptr<ProtocolData> parse(const PacketView&) override {
+        ++calls_;
+        return nullptr;
+    }
+    std::vector<uint16_t> getPorts() const override { return {9999}; }
+    std::vector<uint8_t> getLeadingBytes() const override { return {'X'}; }
+
+private:
+    int& calls_;
+};
+
+}
+
+TEST_CASE("ProtocolClassifier dispatch", "[protocol_parser]") {
+    ProtocolClassifier classifier(ProtocolParserFactory::createAllParsers());
+    std::vector<uint8_t> frame;
+
+    SECTION("HTTP is found by its start line on any port") {
+        auto packet = makePacket(frame, "GET /index.html HTTP/1.1\r\nHost: example.com\r\n\r\n", TCP, 40000, 3000);
+        auto data = classifier.classify(packet);
+        REQUIRE(data);
+        REQUIRE(data->type == ProtocolType::HTTP);
+
+        auto& http = static_cast<HttpData&>(*data);
+        REQUIRE(http.is_request);
+        REQUIRE(http.method == "GET");
+        REQUIRE(http.headers["Host"] == "example.com");
+
+        packet = makePacket(frame, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n", TCP, 3000, 40000);
+        data = classifier.classify(packet);
+        REQUIRE(data);
+        REQUIRE(static_cast<HttpData&>(*data).status_code == 404);
+    }
+
+    SECTION("TLS is found by its record header") {
+        std::string record = {22, 3, 3, 0, 5, 1, 0, 0, 1, 0};
+        auto packet = makePacket(frame, record, TCP, 40000, 9000);
+        auto data = classifier.classify(packet);
+        REQUIRE(data);
+        REQUIRE(data->type == ProtocolType::TLS);
+    }
+
+    SECTION("DNS is found by port") {
+        std::string query(12, '\0');
+        auto packet = makePacket(frame, query, UDP, 40000, 53);
+        auto data = classifier.classify(packet);
+        REQUIRE(data);
+        REQUIRE(data->type == ProtocolType::DNS);
+    }
+
+    SECTION("Unrecognized payload matches nothing") {
+        auto packet = makePacket(frame, "SSH-2.0-OpenSSH_9.6\r\n", TCP, 40000, 22);
+        REQUIRE_FALSE(classifier.classify(packet));
+
+        // On an HTTP port, but not HTTP
+        packet = makePacket(frame, "\x01\x02\x03\x04 binary protocol data", TCP, 40000, 80);
+        REQUIRE_FALSE(classifier.classify(packet));
+    }
+}
+
+TEST_CASE("ProtocolClassifier only tries candidate parsers", "[protocol_parser]") {
+    int calls = 0;
+
+    std::vector<std::unique_ptr<ProtocolParser>> parsers;
+    parsers.push_back(std::make_unique<CountingParser>(calls));
+    ProtocolClassifier classifier(std::move(parsers));
+
+    std::vector<uint8_t> frame;
+
+    classifier.classify(makePacket(frame, "hello", TCP, 40000, 80));
+    REQUIRE(calls == 0);
+
+    classifier.classify(makePacket(frame, "hello", TCP, 9999, 40000));
+    REQUIRE(calls == 1);
+
+    classifier.classify(makePacket(frame, "Xhello", UDP, 40000, 1234));
+    REQUIRE(calls == 2);
+}
+
+TEST_CASE("HttpParser start lines", "[protocol_parser]") {
+    std::vector<uint8_t> frame;
+
+    SECTION("A start line without a line break is still parsed") {
+        HttpParser parser;
+        auto data = parser.parse(makePacket(frame, "GET /index.html HTTP/1.1", TCP, 40000, 80));
+        REQUIRE(data);
+        REQUIRE(static_cast<HttpData&>(*data).uri == "/index.html");
+
+        data = parser.parse(makePacket(frame, "HTTP/1.1 301 Moved Permanently", TCP, 80, 40000));
+        REQUIRE(data);
+        REQUIRE(static_cast<HttpData&>(*data).status_code == 301);
+    }
+
+    SECTION("Requests give their target and Host header") {
+        const std::string request = "PUT /items/7?v=2 HTTP/1.1\r\nAccept: */*\r\nHOST:  api.example.com \r\n\r\n";
+        auto line = HttpParser::readStartLine(reinterpret_cast<const uint8_t*>(request.data()), request.size());
+        REQUIRE(line);
+        REQUIRE(line->is_request);
+        REQUIRE(line->uri == "/items/7?v=2");
+        REQUIRE(line->host == "api.example.com");
+
+        // Headers after the end of the header block are not read
+        const std::string body = "GET / HTTP/1.1\r\n\r\nHost: body.example.com\r\n";
+        line = HttpParser::readStartLine(reinterpret_cast<const uint8_t*>(body.data()), body.size());
+        REQUIRE(line);
+        REQUIRE(line->host.empty());
+    }
+
+    SECTION("Responses give their status code") {
+        const std::string response = "HTTP/1.0 502 Bad Gateway\r\n";
+        auto line = HttpParser::readStartLine(reinterpret_cast<const uint8_t*>(response.data()), response.size());
+        REQUIRE(line);
+        REQUIRE_FALSE(line->is_request);
+        REQUIRE(line->status_code == 502);
+
+        const std::string truncated = "HTTP/1.1 2";
+        REQUIRE_FALSE(HttpParser::readStartLine(reinterpret_cast<const uint8_t*>(truncated.data()), truncated.size()));
+
+        const std::string body = "{\"status\": \"ok\"}";
+        REQUIRE_FALSE(HttpParser::readStartLine(reinterpret_cast<const uint8_t*>(body.data()), body.size()));
+    }
+
+    SECTION("Framing headers give the body length") {
+        const std::string response = "HTTP/1.1 200 OK\r\nContent-Length:  42 \r\n\r\nbody";
+        auto framing = HttpParser::readFraming(reinterpret_cast<const uint8_t*>(response.data()), response.size());
+        REQUIRE(framing.header_end == response.size() - 4);
+        REQUIRE(framing.content_length == 42u);
+        REQUIRE_FALSE(framing.chunked);
+
+        const std::string chunked = "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, Chunked\r\n\r\n";
+        framing = HttpParser::readFraming(reinterpret_cast<const uint8_t*>(chunked.data()), chunked.size());
+        REQUIRE(framing.header_end == chunked.size());
+        REQUIRE_FALSE(framing.content_length);
+        REQUIRE(framing.chunked);
+
+        // Headers split across segments end in a later one
+        const std::string partial = "GET / HTTP/1.1\r\ncontent-length: 5\r\n";
+        framing = HttpParser::readFraming(reinterpret_cast<const uint8_t*>(partial.data()), partial.size());
+        REQUIRE(framing.header_end == 0);
+        REQUIRE(framing.content_length == 5u);
+
+        const std::string head = "HEAD / HTTP/1.1\r\n\r\n";
+        auto line = HttpParser::readStartLine(reinterpret_cast<const uint8_t*>(head.data()), head.size());
+        REQUIRE(line);
+        REQUIRE(line->is_head);
+    }
+}
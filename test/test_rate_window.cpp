@@ -0,0 +1,58 @@
+#include "catch2/catch.hpp"
+#include "../src/core/data/rate_window.hpp"
+
+using namespace netsentry::data;
+
+TEST_CASE("RateWindow sums complete periods", "[rate_window]") {
+    RateWindow window;
+
+    SECTION("The second in progress is not counted") {
+        window.add(100, 1000);
+        REQUIRE(window.sum(1, 1000).bytes == 0);
+        REQUIRE(window.sum(1, 1001).bytes == 100);
+        REQUIRE(window.sum(1, 1001).packets == 1);
+        REQUIRE(window.sum(1, 1002).bytes == 0);
+    }
+
+    SECTION("Short windows use one-second buckets") {
+        // 10 bytes in each of seconds 1000..1019
+        for (uint64_t second = 1000; second < 1020; ++second) {
+            window.add(10, second);
+        }
+
+        REQUIRE(window.sum(1, 1020).bytes == 10);
+        REQUIRE(window.sum(10, 1020).bytes == 100);
+        REQUIRE(window.sum(10, 1020).packets == 10);
+
+        // Idle seconds age out of the window
+        REQUIRE(window.sum(10, 1025).bytes == 50);
+        REQUIRE(window.sum(10, 1030).bytes == 0);
+    }
+
+    SECTION("Long windows use ten-second buckets") {
+        for (uint64_t second = 1000; second < 1060; ++second) {
+            window.add(1, second);
+        }
+
+        REQUIRE(window.sum(60, 1060).bytes == 60);
+        REQUIRE(window.sum(30, 1060).bytes == 30);
+        REQUIRE(window.sum(60, 1090).bytes == 30);
+        REQUIRE(window.sum(60, 1200).bytes == 0);
+    }
+
+    SECTION("Buckets are reused after a long gap") {
+        window.add(500, 1000);
+        window.add(7, 5000);
+
+        REQUIRE(window.sum(10, 5001).bytes == 7);
+        REQUIRE(window.sum(60, 5010).bytes == 7);
+    }
+
+    SECTION("Late samples land in the current bucket") {
+        window.add(10, 1005);
+        window.add(20, 1003);
+
+        REQUIRE(window.sum(1, 1006).bytes == 30);
+        REQUIRE(window.sum(10, 1006).packets == 2);
+    }
+}
@@ -0,0 +1,85 @@
+#include "catch2/catch.hpp"
+#include "../src/core/data/seasonal_baseline.hpp"
+#include <cmath>
+
+using namespace netsentry::data;
+
+TEST_CASE("SeasonalBaseline follows a steady series", "[seasonal_baseline]") {
+    SeasonalBaseline baseline;
+    SeasonalBaseline::Parameters parameters;
+    parameters.warmup = 10;
+
+    REQUIRE(baseline.update(1000.0, 0, parameters) == 0.0);
+
+    // Noise of +-50 around 1000
+    for (int i = 0; i < 500; ++i) {
+        double score = baseline.update(i % 2 ? 1050.0 : 950.0, 0, parameters);
+        if (i > 100) {
+            REQUIRE(std::abs(score) < 3.0);
+        }
+    }
+
+    REQUIRE(baseline.forecast(0) == Approx(1000.0).margin(60.0));
+    REQUIRE(baseline.deviation() == Approx(50.0).margin(10.0));
+    REQUIRE(baseline.observations() == 501);
+
+    SECTION("A spike scores high") {
+        REQUIRE(baseline.update(5000.0, 0, parameters) > 20.0);
+        REQUIRE(baseline.score() > 20.0);
+    }
+
+    SECTION("A drop scores negative") {
+        REQUIRE(baseline.update(0.0, 0, parameters) < -10.0);
+    }
+}
+
+TEST_CASE("SeasonalBaseline scores nothing during warm-up", "[seasonal_baseline]") {
+    SeasonalBaseline baseline;
+    SeasonalBaseline::Parameters parameters;
+    parameters.warmup = 5;
+
+    for (int i = 0; i < 4; ++i) {
+        baseline.update(10.0, 0, parameters);
+    }
+    REQUIRE(baseline.update(1e6, 0, parameters) == 0.0);
+    REQUIRE(baseline.update(1e6, 0, parameters) != 0.0);
+}
+
+TEST_CASE("SeasonalBaseline learns the season", "[seasonal_baseline]") {
+    SeasonalBaseline baseline;
+    SeasonalBaseline::Parameters parameters;
+    parameters.warmup = 10;
+    parameters.min_deviation = 10.0f;
+
+    // Busy from 9 to 17, quiet otherwise, 60 observations per hour for a
+    // week
+    auto expected = [](size_t hour) { return hour >= 9 && hour < 17 ? 10000.0 : 1000.0; };
+
+    for (int day = 0; day < 7; ++day) {
+        for (size_t hour = 0; hour < 24; ++hour) {
+            for (int tick = 0; tick < 60; ++tick) {
+                baseline.update(expected(hour) + (tick % 2 ? 100.0 : -100.0), hour, parameters);
+            }
+        }
+    }
+
+    // Going busy at 9 is expected; going busy at 3 is not
+    REQUIRE(baseline.forecast(9) > baseline.forecast(3) + 3000.0);
+
+    SeasonalBaseline night = baseline;
+    REQUIRE(baseline.update(10000.0, 9, parameters) < night.update(10000.0, 3, parameters));
+}
+
+TEST_CASE("SeasonalBaseline with no trend or season is an EWMA", "[seasonal_baseline]") {
+    SeasonalBaseline baseline;
+    SeasonalBaseline::Parameters parameters;
+    parameters.alpha = 0.5f;
+    parameters.beta = 0.0f;
+    parameters.gamma = 0.0f;
+
+    baseline.update(100.0, 3, parameters);
+    baseline.update(200.0, 7, parameters);
+    REQUIRE(baseline.forecast(0) == Approx(150.0));
+    baseline.update(0.0, 11, parameters);
+    REQUIRE(baseline.forecast(23) == Approx(75.0));
+}
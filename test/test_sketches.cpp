@@ -0,0 +1,200 @@
+#include "catch2/catch.hpp"
+#include "../src/core/data/count_min_sketch.hpp"
+#include "../src/core/data/hyper_log_log.hpp"
+#include "../src/core/data/space_saving.hpp"
+#include <unordered_map>
+
+using namespace netsentry::data;
+
+namespace {
+
+uint64_t mix(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+    key *= 0xC4CEB9FE1A85EC53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+struct MixHash {
+    uint64_t operator()(uint64_t key) const { return mix(key); }
+};
+
+// Zipf-like stream: key k appears roughly 1/k as often as key 1
+std::unordered_map<uint64_t, uint64_t> skewedStream(int length, std::vector<uint64_t>& stream) {
+    std::unordered_map<uint64_t, uint64_t> exact;
+    uint64_t state = 42;
+
+    for (int i = 0; i < length; ++i) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        double u = static_cast<double>((state >> 11) + 1) / 9007199254740993.0;
+        uint64_t key = static_cast<uint64_t>(1.0 / u) % 50000;
+
+        stream.push_back(key);
+        exact[key]++;
+    }
+
+    return exact;
+}
+
+}
+
+TEST_CASE("CountMinSketch estimates", "[sketches]") {
+    CountMinSketch sketch(0.001, 0.01);
+
+    SECTION("Dimensions follow epsilon and delta") {
+        REQUIRE(sketch.width() >= 2719);
+        REQUIRE(sketch.depth() == 5);
+        REQUIRE(sketch.epsilon() <= 0.001);
+    }
+
+    SECTION("Estimates never undercount and stay within the bound") {
+        std::vector<uint64_t> stream;
+        auto exact = skewedStream(200000, stream);
+
+        for (uint64_t key : stream) {
+            sketch.add(mix(key));
+        }
+
+        REQUIRE(sketch.total() == stream.size());
+
+        size_t over_bound = 0;
+        for (const auto& entry : exact) {
+            uint64_t estimate = sketch.estimate(mix(entry.first));
+            REQUIRE(estimate >= entry.second);
+            if (estimate - entry.second > sketch.epsilon() * sketch.total()) {
+                ++over_bound;
+            }
+        }
+
+        REQUIRE(over_bound <= exact.size() / 100);
+    }
+
+    SECTION("Merged sketches add up") {
+        CountMinSketch other(0.001, 0.01);
+        sketch.add(mix(1), 5);
+        other.add(mix(1), 7);
+
+        sketch.merge(other);
+        REQUIRE(sketch.estimate(mix(1)) == 12);
+        REQUIRE(sketch.total() == 12);
+    }
+}
+
+TEST_CASE("SpaceSaving heavy hitters", "[sketches]") {
+    SpaceSaving<uint64_t, MixHash> summary(100);
+
+    SECTION("Exact while under capacity") {
+        for (uint64_t key = 0; key < 50; ++key) {
+            summary.add(key, key + 1);
+        }
+
+        auto top = summary.top(3);
+        REQUIRE(top.size() == 3);
+        REQUIRE(top[0].key == 49);
+        REQUIRE(top[0].count == 50);
+        REQUIRE(top[0].error == 0);
+    }
+
+    SECTION("Heavy hitters survive a long tail") {
+        std::vector<uint64_t> stream;
+        auto exact = skewedStream(200000, stream);
+
+        for (uint64_t key : stream) {
+            summary.add(key);
+        }
+
+        REQUIRE(summary.size() == 100);
+
+        // Every key above total / capacity must be tracked, with a count
+        // that brackets its true weight.
+        uint64_t threshold = stream.size() / summary.capacity();
+        for (const auto& entry : exact) {
+            if (entry.second <= threshold) {
+                continue;
+            }
+
+            bool found = false;
+            for (const auto& counter : summary.counters()) {
+                if (counter.key == entry.first) {
+                    REQUIRE(counter.count >= entry.second);
+                    REQUIRE(counter.count - counter.error <= entry.second);
+                    found = true;
+                }
+            }
+            REQUIRE(found);
+        }
+
+        REQUIRE(summary.top(1)[0].key == 1);
+    }
+}
+
+TEST_CASE("HyperLogLog estimates distinct counts", "[sketches]") {
+    SECTION("Small counts are near exact") {
+        HyperLogLog sketch(8);
+        for (uint64_t key = 0; key < 20; ++key) {
+            sketch.add(mix(key));
+            sketch.add(mix(key));
+        }
+
+        REQUIRE(sketch.estimate() >= 19);
+        REQUIRE(sketch.estimate() <= 21);
+    }
+
+    SECTION("Large counts stay within a few standard errors") {
+        for (uint64_t distinct : {1000, 10000, 200000}) {
+            HyperLogLog sketch(10);
+            for (uint64_t key = 0; key < distinct; ++key) {
+                sketch.add(mix(key + distinct));
+            }
+
+            double error = std::abs(static_cast<double>(sketch.estimate()) - distinct) / distinct;
+            REQUIRE(error < 3 * sketch.standardError());
+        }
+    }
+
+    SECTION("Merging is a union") {
+        HyperLogLog a(10);
+        HyperLogLog b(10);
+        HyperLogLog both(10);
+
+        // Overlapping halves: a sees 0-3999, b sees 2000-5999
+        for (uint64_t key = 0; key < 6000; ++key) {
+            if (key < 4000) {
+                a.add(mix(key));
+            }
+            if (key >= 2000) {
+                b.add(mix(key));
+            }
+            both.add(mix(key));
+        }
+
+        a.merge(b);
+        REQUIRE(a.estimate() == both.estimate());
+    }
+}
+
+TEST_CASE("SlidingHyperLogLog forgets old slices", "[sketches]") {
+    // 60-unit window in 6 slices of 10
+    SlidingHyperLogLog sketch(8, 60, 6);
+
+    for (uint64_t key = 0; key < 30; ++key) {
+        sketch.add(mix(key), key);
+    }
+    REQUIRE(sketch.estimate(30) >= 28);
+    REQUIRE(sketch.estimate(30) <= 32);
+
+    // Keys 0-9 fell in the first slice, which has left the window by 60
+    REQUIRE(sketch.estimate(65) >= 18);
+    REQUIRE(sketch.estimate(65) <= 22);
+    REQUIRE_FALSE(sketch.idle(65));
+
+    // Re-adding a key in a recycled slice counts it once
+    sketch.add(mix(25), 70);
+    REQUIRE(sketch.estimate(70) >= 9);
+    REQUIRE(sketch.estimate(70) <= 11);
+
+    REQUIRE(sketch.idle(200));
+    REQUIRE(sketch.estimate(200) == 0);
+}
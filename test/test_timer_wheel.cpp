@@ -0,0 +1,106 @@
+#include "catch2/catch.hpp"
+#include "../src/core/data/timer_wheel.hpp"
+#include <vector>
+
+using namespace netsentry::data;
+
+TEST_CASE("TimerWheel expiry", "[timer_wheel]") {
+    TimerWheel<int> wheel;
+    std::vector<int> fired;
+    auto collect = [&fired](int item) { fired.push_back(item); };
+
+    SECTION("Timers fire once their deadline has passed") {
+        wheel.advance(100, collect);
+        wheel.schedule(1, 105);
+        wheel.schedule(2, 110);
+        REQUIRE(wheel.size() == 2);
+
+        wheel.advance(104, collect);
+        REQUIRE(fired.empty());
+
+        wheel.advance(105, collect);
+        REQUIRE(fired == std::vector<int>{1});
+
+        wheel.advance(200, collect);
+        REQUIRE(fired == std::vector<int>{1, 2});
+        REQUIRE(wheel.empty());
+    }
+
+    SECTION("Overdue timers fire on the next tick") {
+        wheel.advance(50, collect);
+        wheel.schedule(7, 10);
+
+        wheel.advance(51, collect);
+        REQUIRE(fired == std::vector<int>{7});
+    }
+
+    SECTION("Deadlines in upper levels cascade to the exact tick") {
+        std::vector<uint64_t> deadlines = {63, 64, 65, 4095, 4096, 4097, 300000, 262144 * 3 + 17};
+
+        for (size_t i = 0; i < deadlines.size(); ++i) {
+            wheel.schedule(static_cast<int>(i), deadlines[i]);
+        }
+
+        for (size_t i = 0; i < deadlines.size(); ++i) {
+            wheel.advance(deadlines[i] - 1, collect);
+            REQUIRE(fired.size() == i);
+
+            wheel.advance(deadlines[i], collect);
+            REQUIRE(fired.size() == i + 1);
+            REQUIRE(fired.back() == static_cast<int>(i));
+        }
+    }
+
+    SECTION("Epoch timestamps are reached without walking every tick") {
+        const uint64_t second = 1000000;
+        const uint64_t start = 1760000000ULL * second;
+        TimerWheel<int> flows(second);
+
+        flows.schedule(1, start + 30 * second);
+        flows.schedule(2, start + 300 * second);
+
+        flows.advance(start, collect);
+        REQUIRE(fired.empty());
+        REQUIRE(flows.size() == 2);
+
+        flows.advance(start + 30 * second - 1, collect);
+        REQUIRE(fired.empty());
+
+        flows.advance(start + 30 * second, collect);
+        REQUIRE(fired == std::vector<int>{1});
+
+        flows.schedule(3, start + 31 * second);
+        flows.advance(start + 31 * second, collect);
+        REQUIRE(fired == std::vector<int>{1, 3});
+
+        flows.advance(start + 300 * second, collect);
+        REQUIRE(fired == std::vector<int>{1, 3, 2});
+        REQUIRE(flows.empty());
+    }
+
+    SECTION("Callbacks can re-schedule") {
+        int rounds = 0;
+        wheel.schedule(1, 10);
+
+        wheel.advance(1000, [&](int item) {
+            if (++rounds < 3) {
+                wheel.schedule(item, 10 + rounds * 100);
+            }
+        });
+
+        REQUIRE(rounds == 3);
+        REQUIRE(wheel.empty());
+    }
+
+    SECTION("Tick granularity scales deadlines") {
+        TimerWheel<int> coarse(1000);
+        coarse.advance(5000, collect);
+        coarse.schedule(3, 7500);
+
+        coarse.advance(7999, collect);
+        REQUIRE(fired.empty());
+
+        coarse.advance(8000, collect);
+        REQUIRE(fired == std::vector<int>{3});
+    }
+}
@@ -0,0 +1,98 @@
+#include "catch2/catch.hpp"
+#include "../src/network/traffic_baselines.hpp"
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace netsentry::network;
+
+namespace {
+
+IpAddress host(uint8_t index) {
+    const uint8_t address[4] = {10, 0, 0, index};
+    return IpAddress::fromV4(address);
+}
+
+}
+
+TEST_CASE("TrafficBaselines scores hosts and groups", "[traffic_baselines]") {
+    BaselineOptions options;
+    options.interval = std::chrono::seconds(60);
+    options.parameters.warmup = 20;
+    options.parameters.min_deviation = 100.0f;
+    options.idle_retention = std::chrono::seconds(60 * 30);
+
+    TrafficBaselines baselines(options);
+    uint64_t now = 1700000000;
+
+    // Ten hosts sending 10 kB/s give or take 5%, and one group carrying all of it
+    auto tick = [&](double spike) {
+        std::unordered_map<IpAddress, double, IpAddressHash> hosts;
+        for (uint8_t i = 1; i <= 10; ++i) {
+            hosts.emplace(host(i), 10000.0 + ((now / 60 + i) % 2 ? 500.0 : -500.0));
+        }
+        hosts[host(1)] += spike;
+
+        std::vector<std::pair<std::string, double>> groups{{"lan", 100000.0 + spike}};
+        baselines.update(hosts, groups, now);
+        now += 60;
+    };
+
+    for (int i = 0; i < 100; ++i) {
+        tick(0.0);
+    }
+
+    REQUIRE(baselines.getHostCount() == 10);
+    REQUIRE(baselines.getMaxHostScore() < 3.0);
+    REQUIRE(baselines.getMaxGroupScore() < 3.0);
+
+    SECTION("A spike stands out") {
+        tick(50000.0);
+
+        REQUIRE(baselines.getMaxHostScore() > 10.0);
+        REQUIRE(baselines.getMaxGroupScore() > 10.0);
+
+        auto top = baselines.getTopHostAnomalies(3);
+        REQUIRE(top.size() == 3);
+        REQUIRE(top[0].name == "10.0.0.1");
+        REQUIRE(top[0].observed_bytes_per_second > 59000.0);
+        REQUIRE(top[0].score > top[1].score);
+
+        auto groups = baselines.getGroupAnomalies();
+        REQUIRE(groups.size() == 1);
+        REQUIRE(groups[0].name == "lan");
+        REQUIRE(groups[0].score > 10.0);
+    }
+
+    SECTION("Quiet hosts are fed zeros and eventually dropped") {
+        for (int i = 0; i < 40; ++i) {
+            std::unordered_map<IpAddress, double, IpAddressHash> hosts{{host(2), 10000.0}};
+            baselines.update(hosts, {}, now);
+            now += 60;
+
+            if (i == 0) {
+                REQUIRE(baselines.getTopHostAnomalies(10).back().score < -5.0);
+            }
+        }
+
+        REQUIRE(baselines.getHostCount() == 1);
+        REQUIRE(baselines.getGroupAnomalies().empty());
+    }
+}
+
+TEST_CASE("TrafficBaselines caps the hosts tracked", "[traffic_baselines]") {
+    BaselineOptions options;
+    options.max_hosts = 4;
+
+    TrafficBaselines baselines(options);
+
+    std::unordered_map<IpAddress, double, IpAddressHash> hosts;
+    for (uint8_t i = 1; i <= 10; ++i) {
+        hosts.emplace(host(i), 1000.0);
+    }
+
+    baselines.update(hosts, {}, 0);
+    REQUIRE(baselines.getHostCount() == 4);
+    REQUIRE(baselines.getHostsDropped() == 6);
+}